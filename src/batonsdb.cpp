@@ -0,0 +1,285 @@
+#include "batonsdb.h"
+#include "chainindexdb.h"
+#include "dbwrapper.h"
+#include "main.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "uint256.h"
+#include "cc/CCOracles.h"
+#include "cc/CCPrices.h"
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+BatonsDB *pbatons;
+
+static const char DB_BATON_HEAD = 'r';
+static const char DB_BATON_HOP = 'h';
+
+static const CBatonType batonTypes[] = {
+    { EVAL_ORACLES, 1, OraclesIsBatonRoot },     // registration, then the data txs of a publisher
+    { EVAL_PRICES, 0, PricesIsBatonRoot },       // bet, then its added fundings
+};
+
+/*
+ * The chains and the outputs holding their batons are kept in memory, the
+ * hops only in the db. Taken after cs_main, never held while taking mempool.cs.
+ */
+static CCriticalSection cs_batons;
+static std::map<CBatonKey, CBatonHead> mapBatonHeads;
+static std::map<COutPoint, CBatonKey> mapBatonOutputs;
+static uint256 hashBatonsBestBlock;
+
+
+BatonsDB::BatonsDB(size_t nCacheSize, bool fMemory, bool fWipe) : CChainIndexDB("batons", nCacheSize, fMemory, fWipe) { }
+
+
+static const CBatonType *GetBatonType(uint8_t evalcode)
+{
+    for (size_t i = 0; i < sizeof(batonTypes) / sizeof(batonTypes[0]); i++)
+        if (batonTypes[i].evalcode == evalcode)
+            return &batonTypes[i];
+    return NULL;
+}
+
+
+static std::pair<char, std::pair<CBatonKey, int32_t> > BatonHopKey(const CBatonKey &key, int32_t nHop)
+{
+    return std::make_pair(DB_BATON_HOP, std::make_pair(key, nHop));
+}
+
+
+/*
+ * Load the chain heads, as of the block the index was last written at. The
+ * catch-up thread replays the blocks from there to the tip, until then the
+ * contracts walk their batons as before.
+ */
+bool LoadBatons()
+{
+    LOCK(cs_batons);
+    mapBatonHeads.clear();
+    mapBatonOutputs.clear();
+    hashBatonsBestBlock = pbatons->ReadBestBlock();
+
+    boost::scoped_ptr<CDBIterator> pcursor(pbatons->NewIterator());
+    pcursor->Seek(std::make_pair(DB_BATON_HEAD, CBatonKey()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CBatonKey> key;
+        CBatonHead head;
+        if (!pcursor->GetKey(key) || key.first != DB_BATON_HEAD)
+            break;
+        if (!pcursor->GetValue(head))
+            return error("%s: cannot read baton chain %s", __func__, key.second.root.ToString());
+        const CBatonType *type = GetBatonType(key.second.evalcode);
+        if (type != NULL) {
+            mapBatonHeads[key.second] = head;
+            mapBatonOutputs[COutPoint(head.txid, type->vout)] = key.second;
+        }
+        pcursor->Next();
+    }
+    LogPrintf("%s: loaded %u baton chains at block %s\n", __func__, mapBatonHeads.size(), hashBatonsBestBlock.ToString());
+    return true;
+}
+
+
+bool ResetBatons()
+{
+    LOCK(cs_batons);
+    mapBatonHeads.clear();
+    mapBatonOutputs.clear();
+    hashBatonsBestBlock.SetNull();
+    return pbatons->Wipe(std::string(1, DB_BATON_HEAD) + DB_BATON_HOP, uint256());
+}
+
+
+uint256 GetBatonsBestBlock()
+{
+    LOCK(cs_batons);
+    return hashBatonsBestBlock;
+}
+
+
+// A failed batch makes ConnectBlock or DisconnectTip abort the node. The heads in
+// memory would be ahead of the db until then, LoadBatons reads them back on restart
+static bool BatonsWriteFailed()
+{
+    AssertLockHeld(cs_batons);
+    mapBatonHeads.clear();
+    mapBatonOutputs.clear();
+    hashBatonsBestBlock.SetNull();
+    return error("%s: cannot write the baton index", __func__);
+}
+
+
+/*
+ * A tx spending the baton output of a chain becomes its head, a root tx
+ * starts a chain. Only the block on top of hashBatonsBestBlock is indexed,
+ * an empty index starts with the genesis block.
+ */
+bool ConnectBatons(const CBlock &block, int nHeight)
+{
+    LOCK(cs_batons);
+    if (pbatons == NULL || block.hashPrevBlock != hashBatonsBestBlock || (hashBatonsBestBlock.IsNull() && nHeight != 0))
+        return true;
+
+    CDBBatch batch(*pbatons);
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+    {
+        uint256 txid = tx.GetHash();
+        BOOST_FOREACH(const CTxIn &txin, tx.vin)
+        {
+            std::map<COutPoint, CBatonKey>::iterator it = mapBatonOutputs.find(txin.prevout);
+            if (it == mapBatonOutputs.end())
+                continue;
+            CBatonKey key = it->second;
+            COutPoint next(txid, GetBatonType(key.evalcode)->vout);
+            mapBatonOutputs.erase(it);
+            if (mapBatonOutputs.count(next)) {
+                // the tx passes the baton of another chain on too, this one is walked as before from now on
+                mapBatonHeads.erase(key);
+                batch.Erase(std::make_pair(DB_BATON_HEAD, key));
+                continue;
+            }
+            CBatonHead &head = mapBatonHeads[key];
+            head.txid = txid;
+            head.nHops++;
+            head.nHeight = nHeight;
+            mapBatonOutputs[next] = key;
+            batch.Write(BatonHopKey(key, head.nHops), std::make_pair(txid, (int32_t)nHeight));
+            batch.Write(std::make_pair(DB_BATON_HEAD, key), head);
+        }
+        for (size_t i = 0; i < sizeof(batonTypes) / sizeof(batonTypes[0]); i++)
+        {
+            COutPoint out(txid, batonTypes[i].vout);
+            if (mapBatonOutputs.count(out) || !batonTypes[i].IsRoot(tx))
+                continue;
+            CBatonKey key(batonTypes[i].evalcode, txid);
+            CBatonHead head;
+            head.txid = txid;
+            head.nHeight = head.nRootHeight = nHeight;
+            mapBatonHeads[key] = head;
+            mapBatonOutputs[out] = key;
+            batch.Write(std::make_pair(DB_BATON_HEAD, key), head);
+        }
+    }
+    if (!pbatons->WriteBlock(batch, block.GetHash()))
+        return BatonsWriteFailed();
+    hashBatonsBestBlock = block.GetHash();
+    return true;
+}
+
+
+bool DisconnectBatons(const CBlock &block, int nHeight)
+{
+    LOCK(cs_batons);
+    if (pbatons == NULL || block.GetHash() != hashBatonsBestBlock)
+        return true;
+
+    CDBBatch batch(*pbatons);
+    for (int32_t n = (int32_t)block.vtx.size() - 1; n >= 0; n--)
+    {
+        uint256 txid = block.vtx[n].GetHash();
+        for (size_t i = 0; i < sizeof(batonTypes) / sizeof(batonTypes[0]); i++)
+        {
+            std::map<COutPoint, CBatonKey>::iterator it = mapBatonOutputs.find(COutPoint(txid, batonTypes[i].vout));
+            if (it == mapBatonOutputs.end())
+                continue;
+            CBatonKey key = it->second;
+            mapBatonOutputs.erase(it);
+            std::map<CBatonKey, CBatonHead>::iterator itHead = mapBatonHeads.find(key);
+            if (itHead == mapBatonHeads.end())
+                continue;
+            CBatonHead &head = itHead->second;
+            std::pair<uint256, int32_t> prev(key.root, head.nRootHeight);
+            if (head.nHops == 0 || (head.nHops > 1 && !pbatons->Read(BatonHopKey(key, head.nHops - 1), prev))) {
+                // the root goes with its block
+                mapBatonHeads.erase(itHead);
+                batch.Erase(std::make_pair(DB_BATON_HEAD, key));
+                continue;
+            }
+            batch.Erase(BatonHopKey(key, head.nHops));
+            head.txid = prev.first;
+            head.nHeight = prev.second;
+            head.nHops--;
+            mapBatonOutputs[COutPoint(head.txid, GetBatonType(key.evalcode)->vout)] = key;
+            batch.Write(std::make_pair(DB_BATON_HEAD, key), head);
+        }
+    }
+    if (!pbatons->WriteBlock(batch, block.hashPrevBlock))
+        return BatonsWriteFailed();
+    hashBatonsBestBlock = block.hashPrevBlock;
+    return true;
+}
+
+
+// the chains are only answered for at the tip, while the index catches up they are walked
+static bool BatonsAtTip()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_batons);
+    return pbatons != NULL && chainActive.Tip() != NULL && hashBatonsBestBlock == chainActive.Tip()->GetBlockHash();
+}
+
+
+// follow the spends of the baton in the mempool
+static void ApplyMempoolBatons(int32_t vout, CBatonHead &head, std::vector<uint256> *pvTxids)
+{
+    LOCK(mempool.cs);
+    std::map<COutPoint, CInPoint>::const_iterator it;
+    while ((it = mempool.mapNextTx.find(COutPoint(head.txid, vout))) != mempool.mapNextTx.end())
+    {
+        head.txid = it->second.ptx->GetHash();
+        head.nHops++;
+        head.nHeight = 0;
+        if (pvTxids != NULL)
+            pvTxids->push_back(head.txid);
+    }
+}
+
+
+bool GetBatonHead(uint8_t evalcode, const uint256 &root, CBatonHead &head)
+{
+    const CBatonType *type = GetBatonType(evalcode);
+    if (type == NULL)
+        return false;
+    {
+        LOCK2(cs_main, cs_batons);
+        std::map<CBatonKey, CBatonHead>::const_iterator it = mapBatonHeads.find(CBatonKey(evalcode, root));
+        if (!BatonsAtTip() || it == mapBatonHeads.end())
+            return false;
+        head = it->second;
+    }
+    ApplyMempoolBatons(type->vout, head, NULL);
+    return true;
+}
+
+
+bool GetBatonChain(uint8_t evalcode, const uint256 &root, std::vector<uint256> &vTxids)
+{
+    const CBatonType *type = GetBatonType(evalcode);
+    CBatonKey key(evalcode, root);
+    CBatonHead head;
+
+    vTxids.clear();
+    if (type == NULL)
+        return false;
+    {
+        LOCK2(cs_main, cs_batons);
+        std::map<CBatonKey, CBatonHead>::const_iterator it = mapBatonHeads.find(key);
+        if (!BatonsAtTip() || it == mapBatonHeads.end())
+            return false;
+        head = it->second;
+        vTxids.push_back(root);
+        for (int32_t nHop = 1; nHop <= head.nHops; nHop++)
+        {
+            std::pair<uint256, int32_t> hop;
+            if (!pbatons->Read(BatonHopKey(key, nHop), hop))
+                return error("%s: hop %d of baton chain %s is missing", __func__, nHop, root.ToString());
+            vTxids.push_back(hop.first);
+        }
+    }
+    ApplyMempoolBatons(type->vout, head, &vTxids);
+    return true;
+}
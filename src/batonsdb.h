@@ -0,0 +1,88 @@
+#ifndef BATONSDB_H
+#define BATONSDB_H
+
+#include "chainindexdb.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+
+/** A contract whose txs pass a baton on: each tx spending the baton vout of the last one becomes the next */
+struct CBatonType
+{
+    uint8_t evalcode;
+    int32_t vout;                                   //!< the baton vout of the root and of every hop
+    bool (*IsRoot)(const CTransaction &tx);         //!< tx starting a new chain
+};
+
+/** Chain of a contract from its root tx */
+struct CBatonKey
+{
+    uint8_t evalcode;
+    uint256 root;
+
+    CBatonKey() : evalcode(0) {}
+    CBatonKey(uint8_t evalcodeIn, const uint256 &rootIn) : evalcode(evalcodeIn), root(rootIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(evalcode);
+        READWRITE(root);
+    }
+
+    friend bool operator<(const CBatonKey &a, const CBatonKey &b) {
+        if (a.evalcode != b.evalcode)
+            return a.evalcode < b.evalcode;
+        return a.root < b.root;
+    }
+};
+
+/** Tx holding the baton of a chain */
+struct CBatonHead
+{
+    uint256 txid;
+    int32_t nHops;              //!< 0 while the root holds the baton
+    int32_t nHeight;            //!< 0 for a tx in the mempool
+    int32_t nRootHeight;
+
+    CBatonHead() : nHops(0), nHeight(0), nRootHeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(nHops);
+        READWRITE(nHeight);
+        READWRITE(nRootHeight);
+    }
+};
+
+
+class BatonsDB : public CChainIndexDB
+{
+public:
+    BatonsDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+};
+
+
+extern BatonsDB *pbatons;
+
+bool LoadBatons();
+bool ResetBatons();
+uint256 GetBatonsBestBlock();
+bool ConnectBatons(const CBlock &block, int nHeight);
+bool DisconnectBatons(const CBlock &block, int nHeight);
+
+/**
+ * Head of the chain with the mempool spends applied, false if the chain is not
+ * indexed or the index is not at the tip
+ */
+bool GetBatonHead(uint8_t evalcode, const uint256 &root, CBatonHead &head);
+/** Txs of the chain, the root first and the head last, with the mempool spends applied */
+bool GetBatonChain(uint8_t evalcode, const uint256 &root, std::vector<uint256> &vTxids);
+
+#endif  /* BATONSDB_H */
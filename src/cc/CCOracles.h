@@ -19,6 +19,8 @@
 
 #include "CCinclude.h"
 
+struct COracleSample;
+
 bool OraclesValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
 UniValue OracleCreate(const CPubKey& pk, int64_t txfee,std::string name,std::string description,std::string format);
 UniValue OracleFund(const CPubKey& pk, int64_t txfee,uint256 oracletxid);
@@ -30,5 +32,11 @@ UniValue OracleDataSample(uint256 reforacletxid,uint256 txid);
 UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num);
 UniValue OracleInfo(uint256 origtxid);
 UniValue OraclesList();
+bool OraclesIsBatonRoot(const CTransaction &tx);
+bool OraclesDecodeSample(const CTransaction &tx,uint256 &oracletxid,CPubKey &publisher,std::vector<uint8_t> &data,char *batonaddr);
+UniValue OracleDataSeries(uint256 reforacletxid,CPubKey publisher,uint32_t from,uint32_t to,bool raw);
+int64_t OracleCorrelatedPrice(int32_t height,std::vector <int64_t> origprices);
+int64_t OraclePrice(int32_t height,uint256 reforacletxid,int32_t maxage,int64_t &median,std::vector<COracleSample> &samples);
+UniValue OraclePrices(uint256 reforacletxid,int32_t maxage);
 
 #endif
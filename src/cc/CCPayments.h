@@ -20,12 +20,76 @@
 #include "CCinclude.h"
 #include <gmp.h>
 #include <key_io.h>
+#include <unordered_map>
 
 #define PAYMENTS_TXFEE 10000
 #define PAYMENTS_MERGEOFSET 60 // 1H extra. 
+#define PAYMENTS_MAXTOKENHOLDERS 32 // tokens whose holders are kept between releases
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 extern int32_t lastSnapShotHeight;
 
+/**
+ * A snapshot as releases read it: the scripts paid worked out once, richest
+ * first, with the running totals of the allocations and the position of each
+ * script by its hash to find the excluded ones.
+ */
+struct CPaymentsSnapshot
+{
+    int32_t nHeight;                        //!< lastSnapShotHeight it was taken at, -1 if not taken
+    std::vector<CScript> vScriptPubKeys;
+    std::vector<int64_t> vAllocations;
+    std::vector<int64_t> vTotals;           //!< vTotals[i] is the sum of the first i allocations
+    std::unordered_map<uint256, int32_t, BlockHasher> mapIndex;
+
+    CPaymentsSnapshot() : nHeight(-1) {}
+
+    //! vEntries sorted richest first
+    void Set(int32_t nHeightIn, const std::vector<std::pair<CAmount, CScript>> &vEntries);
+    /** Allocations of the entries from bottom on until top-bottom are paid, without the excluded scripts */
+    int32_t GetAllocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys, std::vector<int64_t> &allocations) const;
+};
+
+/**
+ * Unspent outputs of a token up to a height, found by scanning the blocks from
+ * its tokenbase on: the tokenbase outputs and then the token outputs of the txs
+ * spending them, as long as they do not create more than they spend. Every
+ * node gets the same holders whatever indexes it keeps.
+ */
+struct CPaymentsTokenHolders
+{
+    int32_t nHeight;                                                //!< scanned up to, -1 if not scanned
+    uint256 hashBlock;                                              //!< block at nHeight, the scan starts over if it left chainActive
+    std::map<COutPoint, std::pair<CAmount, CScript>> mapOutputs;    //!< amount and the script of the holder, empty if locked in another contract
+    CPaymentsSnapshot snapshot;                                     //!< holders at nHeight
+    int64_t nLastUsed;                                              //!< orders the cached holders for eviction
+
+    CPaymentsTokenHolders() : nHeight(-1), nLastUsed(0) {}
+    virtual ~CPaymentsTokenHolders() {}
+
+    void Clear();
+    //! Drops the outputs tx spends and adds the token outputs it creates
+    void ScanTx(const CTransaction &tx, uint256 tokenid);
+    /** Scans on from nHeight, or from the tokenbase, up to height and takes the snapshot there. cs_main is held. */
+    bool Scan(uint256 tokenid, int32_t height);
+
+protected:
+    //! The block index of the tokenbase, from the mempool or the txindex
+    virtual CBlockIndex *GetTokenbaseIndex(uint256 tokenid) const;
+    virtual bool ReadBlock(CBlockIndex *pindex, CBlock &block) const;
+};
+
+int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys, std::vector<int64_t> &allocations);
+/** Token airdrop releases are valid from -ac_paymentstokensht on */
+bool payments_tokensactive(int32_t height);
+/** Height of the token snapshot a release at height pays, the last snapshot interval below it, 0 if none */
+int32_t payments_tokensnapshotheight(int32_t height);
+/**
+ * Allocations of the holders of tokenid at the token snapshot height of a
+ * release at height, taken from the blocks alone. With fGame top and bottom
+ * are set from the snapshot. -1 if the holders cannot be worked out.
+ */
+int32_t payments_gettokenallocations(int32_t height, uint256 tokenid, int32_t &top, int32_t &bottom, bool fGame, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys, std::vector<int64_t> &allocations);
+
 bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
 
 // CCcustom
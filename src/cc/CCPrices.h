@@ -21,6 +21,7 @@
 #include "CCinclude.h"
 
 int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks);
+void prices_invalidatecache(int32_t height);
 extern void GetKomodoEarlytxidScriptPub();
 extern CScript KOMODO_EARLYTXID_SCRIPTPUB;
 
@@ -42,12 +43,25 @@ extern CScript KOMODO_EARLYTXID_SCRIPTPUB;
 //#define PRICES_NORMFACTOR   (int64_t)(SATOSHIDEN)
 //#define PRICES_POINTFACTOR   (int64_t)10000
 
+#define NVOUT_CCMARKER 1
+#define NVOUT_NORMALMARKER 3
+
 #define PRICES_REVSHAREDUST 10000
 #define PRICES_SUBREVSHAREFEE(amount) ((amount) * 199 / 200)    // revshare fee percentage == 0.005
 #define PRICES_MINAVAILFUNDFRACTION  0.1                             // leveraged bet limit < fund fraction
 
 bool PricesValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
 
+// bets index
+struct CPricesBetState;
+uint8_t prices_addopretdecode(CScript scriptPubKey,uint256 &bettxid,CPubKey &pk,int64_t &amount);
+bool prices_isaddedbet(const CTransaction &tx, int64_t &amount);
+bool prices_betstatefromtx(const CTransaction &bettx, CPricesBetState &state);
+void prices_betstatescan(CPricesBetState &state, int32_t height);
+bool prices_betstatescanchain(CPricesBetState &state);
+bool prices_betstatefromchain(uint256 bettxid, CPricesBetState &state);
+void prices_listbettxids(std::vector<uint256> &bettxids);
+
 // CCcustom
 UniValue PricesBet(int64_t txfee,int64_t amount,int16_t leverage,std::vector<std::string> synthetic);
 UniValue PricesAddFunding(int64_t txfee,uint256 bettxid,int64_t amount);
@@ -58,6 +72,8 @@ UniValue PricesInfo(uint256 bettxid,int32_t refheight);
 UniValue PricesList(uint32_t filter, CPubKey mypk);
 UniValue PricesGetOrderbook();
 UniValue PricesRefillFund(int64_t amount);
+UniValue PricesRektList();
+bool PricesIsBatonRoot(const CTransaction &tx);
 
 
 #endif
@@ -14,6 +14,7 @@
  ******************************************************************************/
 
 #include "CCassets.h"
+#include "CCtokens.h"
 
 /*
  The SetAssetFillamounts() and ValidateAssetRemainder() work in tandem to calculate the vouts for a fill and to validate the vouts, respectively.
@@ -648,3 +649,39 @@ bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t
 		it's now done in Tokens  */
 	return(true);
 }
+
+// the open order held in vout 0 of a bid, ask or swap tx or of a fill which left a remainder
+bool GetAssetOrderFromTx(const CTransaction &tx, CAssetOrder &order)
+{
+    struct CCcontract_info *cpAssets, assetsC;
+    uint8_t funcid, evalCode, dummyEvalCode;
+    uint256 dummyTokenid;
+    std::vector<CPubKey> voutPubkeysDummy;
+    std::vector<std::pair<uint8_t, vscript_t>> oprets;
+    vscript_t vopretAssets, vopretNonfungible;
+
+    if (!IsTokenOpRet(tx))
+        return false;
+    const CScript &opret = tx.vout.back().scriptPubKey;
+    // token transfers have no assets data, skip them before the decoder logs about it
+    if (DecodeTokenOpRet(opret, dummyEvalCode, dummyTokenid, voutPubkeysDummy, oprets) == 0 ||
+        !GetOpretBlob(oprets, OPRETID_ASSETSDATA, vopretAssets) || vopretAssets.size() < 2 || vopretAssets[0] != EVAL_ASSETS)
+        return false;
+
+    order = CAssetOrder();
+    funcid = DecodeAssetTokenOpRet(opret, evalCode, order.assetid, order.assetid2, order.nRequired, order.origpubkey);
+    if (funcid == 0 || strchr("bBsSeE", funcid) == NULL || tx.vout[0].nValue <= 0)
+        return false;
+    order.funcid = funcid;
+    order.nValue = tx.vout[0].nValue;
+
+    cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+    CPubKey unspendableAssetsPk = GetUnspendable(cpAssets, NULL);
+    if (funcid == 'b' || funcid == 'B')
+        return tx.vout[0] == MakeCC1vout(EVAL_ASSETS, order.nValue, unspendableAssetsPk);
+
+    GetNonfungibleData(order.assetid, vopretNonfungible);
+    if (!vopretNonfungible.empty())
+        order.evalCode2 = vopretNonfungible[0];
+    return tx.vout[0] == MakeTokensCC1vout(EVAL_ASSETS, order.evalCode2, order.nValue, unspendableAssetsPk);
+}
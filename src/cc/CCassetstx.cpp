@@ -17,6 +17,65 @@
 #include "CCtokens.h"
 
 
+// add the order held in vout 'index' of txid to the tokenorders or mytokenorders result, order.nValue is the value of its vout 0
+static void AddAssetOrderItem(UniValue &result, struct CCcontract_info *cp, struct CCcontract_info *cpTokens, uint256 txid, int32_t index, int64_t nValue, const CAssetOrder &order)
+{
+    char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
+    uint8_t funcid = order.funcid;
+    int64_t price = order.nRequired;
+
+    UniValue item(UniValue::VOBJ);
+
+    funcidstr[0] = funcid;
+    funcidstr[1] = 0;
+    item.push_back(Pair("funcid", funcidstr));
+    item.push_back(Pair("txid", txid.GetHex()));
+    item.push_back(Pair("vout", (int64_t)index));
+    if (funcid == 'b' || funcid == 'B')
+    {
+        sprintf(numstr, "%.8f", (double)nValue / COIN);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%.8f", (double)order.nValue / COIN);
+        item.push_back(Pair("bidamount", numstr));
+    }
+    else
+    {
+        sprintf(numstr, "%llu", (long long)nValue);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%llu", (long long)order.nValue);
+        item.push_back(Pair("askamount", numstr));
+    }
+    if (order.origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
+    {
+        GetCCaddress(cp, origaddr, pubkey2pk(order.origpubkey));  
+        item.push_back(Pair("origaddress", origaddr));
+        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origtokenaddress", origtokenaddr));
+    }
+    if (order.assetid != zeroid)
+        item.push_back(Pair("tokenid", order.assetid.GetHex()));
+    if (order.assetid2 != zeroid)
+        item.push_back(Pair("otherid", order.assetid2.GetHex()));
+    if (price > 0)
+    {
+        if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e')
+        {
+            sprintf(numstr, "%.8f", (double)price / COIN);
+            item.push_back(Pair("totalrequired", numstr));
+            sprintf(numstr, "%.8f", (double)price / (COIN * order.nValue));
+            item.push_back(Pair("price", numstr));
+        }
+        else
+        {
+            item.push_back(Pair("totalrequired", (int64_t)price));
+            sprintf(numstr, "%.8f", (double)order.nValue / (price * COIN));
+            item.push_back(Pair("price", numstr));
+        }
+    }
+    result.push_back(item);
+    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " index=" << index << " nValue=" << nValue << " tokenid=" << order.assetid.GetHex() << std::endl);
+}
+
 UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
 {
 	UniValue result(UniValue::VARR);  
@@ -27,26 +86,46 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
     cpAssets = CCinit(&assetsC, EVAL_ASSETS);
     cpTokens = CCinit(&tokensC, EVAL_TOKENS);
 
+    // tokenorders lists every order of the token, mytokenorders only my asks
+    auto isListed = [&](const CAssetOrder &order) -> bool
+    {
+        return pk == CPubKey() && (refassetid == zeroid || order.assetid == refassetid)
+            || pk != CPubKey() && pk == pubkey2pk(order.origpubkey) && (order.funcid == 'S' || order.funcid == 's');
+    };
+
+    AssetOrderList vOrders;
+    if (GetAllAssetOrders(refassetid, vOrders))
+    {
+        for (AssetOrderList::const_iterator it = vOrders.begin(); it != vOrders.end(); it++)
+        {
+            const CAssetOrder &order = it->second;
+            // asks of non-fungible tokens are listed for their token or for the evalcode asked for, as when the unspendable addresses were scanned
+            if (order.Side() != 'b' && order.evalCode2 != 0 && refassetid == zeroid && order.evalCode2 != additionalEvalCode)
+                continue;
+            if (isListed(order))
+                AddAssetOrderItem(result, cpAssets, cpTokens, it->first.hash, it->first.n, order.nValue, order);
+        }
+        return(result);
+    }
+
+    // no orderbook without the address index, scan the unspendable addresses
 	auto addOrders = [&](struct CCcontract_info *cp, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it)
 	{
-		uint256 txid, hashBlock, assetid, assetid2;
-		int64_t price;
-		std::vector<uint8_t> origpubkey;
+		uint256 txid, hashBlock;
 		CTransaction ordertx;
-		uint8_t funcid, evalCode;
-		char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
+		uint8_t evalCode;
+		CAssetOrder order;
 
         txid = it->first.txhash;
         LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking txid=" << txid.GetHex() << std::endl);
         if ( myGetTransaction(txid, ordertx, hashBlock) != 0 )
         {
 			// for logging: funcid = DecodeAssetOpRet(vintx.vout[vintx.vout.size() - 1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey);
-            if (ordertx.vout.size() > 0 && (funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey)) != 0)
+            if (ordertx.vout.size() > 0 && (order.funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, order.assetid, order.assetid2, order.nRequired, order.origpubkey)) != 0)
             {
-                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(funcid ? funcid : ' ') << " assetid=" << assetid.GetHex() << std::endl);
+                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(order.funcid ? order.funcid : ' ') << " assetid=" << order.assetid.GetHex() << std::endl);
 
-                if (pk == CPubKey() && (refassetid == zeroid || assetid == refassetid)  // tokenorders
-                    || pk != CPubKey() && pk == pubkey2pk(origpubkey) && (funcid == 'S' || funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
+                if (isListed(order))
                 {
 
                     LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << std::endl);
@@ -54,57 +133,8 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
                         LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() order with value=0 skipped" << std::endl);
                         return;
                     }
-
-                    UniValue item(UniValue::VOBJ);
-
-                    funcidstr[0] = funcid;
-                    funcidstr[1] = 0;
-                    item.push_back(Pair("funcid", funcidstr));
-                    item.push_back(Pair("txid", txid.GetHex()));
-                    item.push_back(Pair("vout", (int64_t)it->first.index));
-                    if (funcid == 'b' || funcid == 'B')
-                    {
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[it->first.index].nValue / COIN);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / COIN);
-                        item.push_back(Pair("bidamount", numstr));
-                    }
-                    else
-                    {
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[it->first.index].nValue);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[0].nValue);
-                        item.push_back(Pair("askamount", numstr));
-                    }
-                    if (origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
-                    {
-                        GetCCaddress(cp, origaddr, pubkey2pk(origpubkey));  
-                        item.push_back(Pair("origaddress", origaddr));
-                        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(origpubkey));
-                        item.push_back(Pair("origtokenaddress", origtokenaddr));
-                    }
-                    if (assetid != zeroid)
-                        item.push_back(Pair("tokenid", assetid.GetHex()));
-                    if (assetid2 != zeroid)
-                        item.push_back(Pair("otherid", assetid2.GetHex()));
-                    if (price > 0)
-                    {
-                        if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e')
-                        {
-                            sprintf(numstr, "%.8f", (double)price / COIN);
-                            item.push_back(Pair("totalrequired", numstr));
-                            sprintf(numstr, "%.8f", (double)price / (COIN * ordertx.vout[0].nValue));
-                            item.push_back(Pair("price", numstr));
-                        }
-                        else
-                        {
-                            item.push_back(Pair("totalrequired", (int64_t)price));
-                            sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / (price * COIN));
-                            item.push_back(Pair("price", numstr));
-                        }
-                    }
-                    result.push_back(item);
-                    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << " tokenid=" << assetid.GetHex() << std::endl);
+                    order.nValue = ordertx.vout[0].nValue;
+                    AddAssetOrderItem(result, cp, cpTokens, txid, it->first.index, ordertx.vout[it->first.index].nValue, order);
                 }
             }
         }
@@ -589,14 +619,41 @@ std::string FillBuyOffer(int64_t txfee,uint256 assetid,uint256 bidtxid,int64_t f
 
     mypk = pubkey2pk(Mypubkey());
 
+    if (bidtxid == zeroid)
+    {
+        // fill the best bid of the orderbook
+        AssetOrderList vBest;
+        if (!GetAssetOrderbook(CAssetBookKey(assetid, zeroid, 'b'), 1, vBest) || vBest.empty())
+        {
+            CCerror = strprintf("no bid to fill");
+            fprintf(stderr,"%s\n", CCerror.c_str());
+            return("");
+        }
+        bidtxid = vBest[0].first.hash;
+    }
+
     if (AddNormalinputs(mtx, mypk, 2*txfee, 3) > 0)
     {
+        CAssetOrder order;
+        bool haveOrder = false;
+
         mask = ~((1LL << mtx.vin.size()) - 1);
-        if (myGetTransaction(bidtxid, vintx, hashBlock) != 0)
+        // the orderbook has the bid unless it is in the mempool or there is no address index
+        if (GetAssetOrder(COutPoint(bidtxid, bidvout), order))
+        {
+            bidamount = order.nValue;
+            origprice = order.nRequired;
+            origpubkey = order.origpubkey;
+            haveOrder = true;
+        }
+        else if (myGetTransaction(bidtxid, vintx, hashBlock) != 0)
         {
             bidamount = vintx.vout[bidvout].nValue;
             SetAssetOrigpubkey(origpubkey, origprice, vintx);
-          
+            haveOrder = true;
+        }
+        if (haveOrder)
+        {
 			mtx.vin.push_back(CTxIn(bidtxid, bidvout, CScript()));					// Coins on Assets unspendable
             
             std::vector<uint8_t> vopretNonfungible;
@@ -692,13 +749,41 @@ std::string FillSell(int64_t txfee, uint256 assetid, uint256 assetid2, uint256 a
         txfee = 10000;
 
     mypk = pubkey2pk(Mypubkey());
+
+    if (asktxid == zeroid)
+    {
+        // fill the best ask of the orderbook
+        AssetOrderList vBest;
+        if (!GetAssetOrderbook(CAssetBookKey(assetid, zeroid, 's'), 1, vBest) || vBest.empty())
+        {
+            CCerror = strprintf("no ask to fill");
+            fprintf(stderr,"%s\n", CCerror.c_str());
+            return("");
+        }
+        asktxid = vBest[0].first.hash;
+    }
+
+    CAssetOrder order;
+    bool haveOrder = false;
+    // the orderbook has the ask unless it is in the mempool or there is no address index
+    if (GetAssetOrder(COutPoint(asktxid, askvout), order))
+    {
+        orig_assetoshis = order.nValue;
+        total_nValue = order.nRequired;
+        origpubkey = order.origpubkey;
+        haveOrder = true;
+    }
+    else if (myGetTransaction(asktxid, vintx, hashBlock) != 0)
+    {
+        orig_assetoshis = vintx.vout[askvout].nValue;
+        SetAssetOrigpubkey(origpubkey, total_nValue, vintx);
+        haveOrder = true;
+    }
     //if (AddNormalinputs(mtx, mypk, 2*txfee, 3) > 0)
     //{
         //mask = ~((1LL << mtx.vin.size()) - 1);
-        if (myGetTransaction(asktxid, vintx, hashBlock) != 0)
+        if (haveOrder)
         {
-            orig_assetoshis = vintx.vout[askvout].nValue;
-            SetAssetOrigpubkey(origpubkey, total_nValue, vintx);
             dprice = (double)total_nValue / orig_assetoshis;
             paid_nValue = dprice * fillunits;
 
@@ -67,6 +67,7 @@ Details.
 #include "../wallet/wallet.h"
 #include <univalue.h>
 #include <exception>
+#include <functional>
 #include "../komodo_defs.h"
 #include "../utlist.h"
 #include "../uthash.h"
@@ -851,6 +852,56 @@ void SetCCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex
 /// @param func funcid for which outputs will be filtered
 void SetCCtxids(std::vector<uint256> &txids,char *coinaddr,bool ccflag, uint8_t evalcode, uint256 filtertxid, uint8_t func);
 
+/// visitor callbacks for IterateCCunspents and IterateCCtxids, return false to stop the iteration
+typedef std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> CCunspentVisitor;
+typedef std::function<bool(const CAddressIndexKey&, CAmount)> CCtxidVisitor;
+
+/// IterateCCunspents streams the unspent outputs on an address in address index order without loading them all,
+/// so callers can stop as soon as they have what they need
+/// @param coinaddr address where unspent outputs are searched
+/// @param ccflag if true the function searches for cc outputs, otherwise for normal outputs
+/// @param pAfter if not null the iteration resumes right after this key (a cursor returned from a previous visit)
+/// @param visitor called for each output, returns false to stop
+/// @returns false if the address is invalid or the address index is not available
+bool IterateCCunspents(char *coinaddr,bool ccflag,const CAddressUnspentKey *pAfter,const CCunspentVisitor &visitor);
+
+/// IterateCCtxids streams the address index entries (outputs and spends) of an address in height order
+/// @param coinaddr address where the outputs are searched
+/// @param ccflag if true the function searches for cc outputs, otherwise for normal outputs
+/// @param pAfter if not null the iteration resumes right after this key
+/// @param visitor called for each entry, returns false to stop
+/// @returns false if the address is invalid or the address index is not available
+bool IterateCCtxids(char *coinaddr,bool ccflag,const CAddressIndexKey *pAfter,const CCtxidVisitor &visitor);
+
+/// candidate order for CCselectInputs
+enum CCinputsOrder
+{
+    CCINPUTS_INDEX = 0,     ///< address index order, streamed, no upfront scan
+    CCINPUTS_LARGEST = 1,   ///< largest value first, fewest inputs for the target
+    CCINPUTS_OLDEST = 2     ///< lowest height first, for outputs that mature with age
+};
+
+/// contract specific check of a candidate utxo for CCselectInputs
+/// @param vintx the tx that created the utxo
+/// @param vout the utxo vout number
+/// @param unspent address index record of the utxo
+/// @returns > 0 if the utxo may be spent
+typedef std::function<int64_t(const CTransaction &vintx, int32_t vout, const CAddressUnspentValue &unspent)> CCinputValidator;
+
+/// CCselectInputs is the shared input selection loop behind the cc Add*Inputs helpers.
+/// Candidates below the threshold, already in mtx.vin or spent in the mempool are dropped before their tx is loaded,
+/// each tx is loaded once per call, and the iteration stops as soon as total or maxinputs is reached
+/// @param mtx mutable transaction, inputs are added to vin only if both total and maxinputs are not 0
+/// @param coinaddr cc address to take the utxos from
+/// @param total amount to collect, 0 to sum all matching utxos
+/// @param maxinputs max number of inputs to add, 0 for no limit
+/// @param threshold utxos with less value are skipped
+/// @param order candidate order, one of CCinputsOrder
+/// @param validator contract specific utxo check
+/// @param[out] nump if not null receives the number of selected utxos
+/// @returns total value of the selected utxos
+int64_t CCselectInputs(CMutableTransaction &mtx,char *coinaddr,int64_t total,int32_t maxinputs,int64_t threshold,int32_t order,const CCinputValidator &validator,int32_t *nump = 0);
+
 /// In NSPV mode adds normal (not cc) inputs to the transaction object vin array for the specified total amount using available utxos on mypk's TX_PUBKEY address
 /// @param mtx mutable transaction object
 /// @param mypk pubkey to make TX_PUBKEY address from
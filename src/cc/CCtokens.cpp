@@ -287,9 +287,16 @@ int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true
         return(0);
     }
 
+    // outputs of confirmed token txs had their inputs checked when the block was connected,
+    // the tokens db only saves going deeper, the output itself is checked below as always
+    CTokenOutput tokenOutput;
+    bool fInTokensDB = GetTokenOutput(COutPoint(tx.GetHash(), v), tokenOutput) && tokenOutput.tokenid == reftokenid && tokenOutput.nValue == tx.vout[v].nValue;
+    if (fInTokensDB)
+        LOGSTREAM((char *)"cctokens", CCLOG_DEBUG2, stream << indentStr << "IsTokensvout() found in tokens db amount=" << tokenOutput.nValue << " txid=" << tx.GetHash().GetHex() << " v=" << v << std::endl);
+
 	if (tx.vout[v].scriptPubKey.IsPayToCryptoCondition()) 
 	{
-		if (goDeeper) {
+		if (goDeeper && !fInTokensDB) {
 			//validate all tx
 			int64_t myCCVinsAmount = 0, myCCVoutsAmount = 0;
 
@@ -507,6 +514,50 @@ bool IsTokenMarkerVout(CTxOut vout) {
     return vout == MakeCC1vout(EVAL_TOKENS, vout.nValue, GetUnspendable(cpTokens, NULL));
 }
 
+// checks the evalcode before decoding the opret, most txs are not token txs
+bool IsTokenOpRet(const CTransaction &tx)
+{
+    vscript_t vopret;
+    return tx.vout.size() > 1 && GetOpReturnData(tx.vout.back().scriptPubKey, vopret) && vopret.size() > 2 && vopret[0] == EVAL_TOKENS;
+}
+
+// returns the token vouts of a connected tx for the tokens db, validated as IsTokensvout(goDeeper) validates them
+// without goDeeper the inputs are left to the caller and the tokens db is not read
+void GetValidTokenOutputs(const CTransaction &tx, std::vector<std::pair<int32_t, CTokenOutput> > &outputs, bool goDeeper)
+{
+    uint8_t evalCode, funcId;
+    uint256 tokenid;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<std::pair<uint8_t, vscript_t>>  oprets;
+    vscript_t vopretExtra, vopretNonfungible;
+    struct CCcontract_info *cpTokens, tokensC;
+
+    outputs.clear();
+    if ((funcId = DecodeTokenOpRet(tx.vout.back().scriptPubKey, evalCode, tokenid, voutPubkeys, oprets)) == 0)
+        return;
+    if (funcId == 'c')
+        tokenid = tx.GetHash();
+    if (tokenid.IsNull())
+        return;
+
+    cpTokens = CCinit(&tokensC, EVAL_TOKENS);
+    FilterOutNonCCOprets(oprets, vopretExtra);
+    GetNonfungibleData(tokenid, vopretNonfungible);
+
+    CTokenOutput out;
+    out.tokenid = tokenid;
+    out.evalCode2 = vopretExtra.size() > 0 ? vopretExtra.begin()[0] : 0;
+    if (vopretNonfungible.size() > 0)
+        out.nonfungibleHash = Hash(vopretNonfungible.begin(), vopretNonfungible.end());
+
+    for (int32_t v = 0; v < (int32_t)tx.vout.size() - 1; v++) {
+        if (!tx.vout[v].scriptPubKey.IsPayToCryptoCondition())
+            continue;
+        if ((out.nValue = IsTokensvout(goDeeper, true, cpTokens, NULL, tx, v, tokenid)) > 0)
+            outputs.push_back(std::make_pair(v, out));
+    }
+}
+
 // compares cc inputs vs cc outputs (to prevent feeding vouts from normal inputs)
 bool TokensExactAmounts(bool goDeeper, struct CCcontract_info *cp, int64_t &inputs, int64_t &outputs, Eval* eval, const CTransaction &tx, uint256 reftokenid)
 {
@@ -618,81 +669,40 @@ int64_t AddTokenCCInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, C
 // also sets evalcode in cp, if needed
 int64_t AddTokenCCInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, CPubKey pk, uint256 tokenid, int64_t total, int32_t maxinputs, vscript_t &vopretNonfungible)
 {
-	char tokenaddr[64], destaddr[64]; 
-	int64_t threshold, nValue, price, totalinputs = 0;  
-	int32_t n = 0;
-	std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+	char tokenaddr[64];
+	int64_t threshold, totalinputs;
 
     GetNonfungibleData(tokenid, vopretNonfungible);
     if (vopretNonfungible.size() > 0)
         cp->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
 
 	GetTokensCCaddress(cp, tokenaddr, pk);
-	SetCCunspents(unspentOutputs, tokenaddr,true);
-
-
-    if (unspentOutputs.empty()) {
-        LOGSTREAM((char *)"cctokens", CCLOG_INFO, stream << "AddTokenCCInputs() no utxos for token dual/three eval addr=" << tokenaddr << " evalcode=" << (int)cp->evalcode << " additionalTokensEvalcode2=" << (int)cp->additionalTokensEvalcode2 << std::endl);
-    }
 
 	threshold = total / (maxinputs != 0 ? maxinputs : CC_MAXVINS);
 
-	for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++)
-	{
-        CTransaction vintx;
-        uint256 hashBlock;
-        uint256 vintxid = it->first.txhash;
-		int32_t vout = (int32_t)it->first.index;
+    // largest first: the global token address holds utxos of every token, so fewer candidates need their tx loaded
+    // this should work also for non-fungible tokens (there should be only 1 satoshi for non-fungible token issue)
+	totalinputs = CCselectInputs(mtx, tokenaddr, total, maxinputs, threshold, CCINPUTS_LARGEST, [&](const CTransaction &vintx, int32_t vout, const CAddressUnspentValue &unspent) {
+        char destaddr[64];
+        int64_t nValue;
 
-		if (it->second.satoshis < threshold)            // this should work also for non-fungible tokens (there should be only 1 satoshi for non-fungible token issue)
-			continue;
+        Getscriptaddress(destaddr, vintx.vout[vout].scriptPubKey);
+        if (strcmp(destaddr, tokenaddr) != 0 &&
+            strcmp(destaddr, cp->unspendableCCaddr) != 0 &&   // TODO: check why this. Should not we add token inputs from unspendable cc addr if mypubkey is used?
+            strcmp(destaddr, cp->unspendableaddr2) != 0)      // or the logic is to allow to spend all available tokens (what about unspendableaddr3)?
+            return (int64_t)0;
 
-        int32_t ivin;
-		for (ivin = 0; ivin < mtx.vin.size(); ivin ++)
-			if (vintxid == mtx.vin[ivin].prevout.hash && vout == mtx.vin[ivin].prevout.n)
-				break;
-		if (ivin != mtx.vin.size()) // that is, the tx.vout is already added to mtx.vin (in some previous calls)
-			continue;
+        LOGSTREAM((char *)"cctokens", CCLOG_DEBUG1, stream << "AddTokenCCInputs() check vintx vout destaddress=" << destaddr << " amount=" << vintx.vout[vout].nValue << std::endl);
 
-		if (myGetTransaction(vintxid, vintx, hashBlock) != 0)
-		{
-			Getscriptaddress(destaddr, vintx.vout[vout].scriptPubKey);
-			if (strcmp(destaddr, tokenaddr) != 0 && 
-                strcmp(destaddr, cp->unspendableCCaddr) != 0 &&   // TODO: check why this. Should not we add token inputs from unspendable cc addr if mypubkey is used?
-                strcmp(destaddr, cp->unspendableaddr2) != 0)      // or the logic is to allow to spend all available tokens (what about unspendableaddr3)?
-				continue;
-			
-            LOGSTREAM((char *)"cctokens", CCLOG_DEBUG1, stream << "AddTokenCCInputs() check vintx vout destaddress=" << destaddr << " amount=" << vintx.vout[vout].nValue << std::endl);
-
-			if ((nValue = IsTokensvout(true, true/*<--add only valid token uxtos */, cp, NULL, vintx, vout, tokenid)) > 0 && myIsutxo_spentinmempool(ignoretxid,ignorevin,vintxid, vout) == 0)
-			{
-				//for non-fungible tokens check payload:
-                if (!vopretNonfungible.empty()) {
-                    vscript_t vopret;
-
-                    // check if it is non-fungible token:
-                    GetNonfungibleData(tokenid, vopret);
-                    if (vopret != vopretNonfungible) {
-                        LOGSTREAM((char *)"cctokens", CCLOG_INFO, stream << "AddTokenCCInputs() found incorrect non-fungible opret payload for vintxid=" << vintxid.GetHex() << std::endl);
-                        continue;
-                    }
-                    // non-fungible evalCode2 cc contract should also check if there exists only one non-fungible vout with amount = 1
-                }
-
-                
-                if (total != 0 && maxinputs != 0)  // if it is not just to calc amount...
-					mtx.vin.push_back(CTxIn(vintxid, vout, CScript()));
-
-				nValue = it->second.satoshis;
-				totalinputs += nValue;
-                LOGSTREAM((char *)"cctokens", CCLOG_DEBUG1, stream << "AddTokenCCInputs() adding input nValue=" << nValue  << std::endl);
-				n++;
+        // the non-fungible payload belongs to the token, not to the utxo, so it was checked once above
+        if ((nValue = IsTokensvout(true, true/*<--add only valid token uxtos */, cp, NULL, vintx, vout, tokenid)) > 0)
+            LOGSTREAM((char *)"cctokens", CCLOG_DEBUG1, stream << "AddTokenCCInputs() adding input nValue=" << unspent.satoshis << std::endl);
+        return nValue;
+    });
 
-				if ((total > 0 && totalinputs >= total) || (maxinputs > 0 && n >= maxinputs))
-					break;
-			}
-		}
-	}
+    if (totalinputs == 0) {
+        LOGSTREAM((char *)"cctokens", CCLOG_INFO, stream << "AddTokenCCInputs() no usable utxos for token dual/three eval addr=" << tokenaddr << " evalcode=" << (int)cp->evalcode << " additionalTokensEvalcode2=" << (int)cp->additionalTokensEvalcode2 << std::endl);
+    }
 
 	//std::cerr << "AddTokenCCInputs() found totalinputs=" << totalinputs << std::endl;
 	return(totalinputs);
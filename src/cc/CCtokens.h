@@ -24,6 +24,7 @@
 #define CC_TOKENS_H
 
 #include "CCinclude.h"
+#include "../tokensdb.h"
 
 // CCcustom
 bool TokensValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
@@ -33,6 +34,8 @@ std::string TokenTransfer(int64_t txfee, uint256 assetid, std::vector<uint8_t> d
 int64_t HasBurnedTokensvouts(struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, uint256 reftokenid);
 CPubKey GetTokenOriginatorPubKey(CScript scriptPubKey);
 bool IsTokenMarkerVout(CTxOut vout);
+bool IsTokenOpRet(const CTransaction &tx);
+void GetValidTokenOutputs(const CTransaction &tx, std::vector<std::pair<int32_t, CTokenOutput> > &outputs, bool goDeeper = true);
 
 int64_t GetTokenBalance(CPubKey pk, uint256 tokenid);
 UniValue TokenInfo(uint256 tokenid);
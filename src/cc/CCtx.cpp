@@ -15,6 +15,7 @@
 
 #include "CCinclude.h"
 #include "key_io.h"
+#include "../tokensdb.h"
 
 std::vector<CPubKey> NULL_pubkeys;
 struct NSPV_CCmtxinfo NSPV_U;
@@ -471,17 +472,136 @@ void SetCCtxids(std::vector<uint256> &txids,char *coinaddr,bool ccflag, uint8_t
     } 
 }
 
-int64_t CCutxovalue(char *coinaddr,uint256 utxotxid,int32_t utxovout,int32_t CCflag)
+static bool CCaddress_indexkey(char *coinaddr,bool ccflag,uint160 &hashBytes,int &type)
 {
-    uint256 txid; std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,CCflag!=0?true:false);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    std::string addrstr(coinaddr);
+    CBitcoinAddress address(addrstr);
+    type = 0;
+    return(address.GetIndexKey(hashBytes, type, ccflag));
+}
+
+bool IterateCCunspents(char *coinaddr,bool ccflag,const CAddressUnspentKey *pAfter,const CCunspentVisitor &visitor)
+{
+    uint160 hashBytes; int type;
+    if ( KOMODO_NSPV_SUPERLITE )
     {
-        txid = it->first.txhash;
-        if ( txid == utxotxid && utxovout == it->first.index )
-            return(it->second.satoshis);
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; bool skipping = (pAfter != 0);
+        NSPV_CCunspents(unspentOutputs,coinaddr,ccflag);
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+        {
+            if ( skipping )
+            {
+                skipping = !(it->first.txhash == pAfter->txhash && it->first.index == pAfter->index);
+                continue;
+            }
+            if ( !visitor(it->first,it->second) )
+                break;
+        }
+        return(true);
     }
-    return(0);
+    if ( !CCaddress_indexkey(coinaddr,ccflag,hashBytes,type) )
+        return(false);
+    return(ScanAddressUnspent(hashBytes,type,pAfter,visitor));
+}
+
+bool IterateCCtxids(char *coinaddr,bool ccflag,const CAddressIndexKey *pAfter,const CCtxidVisitor &visitor)
+{
+    uint160 hashBytes; int type;
+    if ( KOMODO_NSPV_SUPERLITE )
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > txids; bool skipping = (pAfter != 0);
+        NSPV_CCtxids(txids,coinaddr,ccflag);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=txids.begin(); it!=txids.end(); it++)
+        {
+            if ( skipping )
+            {
+                skipping = !(it->first.txhash == pAfter->txhash && it->first.index == pAfter->index && it->first.spending == pAfter->spending);
+                continue;
+            }
+            if ( !visitor(it->first,it->second) )
+                break;
+        }
+        return(true);
+    }
+    if ( !CCaddress_indexkey(coinaddr,ccflag,hashBytes,type) )
+        return(false);
+    return(ScanAddressIndex(hashBytes,type,0,0,pAfter,visitor));
+}
+
+int64_t CCselectInputs(CMutableTransaction &mtx,char *coinaddr,int64_t total,int32_t maxinputs,int64_t threshold,int32_t order,const CCinputValidator &validator,int32_t *nump)
+{
+    int64_t totalinputs = 0; int32_t n = 0; std::map<uint256,CTransaction> txcache; std::set<uint256> missing;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > candidates;
+    // cheap checks first, the parent tx is only loaded for candidates that could be used
+    auto consider = [&](const CAddressUnspentKey &key,const CAddressUnspentValue &unspent) {
+        uint256 txid = key.txhash,hashBlock; int32_t i,vout = (int32_t)key.index; CTransaction vintx;
+        if ( unspent.satoshis < threshold )
+            return(true);
+        for (i=0; i<mtx.vin.size(); i++)
+            if ( txid == mtx.vin[i].prevout.hash && vout == mtx.vin[i].prevout.n )
+                return(true);
+        if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) != 0 )
+            return(true);
+        std::map<uint256,CTransaction>::const_iterator it = txcache.find(txid);
+        if ( it == txcache.end() )
+        {
+            if ( missing.count(txid) != 0 || myGetTransaction(txid,vintx,hashBlock) == 0 )
+            {
+                missing.insert(txid);
+                return(true);
+            }
+            it = txcache.insert(std::make_pair(txid,vintx)).first;
+        }
+        if ( vout >= it->second.vout.size() || validator(it->second,vout,unspent) <= 0 )
+            return(true);
+        if ( total != 0 && maxinputs != 0 )
+            mtx.vin.push_back(CTxIn(txid,vout,CScript()));
+        totalinputs += unspent.satoshis;
+        n++;
+        return(!((total > 0 && totalinputs >= total) || (maxinputs > 0 && n >= maxinputs)));
+    };
+    if ( order == CCINPUTS_INDEX )
+        IterateCCunspents(coinaddr,true,0,consider);
+    else
+    {
+        IterateCCunspents(coinaddr,true,0,[&](const CAddressUnspentKey &key,const CAddressUnspentValue &unspent) {
+            if ( unspent.satoshis >= threshold )
+                candidates.push_back(std::make_pair(key,unspent));
+            return(true);
+        });
+        if ( order == CCINPUTS_LARGEST )
+        {
+            std::stable_sort(candidates.begin(),candidates.end(),[](const std::pair<CAddressUnspentKey, CAddressUnspentValue> &a,const std::pair<CAddressUnspentKey, CAddressUnspentValue> &b) {
+                return(a.second.satoshis > b.second.satoshis);
+            });
+        }
+        else
+        {
+            std::stable_sort(candidates.begin(),candidates.end(),[](const std::pair<CAddressUnspentKey, CAddressUnspentValue> &a,const std::pair<CAddressUnspentKey, CAddressUnspentValue> &b) {
+                return(a.second.blockHeight < b.second.blockHeight);
+            });
+        }
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=candidates.begin(); it!=candidates.end(); it++)
+            if ( !consider(it->first,it->second) )
+                break;
+    }
+    if ( nump != 0 )
+        *nump = n;
+    return(totalinputs);
+}
+
+int64_t CCutxovalue(char *coinaddr,uint256 utxotxid,int32_t utxovout,int32_t CCflag)
+{
+    int64_t value = 0;
+    IterateCCunspents(coinaddr,CCflag!=0?true:false,0,[&](const CAddressUnspentKey &key,const CAddressUnspentValue &unspent) {
+        if ( key.txhash == utxotxid && utxovout == key.index )
+        {
+            value = unspent.satoshis;
+            return(false);
+        }
+        return(true);
+    });
+    return(value);
 }
 
 int64_t CCgettxout(uint256 txid,int32_t vout,int32_t mempoolflag,int32_t lockflag)
@@ -532,12 +652,11 @@ int32_t CCgetspenttxid(uint256 &spenttxid,int32_t &vini,int32_t &height,uint256
 
 int64_t CCaddress_balance(char *coinaddr,int32_t CCflag)
 {
-    int64_t sum = 0; std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,CCflag!=0?true:false);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-    {
-        sum += it->second.satoshis;
-    }
+    int64_t sum = 0;
+    IterateCCunspents(coinaddr,CCflag!=0?true:false,0,[&sum](const CAddressUnspentKey &key,const CAddressUnspentValue &unspent) {
+        sum += unspent.satoshis;
+        return(true);
+    });
     return(sum);
 }
 
@@ -565,6 +684,14 @@ int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
         txid = it->first.txhash;
+        // confirmed token outputs are in the tokens db with the tokenid of their opret
+        CTokenOutput tokenOutput;
+        if ( GetTokenOutput(COutPoint(txid,it->first.index),tokenOutput) )
+        {
+            if ( tokenOutput.tokenid == reftokenid )
+                sum += it->second.satoshis;
+            continue;
+        }
         if ( myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size()) > 0 )
         {
             char str[65];
@@ -636,7 +763,7 @@ int32_t CC_vinselect(int32_t *aboveip,int64_t *abovep,int32_t *belowip,int64_t *
 
 int64_t AddNormalinputsLocal(CMutableTransaction &mtx,CPubKey mypk,int64_t total,int32_t maxinputs)
 {
-    int32_t abovei,belowi,ind,vout,i,n = 0; int64_t sum,threshold,above,below; int64_t remains,nValue,totalinputs = 0; uint256 txid,hashBlock; std::vector<COutput> vecOutputs; CTransaction tx; struct CC_utxo *utxos,*up;
+    int32_t abovei,belowi,ind,vout,i,n = 0; int64_t sum,threshold,above,below; int64_t remains,nValue,totalinputs = 0; uint256 txid; std::vector<COutput> vecOutputs; struct CC_utxo *utxos,*up;
     if ( KOMODO_NSPV_SUPERLITE )
         return(NSPV_AddNormalinputs(mtx,mypk,total,maxinputs,&NSPV_U));
 
@@ -661,7 +788,8 @@ int64_t AddNormalinputsLocal(CMutableTransaction &mtx,CPubKey mypk,int64_t total
         {
             txid = out.tx->GetHash();
             vout = out.i;
-            if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout.size() > 0 && vout < tx.vout.size() && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() == 0 )
+            // the wallet already holds the tx, no need to look it up again
+            if ( out.tx->vout[vout].scriptPubKey.IsPayToCryptoCondition() == 0 )
             {
                 //fprintf(stderr,"check %.8f to vins array.%d of %d %s/v%d\n",(double)out.tx->vout[out.i].nValue/COIN,n,maxutxos,txid.GetHex().c_str(),(int32_t)vout);
                 if ( mtx.vin.size() > 0 )
@@ -20,6 +20,7 @@
 #include "primitives/transaction.h"
 #include "script/cc.h"
 #include "cc/eval.h"
+#include "cc/evalstats.h"
 #include "cc/utils.h"
 #include "cc/CCinclude.h"
 #include "main.h"
@@ -37,9 +38,18 @@ extern pthread_mutex_t KOMODO_CC_mutex;
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 {
     EvalRef eval;
-    pthread_mutex_lock(&KOMODO_CC_mutex);
+    // reentrant validators run concurrently on the script check threads
+    bool fReentrant = cond->codeLength > 0 && IsReentrantEval(cond->code[0]);
+    if ( !fReentrant )
+        pthread_mutex_lock(&KOMODO_CC_mutex);
+    uint64_t nTxFetches = nCCTxFetches, nSpentLookups = nCCSpentLookups;
+    int64_t nStart = GetTimeMicros();
     bool out = eval->Dispatch(cond, tx, nIn);
-    pthread_mutex_unlock(&KOMODO_CC_mutex);
+    int64_t nMicros = GetTimeMicros() - nStart;
+    if ( !fReentrant )
+        pthread_mutex_unlock(&KOMODO_CC_mutex);
+    if ( cond->codeLength > 0 )
+        RecordCCEval(cond->code[0], CCEvalFuncid(tx), eval->state.IsValid(), nMicros, nCCTxFetches - nTxFetches, nCCSpentLookups - nSpentLookups);
     if ( eval->state.IsValid() != out)
         fprintf(stderr,"out %d vs %d isValid\n",(int32_t)out,(int32_t)eval->state.IsValid());
     //assert(eval->state.IsValid() == out);
@@ -66,6 +76,49 @@ bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 }
 
 
+/*
+ * A validator opts in here once it is proven reentrant: it reads the chain,
+ * the indexes and txs only through calls that do not take cs_main, keeps no
+ * statics it writes to and keeps its state in the contract info of its Eval.
+ * ConnectBlock holds cs_main while the checks run, so the chain does not
+ * change under them. The others run on the connecting thread one at a time.
+ */
+bool IsReentrantEval(EvalCode ecode)
+{
+    switch ( ecode )
+    {
+        case EVAL_FAUCET:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static int ReentrantEvalVisit(CC *cond, CCVisitor visitor)
+{
+    if ( cc_typeId(cond) == CC_Eval && (cond->codeLength == 0 || !IsReentrantEval(cond->code[0])) )
+    {
+        *(bool *)visitor.context = false;
+        return 0;
+    }
+    return 1;
+}
+
+
+bool IsReentrantCCInput(const CScript &scriptSig)
+{
+    CC *cond;
+    bool fReentrant = true;
+    if ( (cond= GetCryptoCondition(scriptSig)) == 0 )
+        return false;
+    CCVisitor visitor = {&ReentrantEvalVisit, (uint8_t*)"", 0, &fReentrant};
+    cc_visit(cond, visitor);
+    cc_free(cond);
+    return fReentrant;
+}
+
+
 /*
  * Test the validity of an Eval node
  */
@@ -78,11 +131,13 @@ bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
     uint8_t ecode = cond->code[0];
     if ( ASSETCHAINS_CCDISABLES[ecode] != 0 )
     {
-        // check if a height activation has been set. 
-        if ( mapHeightEvalActivate[ecode] == 0 || this->GetCurrentHeight() == 0 || mapHeightEvalActivate[ecode] > this->GetCurrentHeight() )
+        // check if a height activation has been set. find does not insert, evals may run on several threads
+        std::map<std::int8_t, int32_t>::const_iterator it = mapHeightEvalActivate.find(ecode);
+        int32_t activateHeight = it != mapHeightEvalActivate.end() ? it->second : 0;
+        if ( activateHeight == 0 || this->GetCurrentHeight() == 0 || activateHeight > this->GetCurrentHeight() )
         {
             fprintf(stderr,"%s evalcode.%d %02x\n",txTo.GetHash().GetHex().c_str(),ecode,ecode);
-            fprintf(stderr, "ac_ccactivateht: evalcode.%i activates at height.%i vs current height.%i\n", ecode, mapHeightEvalActivate[ecode], this->GetCurrentHeight());
+            fprintf(stderr, "ac_ccactivateht: evalcode.%i activates at height.%i vs current height.%i\n", ecode, activateHeight, this->GetCurrentHeight());
             return Invalid("disabled-code, -ac_ccenables didnt include this ecode");
         }
     }
@@ -93,11 +148,17 @@ bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
             return CClib_Dispatch(cond,this,vparams,txTo,nIn);
         else return Invalid("mismatched -ac_cclib vs CClib_name");
     }
-    cp = &CCinfos[(int32_t)ecode];
-    if ( cp->didinit == 0 )
+    struct CCcontract_info C;
+    if ( IsReentrantEval(ecode) )
+        cp = CCinit(&C,ecode); // not shared with the evals on other threads
+    else
     {
-        CCinit(cp,ecode);
-        cp->didinit = 1;
+        cp = &CCinfos[(int32_t)ecode];
+        if ( cp->didinit == 0 )
+        {
+            CCinit(cp,ecode);
+            cp->didinit = 1;
+        }
     }
 
     switch ( ecode )
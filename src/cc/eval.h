@@ -134,6 +134,16 @@ public:
 
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn);
 
+/*
+ * Evals whose validator can run on the script check threads
+ */
+bool IsReentrantEval(EvalCode ecode);
+
+/*
+ * True if every eval of the fulfillment in scriptSig is reentrant
+ */
+bool IsReentrantCCInput(const CScript &scriptSig);
+
 
 /*
  * Virtual machine to use in the case of on-chain app evaluation
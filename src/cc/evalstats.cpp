@@ -0,0 +1,111 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "cc/evalstats.h"
+#include "cc/eval.h"
+#include "script/cc.h"
+#include "sync.h"
+#include "util.h"
+
+#include <algorithm>
+
+thread_local uint64_t nCCTxFetches = 0;
+thread_local uint64_t nCCSpentLookups = 0;
+
+static CCriticalSection cs_ccevalstats;
+static std::map<CCEvalKey, CCEvalStats> mapCCEvalStats;
+// evals of the block being connected, only kept while ccstats is logged
+static std::map<CCEvalKey, CCEvalStats> mapCCBlockEvalStats;
+static bool fCCBlockEvalStats = false;
+
+
+void CCEvalStats::Add(bool fValid, int64_t nMicros, uint64_t nTxFetchesIn, uint64_t nSpentLookupsIn)
+{
+    int nBucket = 0;
+    for (int64_t nLimit = 10; nBucket < CC_EVAL_TIMING_BUCKETS - 1 && nMicros >= nLimit; nLimit <<= 1)
+        nBucket++;
+    nCount++;
+    if (!fValid)
+        nInvalid++;
+    nTotalMicros += nMicros;
+    nMaxMicros = std::max(nMaxMicros, nMicros);
+    nTxFetches += nTxFetchesIn;
+    nSpentLookups += nSpentLookupsIn;
+    vBuckets[nBucket]++;
+}
+
+
+int64_t CCEvalStats::PercentileMicros(double dFraction) const
+{
+    uint64_t nSeen = 0, nWanted = (uint64_t)(dFraction * nCount + 0.999999);
+    for (int i = 0; i < CC_EVAL_TIMING_BUCKETS - 1; i++)
+    {
+        nSeen += vBuckets[i];
+        if (nSeen >= nWanted)
+            return std::min(nMaxMicros, ((int64_t)10 << i) - 1);
+    }
+    return nMaxMicros;
+}
+
+
+uint8_t CCEvalFuncid(const CTransaction &tx)
+{
+    std::vector<uint8_t> vopret;
+    if (tx.vout.size() > 0 && GetOpReturnData(tx.vout.back().scriptPubKey, vopret) && vopret.size() > 1)
+        return vopret[1];
+    return 0;
+}
+
+
+void RecordCCEval(uint8_t evalcode, uint8_t funcid, bool fValid, int64_t nMicros, uint64_t nTxFetches, uint64_t nSpentLookups)
+{
+    CCEvalKey key(evalcode, funcid);
+    LOCK(cs_ccevalstats);
+    mapCCEvalStats[key].Add(fValid, nMicros, nTxFetches, nSpentLookups);
+    if (fCCBlockEvalStats)
+        mapCCBlockEvalStats[key].Add(fValid, nMicros, nTxFetches, nSpentLookups);
+}
+
+
+void GetCCEvalStats(std::map<CCEvalKey, CCEvalStats> &mapStats, bool fReset)
+{
+    LOCK(cs_ccevalstats);
+    mapStats = mapCCEvalStats;
+    if (fReset)
+        mapCCEvalStats.clear();
+}
+
+
+// evals of txs accepted to the mempool before the block are not counted with it
+void ResetCCBlockEvalStats()
+{
+    LOCK(cs_ccevalstats);
+    mapCCBlockEvalStats.clear();
+    fCCBlockEvalStats = LogAcceptCategory("ccstats");
+}
+
+
+void LogCCBlockEvalStats(int nHeight)
+{
+    LOCK(cs_ccevalstats);
+    for (std::map<CCEvalKey, CCEvalStats>::const_iterator it = mapCCBlockEvalStats.begin(); it != mapCCBlockEvalStats.end(); ++it)
+    {
+        const CCEvalStats &stats = it->second;
+        LogPrint("ccstats", "ccstats: height %d %s funcid 0x%02x: %u evals, %u invalid, %dus total, %dus max, %u tx fetches, %u spent lookups\n",
+            nHeight, EvalToStr(it->first.first), (int)it->first.second, stats.nCount, stats.nInvalid,
+            stats.nTotalMicros, stats.nMaxMicros, stats.nTxFetches, stats.nSpentLookups);
+    }
+    mapCCBlockEvalStats.clear();
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef CC_EVALSTATS_H
+#define CC_EVALSTATS_H
+
+#include "primitives/transaction.h"
+
+#include <map>
+#include <stdint.h>
+
+/** Eval time histogram, bucket i counts evals under 10us << i and the last one the rest */
+static const int CC_EVAL_TIMING_BUCKETS = 22;
+
+/** Calls of the validator of one evalcode and funcid, see RecordCCEval() */
+struct CCEvalStats
+{
+    uint64_t nCount;
+    uint64_t nInvalid;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    uint64_t nTxFetches;        //!< myGetTransaction calls made by the validator
+    uint64_t nSpentLookups;     //!< spent index reads made by the validator
+    uint64_t vBuckets[CC_EVAL_TIMING_BUCKETS];
+
+    CCEvalStats() : nCount(0), nInvalid(0), nTotalMicros(0), nMaxMicros(0), nTxFetches(0), nSpentLookups(0)
+    {
+        for (int i = 0; i < CC_EVAL_TIMING_BUCKETS; i++)
+            vBuckets[i] = 0;
+    }
+
+    void Add(bool fValid, int64_t nMicros, uint64_t nTxFetchesIn, uint64_t nSpentLookupsIn);
+    /** Upper limit of the bucket holding the given fraction of the evals, at most nMaxMicros */
+    int64_t PercentileMicros(double dFraction) const;
+};
+
+/** evalcode and funcid */
+typedef std::pair<uint8_t, uint8_t> CCEvalKey;
+
+/** Counted on the thread doing them, RunCCEval records the difference across an eval */
+extern thread_local uint64_t nCCTxFetches;
+extern thread_local uint64_t nCCSpentLookups;
+
+/** Second byte of the opret of tx, the funcid of most contracts, 0 if it has no opret */
+uint8_t CCEvalFuncid(const CTransaction &tx);
+
+void RecordCCEval(uint8_t evalcode, uint8_t funcid, bool fValid, int64_t nMicros, uint64_t nTxFetches, uint64_t nSpentLookups);
+/** The evals recorded since startup or the last reset, cleared if fReset */
+void GetCCEvalStats(std::map<CCEvalKey, CCEvalStats> &mapStats, bool fReset = false);
+
+/** With -debug=ccstats the evals of a block are logged when it is connected */
+void ResetCCBlockEvalStats();
+void LogCCBlockEvalStats(int nHeight);
+
+#endif /* CC_EVALSTATS_H */
@@ -143,38 +143,20 @@ bool FaucetValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx
 
 int64_t AddFaucetInputs(struct CCcontract_info *cp,CMutableTransaction &mtx,CPubKey pk,int64_t total,int32_t maxinputs)
 {
-    char coinaddr[64]; int64_t threshold,nValue,price,totalinputs = 0; uint256 txid,hashBlock; std::vector<uint8_t> origpubkey; CTransaction vintx; int32_t vout,n = 0;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    char coinaddr[64]; int64_t threshold;
     GetCCaddress(cp,coinaddr,pk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
     if ( maxinputs > CC_MAXVINS )
         maxinputs = CC_MAXVINS;
     if ( maxinputs > 0 )
         threshold = total/maxinputs;
     else threshold = total;
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-    {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        if ( it->second.satoshis < threshold )
-            continue;
-        //char str[65]; fprintf(stderr,"check %s/v%d %.8f`\n",uint256_str(str,txid),vout,(double)it->second.satoshis/COIN);
-        // no need to prevent dup
-        if ( myGetTransaction(txid,vintx,hashBlock) != 0 )
-        {
-            if ( (nValue= IsFaucetvout(cp,vintx,vout)) > 1000000 && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
-            {
-                if ( total != 0 && maxinputs != 0 )
-                    mtx.vin.push_back(CTxIn(txid,vout,CScript()));
-                nValue = it->second.satoshis;
-                totalinputs += nValue;
-                n++;
-                if ( (total > 0 && totalinputs >= total) || (maxinputs > 0 && n >= maxinputs) )
-                    break;
-            } else fprintf(stderr,"vout.%d nValue %.8f too small or already spent in mempool\n",vout,(double)nValue/COIN);
-        } else fprintf(stderr,"couldn't get tx\n");
-    }
-    return(totalinputs);
+    return(CCselectInputs(mtx,coinaddr,total,maxinputs,threshold,CCINPUTS_INDEX,[&](const CTransaction &vintx,int32_t vout,const CAddressUnspentValue &unspent) {
+        int64_t nValue;
+        if ( (nValue= IsFaucetvout(cp,vintx,vout)) > 1000000 )
+            return(nValue);
+        fprintf(stderr,"vout.%d nValue %.8f too small\n",vout,(double)nValue/COIN);
+        return((int64_t)0);
+    }));
 }
 
 UniValue FaucetGet(const CPubKey& pk, uint64_t txfee)
@@ -14,6 +14,8 @@
  ******************************************************************************/
 
 #include "CCOracles.h"
+#include "../batonsdb.h"
+#include "../oraclesdb.h"
 #include <secp256k1.h>
 
 /*
@@ -305,6 +307,42 @@ uint256 OracleBatonUtxo(uint64_t txfee,struct CCcontract_info *cp,uint256 refora
     return(batontxid);
 }
 
+// a registration passes the baton in vout1 on to the data txs of its publisher
+bool OraclesIsBatonRoot(const CTransaction &tx)
+{
+    uint256 oracletxid; CPubKey pk; int64_t datafee;
+    return(tx.vout.size() > 2 && DecodeOraclesOpRet(tx.vout.back().scriptPubKey,oracletxid,pk,datafee) == 'R');
+}
+
+// a data tx of a publisher, its baton is vout1
+bool OraclesDecodeSample(const CTransaction &tx,uint256 &oracletxid,CPubKey &publisher,std::vector<uint8_t> &data,char *batonaddr)
+{
+    uint256 btxid; int32_t numvouts;
+    if ( (numvouts= tx.vout.size()) < 3 || tx.vout[1].nValue != CC_MARKER_VALUE || DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,btxid,publisher,data) != 'D' )
+        return(false);
+    return(Getscriptaddress(batonaddr,tx.vout[1].scriptPubKey));
+}
+
+// the baton with the highest height among the chains of the registrations, as OracleBatonUtxo finds it in the baton address.
+// Only for the rpcs, the index may not be at the tip and validation keeps walking the baton address.
+static bool OracleIndexedBaton(uint256 reforacletxid,CPubKey refpk,const std::vector<uint256> &regtxids,uint256 &batontxid)
+{
+    CBatonHead head,best; bool found = false; CTransaction tx; uint256 hashBlock,oracletxid,btxid; CPubKey pk; std::vector<uint8_t> data;
+    for (std::vector<uint256>::const_iterator it=regtxids.begin(); it!=regtxids.end(); it++)
+    {
+        if ( !GetBatonHead(EVAL_ORACLES,*it,head) )
+            return(false);
+        if ( !found || (head.nHeight == 0 && best.nHeight != 0) || (best.nHeight != 0 && head.nHeight > best.nHeight) )
+            best = head, found = true;
+    }
+    // a head which is not a data tx of the publisher is left to the walk
+    if ( found && best.nHops > 0 && (myGetTransaction(best.txid,tx,hashBlock) == 0 || tx.vout.size() < 3 || tx.vout[1].nValue != 10000 ||
+        DecodeOraclesData(tx.vout.back().scriptPubKey,oracletxid,btxid,pk,data) != 'D' || oracletxid != reforacletxid || pk != refpk) )
+        return(false);
+    batontxid = best.txid;
+    return(found);
+}
+
 uint256 OraclesBatontxid(uint256 reforacletxid,CPubKey refpk)
 {
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
@@ -498,7 +536,7 @@ int64_t OracleCorrelatedPrice(int32_t height,std::vector <int64_t> origprices)
     std::sort(origprices.begin(), origprices.end());
     prices = (int64_t *)calloc(n,sizeof(*prices));
     i = 0;
-    for (std::vector<int64_t>::const_iterator it=sorted.begin(); it!=sorted.end(); it++)
+    for (std::vector<int64_t>::const_iterator it=origprices.begin(); it!=origprices.end(); it++)
         prices[i++] = *it;
     price = correlate_price(height,prices,i);
     free(prices);
@@ -531,44 +569,32 @@ int32_t oracleprice_add(std::vector<struct oracleprice_info> &publishers,CPubKey
     } else return(0);
 }
 
-/*int64_t OraclePrice(int32_t height,uint256 reforacletxid,char *markeraddr,char *format)
+// the latest 'L' value of each publisher which published within maxage blocks of the newest of them, as the index keeps them block by block, -1 while it catches up
+int64_t OraclePrice(int32_t height,uint256 reforacletxid,int32_t maxage,int64_t &median,std::vector<COracleSample> &samples)
 {
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    CTransaction regtx; uint256 hash,txid,oracletxid,batontxid; CPubKey pk; int32_t i,ht,maxheight=0; int64_t datafee,price; char batonaddr[64]; std::vector <uint8_t> data; struct CCcontract_info *cp,C; std::vector <struct oracleprice_info> publishers; std::vector <int64_t> prices;
-    if ( format[0] != 'L' )
-        return(0);
-    cp = CCinit(&C,EVAL_ORACLES);
-    SetCCunspents(unspentOutputs,markeraddr,false);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    std::vector<COracleSample> latest; std::vector<int64_t> prices; uint256 hash; int64_t price; int32_t maxheight = 0;
+    median = 0;
+    samples.clear();
+    if ( !GetOracleLatestSamples(reforacletxid,latest) )
+        return(-1);
+    for (std::vector<COracleSample>::const_iterator it=latest.begin(); it!=latest.end(); it++)
+        if ( it->nHeight > maxheight )
+            maxheight = it->nHeight;
+    for (std::vector<COracleSample>::const_iterator it=latest.begin(); it!=latest.end(); it++)
     {
-        txid = it->first.txhash;
-        ht = (int32_t)it->second.blockHeight;
-        if ( myGetTransaction(txid,regtx,hash) != 0 )
+        if ( it->nHeight >= maxheight-maxage && oracle_format(&hash,&price,0,'L',(uint8_t *)it->data.data(),0,(int32_t)it->data.size()) == sizeof(int64_t) && price != 0 )
         {
-            if ( regtx.vout.size() > 0 && DecodeOraclesOpRet(regtx.vout[regtx.vout.size()-1].scriptPubKey,oracletxid,pk,datafee) == 'R' && oracletxid == reforacletxid )
-            {
-                Getscriptaddress(batonaddr,regtx.vout[1].scriptPubKey);
-                batontxid = OracleBatonUtxo(10000,cp,oracletxid,batonaddr,pk,data);
-                if ( batontxid != zeroid && (ht= oracleprice_add(publishers,pk,ht,data,maxheight)) > maxheight )
-                    maxheight = ht;
-            }
+            prices.push_back(price);
+            samples.push_back(*it);
         }
     }
-    if ( maxheight > 10 )
-    {
-        for (std::vector<struct oracleprice_info>::const_iterator it=publishers.begin(); it!=publishers.end(); it++)
-        {
-            if ( it->height >= maxheight-10 )
-            {
-                oracle_format(&hash,&price,0,'L',(uint8_t *)it->data.data(),0,(int32_t)it->data.size());
-                if ( price != 0 )
-                    prices.push_back(price);
-            }
-        }
-        return(OracleCorrelatedPrice(height,prices));
-    }
-    return(0);
-}*/
+    if ( prices.size() == 0 )
+        return(0);
+    std::vector<int64_t> sorted(prices);
+    std::sort(sorted.begin(),sorted.end());
+    median = sorted[sorted.size() >> 1];
+    return(OracleCorrelatedPrice(height,prices));
+}
 
 int64_t IsOraclesvout(struct CCcontract_info *cp,const CTransaction& tx,int32_t v)
 {
@@ -1070,8 +1096,8 @@ UniValue OracleDataSample(uint256 reforacletxid,uint256 txid)
 UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
 {
     UniValue result(UniValue::VOBJ),b(UniValue::VARR); CTransaction tx,oracletx; uint256 txid,hashBlock,btxid,oracletxid; 
-    CPubKey pk; std::string name,description,format; int32_t numvouts,n=0,vout; std::vector<uint8_t> data; char *formatstr = 0, addr[64];
-    std::vector<uint256> txids; int64_t nValue;
+    CPubKey pk,publisher; std::string name,description,format; int32_t numvouts,n=0,vout; std::vector<uint8_t> data; char *formatstr = 0, addr[64];
+    std::vector<uint256> txids; int64_t nValue; std::vector<COracleSample> samples;
     
     result.push_back(Pair("result","success"));
     if ( myGetTransaction(reforacletxid,oracletx,hashBlock) != 0 && (numvouts=oracletx.vout.size()) > 0 )
@@ -1101,6 +1127,21 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
                     }
                 }
             }
+            // the confirmed samples come from the series of the publisher, else from the baton address
+            if ( GetOraclePublisher(reforacletxid,batonaddr,publisher) != 0 && GetOracleSamples(COracleSeriesKey(reforacletxid,publisher),0,0,num != 0 ? num-n : 0,samples) != 0 )
+            {
+                if ( (formatstr= (char *)format.c_str()) == 0 )
+                    formatstr = (char *)"";
+                for (std::vector<COracleSample>::const_iterator it=samples.begin(); it!=samples.end(); it++)
+                {
+                    UniValue a(UniValue::VOBJ);
+                    a.push_back(Pair("txid",it->txid.GetHex()));
+                    a.push_back(Pair("data",OracleFormat((uint8_t *)it->data.data(),(int32_t)it->data.size(),formatstr,(int32_t)format.size())));
+                    b.push_back(a);
+                }
+                result.push_back(Pair("samples",b));
+                return(result);
+            }
             SetCCtxids(txids,batonaddr,true,EVAL_ORACLES,reforacletxid,'D');
             if (txids.size()>0)
             {
@@ -1136,6 +1177,83 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
     return(result);
 }
 
+UniValue OracleDataSeries(uint256 reforacletxid,CPubKey publisher,uint32_t from,uint32_t to,bool raw)
+{
+    UniValue result(UniValue::VOBJ),b(UniValue::VARR); CTransaction oracletx; uint256 hashBlock,oracletxid; CPubKey pk;
+    std::string name,description,format; int32_t numvouts; std::vector<uint8_t> data; char *formatstr,batonaddr[64];
+    std::vector<COracleSample> samples; bool complete,bytime = (from >= LOCKTIME_THRESHOLD);
+
+    if ( myGetTransaction(reforacletxid,oracletx,hashBlock) == 0 || (numvouts=oracletx.vout.size()) <= 0 )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "cant find oracletxid " << reforacletxid.GetHex());
+    if ( DecodeOraclesCreateOpRet(oracletx.vout[numvouts-1].scriptPubKey,name,description,format) != 'C' )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "invalid oracletxid " << reforacletxid.GetHex());
+    if ( (formatstr= (char *)format.c_str()) == 0 )
+        formatstr = (char *)"";
+    // heights, or block times as for a locktime
+    if ( bytime != 0 )
+        complete = GetOracleSamplesByTime(COracleSeriesKey(reforacletxid,publisher),from,to,0,samples);
+    else complete = GetOracleSamples(COracleSeriesKey(reforacletxid,publisher),(int32_t)from,(int32_t)to,0,samples);
+    if ( to == 0 )
+    {
+        std::vector<CTransaction> tmp_txs; std::vector<COracleSample> pending;
+        myGet_mempool_txs(tmp_txs,EVAL_ORACLES,'D');
+        for (std::vector<CTransaction>::const_iterator it=tmp_txs.begin(); it!=tmp_txs.end(); it++)
+        {
+            COracleSample sample;
+            if ( OraclesDecodeSample(*it,oracletxid,pk,sample.data,batonaddr) != 0 && oracletxid == reforacletxid && pk == publisher )
+            {
+                sample.txid = it->GetHash();
+                sample.publisher = pk;
+                pending.push_back(sample);
+            }
+        }
+        samples.insert(samples.begin(),pending.begin(),pending.end());
+    }
+    for (std::vector<COracleSample>::const_iterator it=samples.begin(); it!=samples.end(); it++)
+    {
+        UniValue a(UniValue::VOBJ);
+        a.push_back(Pair("txid",it->txid.GetHex()));
+        a.push_back(Pair("height",it->nHeight));
+        a.push_back(Pair("time",(int64_t)it->nTime));
+        if ( raw != 0 )
+            a.push_back(Pair("data",HexStr(it->data)));
+        else a.push_back(Pair("data",OracleFormat((uint8_t *)it->data.data(),(int32_t)it->data.size(),formatstr,(int32_t)format.size())));
+        b.push_back(a);
+    }
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("samples",b));
+    result.push_back(Pair("complete",complete));
+    return(result);
+}
+
+UniValue OraclePrices(uint256 reforacletxid,int32_t maxage)
+{
+    UniValue result(UniValue::VOBJ),a(UniValue::VARR); CTransaction oracletx; uint256 hashBlock; std::string name,description,format;
+    int32_t numvouts,height; int64_t price,median; std::vector<COracleSample> samples;
+
+    if ( myGetTransaction(reforacletxid,oracletx,hashBlock) == 0 || (numvouts=oracletx.vout.size()) <= 0 )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "cant find oracletxid " << reforacletxid.GetHex());
+    if ( DecodeOraclesCreateOpRet(oracletx.vout[numvouts-1].scriptPubKey,name,description,format) != 'C' || format.size() == 0 || format[0] != 'L' )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "oracle " << reforacletxid.GetHex() << " has no price, its format does not start with L");
+    height = komodo_get_current_height();
+    if ( (price= OraclePrice(height,reforacletxid,maxage,median,samples)) < 0 )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "oracle samples are not indexed up to the tip yet");
+    for (std::vector<COracleSample>::const_iterator it=samples.begin(); it!=samples.end(); it++)
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("publisher",HexStr(it->publisher)));
+        obj.push_back(Pair("txid",it->txid.GetHex()));
+        obj.push_back(Pair("height",it->nHeight));
+        a.push_back(obj);
+    }
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("height",height));
+    result.push_back(Pair("correlated",price));
+    result.push_back(Pair("median",median));
+    result.push_back(Pair("publishers",a));
+    return(result);
+}
+
 UniValue OracleInfo(uint256 origtxid)
 {
     UniValue result(UniValue::VOBJ),a(UniValue::VARR);
@@ -1143,7 +1261,7 @@ UniValue OracleInfo(uint256 origtxid)
     CMutableTransaction mtx = CreateNewContextualCMutableTransaction(Params().GetConsensus(), komodo_nextheight());
     CTransaction tx; std::string name,description,format; uint256 hashBlock,txid,oracletxid,batontxid; CPubKey pk;
     struct CCcontract_info *cp,C; int64_t datafee,funding; char str[67],markeraddr[64],numstr[64],batonaddr[64]; std::vector <uint8_t> data;
-    std::map<CPubKey,std::pair<uint256,int32_t>> publishers;
+    std::map<CPubKey,std::pair<uint256,int32_t>> publishers; std::map<CPubKey,std::vector<uint256>> regtxids;
 
     cp = CCinit(&C,EVAL_ORACLES);
     CCtxidaddr(markeraddr,origtxid);
@@ -1177,6 +1295,7 @@ UniValue OracleInfo(uint256 origtxid)
                         publishers[pk].first=txid;
                         publishers[pk].second=height;
                     }
+                    regtxids[pk].push_back(txid);
                 }
             }
             for (std::map<CPubKey,std::pair<uint256,int32_t>>::iterator it = publishers.begin(); it != publishers.end(); ++it)
@@ -1186,7 +1305,8 @@ UniValue OracleInfo(uint256 origtxid)
                     UniValue obj(UniValue::VOBJ);
                     obj.push_back(Pair("publisher",pubkey33_str(str,(uint8_t *)pk.begin())));
                     Getscriptaddress(batonaddr,tx.vout[1].scriptPubKey);
-                    batontxid = OracleBatonUtxo(10000,cp,oracletxid,batonaddr,pk,data);
+                    if ( !OracleIndexedBaton(oracletxid,pk,regtxids[pk],batontxid) )
+                        batontxid = OracleBatonUtxo(10000,cp,oracletxid,batonaddr,pk,data);
                     obj.push_back(Pair("baton",batonaddr));
                     obj.push_back(Pair("batontxid",uint256_str(str,batontxid)));
                     funding = LifetimeOraclesFunds(cp,oracletxid,pk);
@@ -14,6 +14,7 @@
  ******************************************************************************/
 #include "hex.h"
 #include "CCPayments.h"
+#include "CCtokens.h"
 
 /* 
  0) txidopret <- allocation, scriptPubKey, opret
@@ -228,7 +229,7 @@ uint8_t DecodePaymentsTokensOpRet(CScript scriptPubKey,int32_t &lockedblocks,int
     std::vector<uint8_t> vopret; uint8_t *script,e,f;
     GetOpReturnData(scriptPubKey, vopret);
     script = (uint8_t *)vopret.data();
-    if ( vopret.size() > 2 && E_UNMARSHAL(vopret,ss >> e; ss >> f; ss >> lockedblocks; ss >> minimum; ss >> top; ; ss >> bottom; ss >> fixedAmount; ss >> excludeScriptPubKeys; ss >> tokenid) != 0 )
+    if ( vopret.size() > 2 && E_UNMARSHAL(vopret,ss >> e; ss >> f; ss >> lockedblocks; ss >> minrelease; ss >> minimum; ss >> top; ; ss >> bottom; ss >> fixedAmount; ss >> excludeScriptPubKeys; ss >> tokenid) != 0 )
     {
         if ( e == EVAL_PAYMENTS && f == 'O' )
             return(f);
@@ -247,18 +248,23 @@ int64_t IsPaymentsvout(struct CCcontract_info *cp,const CTransaction& tx,int32_t
     return(0);
 }
 
-bool payments_game(int32_t &top, int32_t &bottom)
+// the range of a snapshot of n entries taken at the block hash paid by a game plan
+static void payments_gamerange(uint256 tmphash, int32_t n, int32_t &top, int32_t &bottom)
 {
     uint64_t x;
-    uint256 tmphash = chainActive[lastSnapShotHeight]->GetBlockHash();
     memcpy(&x,&tmphash,sizeof(x));
     bottom = ((x & 0xff) % 50);
     if ( bottom == 0 ) bottom = 1;
     top = (((x>>8) & 0xff) % 100);
     if ( top < 50 ) top += 50;
-    bottom = (vAddressSnapshot.size()*bottom)/100;
-    top = (vAddressSnapshot.size()*top)/100;
+    bottom = (n*bottom)/100;
+    top = (n*top)/100;
     //fprintf(stderr, "bottom.%i top.%i\n",bottom,top);
+}
+
+bool payments_game(int32_t &top, int32_t &bottom)
+{
+    payments_gamerange(chainActive[lastSnapShotHeight]->GetBlockHash(), vAddressSnapshot.size(), top, bottom);
     return true;
 }
 
@@ -275,47 +281,247 @@ bool payments_lockedblocks(uint256 blockhash,int32_t lockedblocks,int32_t &block
     return true;
 }
 
-int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
+void CPaymentsSnapshot::Set(int32_t nHeightIn, const std::vector<std::pair<CAmount, CScript>> &vEntries)
 {
-    mpz_t mpzAllocation; int32_t i =0;
-    for (int32_t j = bottom; j < vAddressSnapshot.size(); j++)
+    nHeight = nHeightIn;
+    vScriptPubKeys.clear();
+    vAllocations.clear();
+    vTotals.assign(1, 0);
+    mapIndex.clear();
+    for (auto &entry : vEntries)
     {
-        auto &address = vAddressSnapshot[j];
-        CScript scriptPubKey = GetScriptForDestination(address.second); 
-        bool skip = false;
-        // skip excluded addresses. 
-        for ( auto skipkey : excludeScriptPubKeys ) 
+        mapIndex.insert(std::make_pair(Hash(entry.second.begin(), entry.second.end()), (int32_t)vScriptPubKeys.size()));
+        vScriptPubKeys.push_back(entry.second);
+        vAllocations.push_back(entry.first);
+        vTotals.push_back(vTotals.back() + entry.first);
+    }
+}
+
+int32_t CPaymentsSnapshot::GetAllocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys, std::vector<int64_t> &allocations) const
+{
+    int32_t i = 0, j, n = (int32_t)vScriptPubKeys.size(); int64_t total; size_t e = 0;
+    if ( bottom < 0 || bottom >= n )
+        return(0);
+    // positions of the excluded addresses, merged in the walk below
+    std::vector<int32_t> vExcluded;
+    for ( auto &skipkey : excludeScriptPubKeys )
+    {
+        auto it = mapIndex.find(Hash(skipkey.begin(), skipkey.end()));
+        if ( it != mapIndex.end() && it->second >= bottom )
+            vExcluded.push_back(it->second);
+    }
+    std::sort(vExcluded.begin(), vExcluded.end());
+    for (j = bottom; j < n; j++)
+    {
+        if ( e < vExcluded.size() && vExcluded[e] == j )
         {
-            if ( scriptPubKey == CScript(skipkey.begin(), skipkey.end()) )
-                skip = true;
+            while ( e < vExcluded.size() && vExcluded[e] == j )
+                e++;
         }
-        if ( !skip )
+        else
         {
-            mpz_init(mpzAllocation); 
             i++;
-            //fprintf(stderr, "address: %s nValue.%li \n", CBitcoinAddress(address.second).ToString().c_str(), address.first);
-            scriptPubKeys.push_back(scriptPubKey);
-            allocations.push_back(address.first);
-            mpz_set_lli(mpzAllocation,address.first);
-            mpz_add(mpzTotalAllocations,mpzTotalAllocations,mpzAllocation); 
-            mpz_clear(mpzAllocation);
+            scriptPubKeys.push_back(vScriptPubKeys[j]);
+            allocations.push_back(vAllocations[j]);
         }
-        if ( i+bottom == top ) 
+        if ( i+bottom == top )
+        {
+            j++;
             break; // we reached top amount to pay, it can be less than this, if less address exist on chain, return the number we got.
+        }
     }
+    // allocations from bottom up to where the walk stopped, less the excluded ones in it
+    total = vTotals[j] - vTotals[bottom];
+    for (size_t k = 0; k < e; k++)
+        if ( k == 0 || vExcluded[k] != vExcluded[k-1] )
+            total -= vAllocations[vExcluded[k]];
+    mpz_t mpzAllocation;
+    mpz_init(mpzAllocation);
+    mpz_set_lli(mpzAllocation,total);
+    mpz_add(mpzTotalAllocations,mpzTotalAllocations,mpzAllocation);
+    mpz_clear(mpzAllocation);
     return(i);
 }
 
-int32_t payments_gettokenallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, uint256 tokenid, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
+static CCriticalSection cs_paymentssnapshots;
+static CPaymentsSnapshot addressSnapshot;
+
+int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
+{
+    LOCK(cs_paymentssnapshots);
+    // the daily snapshot is scripted once after it is taken
+    if ( addressSnapshot.nHeight != lastSnapShotHeight || addressSnapshot.vAllocations.size() != vAddressSnapshot.size() )
+    {
+        std::vector<std::pair<CAmount, CScript>> vEntries;
+        for ( auto &address : vAddressSnapshot )
+            vEntries.push_back(std::make_pair(address.first, GetScriptForDestination(address.second)));
+        addressSnapshot.Set(lastSnapShotHeight, vEntries);
+    }
+    return(addressSnapshot.GetAllocations(top, bottom, excludeScriptPubKeys, mpzTotalAllocations, scriptPubKeys, allocations));
+}
+
+bool payments_tokensactive(int32_t height)
 {
-    /*
-    - check tokenid exists.
-    - iterate tokenid address and extract all pubkeys, add to map. 
-    - rewind to last notarized height for balances? see main.cpp: line# 660.
-    - convert balances to mpz_t and add up totalallocations
-    - sort the map into a vector, then convert to the correct output.
-    */
-    return(0);
+    return(KOMODO_PAYMENTSTOKENS_HEIGHT > 0 && height >= KOMODO_PAYMENTSTOKENS_HEIGHT);
+}
+
+int32_t payments_tokensnapshotheight(int32_t height)
+{
+    if ( KOMODO_SNAPSHOT_INTERVAL <= 0 || height <= KOMODO_SNAPSHOT_INTERVAL )
+        return(0);
+    return(((height - 1) / KOMODO_SNAPSHOT_INTERVAL) * KOMODO_SNAPSHOT_INTERVAL);
+}
+
+void CPaymentsTokenHolders::Clear()
+{
+    nHeight = -1;
+    hashBlock.SetNull();
+    mapOutputs.clear();
+    snapshot = CPaymentsSnapshot();
+}
+
+void CPaymentsTokenHolders::ScanTx(const CTransaction &tx, uint256 tokenid)
+{
+    std::vector<std::pair<int32_t, CTokenOutput>> outputs; int64_t spent = 0, created = 0;
+    uint8_t evalCode; uint256 tokenidInOpret; std::vector<CPubKey> voutPubkeys; std::vector<std::pair<uint8_t, vscript_t>> oprets;
+    for ( auto &vin : tx.vin )
+    {
+        auto it = mapOutputs.find(vin.prevout);
+        if ( it != mapOutputs.end() )
+        {
+            spent += it->second.first;
+            mapOutputs.erase(it);
+        }
+    }
+    if ( tx.GetHash() != tokenid && spent == 0 )
+        return;
+    GetValidTokenOutputs(tx, outputs, false);
+    for ( auto &out : outputs )
+        if ( out.second.tokenid == tokenid )
+            created += out.second.nValue;
+    // the tokens validation keeps transfers balanced, more than was spent cannot be tokens
+    if ( tx.GetHash() != tokenid && created > spent )
+        return;
+    if ( tx.GetHash() == tokenid )
+    {
+        // the tokenbase pays its creator, the create opret names no other pubkeys
+        std::vector<uint8_t> origpubkey; std::string name, description;
+        if ( DecodeTokenCreateOpRet(tx.vout.back().scriptPubKey, origpubkey, name, description) == 'c' )
+            voutPubkeys.push_back(pubkey2pk(origpubkey));
+    }
+    else DecodeTokenOpRet(tx.vout.back().scriptPubKey, evalCode, tokenidInOpret, voutPubkeys, oprets);
+    for ( auto &out : outputs )
+    {
+        CScript holder;
+        if ( out.second.tokenid != tokenid )
+            continue;
+        for ( auto &pk : voutPubkeys )
+        {
+            if ( tx.vout[out.first].scriptPubKey == MakeTokensCC1vout(EVAL_TOKENS, out.second.nValue, pk).scriptPubKey || (out.second.evalCode2 != 0 && tx.vout[out.first].scriptPubKey == MakeTokensCC1vout(EVAL_TOKENS, out.second.evalCode2, out.second.nValue, pk).scriptPubKey) )
+            {
+                holder = GetScriptForDestination(pk.GetID());
+                break;
+            }
+        }
+        mapOutputs[COutPoint(tx.GetHash(), out.first)] = std::make_pair(out.second.nValue, holder);
+    }
+}
+
+CBlockIndex *CPaymentsTokenHolders::GetTokenbaseIndex(uint256 tokenid) const
+{
+    CTransaction tokenbase; uint256 hashBlock;
+    if ( myGetTransaction(tokenid, tokenbase, hashBlock) == 0 )
+        return(0);
+    return(komodo_blockindex(hashBlock));
+}
+
+bool CPaymentsTokenHolders::ReadBlock(CBlockIndex *pindex, CBlock &block) const
+{
+    return(komodo_blockload(block, pindex) == 0);
+}
+
+bool CPaymentsTokenHolders::Scan(uint256 tokenid, int32_t height)
+{
+    CBlockIndex *pindex; int32_t from;
+    AssertLockHeld(cs_main);
+    if ( height <= 0 || height > chainActive.Height() )
+        return(false);
+    if ( nHeight >= 0 && (nHeight > height || chainActive[nHeight]->GetBlockHash() != hashBlock) )
+        Clear();
+    if ( nHeight == height )
+        return(true);
+    if ( nHeight < 0 )
+    {
+        // nothing to scan before the tokenbase
+        if ( (pindex= GetTokenbaseIndex(tokenid)) == 0 || !chainActive.Contains(pindex) )
+            return(false);
+        from = pindex->GetHeight();
+    }
+    else from = nHeight + 1;
+    for (int32_t h = from; h <= height; h++)
+    {
+        CBlock block;
+        if ( !ReadBlock(chainActive[h], block) )
+        {
+            Clear();
+            return(false);
+        }
+        for ( auto &tx : block.vtx )
+            ScanTx(tx, tokenid);
+    }
+    nHeight = height;
+    hashBlock = chainActive[height]->GetBlockHash();
+
+    std::map<CScript, CAmount> mapBalances;
+    std::vector<std::pair<CAmount, CScript>> vEntries;
+    for ( auto &output : mapOutputs )
+        if ( output.second.second.size() > 0 )
+            mapBalances[output.second.second] += output.second.first;
+    for ( auto &balance : mapBalances )
+        vEntries.push_back(std::make_pair(balance.second, balance.first));
+    // sort by amount, highest at top, as the daily snapshot is.
+    std::sort(vEntries.rbegin(), vEntries.rend());
+    if ( vEntries.size() > 3999 ) vEntries.resize(3999);
+    snapshot.Set(height, vEntries);
+    return(true);
+}
+
+static std::map<uint256, CPaymentsTokenHolders> mapTokenHolders;
+
+// the holders of the tokens released last, a token evicted is scanned again from its tokenbase
+static CPaymentsTokenHolders &payments_tokenholders(uint256 tokenid)
+{
+    static int64_t nUses;
+    std::map<uint256, CPaymentsTokenHolders>::iterator it = mapTokenHolders.find(tokenid);
+    AssertLockHeld(cs_paymentssnapshots);
+    if ( it == mapTokenHolders.end() )
+    {
+        if ( mapTokenHolders.size() >= PAYMENTS_MAXTOKENHOLDERS )
+        {
+            std::map<uint256, CPaymentsTokenHolders>::iterator oldest = mapTokenHolders.begin();
+            for ( std::map<uint256, CPaymentsTokenHolders>::iterator it2 = mapTokenHolders.begin(); it2 != mapTokenHolders.end(); it2++ )
+                if ( it2->second.nLastUsed < oldest->second.nLastUsed )
+                    oldest = it2;
+            mapTokenHolders.erase(oldest);
+        }
+        it = mapTokenHolders.insert(std::make_pair(tokenid, CPaymentsTokenHolders())).first;
+    }
+    it->second.nLastUsed = ++nUses;
+    return(it->second);
+}
+
+int32_t payments_gettokenallocations(int32_t height, uint256 tokenid, int32_t &top, int32_t &bottom, bool fGame, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
+{
+    int32_t snapshotHeight = payments_tokensnapshotheight(height);
+    if ( !payments_tokensactive(height) || snapshotHeight <= 0 )
+        return(-1);
+    LOCK2(cs_main, cs_paymentssnapshots);
+    CPaymentsTokenHolders &holders = payments_tokenholders(tokenid);
+    if ( !holders.Scan(tokenid, snapshotHeight) )
+        return(-1);
+    if ( fGame )
+        payments_gamerange(holders.hashBlock, holders.snapshot.vAllocations.size(), top, bottom);
+    return(holders.snapshot.GetAllocations(top, bottom, excludeScriptPubKeys, mpzTotalAllocations, scriptPubKeys, allocations));
 }
 
 bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn)
@@ -324,7 +530,7 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
     int32_t i,lockedblocks,minrelease,blocksleft,dust = 0, top,bottom=0,minimum=10000; int64_t change,totalallocations,actualtxfee,amountReleased=0; std::vector<uint256> txidoprets; bool fHasOpret = false,fIsMerge = false; CPubKey txidpk,Paymentspk;
     std::vector<std::vector<uint8_t>> excludeScriptPubKeys; bool fFixedAmount = false; CScript ccopret;
     mpz_t mpzTotalAllocations,mpzAllocation,mpzCheckamount;
-    mpz_init(mpzCheckamount); mpz_init(mpzTotalAllocations);
+    mpz_init(mpzCheckamount); mpz_init(mpzTotalAllocations); mpz_init(mpzAllocation);
     // Check change is in vout[0], and also fetch the ccopret to determine what type of tx this is. txidaddr is unknown, recheck this later.
     if ( (change= IsPaymentsvout(cp,tx,0,txidaddr,ccopret)) != 0 && ccopret.size() > 2 )
     {
@@ -408,14 +614,16 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
                     // snapshot payment
                     if ( KOMODO_SNAPSHOT_INTERVAL == 0 )
                         return(eval->Invalid("snapshots not activated on this chain"));
-                    if ( vAddressSnapshot.size() == 0 )
+                    if ( funcid == 'O' && !payments_tokensactive(eval->GetCurrentHeight()+1) )
+                        return(eval->Invalid("tokens not yet implemented"));
+                    if ( funcid == 'S' && vAddressSnapshot.size() == 0 )
                         return(eval->Invalid("need first snapshot"));
                     if ( top > 3999 )
                         return(eval->Invalid("transaction too big"));
                     if ( fixedAmount == 7 ) 
                     {
-                        // game setting, randomise bottom and top values 
-                        fFixedAmount = payments_game(top,bottom);
+                        // game setting, randomise bottom and top values, of a token plan from its own snapshot below
+                        fFixedAmount = funcid == 'S' ? payments_game(top,bottom) : true;
                     }
                     else if ( fixedAmount != 0 )
                     {
@@ -425,9 +633,9 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
                         payments_getallocations(top, bottom, excludeScriptPubKeys, mpzTotalAllocations, scriptPubKeys, allocations);
                     else 
                     {
-                        // token snapshot
-                        // payments_gettokenallocations(top, bottom, excludeScriptPubKeys, tokenid, mpzTotalAllocations, scriptPubKeys, allocations);
-                        return(eval->Invalid("tokens not yet implemented"));
+                        // token snapshot, at the height the release is in
+                        if ( payments_gettokenallocations(eval->GetCurrentHeight()+1, tokenid, top, bottom, fixedAmount == 7, excludeScriptPubKeys, mpzTotalAllocations, scriptPubKeys, allocations) < 0 )
+                            return(eval->Invalid("cannot take token snapshot"));
                     }
                 }
                 // sanity check to make sure we got all the required info, skip for merge type tx
@@ -456,12 +664,10 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
                     }
                     else 
                     {
-                        mpz_init(mpzAllocation); 
                         mpz_set_lli(mpzAllocation,allocations[n]);
                         mpz_mul(mpzAllocation,mpzAllocation,mpzCheckamount);
                         mpz_tdiv_q(mpzAllocation,mpzAllocation,mpzTotalAllocations);
                         test = mpz_get_si2(mpzAllocation);
-                        mpz_clear(mpzAllocation);
                     }
                     //fprintf(stderr, "vout.%i test.%lli vs nVlaue.%lli\n",i, (long long)test, (long long)tx.vout[i].nValue);
                     if ( test != tx.vout[i].nValue ) 
@@ -481,7 +687,6 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
                 if ( allocations.size() > n )
                 {
                     // need to check that the next allocation was less than minimum, otherwise ppl can truncate the tx at any place not paying all elegible addresses. 
-                    mpz_init(mpzAllocation); 
                     mpz_set_lli(mpzAllocation,allocations[n+1]);
                     mpz_mul(mpzAllocation,mpzAllocation,mpzCheckamount);
                     mpz_tdiv_q(mpzAllocation,mpzAllocation,mpzTotalAllocations);
@@ -490,7 +695,7 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
                     if ( test > minimum )
                         return(eval->Invalid("next allocation was not under minimum"));
                 }
-                mpz_clear(mpzTotalAllocations); mpz_clear(mpzCheckamount);
+                mpz_clear(mpzTotalAllocations); mpz_clear(mpzCheckamount); mpz_clear(mpzAllocation);
             }
             // Check vins
             i = 0; 
@@ -809,7 +1014,15 @@ UniValue PaymentsRelease(struct CCcontract_info *cp,char *jsonstr)
                 else if ( funcid == 'S' || funcid == 'O' )
                 {
                     // normal snapshot
-                    if ( vAddressSnapshot.size() == 0 )
+                    if ( funcid == 'O' && !payments_tokensactive(chainActive.Height()+1) )
+                    {
+                        result.push_back(Pair("result","error"));
+                        result.push_back(Pair("error","token airdrops are not active yet"));
+                        if ( params != 0 )
+                            free_json(params);
+                        return(result);
+                    }
+                    if ( funcid == 'S' && vAddressSnapshot.size() == 0 )
                     {
                         result.push_back(Pair("result","error"));
                         result.push_back(Pair("error","first snapshot has not happened yet"));
@@ -827,8 +1040,8 @@ UniValue PaymentsRelease(struct CCcontract_info *cp,char *jsonstr)
                     }
                     if ( fixedAmount == 7 ) 
                     {
-                        // game setting, randomise bottom and top values 
-                        fFixedAmount = payments_game(top,bottom);
+                        // game setting, randomise bottom and top values, of a token plan from its own snapshot below
+                        fFixedAmount = funcid == 'S' ? payments_game(top,bottom) : true;
                     }
                     else if ( fixedAmount != 0 )
                     {
@@ -849,8 +1062,15 @@ UniValue PaymentsRelease(struct CCcontract_info *cp,char *jsonstr)
                         m = payments_getallocations(top, bottom, excludeScriptPubKeys, mpzTotalAllocations, scriptPubKeys, allocations);
                     else 
                     {
-                        // token snapshot
-                        // payments_gettokenallocations(top, bottom, excludeScriptPubKeys, tokenid, mpzTotalAllocations, scriptPubKeys, allocations);
+                        // token snapshot, at the height the release goes in
+                        if ( (m= payments_gettokenallocations(chainActive.Height()+1, tokenid, top, bottom, fixedAmount == 7, excludeScriptPubKeys, mpzTotalAllocations, scriptPubKeys, allocations)) < 0 || (top-bottom) < 0 )
+                        {
+                            result.push_back(Pair("result","error"));
+                            result.push_back(Pair("error",m < 0 ? "cannot take the token snapshot" : "invalid range top/bottom"));
+                            if ( params != 0 )
+                                free_json(params);
+                            return(result);
+                        }
                     }
                     if ( (allocations.size() == 0 || scriptPubKeys.size() == 0 || allocations.size() != scriptPubKeys.size()) )
                     {
@@ -1313,8 +1533,7 @@ UniValue PaymentsAirdropTokens(struct CCcontract_info *cp,char *jsonstr)
     uint256 hashBlock, tokenid = zeroid; CTransaction tx; CPubKey Paymentspk,mypk; char markeraddr[64]; std::string rawtx; 
     int32_t lockedblocks,minrelease,top,bottom,n,i,minimum=10000; std::vector<std::vector<uint8_t>> excludeScriptPubKeys; int8_t fixedAmount;
     cJSON *params = payments_reparse(&n,jsonstr);
-    // disable for now. Need token snapshot function. 
-    if ( 0 ) //params != 0 && n >= 6 )
+    if ( params != 0 && n >= 6 )
     {
         tokenid = payments_juint256(jitem(params,0));
         lockedblocks = juint(jitem(params,1),0);
@@ -1332,12 +1551,20 @@ UniValue PaymentsAirdropTokens(struct CCcontract_info *cp,char *jsonstr)
                 free_json(params);
             return(result);
         }
-        // TODO: lookup tokenid and make sure it exists. 
+        std::vector<uint8_t> origpubkey; std::string name, description;
+        if ( myGetTransaction(tokenid,tx,hashBlock) == 0 || tx.vout.size() < 2 || DecodeTokenCreateOpRet(tx.vout.back().scriptPubKey,origpubkey,name,description) != 'c' )
+        {
+            result.push_back(Pair("result","error"));
+            result.push_back(Pair("error","tokenid is not a token"));
+            if ( params != 0 )
+                free_json(params);
+            return(result);
+        }
         if ( n > 7 )
         {
             for (i=0; i<n-7; i++)
             {
-                // Change to pubkeys! tokens are owned by a pubkey not an address.
+                // tokens are owned by a pubkey, its holders are paid to the address of it.
                 std::string address; 
                 address.append(jstri(params,7+i));
                 CTxDestination destination = DecodeDestination(address);
@@ -1381,8 +1608,7 @@ UniValue PaymentsAirdropTokens(struct CCcontract_info *cp,char *jsonstr)
     else
     {
         result.push_back(Pair("result","error"));
-        //result.push_back(Pair("error","parameters error"));
-        result.push_back(Pair("error","tokens airdrop not yet impmlemented"));
+        result.push_back(Pair("error","parameters error"));
     }
     if ( params != 0 )
         free_json(params);
@@ -71,14 +71,14 @@ GetKomodoEarlytxidScriptPub is on line #2080 of komodo_bitcoind.h
 
 #include "CCassets.h"
 #include "CCPrices.h"
+#include "../batonsdb.h"
+#include "../pricesdb.h"
 
 #include <cstdlib>
 #include <gmp.h>
 
 #define IS_CHARINSTR(c, str) (std::string(str).find((char)(c)) != std::string::npos)
 
-#define NVOUT_CCMARKER 1
-#define NVOUT_NORMALMARKER 3
 
 typedef struct OneBetData {
     int64_t positionsize;
@@ -90,12 +90,13 @@ typedef struct OneBetData {
 } onebetdata;
 
 typedef struct BetInfo {
-    uint256 txid;
+    uint256 txid, batontxid;
     int64_t averageCostbasis, firstprice, lastprice, liquidationprice, equity;
     int64_t exitfee;
     int32_t lastheight;
     int16_t leverage;
     bool isOpen, isRekt;
+    bool isScanRekt;    // the scan of the profits stopped at a rekt height, not at a height without a price
     uint256 tokenid;
 
     std::vector<uint16_t> vecparsed;
@@ -109,7 +110,7 @@ typedef struct BetInfo {
         lastheight = 0;
         leverage = 0;
         exitfee = 0;
-        isOpen = isRekt = isUp = false;
+        isOpen = isRekt = isScanRekt = isUp = false;
     }
 } BetInfo;
 
@@ -965,12 +966,32 @@ int32_t prices_syntheticvec(std::vector<uint16_t> &vec, std::vector<std::string>
     return(0);
 }
 
+// synthetic prices evaluated so far by height and expression, the prices of a height are dropped when its block is connected again
+static CCriticalSection cs_syntheticprices;
+static std::map<std::pair<int32_t, std::vector<uint16_t> >, int64_t> syntheticPrices;
+static const size_t PRICES_SYNTHETICCACHESIZE = 100000;
+
+void prices_invalidatecache(int32_t height)
+{
+    LOCK(cs_syntheticprices);
+    syntheticPrices.erase(syntheticPrices.lower_bound(std::make_pair(height, std::vector<uint16_t>())), syntheticPrices.end());
+}
+
 // calculates price for synthetic expression
 int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
 {
     int32_t i, value, errcode, depth, retval = -1;
     uint16_t opcode;
-    int64_t *pricedata, pricestack[4], a, b, c;
+    int64_t pricedata[PRICES_MAXDATAPOINTS], pricestack[4], a, b, c;
+
+    // minmax and leverage do not change the price
+    std::pair<int32_t, std::vector<uint16_t> > cachekey(height, vec);
+    {
+        LOCK(cs_syntheticprices);
+        std::map<std::pair<int32_t, std::vector<uint16_t> >, int64_t>::const_iterator it = syntheticPrices.find(cachekey);
+        if (it != syntheticPrices.end())
+            return it->second;
+    }
 
     mpz_t mpzTotalPrice, mpzPriceValue, mpzDen, mpzA, mpzB, mpzC, mpzResult;
 
@@ -983,7 +1004,6 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     mpz_init(mpzC);
     mpz_init(mpzResult);
 
-    pricedata = (int64_t *)calloc(sizeof(*pricedata) * 3, 1 + PRICES_DAYWINDOW * 2 + PRICES_SMOOTHWIDTH);
     depth = errcode = 0;
     mpz_set_si(mpzTotalPrice, 0);
     mpz_set_si(mpzDen, 0);
@@ -1183,7 +1203,6 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
  //           std::cerr << "prices_syntheticprice pricestack empty" << std::endl;
 
     }
-    free(pricedata);
     mpz_clear(mpzResult);
     mpz_clear(mpzA);
     mpz_clear(mpzB);
@@ -1229,6 +1248,12 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     }
 //    std::cerr << "prices_syntheticprice priceIndex=totalprice/den=" << priceIndex << " den=" << den << std::endl;
 
+    {
+        LOCK(cs_syntheticprices);
+        if (syntheticPrices.size() >= PRICES_SYNTHETICCACHESIZE)
+            syntheticPrices.erase(syntheticPrices.begin());
+        syntheticPrices[cachekey] = priceIndex;
+    }
     return priceIndex;
 }
 
@@ -1404,6 +1429,21 @@ int64_t prices_costbasis(CTransaction bettx, uint256 &txidCostbasis)
     return 0;
 }
 
+// a bet passes the baton in vout0 on to its added fundings
+bool PricesIsBatonRoot(const CTransaction &tx)
+{
+    CPubKey pk; int32_t height; int64_t amount, firstprice; int16_t leverage; std::vector<uint16_t> vec; uint256 tokenid;
+    return tx.vout.size() > 1 && prices_betopretdecode(tx.vout.back().scriptPubKey, pk, height, amount, leverage, firstprice, vec, tokenid) == 'B';
+}
+
+// an added funding of the bet whose baton it spends, PricesValidate only checks the bettxid of its opret on the first one
+bool prices_isaddedbet(const CTransaction &tx, int64_t &amount)
+{
+    uint256 bettxid;
+    CPubKey pk;
+    return tx.vout.size() > 0 && prices_addopretdecode(tx.vout.back().scriptPubKey, bettxid, pk, amount) == 'A';
+}
+
 // enumerates and retrieves added bets, returns the last baton txid
 int64_t prices_enumaddedbets(uint256 &batontxid, std::vector<OneBetData> &bets, uint256 bettxid)
 {
@@ -1415,22 +1455,17 @@ int64_t prices_enumaddedbets(uint256 &batontxid, std::vector<OneBetData> &bets,
     batontxid = bettxid; // initially set to the source bet tx
     uint256 sourcetxid = bettxid;
 
-    // iterate through batons, adding up vout1 -> addedbets
-    while ((retcode = CCgetspenttxid(batontxid, vini, height, sourcetxid, 0)) == 0) {
-
+    auto addBet = [&](uint256 txid) -> bool
+    {
         CTransaction txBaton;
         CBlockIndex blockIdx;
-        uint256 bettxidInOpret;
-        CPubKey pk;
-        bool isLoaded = false;
-        uint8_t funcId = 0;
+        bool isLoaded = false, isAdded = false;
         int64_t amount;
         EvalRef eval;
 
-        if ((isLoaded = eval->GetTxConfirmed(batontxid, txBaton, blockIdx)) &&
+        if ((isLoaded = eval->GetTxConfirmed(txid, txBaton, blockIdx)) &&
             blockIdx.IsValid() &&
-            txBaton.vout.size() > 0 &&
-            (funcId = prices_addopretdecode(txBaton.vout.back().scriptPubKey, bettxidInOpret, pk, amount)) != 0) 
+            (isAdded = prices_isaddedbet(txBaton, amount)))
         {    
             OneBetData added;
 
@@ -1439,11 +1474,27 @@ int64_t prices_enumaddedbets(uint256 &batontxid, std::vector<OneBetData> &bets,
             added.firstheight = blockIdx.GetHeight();  //TODO: check if this is correct (to get height from the block not from the opret)
             bets.push_back(added);
             //std::cerr << "prices_batontxid() added amount=" << amount << std::endl;
+            return true;
         }
-        else {
-            std::cerr << "prices_batontxid() cannot load or decode add bet tx, isLoaded=" << isLoaded << " funcId=" << (int)funcId << std::endl;
-            return -1;
+        std::cerr << "prices_batontxid() cannot load or decode add bet tx, isLoaded=" << isLoaded << " isAdded=" << isAdded << std::endl;
+        return false;
+    };
+
+    // the baton index has the chain of the bet, else walk it through the spent index
+    std::vector<uint256> vChain;
+    if (GetBatonChain(EVAL_PRICES, bettxid, vChain)) {
+        for (size_t i = 1; i < vChain.size(); i++) {
+            batontxid = vChain[i];
+            if (!addBet(batontxid))
+                return -1;
         }
+        return(addedBetsTotal);
+    }
+
+    // iterate through batons, adding up vout1 -> addedbets
+    while ((retcode = CCgetspenttxid(batontxid, vini, height, sourcetxid, 0)) == 0) {
+        if (!addBet(batontxid))
+            return -1;
         sourcetxid = batontxid;
     }
 
@@ -1599,43 +1650,50 @@ UniValue PricesAddFunding(int64_t txfee, uint256 bettxid, int64_t amount)
     return(result);
 }
 
+// calculates costbasises and profits of the bet's positions at the height, -1 if there is no price for it, 1 if the bet is rekt at it
+static int32_t prices_scanheight(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int32_t height, int64_t &lastprice)
+{
+    int64_t totalposition = 0;
+    int64_t totalprofits = 0;
+
+    for (int i = 0; i < bets.size(); i++) {
+
+        if (height > bets[i].firstheight) {
+
+            int32_t retcode = prices_syntheticprofits(bets[i].costbasis, bets[i].firstheight, height, leverage, vec, bets[i].positionsize, bets[i].profits, lastprice);
+            if (retcode < 0) {
+                std::cerr << "prices_scanchain() prices_syntheticprofits returned -1, finishing..." << std::endl;
+                return -1;
+            }
+            totalposition += bets[i].positionsize;
+            totalprofits += bets[i].profits;
+        }
+    }
+
+    int64_t equity = totalposition + totalprofits;
+    if (equity <= (int64_t)((double)totalposition * prices_minmarginpercent(leverage)))
+    {   // we are in loss
+        return 1;
+    }
+    return 0;
+}
+
 // scan chain from the initial bet's first position upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected 
+// returns 1 if it stopped at a rekt height, 0 if at the end of the prices
 int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight) {
 
     if (bets.size() == 0)
         return -1;
 
-    bool stop = false;
     for (int32_t height = bets[0].firstheight+1; ; height++)   // the last datum for 24h is the costbasis value
     {
-        int64_t totalposition = 0;
-        int64_t totalprofits = 0;
-
-        // scan upto the chain tip
-        for (int i = 0; i < bets.size(); i++) {
-
-            if (height > bets[i].firstheight) {
-
-                int32_t retcode = prices_syntheticprofits(bets[i].costbasis, bets[i].firstheight, height, leverage, vec, bets[i].positionsize, bets[i].profits, lastprice);
-                if (retcode < 0) {
-                    std::cerr << "prices_scanchain() prices_syntheticprofits returned -1, finishing..." << std::endl;
-                    stop = true;
-                    break;
-                }
-                totalposition += bets[i].positionsize;
-                totalprofits += bets[i].profits;
-            }
-        }
-
-        if (stop)
+        int32_t retcode = prices_scanheight(bets, leverage, vec, height, lastprice);
+        if (retcode < 0)
             break;
 
         endheight = height;
-        int64_t equity = totalposition + totalprofits;
-        if (equity <= (int64_t)((double)totalposition * prices_minmarginpercent(leverage)))
-        {   // we are in loss
-            break;
-        }
+        if (retcode > 0)
+            return 1;
     }
 
     return 0;
@@ -1741,7 +1799,86 @@ UniValue PricesRefillFund(int64_t amount)
 }
 
 
-int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
+// works out the totals of a bet from its positions
+static void prices_bettotals(BetInfo &betinfo)
+{
+    mpz_t mpzTotalPosition;
+    mpz_t mpzTotalprofits;
+    mpz_t mpzTotalcostbasis;
+
+    mpz_init(mpzTotalPosition);
+    mpz_init(mpzTotalprofits);
+    mpz_init(mpzTotalcostbasis);
+
+    int64_t totalposition = 0;
+    int64_t totalprofits = 0;
+
+    for (auto b : betinfo.bets) {
+        mpz_t mpzProduct;
+        mpz_t mpzProfits;
+
+        mpz_init(mpzProduct);
+        mpz_init(mpzProfits);
+
+        //totalprofits += b.profits;
+        //dcostbasis += b.amount * (double)b.costbasis;  
+        // costbasis += b.amount * (b.costbasis / PRICES_POINTFACTOR);  // prevent int64 overflow (but we have underflow for 1/BTC)
+        // std::cerr << "PricesInfo() acc dcostbasis=" << dcostbasis << " b.amount=" << b.amount << " b.costbasis/PRICES_POINTFACTOR=" << (b.costbasis / PRICES_POINTFACTOR) << std::endl;
+        //std::cerr << "PricesInfo() acc dcostbasis=" << dcostbasis << " b.amount=" << b.amount << " b.costbasis/PRICES_POINTFACTOR=" << (b.costbasis / PRICES_POINTFACTOR) << std::endl;
+        mpz_set_ui(mpzProduct, b.costbasis);
+        mpz_mul_ui(mpzProduct, mpzProduct, (uint64_t)b.positionsize);         // b.costbasis * b.amount
+        mpz_add(mpzTotalcostbasis, mpzTotalcostbasis, mpzProduct);      //averageCostbasis += b.costbasis * b.amount;
+
+        mpz_add_ui(mpzTotalPosition, mpzTotalPosition, (uint64_t)b.positionsize);     //totalposition += b.amount;
+        mpz_add(mpzTotalprofits, mpzTotalprofits, mpzProfits);          //totalprofits += b.profits;
+
+        totalposition += b.positionsize;
+        totalprofits += b.profits;
+
+        mpz_clear(mpzProduct);
+        mpz_clear(mpzProfits);
+    }
+
+    betinfo.equity = totalposition + totalprofits;
+    //int64_t averageCostbasis = 0;
+
+    if (mpz_get_ui(mpzTotalPosition) != 0) { //prevent zero div
+        mpz_t mpzAverageCostbasis;
+        mpz_init(mpzAverageCostbasis);
+
+        //averageCostbasis =  totalcostbasis / totalposition; 
+        mpz_mul_ui(mpzTotalcostbasis, mpzTotalcostbasis, SATOSHIDEN);                 // profits *= SATOSHIDEN normalization to prevent loss of significance while division
+        mpz_tdiv_q(mpzAverageCostbasis, mpzTotalcostbasis, mpzTotalPosition);
+
+        mpz_tdiv_q_ui(mpzAverageCostbasis, mpzAverageCostbasis, SATOSHIDEN);          // profits /= SATOSHIDEN de-normalization
+
+        betinfo.averageCostbasis = mpz_get_ui(mpzAverageCostbasis);
+        mpz_clear(mpzAverageCostbasis);
+    }
+
+    betinfo.liquidationprice = 0;
+    if (betinfo.leverage != 0) {// prevent zero div
+        betinfo.liquidationprice = betinfo.averageCostbasis - (betinfo.averageCostbasis * (1 - prices_minmarginpercent(betinfo.leverage))) / betinfo.leverage;
+    }
+
+    if (!betinfo.isRekt)    {  // not set by check for final tx 
+
+        if (betinfo.equity > (int64_t)((double)totalposition * prices_minmarginpercent(betinfo.leverage)))
+            betinfo.isRekt = false;
+        else
+        {
+            betinfo.isRekt = true;
+            betinfo.exitfee = (int64_t)(((double)totalposition * prices_minmarginpercent(betinfo.leverage)) / 10);    // was: totalposition / 500
+        }
+    }
+
+    mpz_clear(mpzTotalPosition);
+    mpz_clear(mpzTotalprofits);
+    mpz_clear(mpzTotalcostbasis);
+}
+
+// works a bet out from its txs, with the spends in the mempool if fMempool
+static int32_t prices_scanbetinfo(uint256 bettxid, BetInfo &betinfo, bool fMempool)
 {
     CTransaction bettx;
     uint256 hashBlock, batontxid, tokenid;
@@ -1766,7 +1903,9 @@ int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
                                    //std::vector<OneBetData> bets;
             betinfo.txid = bettxid;
 
-            if (CCgetspenttxid(finaltxid, vini, finaltxheight, bettxid, NVOUT_CCMARKER) == 0)
+            CSpentIndexKey spentkey(bettxid, NVOUT_CCMARKER);
+            CSpentIndexValue spentvalue;
+            if (CCgetspenttxid(finaltxid, vini, finaltxheight, bettxid, NVOUT_CCMARKER) == 0 && (fMempool || !mempool.getSpentIndex(spentkey, spentvalue)))
                 betinfo.isOpen = false;
             else
                 betinfo.isOpen = true;
@@ -1777,6 +1916,7 @@ int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
             betinfo.bets.push_back(bet1);
 
             prices_enumaddedbets(batontxid, betinfo.bets, bettxid);
+            betinfo.batontxid = batontxid;
 
             if (!betinfo.isOpen) {
                 CTransaction finaltx;
@@ -1796,88 +1936,175 @@ int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
             }
 
 
-            if (prices_scanchain(betinfo.bets, betinfo.leverage, betinfo.vecparsed, betinfo.lastprice, betinfo.lastheight) < 0) {
+            int32_t scanned = prices_scanchain(betinfo.bets, betinfo.leverage, betinfo.vecparsed, betinfo.lastprice, betinfo.lastheight);
+            if (scanned < 0) {
                 return -4;
             }
+            betinfo.isScanRekt = (scanned > 0);
 
-            mpz_t mpzTotalPosition;
-            mpz_t mpzTotalprofits;
-            mpz_t mpzTotalcostbasis;
-
-            mpz_init(mpzTotalPosition);
-            mpz_init(mpzTotalprofits);
-            mpz_init(mpzTotalcostbasis);
-
-            int64_t totalposition = 0;
-            int64_t totalprofits = 0;
-
-            for (auto b : betinfo.bets) {
-                mpz_t mpzProduct;
-                mpz_t mpzProfits;
-
-                mpz_init(mpzProduct);
-                mpz_init(mpzProfits);
-
-                //totalprofits += b.profits;
-                //dcostbasis += b.amount * (double)b.costbasis;  
-                // costbasis += b.amount * (b.costbasis / PRICES_POINTFACTOR);  // prevent int64 overflow (but we have underflow for 1/BTC)
-                // std::cerr << "PricesInfo() acc dcostbasis=" << dcostbasis << " b.amount=" << b.amount << " b.costbasis/PRICES_POINTFACTOR=" << (b.costbasis / PRICES_POINTFACTOR) << std::endl;
-                //std::cerr << "PricesInfo() acc dcostbasis=" << dcostbasis << " b.amount=" << b.amount << " b.costbasis/PRICES_POINTFACTOR=" << (b.costbasis / PRICES_POINTFACTOR) << std::endl;
-                mpz_set_ui(mpzProduct, b.costbasis);
-                mpz_mul_ui(mpzProduct, mpzProduct, (uint64_t)b.positionsize);         // b.costbasis * b.amount
-                mpz_add(mpzTotalcostbasis, mpzTotalcostbasis, mpzProduct);      //averageCostbasis += b.costbasis * b.amount;
+            prices_bettotals(betinfo);
+            return 0;
+        }
+        return -3;
+    }
+    return (-1);
+}
 
-                mpz_add_ui(mpzTotalPosition, mpzTotalPosition, (uint64_t)b.positionsize);     //totalposition += b.amount;
-                mpz_add(mpzTotalprofits, mpzTotalprofits, mpzProfits);          //totalprofits += b.profits;
+static void prices_betinfofromstate(uint256 bettxid, const CPricesBetState &state, BetInfo &betinfo)
+{
+    betinfo.txid = bettxid;
+    betinfo.batontxid = state.batontxid;
+    betinfo.pk = state.pk;
+    betinfo.leverage = state.leverage;
+    betinfo.firstprice = state.firstprice;
+    betinfo.vecparsed = state.vecparsed;
+    betinfo.tokenid = state.tokenid;
+    betinfo.bets.clear();
+    for (auto p : state.positions) {
+        OneBetData bet;
+        bet.positionsize = p.positionsize;
+        bet.firstheight = p.firstheight;
+        bet.costbasis = p.costbasis;
+        bet.profits = p.profits;
+        betinfo.bets.push_back(bet);
+    }
+    betinfo.isOpen = true;
+    betinfo.lastheight = state.nLastHeight;
+    betinfo.lastprice = state.lastprice;
+    betinfo.equity = state.equity;
+    betinfo.averageCostbasis = state.averageCostbasis;
+    betinfo.liquidationprice = state.liquidationprice;
+    betinfo.exitfee = state.exitfee;
+    betinfo.isRekt = state.fRekt;
+}
 
-                totalposition += b.positionsize;
-                totalprofits += b.profits;
+static void prices_statefrombetinfo(const BetInfo &betinfo, CPricesBetState &state)
+{
+    state.pk = betinfo.pk;
+    state.leverage = betinfo.leverage;
+    state.firstprice = betinfo.firstprice;
+    state.vecparsed = betinfo.vecparsed;
+    state.tokenid = betinfo.tokenid;
+    state.batontxid = betinfo.batontxid;
+    state.positions.clear();
+    state.totalposition = 0;
+    for (auto b : betinfo.bets) {
+        CPricesBetPosition p;
+        p.positionsize = b.positionsize;
+        p.firstheight = b.firstheight;
+        p.costbasis = b.costbasis;
+        p.profits = b.profits;
+        state.positions.push_back(p);
+        state.totalposition += b.positionsize;
+    }
+    state.nLastHeight = betinfo.lastheight;
+    state.lastprice = betinfo.lastprice;
+    state.equity = betinfo.equity;
+    state.averageCostbasis = betinfo.averageCostbasis;
+    state.liquidationprice = betinfo.liquidationprice;
+    state.exitfee = betinfo.exitfee;
+    state.fRekt = betinfo.isRekt;
+}
 
-                mpz_clear(mpzProduct);
-                mpz_clear(mpzProfits);
-            }
+// bet info from the bets index while the bet is open, else worked out from its txs
+int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
+{
+    CPricesBetState state;
+    uint256 finaltxid;
+    int32_t vini, finaltxheight;
 
-            betinfo.equity = totalposition + totalprofits;
-            //int64_t averageCostbasis = 0;
+    if (GetPricesBetState(bettxid, state) && CCgetspenttxid(finaltxid, vini, finaltxheight, bettxid, NVOUT_CCMARKER) != 0) {
+        prices_betinfofromstate(bettxid, state, betinfo);
+        return 0;
+    }
+    return prices_scanbetinfo(bettxid, betinfo, true);
+}
 
-            if (mpz_get_ui(mpzTotalPosition) != 0) { //prevent zero div
-                mpz_t mpzAverageCostbasis;
-                mpz_init(mpzAverageCostbasis);
+// state of a bet tx just confirmed, its profits not scanned yet. Only bets with the normal marker prices_listbettxids finds them by
+bool prices_betstatefromtx(const CTransaction &bettx, CPricesBetState &state)
+{
+    CPricesBetPosition bet1;
+    struct CCcontract_info *cp, C;
+    char markeraddr[64];
 
-                //averageCostbasis =  totalcostbasis / totalposition; 
-                mpz_mul_ui(mpzTotalcostbasis, mpzTotalcostbasis, SATOSHIDEN);                 // profits *= SATOSHIDEN normalization to prevent loss of significance while division
-                mpz_tdiv_q(mpzAverageCostbasis, mpzTotalcostbasis, mpzTotalPosition);
+    if (bettx.vout.size() <= NVOUT_NORMALMARKER || prices_betopretdecode(bettx.vout.back().scriptPubKey, state.pk, bet1.firstheight, bet1.positionsize, state.leverage, state.firstprice, state.vecparsed, state.tokenid) != 'B')
+        return false;
+    cp = CCinit(&C, EVAL_PRICES);
+    if (!Getscriptaddress(markeraddr, bettx.vout[NVOUT_NORMALMARKER].scriptPubKey) || strcmp(markeraddr, cp->normaladdr) != 0)
+        return false;
+    state.batontxid = bettx.GetHash();
+    state.positions.assign(1, bet1);
+    state.totalposition = bet1.positionsize;
+    return true;
+}
 
-                mpz_tdiv_q_ui(mpzAverageCostbasis, mpzAverageCostbasis, SATOSHIDEN);          // profits /= SATOSHIDEN de-normalization
+// scans the profits of an open bet on up to height a height at a time, as prices_scanchain does from its first height
+void prices_betstatescan(CPricesBetState &state, int32_t height)
+{
+    if (state.positions.empty())
+        return;
 
-                betinfo.averageCostbasis = mpz_get_ui(mpzAverageCostbasis);
-                mpz_clear(mpzAverageCostbasis);
-            }
+    BetInfo betinfo;
+    prices_betinfofromstate(zeroid, state, betinfo);
+    for (int32_t h = std::max(state.nLastHeight, betinfo.bets[0].firstheight) + 1; !state.fScanStopped && h <= height; h++)
+    {
+        int32_t retcode = prices_scanheight(betinfo.bets, betinfo.leverage, betinfo.vecparsed, h, betinfo.lastprice);
+        if (retcode < 0)
+            break;  // tried again with the next block, prices_scanchain stops there too
+        betinfo.lastheight = h;
+        state.fScanStopped = (retcode > 0);
+    }
+    // the totals also count positions added since the last scan
+    betinfo.isRekt = false;
+    betinfo.exitfee = 0;
+    prices_bettotals(betinfo);
+    prices_statefrombetinfo(betinfo, state);
+}
 
-            betinfo.liquidationprice = 0;
-            if (betinfo.leverage != 0) {// prevent zero div
-                betinfo.liquidationprice = betinfo.averageCostbasis - (betinfo.averageCostbasis * (1 - prices_minmarginpercent(betinfo.leverage))) / betinfo.leverage;
-            }
+// profits of the positions of a bet scanned again from its first height by prices_scanchain, as without the bets index
+bool prices_betstatescanchain(CPricesBetState &state)
+{
+    BetInfo betinfo;
+    prices_betinfofromstate(zeroid, state, betinfo);
+    for (auto &b : betinfo.bets)
+        b.costbasis = b.profits = 0;
+    betinfo.lastheight = 0;
+    betinfo.lastprice = 0;
+    int32_t scanned = prices_scanchain(betinfo.bets, betinfo.leverage, betinfo.vecparsed, betinfo.lastprice, betinfo.lastheight);
+    if (scanned < 0)
+        return false;
+    betinfo.isRekt = false;
+    betinfo.exitfee = 0;
+    prices_bettotals(betinfo);
+    prices_statefrombetinfo(betinfo, state);
+    state.fScanStopped = (scanned > 0);
+    return true;
+}
 
-            if (!betinfo.isRekt)    {  // not set by check for final tx 
+// state of an open bet at the tip worked out from its txs, false if it is closed or cannot be read
+bool prices_betstatefromchain(uint256 bettxid, CPricesBetState &state)
+{
+    BetInfo betinfo;
+    if (prices_scanbetinfo(bettxid, betinfo, false) < 0 || !betinfo.isOpen)
+        return false;
+    prices_statefrombetinfo(betinfo, state);
+    state.fScanStopped = betinfo.isScanRekt;
+    return true;
+}
 
-                if (betinfo.equity > (int64_t)((double)totalposition * prices_minmarginpercent(betinfo.leverage)))
-                    betinfo.isRekt = false;
-                else
-                {
-                    betinfo.isRekt = true;
-                    betinfo.exitfee = (int64_t)(((double)totalposition * prices_minmarginpercent(betinfo.leverage)) / 10);    // was: totalposition / 500
-                }
-            }
+// txids of the bets, by their normal marker
+void prices_listbettxids(std::vector<uint256> &bettxids)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    struct CCcontract_info *cp, C;
 
-            mpz_clear(mpzTotalPosition);
-            mpz_clear(mpzTotalprofits);
-            mpz_clear(mpzTotalcostbasis);
-            return 0;
-        }
-        return -3;
+    cp = CCinit(&C, EVAL_PRICES);
+    SetCCtxids(addressIndex, cp->normaladdr, false);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++)
+    {
+        if (it->first.index == NVOUT_NORMALMARKER)
+            bettxids.push_back(it->first.txhash);
     }
-    return (-1);
 }
 
 // pricesrekt rpc: anyone can rekt a bet at some block where losses reached limit, collecting fee
@@ -2201,6 +2428,41 @@ UniValue PricesList(uint32_t filter, CPubKey mypk)
 }
 
 
+// pricesrektlist rpc impl: the open bets the bets index found rekt, without the ones a mempool tx already closes
+UniValue PricesRektList()
+{
+    UniValue result(UniValue::VARR);
+    std::map<uint256, CPricesBetState> mapStates;
+
+    if (!GetPricesBetStates(true, mapStates))
+        throw std::runtime_error("cannot build the prices bets index, it needs -addressindex and -spentindex");
+
+    for (std::map<uint256, CPricesBetState>::const_iterator it = mapStates.begin(); it != mapStates.end(); it++)
+    {
+        const CPricesBetState &state = it->second;
+        CSpentIndexKey spentkey(it->first, NVOUT_CCMARKER);
+        CSpentIndexValue spentvalue;
+        if (mempool.getSpentIndex(spentkey, spentvalue))
+            continue;
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("bettxid", it->first.GetHex()));
+        entry.push_back(Pair("pubkey", HexStr(state.pk)));
+        entry.push_back(Pair("expression", prices_getsourceexpression(state.vecparsed)));
+        entry.push_back(Pair("leverage", (int64_t)state.leverage));
+        entry.push_back(Pair("positionsize", ValueFromAmount(state.totalposition)));
+        entry.push_back(Pair("equity", ValueFromAmount(state.equity)));
+        entry.push_back(Pair("costbasis", ValueFromAmount(state.averageCostbasis)));
+        entry.push_back(Pair("LiquidationPrice", ValueFromAmount(state.liquidationprice)));
+        entry.push_back(Pair("lastprice", ValueFromAmount(state.lastprice)));
+        entry.push_back(Pair("rektheight", state.nLastHeight));
+        entry.push_back(Pair("rektfee", state.exitfee));
+        result.push_back(entry);
+    }
+    return(result);
+}
+
+
 static bool prices_addbookentry(uint256 txid, std::vector<BetInfo> &book)
 {
     BetInfo betinfo;
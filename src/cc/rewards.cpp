@@ -374,60 +374,43 @@ static uint64_t myIs_unlockedtx_inmempool(uint256 &txid,int32_t &vout,uint64_t r
 // 'L' vs 'F' and 'A'
 int64_t AddRewardsInputs(CScript &scriptPubKey,uint64_t maxseconds,struct CCcontract_info *cp,CMutableTransaction &mtx,CPubKey pk,int64_t total,int32_t maxinputs,uint64_t refsbits,uint256 reffundingtxid)
 {
-    char coinaddr[64],str[65]; uint64_t threshold,sbits,nValue,totalinputs = 0; uint256 txid,hashBlock,fundingtxid; CTransaction tx; int32_t numblocks,j,vout,n = 0; uint8_t funcid;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    char coinaddr[64]; uint64_t threshold,nValue,totalinputs = 0; uint256 mempooltxid; int32_t mempoolvout,n = 0;
     GetCCaddress(cp,coinaddr,pk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
     if ( maxinputs > CC_MAXVINS )
         maxinputs = CC_MAXVINS;
     if ( maxinputs > 0 )
         threshold = total/maxinputs;
     else threshold = total;
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-    {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        if ( it->second.satoshis < threshold )
-            continue;
-        //fprintf(stderr,"(%s) %s/v%d %.8f\n",coinaddr,uint256_str(str,txid),vout,(double)it->second.satoshis/COIN);
-        for (j=0; j<mtx.vin.size(); j++)
-            if ( txid == mtx.vin[j].prevout.hash && vout == mtx.vin[j].prevout.n )
-                break;
-        if ( j != mtx.vin.size() )
-            continue;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout.size() > 0 && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
+    // oldest first, locked funds only become spendable after maxseconds
+    totalinputs = CCselectInputs(mtx,coinaddr,total,maxinputs,threshold,CCINPUTS_OLDEST,[&](const CTransaction &tx,int32_t vout,const CAddressUnspentValue &unspent) {
+        uint64_t sbits; uint256 fundingtxid,txid = tx.GetHash(); int32_t numblocks; uint8_t funcid;
+        if ( tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() == 0 )
+            return((int64_t)0);
+        if ( (funcid= DecodeRewardsOpRet(txid,tx.vout[tx.vout.size()-1].scriptPubKey,sbits,fundingtxid)) == 0 )
         {
-            if ( (funcid= DecodeRewardsOpRet(txid,tx.vout[tx.vout.size()-1].scriptPubKey,sbits,fundingtxid)) != 0 )
-            {
-                if ( sbits != refsbits || fundingtxid != reffundingtxid )
-                    continue;
-                if ( maxseconds == 0 && funcid != 'F' && funcid != 'A' && funcid != 'U' )
-                    continue;
-                else if ( maxseconds != 0 && funcid != 'L' )
-                {
-                    if ( CCduration(numblocks,txid) < maxseconds )
-                        continue;
-                }
-                fprintf(stderr,"maxseconds.%d (%c) %.8f %.8f\n",(int32_t)maxseconds,funcid,(double)tx.vout[vout].nValue/COIN,(double)it->second.satoshis/COIN);
-                if ( total != 0 && maxinputs != 0 )
-                {
-                    if ( maxseconds != 0 )
-                        scriptPubKey = tx.vout[1].scriptPubKey;
-                    mtx.vin.push_back(CTxIn(txid,vout,CScript()));
-                }
-                totalinputs += it->second.satoshis;
-                n++;
-                if ( (total > 0 && totalinputs >= total) || (maxinputs > 0 && n >= maxinputs) )
-                    break;
-            } else fprintf(stderr,"null funcid\n");
+            fprintf(stderr,"null funcid\n");
+            return((int64_t)0);
         }
-    }
+        if ( sbits != refsbits || fundingtxid != reffundingtxid )
+            return((int64_t)0);
+        if ( maxseconds == 0 && funcid != 'F' && funcid != 'A' && funcid != 'U' )
+            return((int64_t)0);
+        else if ( maxseconds != 0 && funcid != 'L' )
+        {
+            if ( CCduration(numblocks,txid) < maxseconds )
+                return((int64_t)0);
+        }
+        fprintf(stderr,"maxseconds.%d (%c) %.8f %.8f\n",(int32_t)maxseconds,funcid,(double)tx.vout[vout].nValue/COIN,(double)unspent.satoshis/COIN);
+        if ( total != 0 && maxinputs != 0 && maxseconds != 0 )
+            scriptPubKey = tx.vout[1].scriptPubKey;
+        return(unspent.satoshis);
+    },&n);
     if ( maxseconds == 0 && totalinputs < total && (maxinputs == 0 || n < maxinputs-1) )
     {
         fprintf(stderr,"search mempool for unlocked and unspent CC rewards output for %.8f\n",(double)(total-totalinputs)/COIN);
-        if ( (nValue= myIs_unlockedtx_inmempool(txid,vout,refsbits,reffundingtxid,total-totalinputs)) > 0 )
+        if ( (nValue= myIs_unlockedtx_inmempool(mempooltxid,mempoolvout,refsbits,reffundingtxid,total-totalinputs)) > 0 )
         {
-            mtx.vin.push_back(CTxIn(txid,vout,CScript()));
+            mtx.vin.push_back(CTxIn(mempooltxid,mempoolvout,CScript()));
             fprintf(stderr,"added mempool vout for %.8f\n",(double)nValue/COIN);
             totalinputs += nValue;
             n++;
@@ -19,9 +19,77 @@
  ******************************************************************************/
 
 #include "chain.h"
+#include "main.h"
+#include "sync.h"
+#include "txdb.h"
+
+#include <list>
 
 using namespace std;
 
+/**
+ * Equihash solutions trimmed from CBlockIndex are read back from the block tree db. Peers
+ * mostly ask for headers near the tip, so the most recently read solutions are kept here.
+ */
+static const size_t SOLUTION_CACHE_ENTRIES = 4096;
+static CCriticalSection cs_solutions; // guards the cache and CBlockIndex::nSolution trimming
+static std::list<uint256> solutionCacheLRU; // most recently used first
+typedef boost::unordered_map<uint256, std::pair<std::vector<unsigned char>, std::list<uint256>::iterator>, BlockHasher> SolutionCache;
+static SolutionCache solutionCache;
+
+bool CBlockIndex::GetSolution(std::vector<unsigned char> &vSolution) const
+{
+    {
+        LOCK(cs_solutions);
+        if (!fSolutionTrimmed) {
+            vSolution = nSolution;
+            return true;
+        }
+        SolutionCache::iterator it = solutionCache.find(GetBlockHash());
+        if (it != solutionCache.end()) {
+            solutionCacheLRU.splice(solutionCacheLRU.begin(), solutionCacheLRU, it->second.second);
+            vSolution = it->second.first;
+            return true;
+        }
+    }
+
+    CDiskBlockIndex dbindex;
+    if (!pblocktree->ReadDiskBlockIndex(GetBlockHash(), dbindex) || dbindex.nSolution.empty())
+        return error("%s: failed to read block index entry %s", __func__, GetBlockHash().ToString());
+
+    LOCK(cs_solutions);
+    if (solutionCache.count(GetBlockHash()) == 0) {
+        while (solutionCache.size() >= SOLUTION_CACHE_ENTRIES) {
+            solutionCache.erase(solutionCacheLRU.back());
+            solutionCacheLRU.pop_back();
+        }
+        solutionCacheLRU.push_front(GetBlockHash());
+        solutionCache.insert(std::make_pair(GetBlockHash(), std::make_pair(dbindex.nSolution, solutionCacheLRU.begin())));
+    }
+    vSolution.swap(dbindex.nSolution);
+    return true;
+}
+
+bool CBlockIndex::GetBlockHeader(CBlockHeader &block) const
+{
+    block.nVersion       = nVersion;
+    block.hashPrevBlock  = pprev ? pprev->GetBlockHash() : uint256();
+    block.hashMerkleRoot = hashMerkleRoot;
+    block.hashFinalSaplingRoot   = hashFinalSaplingRoot;
+    block.nTime          = nTime;
+    block.nBits          = nBits;
+    block.nNonce         = nNonce;
+    return GetSolution(block.nSolution);
+}
+
+void CBlockIndex::TrimSolution()
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_solutions);
+    std::vector<unsigned char>().swap(nSolution);
+    fSolutionTrimmed = true;
+}
+
 /**
  * CChain implementation
  */
@@ -305,8 +305,13 @@ public:
     unsigned int nTime;
     unsigned int nBits;
     uint256 nNonce;
+    //! Equihash solution. Trimmed (emptied) once the entry is stored in the block tree db,
+    //! read it with GetSolution(). Only written with both cs_main and the solution lock held.
     std::vector<unsigned char> nSolution;
 
+    //! (memory only) nSolution has been released by TrimSolution()
+    bool fSolutionTrimmed;
+
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
@@ -341,6 +346,7 @@ public:
         nBits          = 0;
         nNonce         = uint256();
         nSolution.clear();
+        fSolutionTrimmed = false;
     }
 
     CBlockIndex()
@@ -389,21 +395,23 @@ public:
         return ret;
     }
 
-    CBlockHeader GetBlockHeader() const
+    //! Fill in the header of the block, false if its trimmed solution cannot be read back
+    bool GetBlockHeader(CBlockHeader &block) const;
+
+    //! Whether the equihash solution is still held in memory
+    bool HasSolution() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        if (pprev)
-            block.hashPrevBlock = pprev->GetBlockHash();
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.hashFinalSaplingRoot   = hashFinalSaplingRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
-        return block;
+        return !fSolutionTrimmed;
     }
 
+    //! Get the equihash solution, from memory, the recent solution cache or the block tree db.
+    //! False if a trimmed solution cannot be read back.
+    bool GetSolution(std::vector<unsigned char> &vSolution) const;
+
+    //! Release the in-memory solution, the entry must already be stored in the block tree db.
+    //! Requires cs_main.
+    void TrimSolution();
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -468,15 +476,22 @@ public:
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
 
+    // both only look at nNonce, so avoid building the full header (and reading the solution)
     int32_t GetVerusPOSTarget() const
     {
-        return GetBlockHeader().GetVerusPOSTarget();
+        CBlockHeader block;
+        block.nNonce = nNonce;
+        return block.GetVerusPOSTarget();
     }
 
     bool IsVerusPOSBlock() const
     {
         if ( ASSETCHAINS_LWMAPOS != 0 )
-            return GetBlockHeader().IsVerusPOSBlock();
+        {
+            CBlockHeader block;
+            block.nNonce = nNonce;
+            return block.IsVerusPOSBlock();
+        }
         else return(0);
     }
 };
@@ -493,6 +508,9 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        // left trimmed, so without a solution, if it cannot be read back
+        if (fSolutionTrimmed && pindex->GetSolution(nSolution))
+            fSolutionTrimmed = false;
     }
 
     ADD_SERIALIZE_METHODS;
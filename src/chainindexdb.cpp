@@ -0,0 +1,127 @@
+#include "chainindexdb.h"
+#include "dbwrapper.h"
+#include "main.h"
+#include "sync.h"
+#include "txdb.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+CChainIndexDB::CChainIndexDB(const std::string &strName, size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(GetDataDir() / strName, CDBOptions(strName, nCacheSize, false, 64).ApplyProfileArgs(), fMemory, fWipe) { }
+
+
+uint256 CChainIndexDB::ReadBestBlock(char chBest) const
+{
+    uint256 hashBest;
+    Read(chBest, hashBest);
+    return hashBest;
+}
+
+
+bool CChainIndexDB::WriteBlock(CDBBatch &batch, const uint256 &hashBlock, char chBest)
+{
+    batch.Write(chBest, hashBlock);
+    return WriteBatch(batch, true);
+}
+
+
+bool CChainIndexDB::Wipe(const std::string &strPrefixes, const uint256 &hashBlock, char chBest)
+{
+    CDBBatch batch(*this);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        if (!pcursor->GetKeyDataStream(ssKey))
+            return error("%s: unable to read index key", __func__);
+        if (ssKey.empty() || strPrefixes.find(ssKey[0]) == std::string::npos)
+            continue;
+        batch.Erase(ssKey);
+        if (batch.SizeEstimate() > INDEX_DB_BATCH_SIZE) {
+            if (!WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    return WriteBlock(batch, hashBlock, chBest);
+}
+
+
+/*
+ * Replay the blocks between the best block of each index and the tip, one at a
+ * time. Blocks are read without cs_main and applied under it if the index did
+ * not move meanwhile; once an index is at the tip ConnectBlock keeps it there.
+ */
+static void ThreadChainIndexCatchUp(const std::vector<CChainIndex> vIndexes)
+{
+    RenameThread("komodo-ccindex");
+    BOOST_FOREACH(const CChainIndex &index, vIndexes)
+    {
+        int64_t nTimeStart = GetTimeMillis();
+        int nBlocks = 0;
+        while (true) {
+            boost::this_thread::interruption_point();
+            uint256 hashBest;
+            CBlockIndex *pindex;
+            bool fConnect = true;
+            int nHeight;
+            CDiskBlockPos blockPos;
+            {
+                LOCK(cs_main);
+                hashBest = index.GetBestBlock();
+                if (chainActive.Tip() == NULL || hashBest == chainActive.Tip()->GetBlockHash())
+                    break;
+                BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+                if (hashBest.IsNull())
+                    pindex = chainActive.Genesis();
+                else if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA) == 0) {
+                    LogPrintf("%s: %s is at unknown block %s, it is built again from the genesis block\n", __func__, index.name, hashBest.ToString());
+                    if (!index.Reset()) {
+                        LogPrintf("%s: unable to wipe %s, it stays behind the tip\n", __func__, index.name);
+                        break;
+                    }
+                    continue;
+                }
+                else if (chainActive.Contains(mi->second))
+                    pindex = chainActive.Next(mi->second);
+                else {
+                    // left on a fork, step back to chainActive first
+                    pindex = mi->second;
+                    fConnect = false;
+                }
+                nHeight = pindex->GetHeight();
+                blockPos = pindex->GetBlockPos();
+            }
+
+            CBlock block;
+            bool fRead = ReadBlockFromDisk(block, blockPos, false);
+
+            LOCK(cs_main);
+            if (!fRead) {
+                LogPrintf("%s: unable to read block %s, %s stays behind the tip\n", __func__, pindex->GetBlockHash().ToString(), index.name);
+                break;
+            }
+            // blocks connected or disconnected since moved the index or the chain
+            if (index.GetBestBlock() != hashBest || (fConnect && !chainActive.Contains(pindex)))
+                continue;
+            if (!(fConnect ? index.Connect(block, nHeight) : index.Disconnect(block, nHeight))) {
+                LogPrintf("%s: unable to write %s, it stays behind the tip\n", __func__, index.name);
+                break;
+            }
+            if (++nBlocks % 10000 == 0)
+                LogPrintf("Building %s: height %d of %d\n", index.name, nHeight, chainActive.Height());
+        }
+        if (nBlocks > 0)
+            LogPrintf("%s: %s caught up over %d blocks in %.2fs\n", __func__, index.name, nBlocks, 0.001 * (GetTimeMillis() - nTimeStart));
+    }
+}
+
+
+void StartChainIndexCatchUp(boost::thread_group &threadGroup, const std::vector<CChainIndex> &vIndexes)
+{
+    threadGroup.create_thread(boost::bind(&ThreadChainIndexCatchUp, vIndexes));
+}
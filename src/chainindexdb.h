@@ -0,0 +1,55 @@
+#ifndef CHAININDEXDB_H
+#define CHAININDEXDB_H
+
+#include "dbwrapper.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+
+static const char DB_CHAIN_INDEX_BEST_BLOCK = 'B';
+
+/**
+ * Db of an index the contracts keep of chainActive. The records of a block
+ * are written in one synced batch together with the hash of the block the
+ * index is then at, so the index is consistent at its best block whatever
+ * happens to the node.
+ */
+class CChainIndexDB : public CDBWrapper
+{
+public:
+    CChainIndexDB(const std::string &strName, size_t nCacheSize, bool fMemory, bool fWipe);
+
+    /** Block the index under chBest is at, null if it was never written */
+    uint256 ReadBestBlock(char chBest = DB_CHAIN_INDEX_BEST_BLOCK) const;
+    /** Write the batch of a block with the block the index is now at */
+    bool WriteBlock(CDBBatch &batch, const uint256 &hashBlock, char chBest = DB_CHAIN_INDEX_BEST_BLOCK);
+    /** Erase the records whose keys start with one of strPrefixes and set the best block */
+    bool Wipe(const std::string &strPrefixes, const uint256 &hashBlock, char chBest = DB_CHAIN_INDEX_BEST_BLOCK);
+};
+
+
+/**
+ * Index following chainActive block by block. Connect and Disconnect ignore
+ * blocks which do not follow the index and only fail if it cannot be written.
+ */
+struct CChainIndex
+{
+    const char *name;
+    uint256 (*GetBestBlock)();
+    bool (*Connect)(const CBlock &block, int nHeight);
+    bool (*Disconnect)(const CBlock &block, int nHeight);
+    bool (*Reset)();            //!< wipe the index to follow the chain from the genesis block
+};
+
+/**
+ * Bring the indexes which are not at the tip up to it in the background, from
+ * their best block or from the genesis block if that block is unknown.
+ */
+void StartChainIndexCatchUp(boost::thread_group &threadGroup, const std::vector<CChainIndex> &vIndexes);
+
+#endif  /* CHAININDEXDB_H */
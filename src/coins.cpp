@@ -129,7 +129,7 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+    cachedCoinsUsage += ret->second.DynamicMemoryUsage();
     return ret;
 }
 
@@ -370,7 +370,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
         }
     } else {
-        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+        cachedCoinUsage = ret.first->second.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
@@ -508,7 +508,8 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     assert(it->second.flags & CCoinsCacheEntry::FRESH);
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
-                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+                    entry.dirtyOutputs.swap(it->second.dirtyOutputs);
+                    cachedCoinsUsage += entry.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
                 }
             } else {
@@ -516,14 +517,21 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
-                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    std::vector<bool> &dirty = itUs->second.dirtyOutputs;
+                    const std::vector<bool> &childDirty = it->second.dirtyOutputs;
+                    if (dirty.size() < childDirty.size())
+                        dirty.resize(childDirty.size(), false);
+                    for (unsigned int i = 0; i < childDirty.size(); i++)
+                        if (childDirty[i])
+                            dirty[i] = true;
+                    cachedCoinsUsage += itUs->second.DynamicMemoryUsage();
                 }
             }
         }
@@ -724,6 +732,13 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight) const
 CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    const CCoins &coins = it->second.coins;
+    availableBefore.resize(coins.vout.size());
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        availableBefore[i] = !coins.vout[i].IsNull();
+    nHeightBefore = coins.nHeight;
+    nVersionBefore = coins.nVersion;
+    fCoinBaseBefore = coins.fCoinBase;
 }
 
 CCoinsModifier::~CCoinsModifier()
@@ -735,7 +750,20 @@ CCoinsModifier::~CCoinsModifier()
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
     } else {
+        // Every stored output carries the header fields, a change to them dirties all of them
+        const CCoins &coins = it->second.coins;
+        bool fHeaderChanged = coins.nHeight != nHeightBefore || coins.nVersion != nVersionBefore || coins.fCoinBase != fCoinBaseBefore;
+        std::vector<bool> &dirty = it->second.dirtyOutputs;
+        size_t nOutputs = std::max(availableBefore.size(), coins.vout.size());
+        if (dirty.size() < nOutputs)
+            dirty.resize(nOutputs, false);
+        for (unsigned int i = 0; i < nOutputs; i++) {
+            bool fBefore = i < availableBefore.size() && availableBefore[i];
+            bool fAfter = coins.IsAvailable(i);
+            if (fBefore != fAfter || (fHeaderChanged && fAfter))
+                dirty[i] = true;
+        }
         // If the coin still exists after the modification, add the new usage
-        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        cache.cachedCoinsUsage += it->second.DynamicMemoryUsage();
     }
 }
@@ -296,6 +296,9 @@ struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    // Outputs that were created or spent since the entry was loaded from the parent view.
+    // The coins database stores one record per output, only these are rewritten on flush.
+    std::vector<bool> dirtyOutputs;
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -303,6 +306,10 @@ struct CCoinsCacheEntry
     };
 
     CCoinsCacheEntry() : coins(), flags(0) {}
+
+    size_t DynamicMemoryUsage() const {
+        return coins.DynamicMemoryUsage() + memusage::DynamicUsage(dirtyOutputs);
+    }
 };
 
 struct CAnchorsSproutCacheEntry
@@ -453,7 +460,12 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    size_t cachedCoinUsage; // Cached memory usage of the cache entry before modification
+    // Output availability and header fields before modification, to find the dirty outputs
+    std::vector<bool> availableBefore;
+    int nHeightBefore;
+    int nVersionBefore;
+    bool fCoinBaseBefore;
     CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
@@ -4,9 +4,17 @@
 
 #include "dbwrapper.h"
 
+#include "sync.h"
 #include "util.h"
+#include "utilstrencodings.h"
 
+#include <atomic>
+#include <set>
+#include <stdio.h>
+
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -14,14 +22,116 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles)
+namespace dbwrapper_private {
+
+/** LRU block cache that counts lookups, LevelDB itself does not report its hit rate */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* pcache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CCountingCache(size_t capacity) : pcache(leveldb::NewLRUCache(capacity)), nHits(0), nMisses(0) {}
+    ~CCountingCache() { delete pcache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value)) {
+        return pcache->Insert(key, value, charge, deleter);
+    }
+    Handle* Lookup(const leveldb::Slice& key) {
+        Handle* handle = pcache->Lookup(key);
+        if (handle != NULL)
+            nHits++;
+        else
+            nMisses++;
+        return handle;
+    }
+    void Release(Handle* handle) { pcache->Release(handle); }
+    void* Value(Handle* handle) { return pcache->Value(handle); }
+    void Erase(const leveldb::Slice& key) { pcache->Erase(key); }
+    uint64_t NewId() { return pcache->NewId(); }
+};
+
+};
+
+/** Open databases, for getdbstats */
+static CCriticalSection cs_openDBs;
+static std::set<CDBWrapper*> setOpenDBs;
+
+CDBOptions::CDBOptions(const std::string& nameIn, size_t nCacheSize, bool compression, int maxOpenFiles) :
+    name(nameIn), nBlockCacheSize(nCacheSize / 2),
+    nWriteBufferSize(nCacheSize / 4), // up to two write buffers may be held in memory simultaneously
+    nBloomBits(10), nMaxOpenFiles(maxOpenFiles), fCompression(compression)
+{
+}
+
+static bool ParseDBProfileArg(const std::string& strArg, CDBOptions* pOptions, std::string& strError)
+{
+    size_t nColon = strArg.find(':');
+    if (nColon == std::string::npos || nColon == 0) {
+        strError = strprintf("-dbprofile=%s: expected <name>:<key>=<value>[,<key>=<value>...]", strArg);
+        return false;
+    }
+    if (pOptions != NULL && strArg.substr(0, nColon) != pOptions->name)
+        return true;
+
+    std::vector<std::string> vSettings;
+    boost::split(vSettings, strArg.substr(nColon + 1), boost::is_any_of(","));
+    BOOST_FOREACH(const std::string& strSetting, vSettings) {
+        size_t nEq = strSetting.find('=');
+        std::string strKey = strSetting.substr(0, nEq);
+        int64_t nValue = 0;
+        if (nEq == std::string::npos || !ParseInt64(strSetting.substr(nEq + 1), &nValue) || nValue < 0) {
+            strError = strprintf("-dbprofile=%s: invalid setting '%s'", strArg, strSetting);
+            return false;
+        }
+        if (strKey == "bloombits") {
+            if (pOptions) pOptions->nBloomBits = nValue;
+        } else if (strKey == "blockcache") {
+            if (pOptions) pOptions->nBlockCacheSize = nValue << 20;
+        } else if (strKey == "writebuffer") {
+            if (pOptions) pOptions->nWriteBufferSize = nValue << 20;
+        } else if (strKey == "maxopenfiles") {
+            if (pOptions) pOptions->nMaxOpenFiles = nValue;
+        } else if (strKey == "compression") {
+            if (pOptions) pOptions->fCompression = nValue != 0;
+        } else {
+            strError = strprintf("-dbprofile=%s: unknown setting '%s' (bloombits, blockcache, writebuffer, maxopenfiles or compression)", strArg, strKey);
+            return false;
+        }
+    }
+    return true;
+}
+
+CDBOptions& CDBOptions::ApplyProfileArgs()
+{
+    std::string strError;
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-dbprofile"]) {
+        if (!ParseDBProfileArg(strArg, this, strError))
+            LogPrintf("Ignoring %s\n", strError);
+    }
+    return *this;
+}
+
+bool CheckDBProfileArgs(std::string& strError)
+{
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-dbprofile"]) {
+        if (!ParseDBProfileArg(strArg, NULL, strError))
+            return false;
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(const CDBOptions& profile, leveldb::Cache* pcache)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
-    options.max_open_files = maxOpenFiles;
+    options.block_cache = pcache;
+    options.write_buffer_size = profile.nWriteBufferSize;
+    options.filter_policy = profile.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = profile.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -30,15 +140,29 @@ static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxO
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) :
+    profile(path.filename().string(), nCacheSize, compression, maxOpenFiles)
+{
+    Open(path, fMemory, fWipe);
+}
+
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, const CDBOptions& profileIn, bool fMemory, bool fWipe) :
+    profile(profileIn)
+{
+    Open(path, fMemory, fWipe);
+}
+
+void CDBWrapper::Open(const boost::filesystem::path& path, bool fMemory, bool fWipe)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, compression, maxOpenFiles);
+    pcache = new dbwrapper_private::CCountingCache(profile.nBlockCacheSize);
+    options = GetOptions(profile, pcache);
     options.create_if_missing = true;
+    strPath = path.string();
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
         options.env = penv;
@@ -51,18 +175,29 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
     }
+    LogPrintf("* %s: %.1fMiB block cache, %.1fMiB write buffer, %d bloom filter bits, %d max open files, compression %s\n",
+              profile.name, profile.nBlockCacheSize * (1.0 / 1024 / 1024), profile.nWriteBufferSize * (1.0 / 1024 / 1024),
+              profile.nBloomBits, profile.nMaxOpenFiles, profile.fCompression ? "enabled" : "disabled");
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+
+    LOCK(cs_openDBs);
+    setOpenDBs.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_openDBs);
+        setOpenDBs.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
     options.filter_policy = NULL;
-    delete options.block_cache;
+    delete pcache;
+    pcache = NULL;
     options.block_cache = NULL;
     delete penv;
     options.env = NULL;
@@ -82,6 +217,30 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+void GetDBStats(std::vector<CDBStats>& vStats)
+{
+    LOCK(cs_openDBs);
+    BOOST_FOREACH(CDBWrapper* pdbw, setOpenDBs) {
+        CDBStats stats(pdbw->profile);
+        stats.path = pdbw->strPath;
+        stats.nCacheHits = pdbw->pcache->nHits;
+        stats.nCacheMisses = pdbw->pcache->nMisses;
+        // "leveldb.stats" is a table of level, files, size, and compaction time, read and write
+        std::string strStats;
+        if (pdbw->pdb->GetProperty("leveldb.stats", &strStats)) {
+            std::vector<std::string> vLines;
+            boost::split(vLines, strStats, boost::is_any_of("\n"));
+            BOOST_FOREACH(const std::string& strLine, vLines) {
+                CDBLevelStats level;
+                if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &level.nLevel, &level.nFiles, &level.dSizeMB,
+                           &level.dCompactionSecs, &level.dReadMB, &level.dWriteMB) == 6)
+                    stats.vLevels.push_back(level);
+            }
+        }
+        vStats.push_back(stats);
+    }
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
@@ -13,6 +13,9 @@
 
 #include <boost/filesystem/path.hpp>
 
+#include <string>
+#include <vector>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -27,6 +30,53 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB settings of one database. The defaults derive from its share of -dbcache,
+ * -dbprofile=<name>:<key>=<value>[,...] overrides them per database by name.
+ */
+struct CDBOptions
+{
+    std::string name;           //!< chainstate, blockindex, addressindex, spentindex, timestampindex, notarisations, tokens, batons, oracles or prices
+    size_t nBlockCacheSize;     //!< bytes of uncompressed blocks kept in the LRU cache
+    size_t nWriteBufferSize;    //!< bytes buffered in the memtable before a level 0 file is written
+    int nBloomBits;             //!< bloom filter bits per key, 0 disables the filter
+    int nMaxOpenFiles;
+    bool fCompression;
+
+    CDBOptions(const std::string& nameIn, size_t nCacheSize, bool compression = false, int maxOpenFiles = 64);
+
+    //! Apply the -dbprofile entries naming this database
+    CDBOptions& ApplyProfileArgs();
+};
+
+/** Check the syntax of every -dbprofile argument */
+bool CheckDBProfileArgs(std::string& strError);
+
+/** Per level file count, size and compaction work of a database */
+struct CDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    double dSizeMB;
+    double dCompactionSecs;
+    double dReadMB;
+    double dWriteMB;
+};
+
+struct CDBStats
+{
+    CDBOptions options;
+    std::string path;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    std::vector<CDBLevelStats> vLevels;
+
+    CDBStats(const CDBOptions& optionsIn) : options(optionsIn), nCacheHits(0), nCacheMisses(0) {}
+};
+
+/** Statistics of every open database, for getdbstats */
+void GetDBStats(std::vector<CDBStats>& vStats);
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -35,6 +85,8 @@ namespace dbwrapper_private {
  */
 void HandleError(const leveldb::Status& status);
 
+class CCountingCache;
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -45,12 +97,19 @@ class CDBBatch
 private:
     const CDBWrapper &parent;
     leveldb::WriteBatch batch;
+    size_t size_estimate;
 
 public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch(const CDBWrapper &_parent) : parent(_parent) { };
+    CDBBatch(const CDBWrapper &_parent) : parent(_parent), size_estimate(0) { };
+
+    void Clear()
+    {
+        batch.Clear();
+        size_estimate = 0;
+    }
 
     template <typename K, typename V>
     void Write(const K& key, const V& value)
@@ -66,6 +125,14 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        // LevelDB serializes writes as:
+        // - byte: header
+        // - varint: key length (1 byte up to 127B, 2 bytes up to 16383B, ...)
+        // - byte[]: key
+        // - varint: value length
+        // - byte[]: value
+        // The formula below assumes the key and value are both less than 16k.
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
     }
 
     template <typename K>
@@ -77,7 +144,16 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        // LevelDB serializes erases as:
+        // - byte: header
+        // - varint: key length
+        // - byte[]: key
+        // The formula below assumes the key is less than 16kB.
+        size_estimate += 2 + (slKey.size() > 127) + slKey.size();
     }
+
+    /** Approximate number of bytes this batch adds to the log */
+    size_t SizeEstimate() const { return size_estimate; }
 };
 
 class CDBIterator
@@ -148,6 +224,16 @@ public:
         return true;
     }
 
+    bool GetValueDataStream(CDataStream &ssValue) {
+        leveldb::Slice slValue = piter->value();
+        try {
+            ssValue = CDataStream(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        } catch(std::exception &e) {
+            return false;
+        }
+        return true;
+    }
+
     unsigned int GetValueSize() {
         return piter->value().size();
     }
@@ -178,6 +264,18 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! settings the database was opened with
+    CDBOptions profile;
+
+    //! block cache counting hits and misses
+    dbwrapper_private::CCountingCache* pcache;
+
+    std::string strPath;
+
+    void Open(const boost::filesystem::path& path, bool fMemory, bool fWipe);
+
+    friend void GetDBStats(std::vector<CDBStats>& vStats);
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -186,6 +284,13 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      */
     CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = false, int maxOpenFiles = 64);
+    /**
+     * @param[in] path        Location in the filesystem where leveldb data will be stored.
+     * @param[in] profileIn   LevelDB settings, reported by getdbstats under its name.
+     * @param[in] fMemory     If true, use leveldb's memory environment.
+     * @param[in] fWipe       If true, remove all existing data.
+     */
+    CDBWrapper(const boost::filesystem::path& path, const CDBOptions& profileIn, bool fMemory = false, bool fWipe = false);
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -27,6 +27,8 @@
 #include "primitives/block.h"
 #include "addrman.h"
 #include "amount.h"
+#include "batonsdb.h"
+#include "chainindexdb.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
@@ -35,6 +37,8 @@
 #include "httprpc.h"
 #include "key.h"
 #include "notarisationdb.h"
+#include "oraclesdb.h"
+#include "pricesdb.h"
 #include "komodo_notary.h"
 
 #ifdef ENABLE_MINING
@@ -48,6 +52,7 @@
 #include "rpc/register.h"
 #include "script/standard.h"
 #include "scheduler.h"
+#include "tokensdb.h"
 #include "txdb.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -100,6 +105,7 @@ extern int32_t KOMODO_LOADINGBLOCKS;
 extern bool VERUS_MINTBLOCKS;
 extern char ASSETCHAINS_SYMBOL[];
 extern int32_t KOMODO_SNAPSHOT_INTERVAL;
+extern std::string komodo_pricekernels_autodetect();
 
 ZCJoinSplit* pzcashParams = NULL;
 
@@ -265,6 +271,8 @@ void Shutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsoverlay;
+        pcoinsoverlay = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -375,6 +383,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-asyncflush", strprintf(_("Write the coin cache to disk on a background thread, the flushed entries are kept in memory until written (default: %u)"), DEFAULT_ASYNC_FLUSH));
+    strUsage += HelpMessageOpt("-blockcheckthreads=<n>", strprintf(_("Number of threads verifying the Equihash solution and merkle root of blocks received during initial download, 0 verifies them on the message thread (default: %u, max: %u)"), DEFAULT_BLOCK_CHECK_THREADS, MAX_BLOCK_CHECK_THREADS));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
@@ -389,6 +399,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbprofile=<db>:<key>=<n>[,...]", _("Override LevelDB settings of the chainstate, blockindex, addressindex, spentindex, timestampindex, notarisations, tokens, batons, oracles or prices database: bloombits (bloom filter bits per key, 0 for none), blockcache and writebuffer (MiB), maxopenfiles, compression (0 or 1). Can be specified multiple times"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
@@ -404,6 +415,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-trustblockindex", strprintf(_("Skip block header hash checks while loading the block index and verify them in the background after startup (default: %u)"), DEFAULT_TRUST_BLOCK_INDEX));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
@@ -414,12 +426,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Request new blocks as compact blocks, rebuilt from the mempool, from peers that support them (default: %u)"), DEFAULT_COMPACT_BLOCKS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
     strUsage += HelpMessageOpt("-dnsseed", _("Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect)"));
     strUsage += HelpMessageOpt("-externalip=<ip>", _("Specify your own public address"));
     strUsage += HelpMessageOpt("-forcednsseed", strprintf(_("Always query for peer addresses via DNS lookup (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-getdatathreads=<n>", strprintf(_("Number of threads serving getdata requests, 0 serves them on the message thread (default: %u, max: %u)"), DEFAULT_GETDATA_THREADS, MAX_GETDATA_THREADS));
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
@@ -430,12 +444,19 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with Bloom filters (default: %u)"), 1));
     strUsage += HelpMessageOpt("-nspv_msg", strprintf(_("Enable NSPV messages processing (default: %u)"), DEFAULT_NSPV_PROCESSING));
+    strUsage += HelpMessageOpt("-nspv_threads=<n>", strprintf(_("Number of threads answering NSPV requests, 0 answers them on the message thread (default: %u, max: %u)"), DEFAULT_NSPV_THREADS, MAX_NSPV_THREADS));
+    strUsage += HelpMessageOpt("-nspv_maxqueue=<n>", strprintf(_("Maximum number of NSPV requests waiting for a worker thread (default: %u)"), DEFAULT_NSPV_QUEUE));
+    strUsage += HelpMessageOpt("-nspv_maxpeerqueue=<n>", strprintf(_("Maximum number of NSPV requests one peer may have waiting (default: %u)"), DEFAULT_NSPV_PEER_QUEUE));
+    strUsage += HelpMessageOpt("-nspv_cachesize=<n>", strprintf(_("Memory budget of the NSPV response cache in megabytes (default: %u)"), DEFAULT_NSPV_CACHESIZE));
     if (showDebug)
         strUsage += HelpMessageOpt("-enforcenodebloom", strprintf("Enforce minimum protocol version to limit use of Bloom filters (default: %u)", 0));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 7770, 17770));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef USE_EPOLL
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Wait for socket readiness with <mode>, one of: select, epoll (default: %s)"), DEFAULT_SOCKET_EVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -498,7 +519,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", 0));
         strUsage += HelpMessageOpt("-nuparams=hexBranchId:activationHeight", "Use given activation height for specified network upgrade (regtest-only)");
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, estimatefee, http, libevent, lock, mempool, net, partitioncheck, pow, proxy, prune, "
+    string debugCategories = "addrman, alert, bench, ccstats, cmpctblock, coindb, db, estimatefee, http, libevent, lock, mempool, net, partitioncheck, pow, proxy, prune, "
                              "rand, reindex, rpc, selectcoins, tor, zmq, zrpc, zrpcunsafe (implies zrpc)"; // Don't translate these
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + debugCategories + ".");
@@ -1093,7 +1114,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     //fprintf(stderr,"nMaxConnections %d\n",nMaxConnections);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKET_EVENTS);
+#ifdef USE_EPOLL
+    if (strSocketEvents != "select" && strSocketEvents != "epoll")
+#else
+    if (strSocketEvents != "select")
+#endif
+        return InitError(strprintf(_("Unsupported -socketevents mode: '%s'"), strSocketEvents));
+    // epoll is not bound by FD_SETSIZE, only by the file descriptor limit below
+    if (strSocketEvents == "select")
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    else
+        nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     //fprintf(stderr,"nMaxConnections %d FD_SETSIZE.%d nBind.%d expr.%d \n",nMaxConnections,FD_SETSIZE,nBind,(int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
@@ -1153,6 +1185,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", true);
+    fCompactBlocks = GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
@@ -1334,6 +1367,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    LogPrintf("Using the '%s' prices kernels\n", komodo_pricekernels_autodetect());
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
 
@@ -1624,6 +1658,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     boost::filesystem::create_directories(GetDataDir() / "blocks");
 
     // block tree db settings
+    std::string strDBProfileError;
+    if (!CheckDBProfileArgs(strDBProfileError))
+        return InitError(strDBProfileError);
     int dbMaxOpenFiles = GetArg("-dbmaxopenfiles", DEFAULT_DB_MAX_OPEN_FILES);
     bool dbCompression = GetBoolArg("-dbcompression", DEFAULT_DB_COMPRESSION);
 
@@ -1636,45 +1673,46 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
+        nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
+    }
+    int64_t nIndexDBCache = 0;
     if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
-        nBlockTreeDBCache = nTotalCache * 3 / 4;
-    } else {
-        if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
-            nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
-        }
+        // the address and spent index databases get what is left of 3/4 of the cache
+        nIndexDBCache = nTotalCache * 3 / 4 - nBlockTreeDBCache;
+    } else if (GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+        nIndexDBCache = (1 << 21);
     }
-    nTotalCache -= nBlockTreeDBCache;
+    nTotalCache -= nBlockTreeDBCache + nIndexDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Max cache setting possible %.1fMiB\n", nMaxDbCache);
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for address, spent and timestamp index databases\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
-    if ( fReindex == 0 )
+    // contracts read the address and spent indexes while validating, so on chains with
+    // them the indexes cannot be built behind the tip, switching one on still reindexes.
+    // A new database has no flags and gets the indexes from the genesis block on.
+    if ( fReindex == 0 && ASSETCHAINS_CC != 0 )
     {
-        bool checkval,fAddressIndex,fSpentIndex;
-        pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
-        fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->ReadFlag("addressindex", checkval);
-        if ( checkval != fAddressIndex && fAddressIndex != 0 )
+        bool checkval;
+        pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, false, dbCompression, dbMaxOpenFiles, nIndexDBCache);
+        if ( GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) != 0 && pblocktree->ReadFlag("addressindex", checkval) && checkval == 0 )
         {
-            pblocktree->WriteFlag("addressindex", fAddressIndex);
             fprintf(stderr,"set addressindex, will reindex. could take a while.\n");
             fReindex = true;
         }
-        fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-        pblocktree->ReadFlag("spentindex", checkval);
-        if ( checkval != fSpentIndex && fSpentIndex != 0 )
+        if ( GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) != 0 && pblocktree->ReadFlag("spentindex", checkval) && checkval == 0 )
         {
-            pblocktree->WriteFlag("spentindex", fSpentIndex);
             fprintf(stderr,"set spentindex, will reindex. could take a while.\n");
             fReindex = true;
         }
+        delete pblocktree;
+        pblocktree = NULL;
     }
 
     bool clearWitnessCaches = false;
@@ -1691,18 +1729,39 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsoverlay;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
                 delete pnotarisations;
+                delete ptokens;
+                delete pbatons;
+                delete poracles;
+                delete pprices;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles, nIndexDBCache);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsoverlay = new CCoinsViewFlushOverlay(pcoinscatcher, pcoinsdbview, GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH));
+                pcoinsTip = new CCoinsViewCache(pcoinsoverlay);
                 pnotarisations = new NotarisationDB(100*1024*1024, false, fReindex);
+                ptokens = new TokensDB(8*1024*1024, false, fReindex);
+                pbatons = new BatonsDB(8*1024*1024, false, fReindex);
+                poracles = new OraclesDB(8*1024*1024, false, fReindex);
+                pprices = new PricesDB(8*1024*1024, false, fReindex);
 
 
+                uiInterface.InitMessage(_("Upgrading coin database if needed..."));
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading coin database");
+                    break;
+                }
+                uiInterface.InitMessage(_("Moving indexes to their own databases if needed..."));
+                if (!pblocktree->MigrateIndexes()) {
+                    strLoadError = _("Error moving indexes out of the block index database");
+                    break;
+                }
+
                 if (fReindex) {
                     boost::filesystem::remove(GetDataDir() / "komodostate");
                     boost::filesystem::remove(GetDataDir() / "signedmasks");
@@ -1728,6 +1787,26 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
                 KOMODO_LOADINGBLOCKS = 0;
+                if (!LoadAssetOrders(chainActive.Tip() != NULL ? chainActive.Tip()->GetBlockHash() : uint256())) {
+                    strLoadError = _("Error loading the assets orderbook");
+                    break;
+                }
+                if (!LoadTokenOutputs()) {
+                    strLoadError = _("Error loading the token outputs index");
+                    break;
+                }
+                if (!LoadBatons()) {
+                    strLoadError = _("Error loading the baton index");
+                    break;
+                }
+                if (!LoadOracleSamples()) {
+                    strLoadError = _("Error loading the oracle samples index");
+                    break;
+                }
+                if (!LoadPricesBets(chainActive.Tip() != NULL ? chainActive.Tip()->GetBlockHash() : uint256())) {
+                    strLoadError = _("Error loading the prices bets index");
+                    break;
+                }
                 // Check for changed -txindex state
                 if (fTxIndex != GetBoolArg("-txindex", true)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
@@ -1809,6 +1888,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
+    if (!fReindex && GetBoolArg("-trustblockindex", DEFAULT_TRUST_BLOCK_INDEX))
+        threadGroup.create_thread(&ThreadVerifyBlockIndex);
 
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
@@ -2006,9 +2087,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     if ( KOMODO_NSPV == 0 )
     {
-        if ( GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) != 0 )
+        // an index built in the background is announced once it reaches the tip
+        LOCK(cs_main);
+        if ( fAddressIndex != 0 )
             nLocalServices |= NODE_ADDRINDEX;
-        if ( GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) != 0 )
+        if ( fSpentIndex != 0 )
             nLocalServices |= NODE_SPENTINDEX;
         fprintf(stderr,"nLocalServices %llx %d, %d\n",(long long)nLocalServices,GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX),GetBoolArg("-spentindex", DEFAULT_SPENTINDEX));
     }
@@ -2037,6 +2120,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             MilliSleep(10);
     }
 
+    // indexes switched on since they were last maintained are built without a -reindex
+    std::string strIndexError;
+    if (!StartIndexRebuild(threadGroup, strIndexError))
+        return InitError(strIndexError);
+    // and the contract indexes left behind the tip replay the blocks up to it
+    std::vector<CChainIndex> vChainIndexes;
+    CChainIndex tokenIndex = { "token outputs index", GetTokenOutputsBestBlock, ConnectTokenOutputs, DisconnectTokenOutputs, ResetTokenOutputs };
+    CChainIndex batonIndex = { "baton index", GetBatonsBestBlock, ConnectBatons, DisconnectBatons, ResetBatons };
+    CChainIndex oracleIndex = { "oracle samples index", GetOracleSamplesBestBlock, ConnectOracleSamples, DisconnectOracleSamples, ResetOracleSamples };
+    vChainIndexes.push_back(tokenIndex);
+    vChainIndexes.push_back(batonIndex);
+    vChainIndexes.push_back(oracleIndex);
+    StartChainIndexCatchUp(threadGroup, vChainIndexes);
+
     // ********************************************************* Step 11: start node
 
     if (!CheckDiskSpace())
@@ -2066,8 +2163,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    StartGetDataWorkers(threadGroup);
+    StartBlockCheckThreads(threadGroup);
     StartNode(threadGroup, scheduler);
 
+    if (GetBoolArg("-nspv_msg", DEFAULT_NSPV_PROCESSING) && KOMODO_NSPV == 0)
+        StartNSPVWorkers(threadGroup);
+
 #ifdef ENABLE_MINING
     // Generate coins in the background
  #ifdef ENABLE_WALLET
@@ -1638,9 +1638,10 @@ bool GetStakeParams(const CTransaction &stakeTx, CStakeParams &stakeParams);
 bool ValidateMatchingStake(const CTransaction &ccTx, uint32_t voutNum, const CTransaction &stakeTx, bool &cheating);
 
 // for now, we will ignore slowFlag in the interest of keeping success/fail simpler for security purposes
-bool verusCheckPOSBlock(int32_t slowflag, CBlock *pblock, int32_t height)
+bool verusCheckPOSBlock(int32_t slowflag, CBlock *pblock, int32_t height, bool *pfNotChecked)
 {
     CBlockIndex *pastBlockIndex;
+    CBlockHeader bh;
     uint256 txid, blkHash;
     int32_t txn_count;
     uint32_t voutNum;
@@ -1701,9 +1702,14 @@ bool verusCheckPOSBlock(int32_t slowflag, CBlock *pblock, int32_t height)
                 {
                     fprintf(stderr,"ERROR: invalid PoS block %s - no source transaction\n",blkHash.ToString().c_str());
                 }
+                else if (!pastBlockIndex->GetBlockHeader(bh))
+                {
+                    // our block db is at fault, not the block
+                    fprintf(stderr,"ERROR: PoS block %s - cannot read past block header\n",blkHash.ToString().c_str());
+                    *pfNotChecked = true;
+                }
                 else
                 {
-                    CBlockHeader bh = pastBlockIndex->GetBlockHeader();
                     uint256 pastHash = bh.GetVerusEntropyHash(height - 100);
 
                     // if height is over when Nonce is required to be the new format, we check that the new format is correct
@@ -2145,7 +2151,7 @@ int32_t komodo_checkPOW(int64_t stakeTxValue, int32_t slowflag,CBlock *pblock,in
     uint256 hash,merkleroot; arith_uint256 bnTarget,bhash; bool fNegative,fOverflow; uint8_t *script,pubkey33[33],pubkeys[64][33]; int32_t i,scriptlen,possible,PoSperc,is_PoSblock=0,n,failed = 0,notaryid = -1; int64_t checktoshis,value; CBlockIndex *pprev;
     if ( KOMODO_TEST_ASSETCHAIN_SKIP_POW == 0 && Params().NetworkIDString() == "regtest" )
         KOMODO_TEST_ASSETCHAIN_SKIP_POW = 1;
-    if ( !CheckEquihashSolution(pblock, Params()) )
+    if ( !pblock->fCheckedSolution && !CheckEquihashSolution(pblock, Params()) ) // already verified by PrecheckBlock
     {
         fprintf(stderr,"komodo_checkPOW slowflag.%d ht.%d CheckEquihashSolution failed\n",slowflag,height);
         return(-1);
@@ -2172,10 +2178,13 @@ int32_t komodo_checkPOW(int64_t stakeTxValue, int32_t slowflag,CBlock *pblock,in
     if ( ASSETCHAINS_LWMAPOS != 0 && bhash > bnTarget )
     {
         // if proof of stake is active, check if this is a valid PoS block before we fail
-        if (verusCheckPOSBlock(slowflag, pblock, height))
+        bool fNotChecked = false;
+        if (verusCheckPOSBlock(slowflag, pblock, height, &fNotChecked))
         {
             return(0);
         }
+        if ( fNotChecked )
+            return(KOMODO_CHECKPOW_NOTCHECKED);
     }
     if ( (ASSETCHAINS_SYMBOL[0] != 0 || height > 792000) && bhash > bnTarget )
     {
@@ -202,7 +202,8 @@ uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeigh
 int32_t komodo_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash);
 
 // for now, we will ignore slowFlag in the interest of keeping success/fail simpler for security purposes
-bool verusCheckPOSBlock(int32_t slowflag, CBlock *pblock, int32_t height);
+// *pfNotChecked is set when the block could not be judged because a past header could not be read
+bool verusCheckPOSBlock(int32_t slowflag, CBlock *pblock, int32_t height, bool *pfNotChecked);
 
 uint64_t komodo_notarypayamount(int32_t nHeight, int64_t notarycount);
 
@@ -220,6 +221,10 @@ void GetKomodoEarlytxidScriptPub();
 
 int64_t komodo_checkcommission(CBlock *pblock,int32_t height);
 
+// returned by komodo_checkPOW when our own block db could not be read to check the block,
+// the block is not invalid and must not be marked as such
+#define KOMODO_CHECKPOW_NOTCHECKED (-2)
+
 int32_t komodo_checkPOW(int64_t stakeTxValue, int32_t slowflag,CBlock *pblock,int32_t height);
 
 int32_t komodo_acpublic(uint32_t tiptime);
@@ -17,6 +17,11 @@
 #include "komodo_utils.h" // komodo_stateptrget
 #include "komodo_bitcoind.h" // komodo_checkcommission
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 struct komodo_extremeprice
 {
     uint256 blockhash;
@@ -32,8 +37,13 @@ struct komodo_priceinfo
 {
     FILE *fp;
     char symbol[64];
+    boost::interprocess::mapped_region *region; // read-only view of the file, komodo_priceget reads from it
+    size_t datalen; // bytes of the file up to its last written row, the file is zero padded past it
 } PRICES[KOMODO_MAXPRICES];
 
+// held shared while reading a mapping, unique while writing a file or mapping it again
+boost::shared_mutex pricemapmutex;
+
 const char *Cryptos[] = { "KMD", "ETH" }; // must be on binance (for now)
 // "LTC", "BCHABC", "XMR", "IOTA", "ZEC", "WAVES",  "LSK", "DCR", "RVN", "DASH", "XEM", "BTS", "ICX", "HOT", "STEEM", "ENJ", "STRAT"
 const char *Forex[] =
@@ -2363,7 +2373,7 @@ int32_t komodo_priceind(const char *symbol)
     return(-1);
 }
 // returns price value which is in a 10% interval for more than 50% points for the preceding 24 hours
-int64_t komodo_pricecorrelated(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth)
+int64_t komodo_pricecorrelated_scalar(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth)
 {
     int32_t i,j,k,n,iter,correlation,maxcorrelation=0; int64_t firstprice,price,sum,den,mult,refprice,lowprice,highprice;
     if ( PRICES_DAYWINDOW < 2 || ind >= KOMODO_MAXPRICES )
@@ -2497,7 +2507,7 @@ int64_t balanced_ave64(int64_t buf[],int32_t i,int32_t width)
     return(sum);
 }
 
-void buf_trioave64(int64_t dest[],int64_t src[],int32_t n)
+void buf_trioave64_scalar(int64_t dest[],int64_t src[],int32_t n)
 {
     register int32_t i,j,width = 3;
     for (i=0; i<128; i++)
@@ -2519,6 +2529,60 @@ void buf_trioave64(int64_t dest[],int64_t src[],int32_t n)
     else dest[n-1] = 0;
 }
 
+static int64_t (*pricecorrelated_kernel)(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth) = komodo_pricecorrelated_scalar;
+static void (*trioave64_kernel)(int64_t dest[],int64_t src[],int32_t n) = buf_trioave64_scalar;
+
+int64_t komodo_pricecorrelated(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth)
+{
+    return((*pricecorrelated_kernel)(seed,ind,rawprices,rawskip,nonzprices,smoothwidth));
+}
+
+void buf_trioave64(int64_t dest[],int64_t src[],int32_t n)
+{
+    (*trioave64_kernel)(dest,src,n);
+}
+
+#ifdef KOMODO_PRICES_AVX2
+// the AVX2 kernels must give the scalar results on three feeds with a trend, gaps and an outlier run
+static bool komodo_pricekernels_selftest()
+{
+    int32_t i,seed,numprices = 3; int64_t srcA[512],srcB[512],destA[512],destB[512];
+    std::vector<uint32_t> rawprices(PRICES_DAYWINDOW * numprices);
+    for (i=0; i<PRICES_DAYWINDOW; i++)
+    {
+        rawprices[i*numprices] = 100000000 + (i % 1000)*1000;
+        rawprices[i*numprices + 1] = 5000 + (i*7919) % 300;
+        rawprices[i*numprices + 2] = (i % 5) == 0 ? 9000000 : 1000000 + (i*104729) % 30000;
+    }
+    for (seed=0; seed<4; seed++)
+        for (i=0; i<numprices; i++)
+            if ( komodo_pricecorrelated_avx2(seed,0,&rawprices[i],numprices,0,PRICES_SMOOTHWIDTH) != komodo_pricecorrelated_scalar(seed,0,&rawprices[i],numprices,0,PRICES_SMOOTHWIDTH) )
+                return(false);
+    for (i=0; i<512; i++)
+        srcA[i] = srcB[i] = (i % 7) == 0 ? 0 : ((int64_t)i * i * 7919) % 1000003 - 500000;
+    buf_trioave64_scalar(destA,srcA,sizeof(srcA)/sizeof(*srcA));
+    buf_trioave64_avx2(destB,srcB,sizeof(srcB)/sizeof(*srcB));
+    return(memcmp(destA,destB,sizeof(destA)) == 0);
+}
+#endif
+
+std::string komodo_pricekernels_autodetect()
+{
+#ifdef KOMODO_PRICES_AVX2
+    if ( __builtin_cpu_supports("avx2") )
+    {
+        if ( komodo_pricekernels_selftest() )
+        {
+            pricecorrelated_kernel = komodo_pricecorrelated_avx2;
+            trioave64_kernel = buf_trioave64_avx2;
+            return("avx2");
+        }
+        fprintf(stderr,"AVX2 prices kernels failed their self test\n");
+    }
+#endif
+    return("scalar");
+}
+
 void smooth64(int64_t dest[],int64_t src[],int32_t width,int32_t smoothiters)
 {
     int64_t smoothbufA[1024],smoothbufB[1024]; int32_t i;
@@ -2577,10 +2641,83 @@ int64_t komodo_priceave(int64_t *buf,int64_t *correlated,int32_t cskip)
     return((price*7 + halfave*5 + thirdave*3 + fourthave*2 + decayprice + buf[PRICES_DAYWINDOW-1]) / 19);
 }
 
+#define PRICES_MAPCHUNK (1 << 16) // bytes a price file is grown by ahead of its writes, so that it is not mapped again every block
+
+// map a price file again once its writes went past the mapping, with pricemapmutex held unique
+static bool komodo_pricemap(int32_t ind)
+{
+    struct komodo_priceinfo *pi = &PRICES[ind]; long filesize; boost::interprocess::mapped_region *region;
+    if ( pi->region != 0 && pi->region->get_size() >= pi->datalen )
+        return(true);
+    fseek(pi->fp,0,SEEK_END);
+    if ( (filesize= ftell(pi->fp)) < (long)pi->datalen )
+        return(false);
+    if ( pi->region != 0 || filesize == 0 )
+    {
+        fseek(pi->fp,pi->datalen + PRICES_MAPCHUNK - 1,SEEK_SET);
+        fputc(0,pi->fp);
+        fflush(pi->fp);
+        filesize = pi->datalen + PRICES_MAPCHUNK;
+    }
+    try
+    {
+        boost::filesystem::path pricefname = GetDataDir() / "prices" / pi->symbol;
+        boost::interprocess::file_mapping mapping(pricefname.string().c_str(),boost::interprocess::read_only);
+        region = new boost::interprocess::mapped_region(mapping,boost::interprocess::read_only,0,filesize);
+    }
+    catch (const boost::interprocess::interprocess_exception &e)
+    {
+        fprintf(stderr,"error mapping %s: %s\n",pi->symbol,e.what());
+        return(false);
+    }
+    delete pi->region;
+    pi->region = region;
+    return(true);
+}
+
+// write to a price file, readers see it once it is in the mapping
+static bool komodo_pricewrite(int32_t ind,size_t offset,const void *ptr,size_t len)
+{
+    boost::unique_lock<boost::shared_mutex> lock(pricemapmutex);
+    struct komodo_priceinfo *pi = &PRICES[ind];
+    if ( fseek(pi->fp,offset,SEEK_SET) != 0 || fwrite(ptr,1,len,pi->fp) != len || fflush(pi->fp) != 0 )
+        return(false);
+    if ( offset + len > pi->datalen )
+        pi->datalen = offset + len;
+    return(komodo_pricemap(ind));
+}
+
+// rows of a price file, only read by the thread writing it
+static const uint8_t *komodo_pricerows(int32_t ind,size_t offset,size_t len)
+{
+    struct komodo_priceinfo *pi = &PRICES[ind];
+    if ( pi->region == 0 || offset + len > pi->datalen )
+        return(0);
+    return((const uint8_t *)pi->region->get_address() + offset);
+}
+
+// the padding komodo_pricemap and a new file add is not data, a row written always has a price
+static size_t komodo_pricedatalen(int32_t ind,size_t rowsize)
+{
+    struct komodo_priceinfo *pi = &PRICES[ind]; const uint8_t *ptr; size_t len,i;
+    if ( pi->region == 0 )
+        return(0);
+    ptr = (const uint8_t *)pi->region->get_address();
+    len = std::min(pi->datalen,pi->region->get_size());
+    len -= len % rowsize;
+    for (; len > 0; len -= rowsize)
+    {
+        for (i=len-rowsize; i<len; i++)
+            if ( ptr[i] != 0 )
+                return(len);
+    }
+    return(0);
+}
+
 int32_t komodo_pricesinit()
 {
     static int32_t didinit;
-    int32_t i,num=0,createflag = 0;
+    int32_t i,j,num=0,createflag = 0;
     if ( didinit != 0 )
         return(-1);
     didinit = 1;
@@ -2617,6 +2754,16 @@ int32_t komodo_pricesinit()
         fputc(0,PRICES[0].fp);
         fflush(PRICES[0].fp);
     }
+    for (j=0; j<i; j++)
+    {
+        if ( PRICES[j].fp == 0 )
+            continue;
+        fseek(PRICES[j].fp,0,SEEK_END);
+        PRICES[j].datalen = ftell(PRICES[j].fp);
+        if ( komodo_pricemap(j) == 0 )
+            fprintf(stderr,"error mapping %s\n",PRICES[j].symbol);
+        else PRICES[j].datalen = komodo_pricedatalen(j,j == 0 ? i * sizeof(uint32_t) : PRICES_MAXDATAPOINTS * sizeof(int64_t));
+    }
     fprintf(stderr,"pricesinit done i.%d num.%d numprices.%d\n",i,num,(int32_t)(komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t)));
     if ( i != num || i != komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t) )
     {
@@ -2626,7 +2773,9 @@ int32_t komodo_pricesinit()
     return(0);
 }
 
-pthread_mutex_t pricemutex;
+pthread_mutex_t pricemutex; // serializes the writers of the price files, readers only take pricemapmutex
+
+void prices_invalidatecache(int32_t height);
 
 // PRICES file layouts
 // [0] rawprice32 / timestamp
@@ -2636,17 +2785,15 @@ pthread_mutex_t pricemutex;
 
 void komodo_pricesupdate(int32_t height,CBlock *pblock)
 {
-    static int numprices; static uint32_t *ptr32; static int64_t *ptr64,*tmpbuf;
-    int32_t ind,offset,width; int64_t correlated,smoothed; uint64_t seed,rngval; uint32_t rawprices[KOMODO_MAXPRICES],buf[PRICES_MAXDATAPOINTS*2];
+    static int numprices; static int64_t *tmpbuf;
+    int32_t ind,offset,width; int64_t correlated,smoothed,*ptr64; uint64_t seed,rngval; uint32_t rawprices[KOMODO_MAXPRICES],buf[PRICES_MAXDATAPOINTS*2],*ptr32;
     width = PRICES_DAYWINDOW;//(2*PRICES_DAYWINDOW + PRICES_SMOOTHWIDTH);
     if ( numprices == 0 )
     {
         pthread_mutex_init(&pricemutex,0);
         numprices = (int32_t)(komodo_cbopretsize(ASSETCHAINS_CBOPRET) / sizeof(uint32_t));
-        ptr32 = (uint32_t *)calloc(sizeof(uint32_t),numprices * width);
-        ptr64 = (int64_t *)calloc(sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS);
         tmpbuf = (int64_t *)calloc(sizeof(int64_t),2*PRICES_DAYWINDOW);
-        fprintf(stderr,"prices update: numprices.%d %p %p\n",numprices,ptr32,ptr64);
+        fprintf(stderr,"prices update: numprices.%d\n",numprices);
     }
     if ( _komodo_heightpricebits(&seed,rawprices,pblock) == numprices )
     {
@@ -2656,14 +2803,13 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
         if ( PRICES[0].fp != 0 )
         {
             pthread_mutex_lock(&pricemutex);
-            fseek(PRICES[0].fp,height * numprices * sizeof(uint32_t),SEEK_SET);
-            if ( fwrite(rawprices,sizeof(uint32_t),numprices,PRICES[0].fp) != numprices )
+            prices_invalidatecache(height);
+            if ( komodo_pricewrite(0,height * numprices * sizeof(uint32_t),rawprices,numprices * sizeof(uint32_t)) == 0 )
                 fprintf(stderr,"error writing rawprices for ht.%d\n",height);
-            else fflush(PRICES[0].fp);
             if ( height > PRICES_DAYWINDOW )
             {
-                fseek(PRICES[0].fp,(height-width+1) * numprices * sizeof(uint32_t),SEEK_SET);
-                if ( fread(ptr32,sizeof(uint32_t),width*numprices,PRICES[0].fp) == width*numprices )
+                // the windows are read in place from the mappings
+                if ( (ptr32= (uint32_t *)komodo_pricerows(0,(height-width+1) * numprices * sizeof(uint32_t),width * numprices * sizeof(uint32_t))) != 0 )
                 {
                     rngval = seed;
                     for (ind=1; ind<numprices; ind++)
@@ -2677,26 +2823,22 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
                         rngval = (rngval*11109 + 13849);
                         if ( (correlated= komodo_pricecorrelated(rngval,ind,&ptr32[offset],-numprices,0,PRICES_SMOOTHWIDTH)) > 0 )
                         {
-                            fseek(PRICES[ind].fp,height * sizeof(int64_t) * PRICES_MAXDATAPOINTS,SEEK_SET);
                             memset(buf,0,sizeof(buf));
                             buf[0] = rawprices[ind];
                             buf[1] = rawprices[0]; // timestamp
                             memcpy(&buf[2],&correlated,sizeof(correlated));
-                            if ( fwrite(buf,1,sizeof(buf),PRICES[ind].fp) != sizeof(buf) )
+                            if ( komodo_pricewrite(ind,height * sizeof(int64_t) * PRICES_MAXDATAPOINTS,buf,sizeof(buf)) == 0 )
                                 fprintf(stderr,"error fwrite buf for ht.%d ind.%d\n",height,ind);
                             else if ( height > PRICES_DAYWINDOW*2 )
                             {
-                                fseek(PRICES[ind].fp,(height-PRICES_DAYWINDOW+1) * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
-                                if ( fread(ptr64,sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS,PRICES[ind].fp) == PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS )
+                                if ( (ptr64= (int64_t *)komodo_pricerows(ind,(height-PRICES_DAYWINDOW+1) * PRICES_MAXDATAPOINTS * sizeof(int64_t),PRICES_DAYWINDOW * PRICES_MAXDATAPOINTS * sizeof(int64_t))) != 0 )
                                 {
                                     if ( (smoothed= komodo_priceave(tmpbuf,&ptr64[(PRICES_DAYWINDOW-1)*PRICES_MAXDATAPOINTS+1],-PRICES_MAXDATAPOINTS)) > 0 )
                                     {
-                                        fseek(PRICES[ind].fp,(height * PRICES_MAXDATAPOINTS + 2) * sizeof(int64_t),SEEK_SET);
-                                        if ( fwrite(&smoothed,1,sizeof(smoothed),PRICES[ind].fp) != sizeof(smoothed) )
+                                        if ( komodo_pricewrite(ind,(height * PRICES_MAXDATAPOINTS + 2) * sizeof(int64_t),&smoothed,sizeof(smoothed)) == 0 )
                                             fprintf(stderr,"error fwrite smoothed for ht.%d ind.%d\n",height,ind);
-                                        else fflush(PRICES[ind].fp);
                                     } else fprintf(stderr,"error price_smoothed ht.%d ind.%d\n",height,ind);
-                                } else fprintf(stderr,"error fread ptr64 for ht.%d ind.%d\n",height,ind);
+                                } else fprintf(stderr,"error reading correlated prices for ht.%d ind.%d\n",height,ind);
                             }
                         } else fprintf(stderr,"error komodo_pricecorrelated for ht.%d ind.%d\n",height,ind);
                     }
@@ -2708,16 +2850,17 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
     } else fprintf(stderr,"numprices mismatch, height.%d\n",height);
 }
 
+// copies the rows out of the mapping of the file, concurrent readers do not wait on each other
 int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks)
 {
-    FILE *fp; int32_t retval = PRICES_MAXDATAPOINTS;
-    pthread_mutex_lock(&pricemutex);
-    if ( ind < KOMODO_MAXPRICES && (fp= PRICES[ind].fp) != 0 )
-    {
-        fseek(fp,height * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
-        if ( fread(buf64,sizeof(int64_t),numblocks*PRICES_MAXDATAPOINTS,fp) != numblocks*PRICES_MAXDATAPOINTS )
-            retval = -1;
-    }
-    pthread_mutex_unlock(&pricemutex);
-    return(retval);
+    size_t offset,len;
+    if ( ind < 0 || ind >= KOMODO_MAXPRICES || height < 0 || numblocks <= 0 )
+        return(-1);
+    offset = (size_t)height * PRICES_MAXDATAPOINTS * sizeof(int64_t);
+    len = (size_t)numblocks * PRICES_MAXDATAPOINTS * sizeof(int64_t);
+    boost::shared_lock<boost::shared_mutex> lock(pricemapmutex);
+    if ( PRICES[ind].region == 0 || offset + len > PRICES[ind].datalen )
+        return(-1);
+    memcpy(buf64,(const uint8_t *)PRICES[ind].region->get_address() + offset,len);
+    return(PRICES_MAXDATAPOINTS);
 }
@@ -185,6 +185,8 @@ int32_t komodo_priceind(const char *symbol);
 // returns price value which is in a 10% interval for more than 50% points for the preceding 24 hours
 int64_t komodo_pricecorrelated(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth);
 
+int64_t komodo_pricecorrelated_scalar(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth);
+
 int64_t _pairave64(int64_t valA,int64_t valB);
 
 int64_t _pairdiff64(register int64_t valA,register int64_t valB);
@@ -193,6 +195,18 @@ int64_t balanced_ave64(int64_t buf[],int32_t i,int32_t width);
 
 void buf_trioave64(int64_t dest[],int64_t src[],int32_t n);
 
+void buf_trioave64_scalar(int64_t dest[],int64_t src[],int32_t n);
+
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__)
+#define KOMODO_PRICES_AVX2
+// same results as the scalar kernels bit for bit, only to be run on cpus with AVX2
+int64_t komodo_pricecorrelated_avx2(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth);
+void buf_trioave64_avx2(int64_t dest[],int64_t src[],int32_t n);
+#endif
+
+// selects the kernels komodo_pricecorrelated and buf_trioave64 run, "avx2" or "scalar"
+std::string komodo_pricekernels_autodetect();
+
 void smooth64(int64_t dest[],int64_t src[],int32_t width,int32_t smoothiters);
 
 // http://www.holoborodko.com/pavel/numerical-methods/noise-robust-smoothing-filter/
@@ -0,0 +1,135 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+// AVX2 versions of the price kernels in komodo_gateway.cpp, built for the target per function
+// so the rest of the binary still runs on any x86_64 cpu
+#include "komodo.h"
+#include "komodo_extern_globals.h"
+
+#ifdef KOMODO_PRICES_AVX2
+#include <immintrin.h>
+#include <vector>
+
+// sum / nonz as balanced_ave64 does it, a constant divisor per case lets the compiler multiply instead
+static inline int64_t nonz_ave64(int64_t sum,int32_t nonz)
+{
+    switch ( nonz )
+    {
+        case 1: return(sum);
+        case 2: return(sum / 2);
+        case 3: return(sum / 3);
+        case 4: return(sum / 4);
+        case 5: return(sum / 5);
+        case 6: return(sum / 6);
+        case 7: return(sum / 7);
+        default: return(nonz != 0 ? sum / nonz : sum);
+    }
+}
+
+__attribute__((target("avx2")))
+void buf_trioave64_avx2(int64_t dest[],int64_t src[],int32_t n)
+{
+    int32_t i,j,k,width = 3; int64_t sums[4],zeros[4];
+    // the scalar kernel reads back what it wrote when they overlap
+    if ( (uintptr_t)dest < (uintptr_t)(src + n) && (uintptr_t)src < (uintptr_t)(dest + n) )
+    {
+        buf_trioave64_scalar(dest,src,n);
+        return;
+    }
+    for (i=0; i<128; i++)
+        src[i] = 0;
+    for (i=1; i<width; i++)
+        dest[i] = balanced_ave64(src,i,i);
+    // four windows at a time, null prices add nothing to the sum and are counted out of the divisor
+    const __m256i zero = _mm256_setzero_si256();
+    for (i=width; i+4<=n-width; i+=4)
+    {
+        __m256i sum = zero,nulls = zero;
+        for (j=-width; j<=width; j++)
+        {
+            __m256i price = _mm256_loadu_si256((const __m256i *)&src[i + j]);
+            sum = _mm256_add_epi64(sum,price);
+            nulls = _mm256_sub_epi64(nulls,_mm256_cmpeq_epi64(price,zero));
+        }
+        _mm256_storeu_si256((__m256i *)sums,sum);
+        _mm256_storeu_si256((__m256i *)zeros,nulls);
+        for (k=0; k<4; k++)
+            dest[i + k] = nonz_ave64(sums[k],2*width + 1 - (int32_t)zeros[k]);
+    }
+    for (; i<n-width; i++)
+        dest[i] = balanced_ave64(src,i,width);
+    dest[0] = _pairave64(dest[0],dest[1] - _pairdiff64(dest[2],dest[1]));
+    j = width-1;
+    for (i=n-width; i<n-1; i++,j--)
+        dest[i] = balanced_ave64(src,i,j);
+    if ( dest[n-3] != 0. && dest[n-2] != 0. )
+        dest[n-1] = ((2 * dest[n-2]) - dest[n-3]);
+    else dest[n-1] = 0;
+}
+
+/*
+ * Without a null price in the window the scan of the scalar kernel passes the
+ * half mark exactly when the whole window does, so each reference price only
+ * needs its count over the window, eight prices at a time. Windows with a null
+ * price and the weighted average into nonzprices depend on the order of the
+ * scan and are left to the scalar kernel.
+ */
+__attribute__((target("avx2")))
+int64_t komodo_pricecorrelated_avx2(uint64_t seed,int32_t ind,uint32_t *rawprices,int32_t rawskip,uint32_t *nonzprices,int32_t smoothwidth)
+{
+    int32_t i,j,iter,daywindow,outside,correlation,maxcorrelation=0; int64_t mult,refprice=0,lowprice=0,highprice=0; uint32_t counts[8];
+    if ( PRICES_DAYWINDOW < 2 || ind >= KOMODO_MAXPRICES || nonzprices != 0 )
+        return(komodo_pricecorrelated_scalar(seed,ind,rawprices,rawskip,nonzprices,smoothwidth));
+    daywindow = PRICES_DAYWINDOW;
+    std::vector<uint32_t> window(daywindow);
+    for (i=0; i<daywindow; i++)
+        if ( (window[i]= rawprices[i*rawskip]) == 0 )
+            return(komodo_pricecorrelated_scalar(seed,ind,rawprices,rawskip,nonzprices,smoothwidth));
+    mult = komodo_pricemult(ind);
+    // unsigned compares as signed ones with the sign bit flipped
+    const __m256i bias = _mm256_set1_epi32(0x80000000);
+    for (iter=0; iter<daywindow; iter++)
+    {
+        i = (iter + seed) % daywindow;
+        refprice = window[i];
+        highprice = (refprice * (COIN + PRICES_ERRORRATE*5)) / COIN;
+        lowprice = (refprice * (COIN - PRICES_ERRORRATE*5)) / COIN;
+        if ( highprice == refprice )
+            highprice++;
+        if ( lowprice == refprice )
+            lowprice--;
+        const __m256i low = _mm256_set1_epi32((uint32_t)lowprice ^ 0x80000000);
+        const __m256i high = _mm256_set1_epi32((uint32_t)(highprice < 0xffffffffLL ? highprice : 0xffffffffLL) ^ 0x80000000);
+        __m256i out = _mm256_setzero_si256();
+        for (j=0; j+8<=daywindow; j+=8)
+        {
+            __m256i price = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&window[j]),bias);
+            out = _mm256_sub_epi32(out,_mm256_or_si256(_mm256_cmpgt_epi32(low,price),_mm256_cmpgt_epi32(price,high)));
+        }
+        _mm256_storeu_si256((__m256i *)counts,out);
+        for (outside=0,i=0; i<8; i++)
+            outside += counts[i];
+        for (; j<daywindow; j++)
+            if ( window[j] < lowprice || window[j] > highprice )
+                outside++;
+        correlation = daywindow - outside;
+        if ( correlation > (daywindow>>1) )
+            return(refprice * mult);
+        if ( correlation > maxcorrelation )
+            maxcorrelation = correlation;
+    }
+    fprintf(stderr,"ind.%d iter.%d maxcorrelation.%d ref.%llu high.%llu low.%llu\n",ind,iter,maxcorrelation,(long long)refprice,(long long)highprice,(long long)lowprice);
+    return(0);
+}
+#endif
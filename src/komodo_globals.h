@@ -126,6 +126,7 @@ unsigned int MAX_BLOCK_SIGOPS = 20000;
 
 bool IS_KOMODO_TESTNODE;
 int32_t KOMODO_SNAPSHOT_INTERVAL; 
+int32_t KOMODO_PAYMENTSTOKENS_HEIGHT;
 CScript KOMODO_EARLYTXID_SCRIPTPUB;
 int32_t ASSETCHAINS_EARLYTXIDCONTRACT;
 int32_t ASSETCHAINS_STAKED_SPLIT_PERCENTAGE;
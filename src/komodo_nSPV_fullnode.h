@@ -22,6 +22,11 @@
 #include "notarisationdb.h"
 #include "rpc/server.h"
 
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <boost/thread.hpp>
+
 static std::map<std::string,bool> nspv_remote_commands =  {{"channelsopen", true},{"channelspayment", true},{"channelsclose", true},{"channelsrefund", true},
 {"channelslist", true},{"channelsinfo", true},{"oraclescreate", true},{"oraclesfund", true},{"oraclesregister", true},{"oraclessubscribe", true}, 
 {"oraclesdata", true},{"oraclesinfo", false},{"oracleslist", false},{"gatewaysbind", true},{"gatewaysdeposit", true},{"gatewaysclaim", true},{"gatewayswithdraw", true},
@@ -34,6 +39,158 @@ struct NSPV_ntzargs
     int32_t txidht,ntzheight;
 };
 
+// Response cache for the hot superlite queries. An entry is either tip sensitive (getinfo,
+// notarization brackets), valid only while the tip it was built on is the active tip, or
+// pinned to a height (ntz proofs, tx merkle proofs), valid while the block at that height
+// is unchanged. NSPV_cache_updatetip drops entries as soon as a block connects or
+// disconnects, lookups re-check the block hash so a racing reorg can never serve stale data.
+// Responses are built without cs_main, so an entry is only stored while the tip it was
+// built from is still the active tip; one built across a tip change is just not cached.
+
+struct NSPV_cacheentry
+{
+    std::vector<uint8_t> response;
+    uint256 blockhash;
+    int32_t height;
+    bool tipsensitive;
+    std::list<std::string>::iterator lru;
+};
+
+struct NSPV_cachestats
+{
+    uint64_t hits,misses,inserts,evictions,invalidations;
+};
+
+static const int32_t NSPV_CACHEENTRY_OVERHEAD = 128;
+static boost::mutex NSPV_cachemutex;
+static std::unordered_map<std::string,NSPV_cacheentry> NSPV_cache;
+static std::list<std::string> NSPV_cachelru; // most recently used first
+static struct NSPV_cachestats NSPV_cstats;
+static int64_t NSPV_cachebytes,NSPV_cachemaxbytes; // set by StartNSPVWorkers, nothing is cached before
+
+static int64_t NSPV_cacheentrysize(const std::string &key,const NSPV_cacheentry &entry)
+{
+    return(key.size() + entry.response.size() + NSPV_CACHEENTRY_OVERHEAD);
+}
+
+static void NSPV_cacheerase(std::unordered_map<std::string,NSPV_cacheentry>::iterator it)
+{
+    NSPV_cachebytes -= NSPV_cacheentrysize(it->first,it->second);
+    NSPV_cachelru.erase(it->second.lru);
+    NSPV_cache.erase(it);
+}
+
+// the active tip and the block at height, read under cs_main; block index entries are never
+// freed, so the fields of the returned pointer can be read after the lock is released
+static CBlockIndex *NSPV_chaintip()
+{
+    LOCK(cs_main);
+    return(chainActive.LastTip());
+}
+
+static CBlockIndex *NSPV_chainactive(int32_t height)
+{
+    LOCK(cs_main);
+    return(komodo_chainactive(height));
+}
+
+static int32_t NSPV_blockheight(uint256 hash)
+{
+    LOCK(cs_main);
+    return(komodo_blockheight(hash));
+}
+
+int32_t NSPV_cacheget(const std::vector<uint8_t> &request,std::vector<uint8_t> &response)
+{
+    CBlockIndex *pindex; std::string key(request.begin(),request.end());
+    LOCK(cs_main); // the validity check reads the active chain
+    boost::unique_lock<boost::mutex> lock(NSPV_cachemutex);
+    std::unordered_map<std::string,NSPV_cacheentry>::iterator it = NSPV_cache.find(key);
+    if ( it == NSPV_cache.end() )
+    {
+        NSPV_cstats.misses++;
+        return(0);
+    }
+    if ( (pindex= komodo_chainactive(it->second.height)) == 0 || pindex->GetBlockHash() != it->second.blockhash || (it->second.tipsensitive && it->second.height != chainActive.Height()) )
+    {
+        NSPV_cstats.invalidations++;
+        NSPV_cstats.misses++;
+        NSPV_cacheerase(it);
+        return(0);
+    }
+    NSPV_cachelru.splice(NSPV_cachelru.begin(),NSPV_cachelru,it->second.lru);
+    response = it->second.response;
+    NSPV_cstats.hits++;
+    return(1);
+}
+
+// pinheight < 0 ties the entry to the current tip, builttip is the tip the response was built from
+void NSPV_cacheput(const std::vector<uint8_t> &request,const std::vector<uint8_t> &response,int32_t pinheight,const CBlockIndex *builttip)
+{
+    CBlockIndex *pindex; std::string key(request.begin(),request.end()); NSPV_cacheentry entry;
+    LOCK(cs_main);
+    if ( builttip == 0 || builttip != chainActive.LastTip() )
+        return;
+    entry.tipsensitive = (pinheight < 0);
+    if ( (pindex= (entry.tipsensitive ? chainActive.LastTip() : komodo_chainactive(pinheight))) == 0 )
+        return;
+    entry.height = pindex->GetHeight();
+    entry.blockhash = pindex->GetBlockHash();
+    entry.response = response;
+    if ( NSPV_cacheentrysize(key,entry) > NSPV_cachemaxbytes / 8 )
+        return;
+    boost::unique_lock<boost::mutex> lock(NSPV_cachemutex);
+    std::unordered_map<std::string,NSPV_cacheentry>::iterator it = NSPV_cache.find(key);
+    if ( it != NSPV_cache.end() )
+        NSPV_cacheerase(it);
+    while ( NSPV_cachelru.empty() == 0 && NSPV_cachebytes + NSPV_cacheentrysize(key,entry) > NSPV_cachemaxbytes )
+    {
+        NSPV_cacheerase(NSPV_cache.find(NSPV_cachelru.back()));
+        NSPV_cstats.evictions++;
+    }
+    NSPV_cachelru.push_front(key);
+    entry.lru = NSPV_cachelru.begin();
+    NSPV_cachebytes += NSPV_cacheentrysize(key,entry);
+    NSPV_cache.insert(std::make_pair(key,entry));
+    NSPV_cstats.inserts++;
+}
+
+// called with cs_main held whenever the active tip changes, in either direction
+void NSPV_cache_updatetip(const CBlockIndex *pindex)
+{
+    int32_t height = (pindex != 0) ? pindex->GetHeight() : -1;
+    boost::unique_lock<boost::mutex> lock(NSPV_cachemutex);
+    for (std::unordered_map<std::string,NSPV_cacheentry>::iterator it = NSPV_cache.begin(); it != NSPV_cache.end(); )
+    {
+        std::unordered_map<std::string,NSPV_cacheentry>::iterator itErase = it++;
+        if ( itErase->second.tipsensitive || itErase->second.height > height )
+        {
+            NSPV_cstats.invalidations++;
+            NSPV_cacheerase(itErase);
+        }
+    }
+}
+
+UniValue NSPV_cachestats_json()
+{
+    UniValue result(UniValue::VOBJ); struct NSPV_cachestats stats; int64_t bytes,entries;
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_cachemutex);
+        stats = NSPV_cstats;
+        bytes = NSPV_cachebytes;
+        entries = NSPV_cache.size();
+    }
+    result.push_back(Pair("entries",entries));
+    result.push_back(Pair("bytes",bytes));
+    result.push_back(Pair("maxbytes",GetArg("-nspv_cachesize",DEFAULT_NSPV_CACHESIZE) << 20));
+    result.push_back(Pair("hits",(int64_t)stats.hits));
+    result.push_back(Pair("misses",(int64_t)stats.misses));
+    result.push_back(Pair("inserts",(int64_t)stats.inserts));
+    result.push_back(Pair("evictions",(int64_t)stats.evictions));
+    result.push_back(Pair("invalidations",(int64_t)stats.invalidations));
+    return(result);
+}
+
 int32_t NSPV_notarization_find(struct NSPV_ntzargs *args,int32_t height,int32_t dir)
 {
     int32_t ntzheight = 0; uint256 hashBlock; CTransaction tx; Notarisation nota; char *symbol; std::vector<uint8_t> opret;
@@ -77,12 +234,14 @@ int32_t NSPV_notarized_bracket(struct NSPV_ntzargs *prev,struct NSPV_ntzargs *ne
 int32_t NSPV_ntzextract(struct NSPV_ntz *ptr,uint256 ntztxid,int32_t txidht,uint256 desttxid,int32_t ntzheight)
 {
     CBlockIndex *pindex;
-    ptr->blockhash = *chainActive[ntzheight]->phashBlock;
+    if ( (pindex= NSPV_chainactive(ntzheight)) == 0 )
+        return(-1);
+    ptr->blockhash = pindex->GetBlockHash();
     ptr->height = ntzheight;
     ptr->txidheight = txidht;
     ptr->othertxid = desttxid;
     ptr->txid = ntztxid;
-    if ( (pindex= komodo_chainactive(ptr->txidheight)) != 0 )
+    if ( (pindex= NSPV_chainactive(ptr->txidheight)) != 0 )
         ptr->timestamp = pindex->nTime;
     return(0);
 }
@@ -90,7 +249,7 @@ int32_t NSPV_ntzextract(struct NSPV_ntz *ptr,uint256 ntztxid,int32_t txidht,uint
 int32_t NSPV_getntzsresp(struct NSPV_ntzsresp *ptr,int32_t origreqheight)
 {
     struct NSPV_ntzargs prev,next; int32_t reqheight = origreqheight;
-    if ( reqheight < chainActive.LastTip()->GetHeight() )
+    if ( reqheight < NSPV_chaintip()->GetHeight() )
         reqheight++;
     if ( NSPV_notarized_bracket(&prev,&next,reqheight) == 0 )
     {
@@ -112,7 +271,7 @@ int32_t NSPV_getntzsresp(struct NSPV_ntzsresp *ptr,int32_t origreqheight)
 int32_t NSPV_setequihdr(struct NSPV_equihdr *hdr,int32_t height)
 {
     CBlockIndex *pindex;
-    if ( (pindex= komodo_chainactive(height)) != 0 )
+    if ( (pindex= NSPV_chainactive(height)) != 0 )
     {
         hdr->nVersion = pindex->nVersion;
         if ( pindex->pprev == 0 )
@@ -123,7 +282,10 @@ int32_t NSPV_setequihdr(struct NSPV_equihdr *hdr,int32_t height)
         hdr->nTime = pindex->nTime;
         hdr->nBits = pindex->nBits;
         hdr->nNonce = pindex->nNonce;
-        memcpy(hdr->nSolution,&pindex->nSolution[0],sizeof(hdr->nSolution));
+        std::vector<unsigned char> solution;
+        if ( !pindex->GetSolution(solution) || solution.size() < sizeof(hdr->nSolution) )
+            return(-1);
+        memcpy(hdr->nSolution,&solution[0],sizeof(hdr->nSolution));
         return(sizeof(*hdr));
     }
     return(-1);
@@ -132,7 +294,7 @@ int32_t NSPV_setequihdr(struct NSPV_equihdr *hdr,int32_t height)
 int32_t NSPV_getinfo(struct NSPV_inforesp *ptr,int32_t reqheight)
 {
     int32_t prevMoMheight,len = 0; CBlockIndex *pindex, *pindex2; struct NSPV_ntzsresp pair;
-    if ( (pindex= chainActive.LastTip()) != 0 )
+    if ( (pindex= NSPV_chaintip()) != 0 )
     {
         ptr->height = pindex->GetHeight();
         ptr->blockhash = pindex->GetBlockHash();
@@ -140,7 +302,7 @@ int32_t NSPV_getinfo(struct NSPV_inforesp *ptr,int32_t reqheight)
         if ( NSPV_getntzsresp(&pair,ptr->height-1) < 0 )
             return(-1);
         ptr->notarization = pair.prevntz;
-        if ( (pindex2= komodo_chainactive(ptr->notarization.txidheight)) != 0 )
+        if ( (pindex2= NSPV_chainactive(ptr->notarization.txidheight)) != 0 )
             ptr->notarization.timestamp = pindex->nTime;
         //fprintf(stderr, "timestamp.%i\n", ptr->notarization.timestamp );
         if ( reqheight == 0 )
@@ -153,64 +315,116 @@ int32_t NSPV_getinfo(struct NSPV_inforesp *ptr,int32_t reqheight)
     } else return(-1);
 }
 
+// Paging cursors for the address queries. Both address indexes are sorted by key, so the
+// position of the n-th returned entry can be remembered as the (n-1)-th returned entry, key
+// and value. A client walking the pages sequentially then resumes with a seek instead of
+// re-reading every skipped entry. Only returned entries are counted, so the offset of a
+// cursor is the skipcount a client asks for after reading the pages before it, and a utxo
+// spent in the mempool between two pages does not shift the next one.
+// Cursors are tip sensitive, the indexes only change when a block connects or disconnects.
+
+static std::vector<uint8_t> NSPV_cursorkey(uint8_t resptype,char *coinaddr,bool isCC,int32_t offset)
+{
+    std::vector<uint8_t> key;
+    key.push_back(resptype);
+    key.push_back(isCC != 0);
+    key.resize(key.size() + sizeof(offset));
+    iguana_rwnum(1,&key[key.size() - sizeof(offset)],sizeof(offset),&offset);
+    key.insert(key.end(),coinaddr,coinaddr + strlen(coinaddr));
+    return(key);
+}
+
+template <typename K>
+static int32_t NSPV_cursorget(uint8_t resptype,char *coinaddr,bool isCC,int32_t offset,K &cursor)
+{
+    std::vector<uint8_t> data;
+    if ( offset <= 0 || NSPV_cacheget(NSPV_cursorkey(resptype,coinaddr,isCC,offset),data) == 0 )
+        return(0);
+    try
+    {
+        CDataStream ss(data,SER_DISK,CLIENT_VERSION);
+        ss >> cursor;
+    } catch (const std::exception &e) { return(0); }
+    return(1);
+}
+
+template <typename K>
+static void NSPV_cursorput(uint8_t resptype,char *coinaddr,bool isCC,int32_t offset,const K &cursor,const CBlockIndex *builttip)
+{
+    CDataStream ss(SER_DISK,CLIENT_VERSION);
+    ss << cursor;
+    NSPV_cacheput(NSPV_cursorkey(resptype,coinaddr,isCC,offset),std::vector<uint8_t>(ss.begin(),ss.end()),-1,builttip);
+}
+
 int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter)
 {
     int64_t total = 0,interest=0; uint32_t locktime; int32_t ind=0,tipheight,maxlen,txheight,n = 0,len = 0;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,isCC);
+    std::pair<CAddressUnspentKey, CAddressUnspentValue> cursor,last; bool resumed = false;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > page;
+    CBlockIndex *tip = NSPV_chaintip();
+    tipheight = tip->GetHeight();
     maxlen = MAX_BLOCK_SIZE(tipheight) - 512;
     maxlen /= sizeof(*ptr->utxos);
+    maxlen = std::min(maxlen,(int32_t)std::numeric_limits<uint16_t>::max()); // numutxos is serialized as uint16_t
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->filter = filter;
+    ptr->nodeheight = tipheight;
     if ( skipcount < 0 )
         skipcount = 0;
-    if ( (ptr->numutxos= (int32_t)unspentOutputs.size()) >= 0 && ptr->numutxos < maxlen )
+    if ( NSPV_cursorget(NSPV_UTXOSRESP,coinaddr,isCC,skipcount,cursor) != 0 )
     {
-        tipheight = chainActive.LastTip()->GetHeight();
-        ptr->nodeheight = tipheight;
-        if ( skipcount >= ptr->numutxos )
-            skipcount = ptr->numutxos-1;
-        ptr->skipcount = skipcount;
-        if ( ptr->numutxos-skipcount > 0 )
+        resumed = true;
+        n = skipcount;
+        last = cursor;
+    }
+    // stream the index and stop once the page is full, instead of loading every utxo of the address
+    if ( IterateCCunspents(coinaddr,isCC,resumed ? &cursor.first : 0,[&](const CAddressUnspentKey &key,const CAddressUnspentValue &value) {
+            // if gettxout is != null to handle mempool, spent ones are neither returned nor counted
+            if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,key.txhash,(int32_t)key.index) != 0 )
+                return(true);
+            if ( n >= skipcount )
+                page.push_back(std::make_pair(key,value));
+            last = std::make_pair(key,value);
+            n++;
+            return((int32_t)page.size() < maxlen);
+        }) == 0 )
+        n = 0;
+    if ( n > 0 && n <= skipcount )
+    {
+        // a skipcount past the end still returns the last utxo, a resumed cursor may have been spent since
+        skipcount = n - 1;
+        if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,last.first.txhash,(int32_t)last.first.index) == 0 )
+            page.push_back(last);
+    }
+    else if ( (int32_t)page.size() >= maxlen )
+        NSPV_cursorput(NSPV_UTXOSRESP,coinaddr,isCC,n,last,tip);
+    ptr->skipcount = skipcount;
+    if ( page.size() > 0 )
+    {
+        ptr->utxos = (struct NSPV_utxoresp *)calloc(page.size(),sizeof(*ptr->utxos));
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=page.begin(); it!=page.end(); it++)
         {
-            ptr->utxos = (struct NSPV_utxoresp *)calloc(ptr->numutxos-skipcount,sizeof(*ptr->utxos));
-            for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+            ptr->utxos[ind].txid = it->first.txhash;
+            ptr->utxos[ind].vout = (int32_t)it->first.index;
+            ptr->utxos[ind].satoshis = it->second.satoshis;
+            ptr->utxos[ind].height = it->second.blockHeight;
+            if ( ASSETCHAINS_SYMBOL[0] == 0 && it->second.satoshis >= 10*COIN )
             {
-                // if gettxout is != null to handle mempool
-                {
-                    if ( n >= skipcount && myIsutxo_spentinmempool(ignoretxid,ignorevin,it->first.txhash,(int32_t)it->first.index) == 0  )
-                    {
-                        ptr->utxos[ind].txid = it->first.txhash;
-                        ptr->utxos[ind].vout = (int32_t)it->first.index;
-                        ptr->utxos[ind].satoshis = it->second.satoshis;
-                        ptr->utxos[ind].height = it->second.blockHeight;
-                        if ( ASSETCHAINS_SYMBOL[0] == 0 && it->second.satoshis >= 10*COIN )
-                        {
-                            ptr->utxos[n].extradata = komodo_accrued_interest(&txheight,&locktime,ptr->utxos[ind].txid,ptr->utxos[ind].vout,ptr->utxos[ind].height,ptr->utxos[ind].satoshis,tipheight);
-                            interest += ptr->utxos[ind].extradata;
-                        }
-                        ind++;
-                        total += it->second.satoshis;
-                    }
-                    n++;
-                }
+                LOCK(cs_main);
+                ptr->utxos[ind].extradata = komodo_accrued_interest(&txheight,&locktime,ptr->utxos[ind].txid,ptr->utxos[ind].vout,ptr->utxos[ind].height,ptr->utxos[ind].satoshis,tipheight);
+                interest += ptr->utxos[ind].extradata;
             }
-        }
-        ptr->numutxos = ind;
-        if ( len < maxlen )
-        {
-            len = (int32_t)(sizeof(*ptr) + sizeof(*ptr->utxos)*ptr->numutxos - sizeof(ptr->utxos));
-            //fprintf(stderr,"getaddressutxos for %s -> n.%d:%d total %.8f interest %.8f len.%d\n",coinaddr,n,ptr->numutxos,dstr(total),dstr(interest),len);
-            ptr->total = total;
-            ptr->interest = interest;
-            return(len);
+            ind++;
+            total += it->second.satoshis;
         }
     }
-    if ( ptr->utxos != 0 )
-        free(ptr->utxos);
-    memset(ptr,0,sizeof(*ptr));
-    return(0);
+    ptr->numutxos = ind;
+    len = (int32_t)(sizeof(*ptr) + sizeof(*ptr->utxos)*ptr->numutxos - sizeof(ptr->utxos));
+    //fprintf(stderr,"getaddressutxos for %s -> n.%d:%d total %.8f interest %.8f len.%d\n",coinaddr,n,ptr->numutxos,dstr(total),dstr(interest),len);
+    ptr->total = total;
+    ptr->interest = interest;
+    return(len);
 }
 
 class BaseCCChecker {
@@ -333,7 +547,7 @@ int32_t NSPV_getccmoduleutxos(struct NSPV_utxosresp *ptr, char *coinaddr, int64_
     ptr->numutxos = 0;
     strncpy(ptr->coinaddr, coinaddr, sizeof(ptr->coinaddr) - 1);
     ptr->CCflag = 1;
-    tipheight = chainActive.LastTip()->GetHeight();  
+    tipheight = NSPV_chaintip()->GetHeight();
     ptr->nodeheight = tipheight; // will be checked in libnspv
     //}
    
@@ -438,49 +652,56 @@ int32_t NSPV_getccmoduleutxos(struct NSPV_utxosresp *ptr, char *coinaddr, int64_
 
 int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter)
 {
-    int32_t maxlen,txheight,ind=0,n = 0,len = 0; CTransaction tx; uint256 hashBlock;
-    std::vector<std::pair<CAddressIndexKey, CAmount> > txids;
-    SetCCtxids(txids,coinaddr,isCC);
-    ptr->nodeheight = chainActive.LastTip()->GetHeight();
+    int32_t maxlen,ind=0,n = 0,len = 0; std::pair<CAddressIndexKey, CAmount> cursor,last; bool resumed = false;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > page;
+    CBlockIndex *tip = NSPV_chaintip();
+    ptr->nodeheight = tip->GetHeight();
     maxlen = MAX_BLOCK_SIZE(ptr->nodeheight) - 512;
     maxlen /= sizeof(*ptr->txids);
+    maxlen = std::min(maxlen,(int32_t)std::numeric_limits<uint16_t>::max()); // numtxids is serialized as uint16_t
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->filter = filter;
     if ( skipcount < 0 )
         skipcount = 0;
-
-    if ( txids.size() <= std::numeric_limits<uint16_t>::max() &&
-         (ptr->numtxids = txids.size()) >= 0 && ptr->numtxids < maxlen )
+    if ( NSPV_cursorget(NSPV_TXIDSRESP,coinaddr,isCC,skipcount,cursor) != 0 )
+    {
+        resumed = true;
+        n = skipcount;
+        last = cursor;
+    }
+    if ( IterateCCtxids(coinaddr,isCC,resumed ? &cursor.first : 0,[&](const CAddressIndexKey &key,CAmount amount) {
+            if ( n >= skipcount )
+                page.push_back(std::make_pair(key,amount));
+            last = std::make_pair(key,amount);
+            n++;
+            return((int32_t)page.size() < maxlen);
+        }) == 0 )
+        n = 0;
+    if ( n > 0 && n <= skipcount )
+    {
+        // a skipcount past the end still returns the last entry
+        skipcount = n - 1;
+        page.push_back(last);
+    }
+    else if ( (int32_t)page.size() >= maxlen )
+        NSPV_cursorput(NSPV_TXIDSRESP,coinaddr,isCC,n,last,tip);
+    ptr->skipcount = skipcount;
+    if ( page.size() > 0 )
     {
-        if ( skipcount >= ptr->numtxids )
-            skipcount = ptr->numtxids-1;
-        ptr->skipcount = skipcount;
-        if ( ptr->numtxids-skipcount > 0 )
+        ptr->txids = (struct NSPV_txidresp *)calloc(page.size(),sizeof(*ptr->txids));
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=page.begin(); it!=page.end(); it++)
         {
-            ptr->txids = (struct NSPV_txidresp *)calloc(ptr->numtxids-skipcount,sizeof(*ptr->txids));
-            // TODO: make this loop optimal (!), probably with reverse iterator, to get only last needed N transactions
-            for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=txids.begin(); it!=txids.end(); it++)
-            {
-                if ( n >= skipcount )
-                {
-                    ptr->txids[ind].txid = it->first.txhash;
-                    ptr->txids[ind].vout = (int32_t)it->first.index;
-                    ptr->txids[ind].satoshis = (int64_t)it->second;
-                    ptr->txids[ind].height = (int64_t)it->first.blockHeight;
-                    ind++;
-                }
-                n++;
-            }
+            ptr->txids[ind].txid = it->first.txhash;
+            ptr->txids[ind].vout = (int32_t)it->first.index;
+            ptr->txids[ind].satoshis = (int64_t)it->second;
+            ptr->txids[ind].height = (int64_t)it->first.blockHeight;
+            ind++;
         }
-        ptr->numtxids = ind;
-        len = (int32_t)(sizeof(*ptr) + sizeof(*ptr->txids)*ptr->numtxids - sizeof(ptr->txids));
-        return(len);
     }
-    if ( ptr->txids != 0 )
-        free(ptr->txids);
-    memset(ptr,0,sizeof(*ptr));
-    return(0);
+    ptr->numtxids = ind;
+    len = (int32_t)(sizeof(*ptr) + sizeof(*ptr->txids)*ptr->numtxids - sizeof(ptr->txids));
+    return(len);
 }
 
 int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint256> &txids,char *coinaddr,bool isCC,uint8_t funcid,uint256 txid,int32_t vout)
@@ -624,7 +845,7 @@ int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint25
 int32_t NSPV_mempooltxids(struct NSPV_mempoolresp *ptr,char *coinaddr,uint8_t isCC,uint8_t funcid,uint256 txid,int32_t vout)
 {
     std::vector<uint256> txids; bits256 satoshis; uint256 tmp,tmpdest; int32_t i,len = 0;
-    ptr->nodeheight = chainActive.LastTip()->GetHeight();
+    ptr->nodeheight = NSPV_chaintip()->GetHeight();
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->txid = txid;
@@ -741,10 +962,14 @@ int32_t NSPV_sendrawtransaction(struct NSPV_broadcastresp *ptr,uint8_t *data,int
     ptr->retcode = 0;
     if ( NSPV_txextract(tx,data,n) == 0 )
     {
-        //LOCK(cs_main);
+        bool accepted;
         ptr->txid = tx.GetHash();
         //fprintf(stderr,"try to addmempool transaction %s\n",ptr->txid.GetHex().c_str());
-        if ( myAddtomempool(tx) != 0 )
+        {
+            LOCK(cs_main);
+            accepted = myAddtomempool(tx);
+        }
+        if ( accepted != 0 )
         {
             ptr->retcode = 1;
             //int32_t i;
@@ -760,7 +985,7 @@ int32_t NSPV_sendrawtransaction(struct NSPV_broadcastresp *ptr,uint8_t *data,int
 
 int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32_t height)
 {
-    int32_t flag = 0,len = 0; CTransaction _tx; uint256 hashBlock; CBlock block; CBlockIndex *pindex;
+    int32_t flag = 0,len = 0; CTransaction _tx; uint256 hashBlock; CBlock block; CBlockIndex *pindex,*tip = NSPV_chaintip();
     ptr->height = -1;
     if ( (ptr->tx= NSPV_getrawtx(_tx,hashBlock,&ptr->txlen,txid)) != 0 )
     {
@@ -768,11 +993,25 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
         ptr->vout = vout;
         ptr->hashblock = hashBlock;
         if ( height == 0 )
-            ptr->height = komodo_blockheight(hashBlock);
+            ptr->height = NSPV_blockheight(hashBlock);
         else
         {
             ptr->height = height;
-            if ( (pindex= komodo_chainactive(height)) != 0 && komodo_blockload(block,pindex) == 0 )
+            std::vector<uint8_t> proofkey,proof;
+            proofkey.push_back(NSPV_TXPROOFRESP);
+            proofkey.insert(proofkey.end(),txid.begin(),txid.end());
+            proofkey.resize(proofkey.size() + sizeof(height));
+            iguana_rwnum(1,&proofkey[proofkey.size() - sizeof(height)],sizeof(height),&height);
+            if ( NSPV_cacheget(proofkey,proof) != 0 )
+            {
+                ptr->txprooflen = (int32_t)proof.size();
+                if ( ptr->txprooflen > 0 )
+                {
+                    ptr->txproof = (uint8_t *)calloc(1,ptr->txprooflen);
+                    memcpy(ptr->txproof,&proof[0],ptr->txprooflen);
+                }
+            }
+            else if ( (pindex= NSPV_chainactive(height)) != 0 && komodo_blockload(block,pindex) == 0 )
             {
                 BOOST_FOREACH(const CTransaction&tx, block.vtx)
                 {
@@ -789,7 +1028,8 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
                     setTxids.insert(txid);
                     CMerkleBlock mb(block, setTxids);
                     ssMB << mb;
-                    std::vector<uint8_t> proof(ssMB.begin(), ssMB.end());
+                    proof.assign(ssMB.begin(), ssMB.end());
+                    NSPV_cacheput(proofkey,proof,height,tip);
                     ptr->txprooflen = (int32_t)proof.size();
                     //fprintf(stderr,"%s txproof.(%s)\n",txid.GetHex().c_str(),HexStr(proof).c_str());
                     if ( ptr->txprooflen > 0 )
@@ -801,6 +1041,7 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
                 }
             }
         }
+        LOCK(cs_main); // the coins view of the tip
         ptr->unspentvalue = CCgettxout(txid,vout,1,1);
     }
     return(sizeof(*ptr) - sizeof(ptr->tx) - sizeof(ptr->txproof) + ptr->txlen + ptr->txprooflen);
@@ -811,18 +1052,18 @@ int32_t NSPV_getntzsproofresp(struct NSPV_ntzsproofresp *ptr,uint256 prevntztxid
     int32_t i; uint256 hashBlock,bhash0,bhash1,desttxid0,desttxid1; CTransaction tx;
     ptr->prevtxid = prevntztxid;
     ptr->prevntz = NSPV_getrawtx(tx,hashBlock,&ptr->prevtxlen,ptr->prevtxid);
-    ptr->prevtxidht = komodo_blockheight(hashBlock);
+    ptr->prevtxidht = NSPV_blockheight(hashBlock);
     if ( NSPV_notarizationextract(0,&ptr->common.prevht,&bhash0,&desttxid0,tx) < 0 )
         return(-2);
-    else if ( komodo_blockheight(bhash0) != ptr->common.prevht )
+    else if ( NSPV_blockheight(bhash0) != ptr->common.prevht )
         return(-3);
     
     ptr->nexttxid = nextntztxid;
     ptr->nextntz = NSPV_getrawtx(tx,hashBlock,&ptr->nexttxlen,ptr->nexttxid);
-    ptr->nexttxidht = komodo_blockheight(hashBlock);
+    ptr->nexttxidht = NSPV_blockheight(hashBlock);
     if ( NSPV_notarizationextract(0,&ptr->common.nextht,&bhash1,&desttxid1,tx) < 0 )
         return(-5);
-    else if ( komodo_blockheight(bhash1) != ptr->common.nextht )
+    else if ( NSPV_blockheight(bhash1) != ptr->common.nextht )
         return(-6);
 
     else if ( ptr->common.prevht > ptr->common.nextht || (ptr->common.nextht - ptr->common.prevht) > 1440 )
@@ -873,13 +1114,19 @@ int32_t NSPV_getspentinfo(struct NSPV_spentinfo *ptr,uint256 txid,int32_t vout)
 void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
 {
     int32_t len,slen,ind,reqheight,n; std::vector<uint8_t> response; uint32_t timestamp = (uint32_t)time(NULL);
+    const CBlockIndex *tip = NSPV_chaintip(); // cached responses are tied to the tip they were built from
     if ( (len= request.size()) > 0 )
     {
         if ( (ind= request[0]>>1) >= sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes) )
             ind = (int32_t)(sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes)) - 1;
         if ( pfrom->prevtimes[ind] > timestamp )
             pfrom->prevtimes[ind] = 0;
-        if ( request[0] == NSPV_INFO ) // info
+        if ( (request[0] == NSPV_INFO || request[0] == NSPV_NTZS || request[0] == NSPV_NTZSPROOF) && timestamp > pfrom->prevtimes[ind] && NSPV_cacheget(request,response) != 0 )
+        {
+            pfrom->PushMessage("nSPV",response);
+            pfrom->prevtimes[ind] = timestamp;
+        }
+        else if ( request[0] == NSPV_INFO ) // info
         {
             //fprintf(stderr,"check info %u vs %u, ind.%d\n",timestamp,pfrom->prevtimes[ind],ind);
             if ( timestamp > pfrom->prevtimes[ind] )
@@ -900,6 +1147,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         //fprintf(stderr,"send info resp to id %d\n",(int32_t)pfrom->id);
                         pfrom->PushMessage("nSPV",response);
                         pfrom->prevtimes[ind] = timestamp;
+                        NSPV_cacheput(request,response,-1,tip);
                     }
                     NSPV_inforesp_purge(&I);
                 }
@@ -1041,6 +1289,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         {
                             pfrom->PushMessage("nSPV",response);
                             pfrom->prevtimes[ind] = timestamp;
+                            NSPV_cacheput(request,response,-1,tip);
                         }
                         NSPV_ntzsresp_purge(&N);
                     }
@@ -1066,6 +1315,8 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         {
                             pfrom->PushMessage("nSPV",response);
                             pfrom->prevtimes[ind] = timestamp;
+                            if ( P.prevtxidht > 0 && P.nexttxidht > 0 )
+                                NSPV_cacheput(request,response,std::max(P.nexttxidht,P.common.nextht),tip);
                         }
                         NSPV_ntzsproofresp_purge(&P);
                     } else fprintf(stderr,"err.%d\n",slen);
@@ -1230,4 +1481,152 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
     }
 }
 
+// getnSPV requests are answered by a pool of worker threads (-nspv_threads) so that
+// address index scans, block reads and mempool walks do not block the message handler.
+// A request holds only the cs_nSPV of its peer, so requests from different peers run in
+// parallel. Handlers take cs_main briefly to read the tip, a height or a mapBlockIndex entry
+// (NSPV_chaintip, NSPV_chainactive, NSPV_blockheight) and for the coins view and mempool
+// accept; the address and spent index scans, block reads and mempool walks run without it.
+// With -nspv_threads=0 requests are still answered inline on the message thread.
+
+struct NSPV_queuedreq
+{
+    CNode *pfrom;
+    std::vector<uint8_t> request;
+    int64_t queuedtime;
+};
+
+struct NSPV_queuestats
+{
+    uint64_t queued,processed,droppedfull,droppedpeer,droppeddisconnected;
+    int64_t waitmicros,servicemicros,maxwaitmicros,maxservicemicros;
+    int32_t maxdepth;
+};
+
+static boost::mutex NSPV_queuemutex;
+static boost::condition_variable NSPV_queuecond;
+static std::deque<NSPV_queuedreq> NSPV_requests;
+static struct NSPV_queuestats NSPV_qstats;
+static int32_t NSPV_numworkers,NSPV_maxqueue = DEFAULT_NSPV_QUEUE,NSPV_maxpeerqueue = DEFAULT_NSPV_PEER_QUEUE;
+
+void komodo_nSPVreq_queue(CNode *pfrom,std::vector<uint8_t> &request)
+{
+    if ( NSPV_numworkers == 0 )
+    {
+        LOCK(pfrom->cs_nSPV);
+        komodo_nSPVreq(pfrom,request);
+        return;
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_queuemutex);
+        if ( NSPV_requests.size() >= (size_t)NSPV_maxqueue )
+        {
+            NSPV_qstats.droppedfull++;
+            LogPrint("nspv","nSPV request queue full (%d), dropping request %d from peer=%d\n",(int32_t)NSPV_requests.size(),request.size() > 0 ? request[0] : -1,pfrom->id);
+            return;
+        }
+        if ( pfrom->nSPVqueued >= NSPV_maxpeerqueue )
+        {
+            NSPV_qstats.droppedpeer++;
+            LogPrint("nspv","peer=%d has %d nSPV requests queued, dropping request\n",pfrom->id,pfrom->nSPVqueued);
+            return;
+        }
+        NSPV_queuedreq item;
+        item.pfrom = pfrom->AddRef();
+        item.request.swap(request);
+        item.queuedtime = GetTimeMicros();
+        NSPV_requests.push_back(item);
+        pfrom->nSPVqueued++;
+        NSPV_qstats.queued++;
+        if ( (int32_t)NSPV_requests.size() > NSPV_qstats.maxdepth )
+            NSPV_qstats.maxdepth = (int32_t)NSPV_requests.size();
+    }
+    NSPV_queuecond.notify_one();
+}
+
+void ThreadNSPVWorker()
+{
+    RenameThread("komodo-nspv");
+    while ( true )
+    {
+        NSPV_queuedreq item; int64_t starttime,waited,elapsed;
+        {
+            boost::unique_lock<boost::mutex> lock(NSPV_queuemutex);
+            while ( NSPV_requests.empty() )
+                NSPV_queuecond.wait(lock); // interruption point
+            item = NSPV_requests.front();
+            NSPV_requests.pop_front();
+        }
+        starttime = GetTimeMicros();
+        waited = starttime - item.queuedtime;
+        if ( item.pfrom->fDisconnect == false )
+        {
+            LOCK(item.pfrom->cs_nSPV);
+            komodo_nSPVreq(item.pfrom,item.request);
+        }
+        elapsed = GetTimeMicros() - starttime;
+        {
+            boost::unique_lock<boost::mutex> lock(NSPV_queuemutex);
+            if ( item.pfrom->fDisconnect != false )
+                NSPV_qstats.droppeddisconnected++;
+            item.pfrom->nSPVqueued--;
+            item.pfrom->Release();
+            NSPV_qstats.processed++;
+            NSPV_qstats.waitmicros += waited;
+            NSPV_qstats.servicemicros += elapsed;
+            if ( waited > NSPV_qstats.maxwaitmicros )
+                NSPV_qstats.maxwaitmicros = waited;
+            if ( elapsed > NSPV_qstats.maxservicemicros )
+                NSPV_qstats.maxservicemicros = elapsed;
+        }
+        boost::this_thread::interruption_point();
+    }
+}
+
+void StartNSPVWorkers(boost::thread_group &threadGroup)
+{
+    NSPV_numworkers = (int32_t)GetArg("-nspv_threads",DEFAULT_NSPV_THREADS);
+    NSPV_maxqueue = (int32_t)GetArg("-nspv_maxqueue",DEFAULT_NSPV_QUEUE);
+    NSPV_maxpeerqueue = (int32_t)GetArg("-nspv_maxpeerqueue",DEFAULT_NSPV_PEER_QUEUE);
+    if ( NSPV_maxqueue < 1 )
+        NSPV_maxqueue = 1;
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_cachemutex);
+        NSPV_cachemaxbytes = std::max((int64_t)0,GetArg("-nspv_cachesize",DEFAULT_NSPV_CACHESIZE)) << 20;
+    }
+    if ( NSPV_numworkers < 0 )
+        NSPV_numworkers = 0;
+    else if ( NSPV_numworkers > MAX_NSPV_THREADS )
+        NSPV_numworkers = MAX_NSPV_THREADS;
+    LogPrintf("Using %d threads for nSPV requests, queue depth %d, %d per peer\n",NSPV_numworkers,NSPV_maxqueue,NSPV_maxpeerqueue);
+    for (int32_t i=0; i<NSPV_numworkers; i++)
+        threadGroup.create_thread(&ThreadNSPVWorker);
+}
+
+UniValue NSPV_serverstats()
+{
+    UniValue result(UniValue::VOBJ); struct NSPV_queuestats stats; int32_t depth;
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_queuemutex);
+        stats = NSPV_qstats;
+        depth = (int32_t)NSPV_requests.size();
+    }
+    result.push_back(Pair("threads",NSPV_numworkers));
+    result.push_back(Pair("maxqueue",NSPV_maxqueue));
+    result.push_back(Pair("maxpeerqueue",NSPV_maxpeerqueue));
+    result.push_back(Pair("depth",depth));
+    result.push_back(Pair("maxdepth",stats.maxdepth));
+    result.push_back(Pair("queued",(int64_t)stats.queued));
+    result.push_back(Pair("processed",(int64_t)stats.processed));
+    result.push_back(Pair("dropped_queuefull",(int64_t)stats.droppedfull));
+    result.push_back(Pair("dropped_peerlimit",(int64_t)stats.droppedpeer));
+    result.push_back(Pair("dropped_disconnected",(int64_t)stats.droppeddisconnected));
+    result.push_back(Pair("avgwait_us",stats.processed != 0 ? stats.waitmicros / (int64_t)stats.processed : 0));
+    result.push_back(Pair("maxwait_us",stats.maxwaitmicros));
+    result.push_back(Pair("avgservice_us",stats.processed != 0 ? stats.servicemicros / (int64_t)stats.processed : 0));
+    result.push_back(Pair("maxservice_us",stats.maxservicemicros));
+    result.push_back(Pair("cache",NSPV_cachestats_json()));
+    return(result);
+}
+
 #endif // KOMODO_NSPVFULLNODE_H
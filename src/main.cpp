@@ -26,6 +26,9 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "batonsdb.h"
+#include "blockencodings.h"
+#include "cc/evalstats.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -37,9 +40,12 @@
 #include "merkleblock.h"
 #include "metrics.h"
 #include "notarisationdb.h"
+#include "oraclesdb.h"
+#include "pricesdb.h"
 #include "net.h"
 #include "pow.h"
 #include "script/interpreter.h"
+#include "tokensdb.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -64,6 +70,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/math/distributions/poisson.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/static_assert.hpp>
 
@@ -109,6 +116,7 @@ bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = true;
+bool fCompactBlocks = DEFAULT_COMPACT_BLOCKS;
 bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -272,6 +280,9 @@ namespace {
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
+    /** Peers asked to announce new blocks with a cmpctblock, oldest first. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
@@ -326,6 +337,8 @@ namespace {
         int nBlocksInFlightValidHeaders;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! The compact block waiting for the transactions requested with getblocktxn.
+        boost::shared_ptr<PartiallyDownloadedBlock> partialBlock;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -399,6 +412,7 @@ namespace {
         mapBlocksInFlight.erase(entry.hash);
         EraseOrphansFor(nodeid);
         nPreferredDownload -= state->fPreferredDownload;
+        lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
         mapNodeState.erase(nodeid);
     }
@@ -644,6 +658,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CCoinsViewFlushOverlay *pcoinsoverlay = NULL;
 
 // Komodo globals
 
@@ -2153,8 +2168,10 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (!fSpentIndex)
         return false;
 
-    if (mempool.getSpentIndex(key, value))
+    if (mempool.getSpentIndex(key, value)) {
+        nCCSpentLookups++;
         return true;
+    }
 
     if (!pblocktree->ReadSpentIndex(key, value))
         return false;
@@ -2186,6 +2203,30 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pAfter,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressIndex(addressHash, type, start, end, pAfter, visitor))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ScanAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey *pAfter,
+                        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &visitor)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressUnspentIndex(addressHash, type, pAfter, visitor))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
 struct CompareBlocksByHeightMain
 {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -2231,6 +2272,7 @@ bool myAddtomempool(CTransaction &tx, CValidationState *pstate, bool fSkipExpiry
 bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
 {
     memset(&hashBlock,0,sizeof(hashBlock));
+    nCCTxFetches++;
     if ( KOMODO_NSPV_SUPERLITE )
     {
         int64_t rewardsum = 0; int32_t i,retval,txheight,currentheight,height=0,vout = 0;
@@ -2924,9 +2966,10 @@ bool ContextualCheckInputs(
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
-                // Verify signature
+                // Verify signature. CC inputs go to the check threads only when
+                // their validators are reentrant, the others run here under cs_main
                 CScriptCheck check(*coins, tx, i, flags, cacheStore, consensusBranchId, &txdata);
-                if (pvChecks) {
+                if (pvChecks && (!coins->vout[prevout.n].scriptPubKey.IsPayToCryptoCondition() || IsReentrantCCInput(tx.vin[i].scriptSig))) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
                 } else if (!check()) {
@@ -3170,6 +3213,137 @@ int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnout
     return keyType;
 }
 
+namespace {
+    /** Optional indexes being built by ThreadIndexRebuild, guarded by cs_main */
+    bool vIndexRebuild[MAX_BLOCKTREE_INDEXES];
+    /**
+     * Block of chainActive up to which the indexes being built are complete, NULL until
+     * the build starts. Blocks connected on top of it or disconnected from it keep the
+     * indexes in step, so it always stays on chainActive.
+     */
+    CBlockIndex *pindexIndexRebuilt = NULL;
+
+    const char* const vIndexNames[MAX_BLOCKTREE_INDEXES] = { "addressindex", "spentindex", "timestampindex" };
+    bool* const vIndexEnabled[MAX_BLOCKTREE_INDEXES] = { &fAddressIndex, &fSpentIndex, &fTimestampIndex };
+}
+
+static void AddOutputIndexEntries(const CTransaction& tx, int nTx, int nHeight, bool fDisconnect, CBlockIndexEntries& entries)
+{
+    const uint256 txhash = tx.GetHash();
+    for (unsigned int n = 0; n < tx.vout.size(); n++) {
+        unsigned int k = fDisconnect ? tx.vout.size() - 1 - n : n;
+        const CTxOut &out = tx.vout[k];
+
+        vector<vector<unsigned char>> vSols;
+        CTxDestination vDest;
+        txnouttype txType = TX_PUBKEYHASH;
+        int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+        if ( keyType != 0 )
+        {
+            for (auto addr : vSols)
+            {
+                uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                // record receiving activity
+                entries.addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, nHeight, nTx, txhash, k, false), out.nValue));
+                // record or remove the unspent output
+                entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k),
+                    fDisconnect ? CAddressUnspentValue() : CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+            }
+        }
+    }
+}
+
+static bool AddInputIndexEntries(const CTransaction& tx, const CTxUndo& txundo, int nTx, int nHeight, bool fAddress, bool fSpent,
+                                 bool fDisconnect, CBlockIndexEntries& entries)
+{
+    const uint256 txhash = tx.GetHash();
+    // the burn input of a pegs import spends nothing
+    unsigned int nSkip = tx.IsPegsImport() ? 1 : 0;
+    if (txundo.vprevout.size() + nSkip != tx.vin.size())
+        return false;
+    for (unsigned int n = 0; n < tx.vin.size(); n++) {
+        unsigned int j = fDisconnect ? tx.vin.size() - 1 - n : n;
+        if (j < nSkip)
+            continue;
+        const CTxIn &input = tx.vin[j];
+        const CTxInUndo &undo = txundo.vprevout[j - nSkip];
+        const CTxOut &prevout = undo.txout;
+
+        vector<vector<unsigned char>> vSols;
+        CTxDestination vDest;
+        txnouttype txType = TX_PUBKEYHASH;
+        uint160 addrHash;
+        int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+        if ( keyType != 0 )
+        {
+            for (auto addr : vSols)
+            {
+                addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                if (!fAddress)
+                    continue;
+                // record or undo spending activity
+                entries.addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, nHeight, nTx, txhash, j, true), prevout.nValue * -1));
+                // remove or restore the unspent output
+                entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n),
+                    fDisconnect ? CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight) : CAddressUnspentValue()));
+            }
+
+            if (fSpent) {
+                // add the spent index to determine the txid and input that spent an output
+                // and to find the amount and address from an input
+                entries.spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n),
+                    fDisconnect ? CSpentIndexValue() : CSpentIndexValue(txhash, j, nHeight, prevout.nValue, keyType, addrHash)));
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Entries of the address and spent indexes for connecting or disconnecting a block,
+ * taken from the block and its undo data. Disconnecting walks the transactions in
+ * reverse so that an output created and spent in the same block ends up unindexed.
+ */
+static bool GetBlockIndexEntries(const CBlock& block, const CBlockUndo& blockUndo, const CBlockIndex* pindex,
+                                 bool fAddress, bool fSpent, bool fDisconnect, CBlockIndexEntries& entries)
+{
+    entries.fEraseAddressIndex = fDisconnect;
+    if (!fAddress && !fSpent)
+        return true;
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return false;
+    for (unsigned int n = 0; n < block.vtx.size(); n++) {
+        unsigned int i = fDisconnect ? block.vtx.size() - 1 - n : n;
+        const CTransaction &tx = block.vtx[i];
+        if (fDisconnect && fAddress)
+            AddOutputIndexEntries(tx, i, pindex->GetHeight(), true, entries);
+        if (!tx.IsMint() && !AddInputIndexEntries(tx, blockUndo.vtxundo[i-1], i, pindex->GetHeight(), fAddress, fSpent, fDisconnect, entries))
+            return false;
+        if (!fDisconnect && fAddress)
+            AddOutputIndexEntries(tx, i, pindex->GetHeight(), false, entries);
+    }
+    return true;
+}
+
+/** The logical timestamp of a block is its time, moved past the one of its parent if needed */
+static void GetTimestampIndexEntry(const CBlockIndex* pindex, CBlockIndexEntries& entries)
+{
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+
+    // retrieve logical timestamp of the previous block
+    if (pindex->pprev)
+        if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+            LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+    if (logicalTS <= prevLogicalTS) {
+        logicalTS = prevLogicalTS + 1;
+        LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
+    }
+    entries.fTimestampIndex = true;
+    entries.timestampIndex = CTimestampIndexKey(logicalTS, pindex->GetBlockHash());
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -3188,34 +3362,19 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    // a background build of the indexes follows the chain back down as well
+    bool fRebuildFollows = pindexIndexRebuilt != NULL && pindexIndexRebuilt == pindex;
+    bool fAddress = fAddressIndex || (fRebuildFollows && vIndexRebuild[ADDRESS_INDEX]);
+    bool fSpent = fSpentIndex || (fRebuildFollows && vIndexRebuild[SPENT_INDEX]);
+    CBlockIndexEntries indexEntries;
+    if (!pfClean && !GetBlockIndexEntries(block, blockUndo, pindex, fAddress, fSpent, true, indexEntries))
+        return error("DisconnectBlock(): transaction and undo data inconsistent");
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
-        if (fAddressIndex) {
-
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-
-                vector<vector<unsigned char>> vSols;
-                CTxDestination vDest;
-                txnouttype txType = TX_PUBKEYHASH;
-                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
-                if ( keyType != 0 )
-                {
-                    for (auto addr : vSols)
-                    {
-                        uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, hash, k, false), out.nValue));
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, hash, k), CAddressUnspentValue()));
-                    }
-                }
-            }
-        }
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
@@ -3251,33 +3410,6 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
-
-                const CTxIn input = tx.vin[j];
-
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
-
-                if (fAddressIndex) {
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // undo spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, hash, j, true), prevout.nValue * -1));
-                            // restore unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-                        }
-                    }
-                }
             }
         }
         else if (tx.IsCoinImport() || tx.IsPegsImport())
@@ -3308,14 +3440,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to delete address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
+    if (!pblocktree->WriteIndexEntries(indexEntries))
+        return AbortNode(state, "Failed to write address or spent index");
+    if (fRebuildFollows)
+        pindexIndexRebuilt = pindex->pprev;
 
     return fClean;
 }
@@ -3352,6 +3480,192 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+// With -trustblockindex the header hashes are not checked while loading the block index,
+// this re-checks every entry loaded at startup once the node is running.
+void ThreadVerifyBlockIndex()
+{
+    RenameThread("komodo-verifyidx");
+    std::vector<CBlockIndex*> vIndexes;
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK(cs_main);
+        vIndexes.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+            if (item.second != NULL)
+                vIndexes.push_back(item.second);
+    }
+    // header fields of an index entry never change once it is loaded, so no lock is needed to hash them,
+    // the solutions kept in memory for this check are released in batches afterwards
+    static const size_t nTrimBatch = 1000;
+    for (size_t i = 0; i < vIndexes.size(); i += nTrimBatch)
+    {
+        size_t nEnd = std::min(vIndexes.size(), i + nTrimBatch);
+        for (size_t j = i; j < nEnd; j++)
+        {
+            boost::this_thread::interruption_point();
+            CBlockHeader header;
+            if (!vIndexes[j]->GetBlockHeader(header) || header.GetHash() != vIndexes[j]->GetBlockHash())
+            {
+                AbortNode(strprintf("%s: block header inconsistency detected: %s", __func__, vIndexes[j]->ToString()),
+                          _("Corrupted block database detected. Please restart with -reindex."));
+                return;
+            }
+        }
+        LOCK(cs_main);
+        for (size_t j = i; j < nEnd; j++)
+            if (setDirtyBlockIndex.count(vIndexes[j]) == 0)
+                vIndexes[j]->TrimSolution();
+    }
+    LogPrintf("%s: verified %u block index entries in %.2fs\n", __func__, (unsigned int)vIndexes.size(), 0.000001 * (GetTimeMicros() - nTimeStart));
+}
+
+/** Give up on building the indexes, they stay off until the next start */
+static void StopIndexRebuild(const std::string& strReason)
+{
+    AssertLockHeld(cs_main);
+    LogPrintf("Building the indexes stopped: %s\n", strReason);
+    for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++)
+        vIndexRebuild[i] = false;
+    pindexIndexRebuilt = NULL;
+}
+
+/**
+ * Build the indexes in vIndexRebuild from the block and undo files, one block at a
+ * time along chainActive while the node keeps running. The indexes are switched on
+ * once the build reaches the tip; an interrupted build starts over on the next start.
+ */
+void static ThreadIndexRebuild()
+{
+    RenameThread("komodo-indexbuild");
+    int64_t nTimeStart = GetTimeMillis();
+    bool vWipe[MAX_BLOCKTREE_INDEXES];
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++)
+            vWipe[i] = vIndexRebuild[i];
+    }
+    // entries left by an interrupted build or from before the index was switched off
+    for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++) {
+        if (vWipe[i] && !pblocktree->WipeIndex((BlockTreeIndex)i)) {
+            LOCK(cs_main);
+            StopIndexRebuild(strprintf("unable to wipe %s", vIndexNames[i]));
+            return;
+        }
+    }
+    {
+        // the genesis block is not connected, it has no entries
+        LOCK(cs_main);
+        pindexIndexRebuilt = chainActive.Genesis();
+        if (pindexIndexRebuilt == NULL) {
+            StopIndexRebuild("no genesis block");
+            return;
+        }
+    }
+
+    int nBlocks = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+        CBlockIndex *pindex;
+        int nHeight;
+        CDiskBlockPos blockPos, undoPos;
+        uint256 hashPrev;
+        {
+            LOCK(cs_main);
+            pindex = chainActive.Next(pindexIndexRebuilt);
+            if (pindex == NULL) {
+                std::string strIndexes;
+                for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++) {
+                    if (vIndexRebuild[i]) {
+                        *vIndexEnabled[i] = true;
+                        pblocktree->WriteFlag(vIndexNames[i], true);
+                        if (KOMODO_NSPV == 0 && i == ADDRESS_INDEX)
+                            nLocalServices |= NODE_ADDRINDEX;
+                        if (KOMODO_NSPV == 0 && i == SPENT_INDEX)
+                            nLocalServices |= NODE_SPENTINDEX;
+                        strIndexes += (strIndexes.empty() ? "" : ", ") + std::string(vIndexNames[i]);
+                        vIndexRebuild[i] = false;
+                    }
+                }
+                pindexIndexRebuilt = NULL;
+                LogPrintf("%s: built %s over %d blocks in %.2fs\n", __func__, strIndexes, nBlocks, 0.001 * (GetTimeMillis() - nTimeStart));
+                return;
+            }
+            nHeight = pindex->GetHeight();
+            blockPos = pindex->GetBlockPos();
+            undoPos = pindex->GetUndoPos();
+            hashPrev = pindex->pprev->GetBlockHash();
+        }
+
+        // block and undo files are only appended to, they are read without the lock
+        CBlock block;
+        CBlockUndo blockUndo;
+        bool fRead = ReadBlockFromDisk(nHeight, block, blockPos, false) && UndoReadFromDisk(blockUndo, undoPos, hashPrev);
+
+        LOCK(cs_main);
+        if (!fRead) {
+            StopIndexRebuild(strprintf("unable to read block %s or its undo data", pindex->GetBlockHash().ToString()));
+            return;
+        }
+        // a reorganisation moved the chain since the block was read
+        if (chainActive.Next(pindexIndexRebuilt) != pindex)
+            continue;
+        CBlockIndexEntries entries;
+        if (!GetBlockIndexEntries(block, blockUndo, pindex, vIndexRebuild[ADDRESS_INDEX], vIndexRebuild[SPENT_INDEX], false, entries)) {
+            StopIndexRebuild(strprintf("block %s and its undo data are inconsistent", pindex->GetBlockHash().ToString()));
+            return;
+        }
+        if (vIndexRebuild[TIMESTAMP_INDEX])
+            GetTimestampIndexEntry(pindex, entries);
+        bool fWritten = false;
+        try {
+            fWritten = pblocktree->WriteIndexEntries(entries);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (!fWritten) {
+            StopIndexRebuild("unable to write the index databases");
+            return;
+        }
+        pindexIndexRebuilt = pindex;
+        if (++nBlocks % 10000 == 0)
+            LogPrintf("Building indexes: height %d of %d\n", nHeight, chainActive.Height());
+    }
+}
+
+bool StartIndexRebuild(boost::thread_group &threadGroup, std::string &strError)
+{
+    bool vRequested[MAX_BLOCKTREE_INDEXES];
+    vRequested[ADDRESS_INDEX] = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    vRequested[SPENT_INDEX] = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    vRequested[TIMESTAMP_INDEX] = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+
+    LOCK(cs_main);
+    std::string strIndexes;
+    for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++) {
+        vIndexRebuild[i] = vRequested[i] && !*vIndexEnabled[i];
+        if (vIndexRebuild[i])
+            strIndexes += (strIndexes.empty() ? "-" : ", -") + std::string(vIndexNames[i]);
+    }
+    if (strIndexes.empty())
+        return true;
+    if (fHavePruned || fPruneMode) {
+        for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++)
+            vIndexRebuild[i] = false;
+        strError = strprintf(_("You need to rebuild the database using -reindex to enable %s on a pruned node"), strIndexes);
+        return false;
+    }
+    // contracts validate against these two, init reindexes to switch them on
+    if (ASSETCHAINS_CC != 0 && (vIndexRebuild[ADDRESS_INDEX] || vIndexRebuild[SPENT_INDEX])) {
+        for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++)
+            vIndexRebuild[i] = false;
+        strError = _("You need to rebuild the database using -reindex to enable -addressindex or -spentindex on a chain with contracts");
+        return false;
+    }
+    LogPrintf("Building %s in the background, the index RPCs are available once it reaches the tip\n", strIndexes);
+    threadGroup.create_thread(&ThreadIndexRebuild);
+    return true;
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -3562,6 +3876,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    ResetCCBlockEvalStats();
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3573,9 +3888,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_sprout_tree_root = view.GetBestAnchor(SPROUT);
@@ -3607,7 +3919,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
-        const uint256 txhash = tx.GetHash();
         nInputs += tx.vin.size();
         nSigOps += GetLegacySigOpCount(tx);
         if (nSigOps > MAX_BLOCK_SIGOPS)
@@ -3627,39 +3938,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("ConnectBlock(): JoinSplit requirements not met"),
                                  REJECT_INVALID, "bad-txns-joinsplit-requirements-not-met");
 
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) 
-                {
-                    if (tx.IsPegsImport() && j==0) continue;
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    uint160 addrHash;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // record spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, txhash, j, true), prevout.nValue * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                        }
-
-                        if (fSpentIndex) {
-                            // add the spent index to determine the txid and input that spent an output
-                            // and to find the amount and address from an input
-                            spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->GetHeight(), prevout.nValue, keyType, addrHash)));
-                        }
-                    }
-                }
-            }
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -3699,31 +3977,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                uint160 addrHash;
-
-                vector<vector<unsigned char>> vSols;
-                CTxDestination vDest;
-                txnouttype txType = TX_PUBKEYHASH;
-                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
-                if ( keyType != 0 )
-                {
-                    for (auto addr : vSols)
-                    {
-                        addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        // record receiving activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, txhash, k, false), out.nValue));
-
-                        // record unspent output
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->GetHeight())));
-                    }
-                }
-            }
-        }
-
         //if ( ASSETCHAINS_SYMBOL[0] == 0 )
         //    komodo_earned_interest(pindex->GetHeight(),sum);
         CTxUndo undoDummy;
@@ -3750,8 +4003,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     
     // This is moved from CheckBlock for staking chains, so we can enforce the staking tx value was indeed paid to the coinbase.
     //fprintf(stderr, "blockReward.%li stakeTxValue.%li sum.%li\n",blockReward,stakeTxValue,sum);
-    if ( ASSETCHAINS_STAKED != 0 && fCheckPOW && komodo_checkPOW(blockReward+stakeTxValue-notarypaycheque,1,(CBlock *)&block,pindex->GetHeight()) < 0 ) 
-        return state.DoS(100, error("ConnectBlock: ac_staked chain failed slow komodo_checkPOW"),REJECT_INVALID, "failed-slow_checkPOW");
+    if ( ASSETCHAINS_STAKED != 0 && fCheckPOW )
+    {
+        int32_t checkpow = komodo_checkPOW(blockReward+stakeTxValue-notarypaycheque,1,(CBlock *)&block,pindex->GetHeight());
+        if ( checkpow == KOMODO_CHECKPOW_NOTCHECKED )
+            return AbortNode(state, "Failed to read block header for staking check");
+        if ( checkpow < 0 )
+            return state.DoS(100, error("ConnectBlock: ac_staked chain failed slow komodo_checkPOW"),REJECT_INVALID, "failed-slow_checkPOW");
+    }
 
     view.PushAnchor(sprout_tree);
     view.PushAnchor(sapling_tree);
@@ -3813,6 +4072,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    LogCCBlockEvalStats(pindex->GetHeight());
+
     // Write undo information to disk
     //fprintf(stderr,"nFile.%d isNull %d vs isvalid %d nStatus %x\n",(int32_t)pindex->nFile,pindex->GetUndoPos().IsNull(),pindex->IsValid(BLOCK_VALID_SCRIPTS),(uint32_t)pindex->nStatus);
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
@@ -3851,41 +4112,30 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
 
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (fTimestampIndex)
-    {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
-    }
+    if (!ConnectTokenOutputs(block, pindex->GetHeight())) // reads back txs of the block through the tx index
+        return AbortNode(state, "Failed to write token index");
+    if (!ConnectAssetOrders(block, pindex->GetHeight()))
+        return AbortNode(state, "Failed to write assets orderbook");
+    if (!ConnectBatons(block, pindex->GetHeight()))
+        return AbortNode(state, "Failed to write baton index");
+    if (!ConnectOracleSamples(block, pindex->GetHeight()))
+        return AbortNode(state, "Failed to write oracle samples index");
+
+    // blocks connected on top of a background build of the indexes are indexed with it
+    bool fRebuildFollows = pindexIndexRebuilt != NULL && pindexIndexRebuilt == pindex->pprev;
+    bool fAddress = fAddressIndex || (fRebuildFollows && vIndexRebuild[ADDRESS_INDEX]);
+    bool fSpent = fSpentIndex || (fRebuildFollows && vIndexRebuild[SPENT_INDEX]);
+    CBlockIndexEntries indexEntries;
+    if (!GetBlockIndexEntries(block, blockundo, pindex, fAddress, fSpent, false, indexEntries))
+        return AbortNode(state, "Failed to collect address or spent index entries");
+    if (fTimestampIndex || (fRebuildFollows && vIndexRebuild[TIMESTAMP_INDEX]))
+        GetTimestampIndexEntry(pindex, indexEntries);
+    // the three index databases are written in parallel
+    if (!pblocktree->WriteIndexEntries(indexEntries))
+        return AbortNode(state, "Failed to write address, spent or timestamp index");
+    if (fRebuildFollows)
+        pindexIndexRebuilt = pindex;
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -3933,6 +4183,9 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
+        // A background write of the chainstate failed, the node cannot go on
+        if (pcoinsoverlay != NULL && !pcoinsoverlay->ReleaseWritten())
+            return AbortNode(state, "Failed to write to coin database");
         if (fPruneMode && fCheckForPruning && !fReindex) {
             FindFilesToPrune(setFilesToPrune);
             fCheckForPruning = false;
@@ -3956,6 +4209,9 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             nLastSetChain = nNow;
         }
         size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // The entries of a write still in flight are in memory too, within -dbcache
+        if (pcoinsoverlay != NULL)
+            cacheSize += pcoinsoverlay->DynamicMemoryUsage();
         // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
         // The cache is over the limit, we have to write now.
@@ -3983,14 +4239,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                     setDirtyFileInfo.erase(it++);
                 }
                 std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CBlockIndex*> vTrim;
                 vBlocks.reserve(setDirtyBlockIndex.size());
+                vTrim.reserve(setDirtyBlockIndex.size());
                 for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                     vBlocks.push_back(*it);
+                    vTrim.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                // The solutions are on disk now, no need to keep them in memory
+                BOOST_FOREACH(CBlockIndex* pindex, vTrim)
+                    pindex->TrimSolution();
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -4007,8 +4269,14 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
+            // With -asyncflush this only hands the entries to the overlay. The block
+            // index and block files above are already on disk, so the chainstate
+            // batch still commits after everything it refers to, as before.
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Explicit flushes (shutdown, RPC) and pruning need the chainstate on disk now
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && pcoinsoverlay != NULL && !pcoinsoverlay->WaitForWrite())
+                return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
@@ -4035,9 +4303,12 @@ void PruneAndFlush() {
 }
 
 /** Update chainActive and related internal data structures. */
+void NSPV_cache_updatetip(const CBlockIndex *pindex);
+
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
     chainActive.SetTip(pindexNew);
+    NSPV_cache_updatetip(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -4121,6 +4392,16 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
         DisconnectNotarisations(block);
+        if (!DisconnectTokenOutputs(block, pindexDelete->GetHeight()))
+            return AbortNode(state, "Failed to write token index");
+        if (!DisconnectAssetOrders(block, pindexDelete->GetHeight()))
+            return AbortNode(state, "Failed to write assets orderbook");
+        if (!DisconnectBatons(block, pindexDelete->GetHeight()))
+            return AbortNode(state, "Failed to write baton index");
+        if (!DisconnectOracleSamples(block, pindexDelete->GetHeight()))
+            return AbortNode(state, "Failed to write oracle samples index");
+        if (!DisconnectPricesBets(block, pindexDelete->GetHeight()))
+            return AbortNode(state, "Failed to write prices bets index");
     }
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
@@ -4260,6 +4541,32 @@ static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 
+// Block sync pipeline counters reported by getsyncstats
+static CCriticalSection cs_blockStageStats;
+static CBlockStageStats vBlockStageStats[BLOCK_STAGE_COUNT];
+
+static void RecordBlockStage(BlockStage stage, int64_t nStart, bool fOk)
+{
+    int64_t nNow = GetTimeMicros();
+    LOCK(cs_blockStageStats);
+    CBlockStageStats& stats = vBlockStageStats[stage];
+    if (stats.nFirstTime == 0)
+        stats.nFirstTime = nStart;
+    stats.nLastTime = nNow;
+    stats.nMicros += nNow - nStart;
+    if (!fOk)
+        stats.nFailed++;
+    else if (++stats.nBlocks % 1000 == 0 && stage == BLOCK_STAGE_CONNECT)
+        LogPrint("bench", "Sync pipeline: precheck %.1f blocks/s, accept %.1f blocks/s, connect %.1f blocks/s\n",
+                 vBlockStageStats[BLOCK_STAGE_PRECHECK].BlocksPerSecond(), vBlockStageStats[BLOCK_STAGE_ACCEPT].BlocksPerSecond(),
+                 stats.BlocksPerSecond());
+}
+
+// Blocks stored after PrecheckBlock verified their Equihash solution. ConnectTip skips the check when it
+// reads one back from disk, the hash comparison against the index guarantees it is the same header.
+static std::set<uint256> setBlocksCheckedSolution; // guarded by cs_main
+static const size_t MAX_BLOCKS_CHECKED_SOLUTION = 4096;
+
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -4274,8 +4581,10 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     if (!pblock) {
         if (!ReadBlockFromDisk(block, pindexNew,1))
             return AbortNode(state, "Failed to read block");
+        block.fCheckedSolution = setBlocksCheckedSolution.count(pindexNew->GetBlockHash()) != 0;
         pblock = &block;
     }
+    setBlocksCheckedSolution.erase(pindexNew->GetBlockHash());
     KOMODO_CONNECTING = (int32_t)pindexNew->GetHeight();
     //fprintf(stderr,"%s connecting ht.%d maxsize.%d vs %d\n",ASSETCHAINS_SYMBOL,(int32_t)pindexNew->GetHeight(),MAX_BLOCK_SIZE(pindexNew->GetHeight()),(int32_t)::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
     // Get the current commitment tree
@@ -4305,6 +4614,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
                     fprintf(stderr,"reconsiderblock %d\n",(int32_t)pindexNew->GetHeight());
                 }*/
             }
+            RecordBlockStage(BLOCK_STAGE_CONNECT, nTime1, false);
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         mapBlockSource.erase(pindexNew->GetBlockHash());
@@ -4350,6 +4660,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     EnforceNodeDeprecation(pindexNew->GetHeight());
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
+    RecordBlockStage(BLOCK_STAGE_CONNECT, nTime1, true);
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
     if ( KOMODO_LONGESTCHAIN != 0 && (pindexNew->GetHeight() == KOMODO_LONGESTCHAIN || pindexNew->GetHeight() == KOMODO_LONGESTCHAIN+1) )
@@ -4363,7 +4674,11 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     if ( KOMODO_NSPV_FULLNODE )
     {
         if ( ASSETCHAINS_CBOPRET != 0 )
+        {
             komodo_pricesupdate(pindexNew->GetHeight(),pblock);
+            if (!ConnectPricesBets(*pblock, pindexNew->GetHeight())) // scans the open bets with the prices of the block
+                return AbortNode(state, "Failed to write prices bets index");
+        }
         if ( ASSETCHAINS_SAPLING <= 0 && pindexNew->nTime > KOMODO_SAPLING_ACTIVATION - 24*3600 )
             komodo_activate_sapling(pindexNew);
         if ( ASSETCHAINS_CC != 0 && KOMODO_SNAPSHOT_INTERVAL != 0 && (pindexNew->GetHeight() % KOMODO_SNAPSHOT_INTERVAL) == 0 && pindexNew->GetHeight() >= KOMODO_SNAPSHOT_INTERVAL )
@@ -4650,10 +4965,29 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
+                // Peers that asked for it get the new tip as a cmpctblock right away instead of an inv,
+                // which saves them the getdata round trip
+                boost::shared_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+                CInv inv(MSG_BLOCK, hashNewTip);
                 LOCK(cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
                 if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                    pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                {
+                    bool fKnown;
+                    {
+                        LOCK(pnode->cs_inventory);
+                        fKnown = pnode->setInventoryKnown.count(inv) != 0;
+                    }
+                    if (pnode->fAnnounceCompactBlocks && pblock != NULL && pblock->GetHash() == hashNewTip && !fKnown)
+                    {
+                        if (!pcmpctblock)
+                            pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
+                        pnode->PushMessage("cmpctblock", *pcmpctblock);
+                        pnode->AddInventoryKnown(inv);
+                    }
+                    else
+                        pnode->PushInventory(inv);
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -5140,7 +5474,8 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
     // These are checks that are independent of context.
     hash = block.GetHash();
     // Check that the header is valid (particularly PoW).  This is mostly redundant with the call in AcceptBlockHeader.
-    if (!CheckBlockHeader(futureblockp,height,pindex,block,state,fCheckPOW))
+    // The Equihash solution of a block that went through PrecheckBlock is not verified again.
+    if (!CheckBlockHeader(futureblockp,height,pindex,block,state,fCheckPOW && !block.fCheckedSolution))
     {
         if ( *futureblockp == 0 )
         {
@@ -5162,8 +5497,14 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
             fprintf(stderr," failed hash ht.%d\n",height);
             return state.DoS(50, error("CheckBlock: proof of work failed"),REJECT_INVALID, "high-hash");
         }
-        if ( ASSETCHAINS_STAKED == 0 && komodo_checkPOW(0,1,(CBlock *)&block,height) < 0 ) // checks Equihash
-            return state.DoS(100, error("CheckBlock: failed slow_checkPOW"),REJECT_INVALID, "failed-slow_checkPOW");
+        if ( ASSETCHAINS_STAKED == 0 ) // checks Equihash
+        {
+            int32_t checkpow = komodo_checkPOW(0,1,(CBlock *)&block,height);
+            if ( checkpow == KOMODO_CHECKPOW_NOTCHECKED )
+                return AbortNode(state, "Failed to read block header for PoS check");
+            if ( checkpow < 0 )
+                return state.DoS(100, error("CheckBlock: failed slow_checkPOW"),REJECT_INVALID, "failed-slow_checkPOW");
+        }
     }
     if ( height > nDecemberHardforkHeight && ASSETCHAINS_SYMBOL[0] == 0 ) // December 2019 hardfork
     {
@@ -5180,8 +5521,8 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
         }
     }
 	
-    // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    // Check the merkle root, unless PrecheckBlock already did.
+    if (fCheckMerkleRoot && !block.fCheckedMerkleRoot) {
         bool mutated;
         uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -5333,6 +5674,36 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
     return true;
 }
 
+bool PrecheckBlock(const CBlock& block, CValidationState& state)
+{
+    if (!block.fCheckedSolution)
+    {
+        if (!CheckEquihashSolution(&block, Params()))
+            return state.DoS(100, error("PrecheckBlock(): Equihash solution invalid"),REJECT_INVALID, "invalid-solution");
+        block.fCheckedSolution = true;
+    }
+    if (!block.fCheckedMerkleRoot)
+    {
+        bool mutated;
+        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
+        if (block.hashMerkleRoot != hashMerkleRoot2)
+            return state.DoS(100, error("PrecheckBlock(): hashMerkleRoot mismatch"),
+                             REJECT_INVALID, "bad-txnmrklroot", true);
+        if (mutated)
+            return state.DoS(100, error("PrecheckBlock(): duplicate transaction"),
+                             REJECT_INVALID, "bad-txns-duplicate", true);
+        block.fCheckedMerkleRoot = true;
+    }
+    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+        return state.DoS(100, error("PrecheckBlock(): first tx is not coinbase"),
+                         REJECT_INVALID, "bad-cb-missing");
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        if (block.vtx[i].IsCoinBase())
+            return state.DoS(100, error("PrecheckBlock(): more than one coinbase"),
+                             REJECT_INVALID, "bad-cb-multiple");
+    return true;
+}
+
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex * const pindexPrev)
 {
     const CChainParams& chainParams = Params();
@@ -5668,6 +6039,12 @@ bool AcceptBlock(int32_t *futureblockp,CBlock& block, CValidationState& state, C
                 AbortNode(state, "Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
+        if (block.fCheckedSolution)
+        {
+            if (setBlocksCheckedSolution.size() >= MAX_BLOCKS_CHECKED_SOLUTION)
+                setBlocksCheckedSolution.clear(); // entries of blocks left on forks, the next ones are simply checked again
+            setBlocksCheckedSolution.insert(pindex->GetBlockHash());
+        }
         if ( usetmp != 0 ) // not during initialdownload or if futureflag==0 and contextchecks ok
             pindex->nStatus |= BLOCK_IN_TMPFILE;
     } catch (const std::runtime_error& e) {
@@ -5785,6 +6162,7 @@ bool ProcessNewBlock(bool from_miner,int32_t height,CValidationState &state, CNo
     //fprintf(stderr,"ProcessBlock %d\n",(int32_t)chainActive.LastTip()->GetHeight());
     {
         LOCK(cs_main);
+        int64_t nAcceptStart = GetTimeMicros();
         if ( chainActive.LastTip() != 0 )
             komodo_currentheight_set(chainActive.LastTip()->GetHeight());
         checked = CheckBlock(&futureblock,height!=0?height:komodo_block2height(pblock),0,*pblock, state, verifier,0);
@@ -5801,6 +6179,7 @@ bool ProcessNewBlock(bool from_miner,int32_t height,CValidationState &state, CNo
             {
                 Misbehaving(pfrom->GetId(), 1);
             }
+            RecordBlockStage(BLOCK_STAGE_ACCEPT, nAcceptStart, false);
             return error("%s: CheckBlock FAILED", __func__);
         }
         // Store to disk
@@ -5819,8 +6198,11 @@ bool ProcessNewBlock(bool from_miner,int32_t height,CValidationState &state, CNo
                 pfrom->PushMessage("getheaders", chainActive.GetLocator(chainActive.LastTip()), uint256());
             }*/
             komodo_longestchain();
+            RecordBlockStage(BLOCK_STAGE_ACCEPT, nAcceptStart, false);
             return error("%s: AcceptBlock FAILED", __func__);
         }
+        if (futureblock == 0)
+            RecordBlockStage(BLOCK_STAGE_ACCEPT, nAcceptStart, true);
         //else fprintf(stderr,"added block %s %p\n",pindex->GetBlockHash().ToString().c_str(),pindex->pprev);
     }
 
@@ -6107,7 +6489,7 @@ bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
     LogPrintf("%s: start loading guts\n", __func__);
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(!GetBoolArg("-trustblockindex", DEFAULT_TRUST_BLOCK_INDEX)))
         return false;
     LogPrintf("%s: loaded guts\n", __func__);
     boost::this_thread::interruption_point();
@@ -7041,14 +7423,60 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/** What serving a requested block needs from the block index and chainActive */
+struct CBlockToServe
+{
+    int32_t nHeight;
+    CDiskBlockPos pos;
+    int32_t nTipHeight;
+    uint256 hashTip;
+};
+
+/**
+ * Look up a requested block under cs_main and copy out what is needed to serve it, so that
+ * ProcessGetData reads the block from disk and replies without the lock. False if it is not sent.
+ */
+static bool FindBlockToServe(CNode* pfrom, const uint256 &hash, CBlockToServe &serve)
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        return false;
+    bool send = false;
+    if (chainActive.Contains(mi->second)) {
+        send = true;
+    } else {
+        static const int nOneMonth = 30 * 24 * 60 * 60;
+        // To prevent fingerprinting attacks, only send blocks outside of the active
+        // chain if they are valid, and no more than a month older (both in time, and in
+        // best equivalent proof of work) than the best header chain we know about.
+        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
+        if (!send) {
+            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+        }
+    }
+    // Pruned nodes may have deleted the block, so check whether
+    // it's available before trying to send.
+    if (!send || !(mi->second->nStatus & BLOCK_HAVE_DATA))
+        return false;
+    serve.nHeight = mi->second->GetHeight();
+    serve.pos = mi->second->GetBlockPos();
+    serve.nTipHeight = chainActive.Height();
+    serve.hashTip = chainActive.Tip()->GetBlockHash();
+    return true;
+}
+
+// The time of every pass is recorded as "getdata", whether it runs on a getdata worker or on the
+// message handler, the message handler does not time the getdata message itself.
 void static ProcessGetData(CNode* pfrom)
 {
+    int64_t nStart = GetTimeMicros();
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -7059,48 +7487,33 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
-                {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-                        }
-                    }
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                CBlockToServe serve;
+                if (FindBlockToServe(pfrom, inv.hash, serve))
                 {
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    if (!ReadBlockFromDisk(serve.nHeight, block, serve.pos, 1) || block.GetHash() != inv.hash)
                     {
-                        assert(!"cannot load block from disk");
+                        // the block may have been pruned since the lookup
+                        LOCK(cs_main);
+                        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                        if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA) && mi->second->GetBlockPos() == serve.pos)
+                            assert(!"cannot load block from disk");
+                        vNotFound.push_back(inv);
                     }
                     else
                     {
-                        if (inv.type == MSG_BLOCK)
+                        if (inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && serve.nHeight < serve.nTipHeight - MAX_CMPCTBLOCK_DEPTH))
                         {
-                            //uint256 hash; int32_t z;
-                            //hash = block.GetHash();
-                            //for (z=31; z>=0; z--)
-                            //    fprintf(stderr,"%02x",((uint8_t *)&hash)[z]);
-                            //fprintf(stderr," send block %d\n",komodo_block2height(&block));
                             pfrom->PushMessage("block", block);
                         }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            CBlockHeaderAndShortTxIDs cmpctblock(block);
+                            pfrom->PushMessage("cmpctblock", cmpctblock);
+                        }
                         else // MSG_FILTERED_BLOCK)
                         {
                             LOCK(pfrom->cs_filter);
@@ -7115,6 +7528,7 @@ void static ProcessGetData(CNode* pfrom)
                                 // Thus, the protocol spec specified allows for us to provide duplicate txn here,
                                 // however we MUST always provide at least what the remote peer needs
                                 typedef std::pair<unsigned int, uint256> PairType;
+                                LOCK(pfrom->cs_inventory);
                                 BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
                                 if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
                                     pfrom->PushMessage("tx", block.vtx[pair.first]);
@@ -7130,7 +7544,7 @@ void static ProcessGetData(CNode* pfrom)
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        vInv.push_back(CInv(MSG_BLOCK, serve.hashTip));
                         pfrom->PushMessage("inv", vInv);
                         pfrom->hashContinue.SetNull();
                     }
@@ -7166,7 +7580,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -7183,6 +7597,64 @@ void static ProcessGetData(CNode* pfrom)
         // having to download the entire memory pool.
         pfrom->PushMessage("notfound", vNotFound);
     }
+    RecordMessageTiming("getdata", GetTimeMicros() - nStart);
+}
+
+// getdata requests are served by a pool of -getdatathreads workers, so reading blocks from disk for
+// one peer does not hold up validation of what the others send. While a peer has getdata outstanding
+// ProcessMessages does not process its next message, which keeps the replies in request order and
+// means only one thread touches the peer's vRecvGetData at a time.
+static boost::mutex csGetDataQueue;
+static boost::condition_variable condGetDataQueue;
+static std::deque<CNode*> vGetDataQueue;
+static int nGetDataThreads = 0;
+
+// requires LOCK(pfrom->cs_vRecvGetData), returns false when getdata is served inline
+static bool QueueGetData(CNode* pfrom)
+{
+    if (nGetDataThreads == 0)
+        return false;
+    pfrom->fGetDataQueued = true;
+    {
+        boost::unique_lock<boost::mutex> lock(csGetDataQueue);
+        vGetDataQueue.push_back(pfrom->AddRef());
+    }
+    condGetDataQueue.notify_one();
+    return true;
+}
+
+void static ThreadGetDataWorker()
+{
+    RenameThread("komodo-getdata");
+    while (true)
+    {
+        CNode* pfrom;
+        {
+            boost::unique_lock<boost::mutex> lock(csGetDataQueue);
+            while (vGetDataQueue.empty())
+                condGetDataQueue.wait(lock); // interruption point
+            pfrom = vGetDataQueue.front();
+            vGetDataQueue.pop_front();
+        }
+        {
+            LOCK(pfrom->cs_vRecvGetData);
+            if (!pfrom->fDisconnect)
+                ProcessGetData(pfrom);
+            pfrom->fGetDataQueued = false;
+        }
+        pfrom->Release();
+        // let the message handler continue with this peer
+        WakeMessageHandler();
+        boost::this_thread::interruption_point();
+    }
+}
+
+void StartGetDataWorkers(boost::thread_group &threadGroup)
+{
+    nGetDataThreads = std::max(0, std::min((int)GetArg("-getdatathreads", DEFAULT_GETDATA_THREADS), MAX_GETDATA_THREADS));
+    LogPrintf("Using %d threads for serving getdata\n", nGetDataThreads);
+    for (int i = 0; i < nGetDataThreads; i++)
+        threadGroup.create_thread(&ThreadGetDataWorker);
 }
 
 #include "komodo_nSPV_defs.h"
@@ -7191,6 +7663,170 @@ void static ProcessGetData(CNode* pfrom)
 #include "komodo_nSPV_superlite.h"  // nSPV superlite client, issuing requests and handling nSPV responses
 #include "komodo_nSPV_wallet.h"     // nSPV_send and support functions, really all the rest is to support this
 
+/** Number of peers asked to announce new blocks with a cmpctblock */
+static const unsigned int MAX_COMPACT_ANNOUNCE_PEERS = 3;
+
+// The peers that most recently gave us a new tip are the ones most likely to be first with the next
+// block, so they are asked to push it as a cmpctblock without waiting for our getdata. Requires cs_main.
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
+{
+    if (!fCompactBlocks || !pfrom->fSupportsCompactBlocks)
+        return;
+    NodeId nodeid = pfrom->GetId();
+    for (list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); ++it) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_COMPACT_ANNOUNCE_PEERS) {
+        NodeId oldest = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == oldest) {
+                pnode->PushMessage("sendcmpct", false, COMPACT_BLOCKS_VERSION);
+                break;
+            }
+        }
+    }
+    pfrom->PushMessage("sendcmpct", true, COMPACT_BLOCKS_VERSION);
+    lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+}
+
+static void ProcessNewBlockFromPeer(CNode* pfrom, CBlock& block, bool fForceProcessing)
+{
+    CValidationState state;
+    ProcessNewBlock(0,0,state, pfrom, &block, fForceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", string("block"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+    else
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != NULL && chainActive.Tip()->GetBlockHash() == block.GetHash())
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+    }
+}
+
+// During initial download blocks arrive out of order from many peers. PrecheckBlock runs on a pool of
+// -blockcheckthreads workers, which then pass each block to ProcessNewBlock, so the Equihash and merkle
+// checks of several blocks proceed in parallel and only the contextual checks, storing and connecting
+// are serialized by cs_main.
+struct CQueuedBlockCheck
+{
+    CNode* pfrom;
+    boost::shared_ptr<CBlock> pblock;
+    bool fRequested;
+};
+
+static boost::mutex csBlockCheckQueue;
+static boost::condition_variable condBlockCheckQueue;
+static std::deque<CQueuedBlockCheck> vBlockCheckQueue;
+static size_t nMaxBlockCheckQueue = 0;
+static uint64_t nBlockCheckQueueFull = 0;
+static int nBlockCheckThreads = 0;
+
+// returns false when the block is to be processed on the message thread
+static bool QueueBlockCheck(CNode* pfrom, const CBlock& block, bool fRequested)
+{
+    CQueuedBlockCheck check;
+    {
+        boost::unique_lock<boost::mutex> lock(csBlockCheckQueue);
+        if (vBlockCheckQueue.size() >= MAX_BLOCK_CHECK_QUEUE)
+        {
+            nBlockCheckQueueFull++;
+            return false;
+        }
+        check.pfrom = pfrom->AddRef();
+        check.pblock.reset(new CBlock(block));
+        check.fRequested = fRequested;
+        vBlockCheckQueue.push_back(check);
+        nMaxBlockCheckQueue = std::max(nMaxBlockCheckQueue, vBlockCheckQueue.size());
+    }
+    condBlockCheckQueue.notify_one();
+    return true;
+}
+
+void static ThreadBlockCheck()
+{
+    RenameThread("komodo-blkcheck");
+    while (true)
+    {
+        CQueuedBlockCheck check;
+        {
+            boost::unique_lock<boost::mutex> lock(csBlockCheckQueue);
+            while (vBlockCheckQueue.empty())
+                condBlockCheckQueue.wait(lock); // interruption point
+            check = vBlockCheckQueue.front();
+            vBlockCheckQueue.pop_front();
+        }
+        CValidationState state;
+        int64_t nStart = GetTimeMicros();
+        RecordBlockStage(BLOCK_STAGE_PRECHECK, nStart, PrecheckBlock(*check.pblock, state));
+        // a block failing the checks still goes to ProcessNewBlock, which rejects it and
+        // punishes the peer the same way as when it is checked on the message thread
+        ProcessNewBlockFromPeer(check.pfrom, *check.pblock, check.fRequested);
+        check.pfrom->Release();
+        boost::this_thread::interruption_point();
+    }
+}
+
+void StartBlockCheckThreads(boost::thread_group &threadGroup)
+{
+    nBlockCheckThreads = std::max(0, std::min((int)GetArg("-blockcheckthreads", DEFAULT_BLOCK_CHECK_THREADS), MAX_BLOCK_CHECK_THREADS));
+    LogPrintf("Using %d threads for checking blocks during initial download\n", nBlockCheckThreads);
+    for (int i = 0; i < nBlockCheckThreads; i++)
+        threadGroup.create_thread(&ThreadBlockCheck);
+}
+
+void GetBlockPipelineStats(CBlockPipelineStats& stats)
+{
+    {
+        LOCK(cs_blockStageStats);
+        for (int i = 0; i < BLOCK_STAGE_COUNT; i++)
+            stats.vStages[i] = vBlockStageStats[i];
+    }
+    boost::unique_lock<boost::mutex> lock(csBlockCheckQueue);
+    stats.nCheckThreads = nBlockCheckThreads;
+    stats.nQueued = vBlockCheckQueue.size();
+    stats.nMaxQueued = nMaxBlockCheckQueue;
+    stats.nQueueFull = nBlockCheckQueueFull;
+}
+
+// Shared by "block" and the compact block messages once the full block is known
+static void ProcessBlockFromPeer(CNode* pfrom, CBlock& block)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+
+    pfrom->AddInventoryKnown(inv);
+
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network.
+    // Such an unrequested block may still be processed, subject to the
+    // conditions in AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    if (nBlockCheckThreads > 0 && IsInitialBlockDownload())
+    {
+        // the block leaves the peer's in flight list now, so the next one is requested while it waits to be checked
+        {
+            LOCK(cs_main);
+            forceProcessing = MarkBlockAsReceived(inv.hash);
+        }
+        if (QueueBlockCheck(pfrom, block, forceProcessing))
+            return;
+    }
+    ProcessNewBlockFromPeer(pfrom, block, forceProcessing);
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     int32_t nProtocolVersion;
@@ -7383,6 +8019,22 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+        // Tell the peer we can take new blocks as cmpctblock, without asking it to push them unannounced
+        // yet. Peers that do not know the message ignore it.
+        if (fCompactBlocks && !KOMODO_NSPV_SUPERLITE)
+            pfrom->PushMessage("sendcmpct", false, COMPACT_BLOCKS_VERSION);
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCmpctBlock = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCmpctBlock >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == COMPACT_BLOCKS_VERSION) {
+            pfrom->fSupportsCompactBlocks = true;
+            pfrom->fAnnounceCompactBlocks = fAnnounceUsingCmpctBlock;
+        }
     }
 
 
@@ -7575,7 +8227,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vRecv >> payload;
 
         if (strCommand == "getnSPV" && KOMODO_NSPV == 0) {
-            komodo_nSPVreq(pfrom, payload);
+            komodo_nSPVreq_queue(pfrom, payload);
         } else if (strCommand == "nSPV" && KOMODO_NSPV_SUPERLITE) {
             komodo_nSPVresp(pfrom, payload);
         }
@@ -7625,7 +8277,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // a new block near the tip is most likely made of transactions we already have
+                        if (fCompactBlocks && pfrom->fSupportsCompactBlocks)
+                            vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        else
+                            vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -7664,8 +8320,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if ((fDebug && vInv.size() > 0) || (vInv.size() == 1))
             LogPrint("net", "received getdata for: %s peer=%d\n", vInv[0].ToString(), pfrom->id);
 
+        // served on the next pass of ProcessMessages, by a getdata worker or inline
+        LOCK(pfrom->cs_vRecvGetData);
         pfrom->vRecvGetData.insert(pfrom->vRecvGetData.end(), vInv.begin(), vInv.end());
-        ProcessGetData(pfrom);
     }
 
 
@@ -7747,10 +8404,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             pfrom->lasthdrsreq = (int32_t)(pindex ? pindex->GetHeight() : -1);
             for (; pindex; pindex = chainActive.Next(pindex))
             {
-                CBlockHeader h = pindex->GetBlockHeader();
+                CBlockHeader h;
+                // headers are sent in order, stop at one whose solution cannot be read
+                if (!pindex->GetBlockHeader(h))
+                    break;
                 //printf("size.%i, solution size.%i\n", (int)sizeof(h), (int)h.nSolution.size());
                 //printf("hash.%s prevhash.%s nonce.%s\n", h.GetHash().ToString().c_str(), h.hashPrevBlock.ToString().c_str(), h.nNonce.ToString().c_str());
-                vHeaders.push_back(pindex->GetBlockHeader());
+                vHeaders.push_back(h);
                 if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                     break;
             }
@@ -7996,28 +8656,186 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CBlock block;
         vRecv >> block;
 
-        CInv inv(MSG_BLOCK, block.GetHash());
-        LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        ProcessBlockFromPeer(pfrom, block);
+    }
 
-        pfrom->AddInventoryKnown(inv);
 
-        CValidationState state;
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network.
-        // Such an unrequested block may still be processed, subject to the
-        // conditions in AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
-        ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex)
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        uint256 hash = cmpctblock.header.GetHash();
+        LogPrint("cmpctblock", "received cmpctblock %s (%u txn, %u prefilled) peer=%d\n", hash.ToString(),
+                 cmpctblock.BlockTxCount(), cmpctblock.PrefilledTxCount(), pfrom->id);
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hash));
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect, fetch the headers leading up to it; the block is requested in full later
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hash);
+                return true;
+            }
+
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                // already have it, e.g. from another peer that was faster
+                MarkBlockAsReceived(hash);
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            int32_t futureblock = 0;
+            if (!AcceptBlockHeader(&futureblock, cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && futureblock == 0)
+                {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS/nDoS);
+                    return error("invalid cmpctblock header received");
+                }
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            bool fInFlightFromPeer = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            if (pindex->pprev != chainActive.Tip()) {
+                // Only the next block is rebuilt from the mempool, anything else is a reorg or catch up
+                // and is fetched in full
+                if (fInFlightFromPeer) {
+                    vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                    pfrom->PushMessage("getdata", vInv);
+                }
+                return true;
+            }
+
+            CNodeState *nodestate = State(pfrom->GetId());
+            if (!fInFlightFromPeer) {
+                if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                    return true;
+                MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex);
+            }
+
+            boost::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+            ReadStatus status = partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Duplicate short ids, the block is still in flight from this peer
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                pfrom->PushMessage("getdata", vInv);
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                if (!partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                std::vector<CTransaction> dummy;
+                status = partialBlock->FillBlock(block, dummy);
+                if (status == READ_STATUS_OK) {
+                    fBlockReconstructed = true;
+                } else {
+                    vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                    pfrom->PushMessage("getdata", vInv);
+                    return true;
+                }
+            } else {
+                req.blockhash = hash;
+                nodestate->partialBlock = partialBlock;
+                pfrom->PushMessage("getblocktxn", req);
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessBlockFromPeer(pfrom, block);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        bool fFullBlock = false;
+        int32_t nHeight = 0;
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("net", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+            // An old block is no relay race, answer like a getdata would
+            fFullBlock = mi->second->GetHeight() < chainActive.Height() - MAX_BLOCKTXN_DEPTH;
+            nHeight = mi->second->GetHeight();
+            pos = mi->second->GetBlockPos();
+        }
+        if (fFullBlock) {
+            LOCK(pfrom->cs_vRecvGetData);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(nHeight, block, pos, 0) || block.GetHash() != req.blockhash)
+            return error("%s: cannot read block %s for getblocktxn", __func__, req.blockhash.ToString());
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
                 LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
             }
+            resp.txn[i] = block.vtx[req.indexes[i]];
         }
+        pfrom->PushMessage("blocktxn", resp);
+    }
 
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex)
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            if (!nodestate->partialBlock || nodestate->partialBlock->header.GetHash() != resp.blockhash) {
+                LogPrint("net", "peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            boost::shared_ptr<PartiallyDownloadedBlock> partialBlock = nodestate->partialBlock;
+            nodestate->partialBlock.reset();
+            ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block/non-matching block transactions", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now; the block is still in flight from this peer
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage("getdata", vInv);
+                return true;
+            }
+        }
+
+        ProcessBlockFromPeer(pfrom, block);
     }
 
 
@@ -8193,11 +9011,18 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
-        ProcessGetData(pfrom);
+    {
+        TRY_LOCK(pfrom->cs_vRecvGetData, lockGetData);
+        // a getdata worker is still serving this peer
+        if (!lockGetData || pfrom->fGetDataQueued)
+            return fOk;
+
+        if (!pfrom->vRecvGetData.empty() && !QueueGetData(pfrom))
+            ProcessGetData(pfrom);
 
-    // this maintains the order of responses
-    if (!pfrom->vRecvGetData.empty()) return fOk;
+        // this maintains the order of responses
+        if (!pfrom->vRecvGetData.empty()) return fOk;
+    }
 
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
@@ -8252,6 +9077,7 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nStart = GetTimeMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
@@ -8284,6 +9110,13 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        // serving the requests is timed by ProcessGetData
+        if (strCommand != "getdata")
+            RecordMessageTiming(strCommand, nElapsed);
+        if (nElapsed >= 1000000)
+            LogPrint("bench", "%s(%s, %u bytes) took %.2fms peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, nElapsed * 0.001, pfrom->id);
+
         if (!fRet)
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
 
@@ -46,6 +46,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -58,6 +59,7 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
+class CCoinsViewFlushOverlay;
 class CInv;
 class CScriptCheck;
 class CValidationInterface;
@@ -120,8 +122,33 @@ static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 
+/** Default for -compactblocks, requesting new blocks as "cmpctblock" from peers that support it */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
+/** Blocks this far below the tip are answered with a full block instead of a cmpctblock */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of a block whose transactions are served with "blocktxn" */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+
+/** Default number of threads serving getdata requests, 0 serves them on the message thread */
+static const int DEFAULT_GETDATA_THREADS = 2;
+static const int MAX_GETDATA_THREADS = 16;
+
+/** Default number of threads running the context-free checks of blocks received during initial download, 0 checks them on the message thread */
+static const int DEFAULT_BLOCK_CHECK_THREADS = 4;
+static const int MAX_BLOCK_CHECK_THREADS = 16;
+/** Maximum number of blocks waiting for a block check thread, blocks beyond it are checked on the message thread */
+static const unsigned int MAX_BLOCK_CHECK_QUEUE = 64;
+
 /** Default NSPV support enabled */
 static const bool DEFAULT_NSPV_PROCESSING = false;
+/** Default number of threads answering getnSPV requests, 0 answers them on the message thread */
+static const int DEFAULT_NSPV_THREADS = 4;
+static const int MAX_NSPV_THREADS = 32;
+/** Default limits for getnSPV requests waiting for a worker, in total and per peer */
+static const int DEFAULT_NSPV_QUEUE = 1024;
+static const int DEFAULT_NSPV_PEER_QUEUE = 8;
+/** Default memory budget (MiB) of the nSPV response cache */
+static const int64_t DEFAULT_NSPV_CACHESIZE = 32;
 
 //static const bool DEFAULT_ADDRESSINDEX = false;
 //static const bool DEFAULT_SPENTINDEX = false;
@@ -130,6 +157,7 @@ static const bool DEFAULT_NSPV_PROCESSING = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
+static const bool DEFAULT_TRUST_BLOCK_INDEX = false;
 
 // Sanity check the magic numbers when we change them
 //BOOST_STATIC_ASSERT(DEFAULT_BLOCK_MAX_SIZE <= MAX_BLOCK_SIZE());
@@ -160,9 +188,12 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+extern bool fCompactBlocks;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
 extern bool fCoinbaseEnforcedProtectionEnabled;
@@ -242,6 +273,52 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Verify the header hashes skipped by -trustblockindex */
+void ThreadVerifyBlockIndex();
+/** Start the threads serving getdata requests from disk and relay memory */
+void StartGetDataWorkers(boost::thread_group &threadGroup);
+/** Stages of the block sync pipeline */
+enum BlockStage
+{
+    BLOCK_STAGE_PRECHECK,   //! PrecheckBlock on a block check thread
+    BLOCK_STAGE_ACCEPT,     //! contextual checks and storing the block, under cs_main
+    BLOCK_STAGE_CONNECT,    //! ConnectTip
+    BLOCK_STAGE_COUNT
+};
+
+struct CBlockStageStats
+{
+    uint64_t nBlocks;
+    uint64_t nFailed;
+    int64_t nMicros;        //! time spent in the stage, summed over threads
+    int64_t nFirstTime;     //! when the first block entered the stage
+    int64_t nLastTime;      //! when the last block left it
+
+    CBlockStageStats() : nBlocks(0), nFailed(0), nMicros(0), nFirstTime(0), nLastTime(0) {}
+
+    double BlocksPerSecond() const
+    {
+        return nLastTime > nFirstTime ? nBlocks * 1000000.0 / (nLastTime - nFirstTime) : 0;
+    }
+};
+
+struct CBlockPipelineStats
+{
+    CBlockStageStats vStages[BLOCK_STAGE_COUNT];
+    int nCheckThreads;
+    size_t nQueued;
+    size_t nMaxQueued;
+    uint64_t nQueueFull;    //! blocks checked on the message thread because the queue was full
+};
+
+/** Block sync pipeline counters since startup */
+void GetBlockPipelineStats(CBlockPipelineStats& stats);
+/** Start the threads checking blocks received during initial download */
+void StartBlockCheckThreads(boost::thread_group &threadGroup);
+/** Build the optional indexes switched on since they were last maintained, in the background */
+bool StartIndexRebuild(boost::thread_group &threadGroup, std::string &strError);
+/** Start the threads answering getnSPV requests */
+void StartNSPVWorkers(boost::thread_group &threadGroup);
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -635,6 +712,19 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** What connecting or disconnecting a block writes to the optional indexes */
+struct CBlockIndexEntries
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    bool fEraseAddressIndex;    //!< disconnecting, the address index entries are erased
+    bool fTimestampIndex;
+    CTimestampIndexKey timestampIndex;
+
+    CBlockIndexEntries() : fEraseAddressIndex(false), fTimestampIndex(false) {}
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -805,6 +895,12 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Streaming variants of the above: entries are handed to the visitor in index order,
+ *  resuming after pAfter when set. The visitor returns false to stop the scan. */
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pAfter,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor);
+bool ScanAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey *pAfter,
+                        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &visitor);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -828,6 +924,10 @@ bool CheckBlockHeader(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,c
 bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
                 bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/** The checks of CheckBlock that need neither cs_main nor the block's position in the chain: Equihash
+ *  solution, merkle root and coinbase placement. They are flagged on the block and not repeated by
+ *  CheckBlock, so they can run on a block check thread ahead of ProcessNewBlock. */
+bool PrecheckBlock(const CBlock& block, CValidationState& state);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
@@ -938,6 +1038,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** The view below pcoinsTip that writes flushes in the background (protected by cs_main) */
+extern CCoinsViewFlushOverlay *pcoinsoverlay;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -39,6 +39,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -374,6 +378,20 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+// Nodes the socket handler has to (re)register with epoll: new nodes, and nodes whose send queue
+// became non-empty outside the socket handler. Queued nodes hold a reference until drained.
+static CCriticalSection cs_vSocketUpdate;
+static vector<CNode*> vSocketUpdate;
+
+static void QueueSocketUpdate(CNode *pnode)
+{
+    LOCK(cs_vSocketUpdate);
+    if (!pnode->fSocketUpdateQueued) {
+        pnode->fSocketUpdateQueued = true;
+        vSocketUpdate.push_back(pnode->AddRef());
+    }
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
 {
     if (pszDest == NULL) {
@@ -416,6 +434,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
         }
+        QueueSocketUpdate(pnode);
 
         pnode->nTimeConnected = GetTime();
 
@@ -1010,179 +1029,347 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    QueueSocketUpdate(pnode);
 }
 
-void ThreadSocketHandler()
+static CCriticalSection cs_socketLoopStats;
+static CSocketLoopStats socketLoopStats;
+
+void GetSocketLoopStats(CSocketLoopStats &stats)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true)
+    LOCK(cs_socketLoopStats);
+    stats = socketLoopStats;
+}
+
+static void DisconnectNodes(unsigned int &nPrevNodeCount)
+{
+    //
+    // Disconnect nodes
+    //
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
             {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                if (pnode->fNetworkNode || pnode->fInbound)
+                    pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                bool fDelete = false;
                 {
-                    bool fDelete = false;
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
                     {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv)
                         {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete)
-                    {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
-                    }
+                }
+                if (fDelete)
+                {
+                    vNodesDisconnected.remove(pnode);
+                    delete pnode;
                 }
             }
         }
-        if(vNodes.size() != nPrevNodeCount) {
-            nPrevNodeCount = vNodes.size();
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+    if(vNodes.size() != nPrevNodeCount) {
+        nPrevNodeCount = vNodes.size();
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+// Receiving is allowed unless a complete message is waiting and the receive buffer is full,
+// see the comment in SocketWaitSelect
+static bool NodeCanReceive(CNode *pnode)
+{
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    return lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                        pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+}
+
+static bool NodeHasSendData(CNode *pnode)
+{
+    TRY_LOCK(pnode->cs_vSend, lockSend);
+    return lockSend && !pnode->vSendMsg.empty();
+}
+
+// Wait for readiness with select(), sets the readiness flags of every node and returns the
+// listen sockets to accept on
+static int SocketWaitSelect(const vector<CNode*> &vNodesCopy, vector<const ListenSocket*> &vAccept)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        FD_SET(pnode->hSocket, &fdsetError);
+        hSocketMax = max(hSocketMax, pnode->hSocket);
+        have_fds = true;
+
+        // Implement the following logic:
+        // * If there is data to send, select() for sending data. As this only
+        //   happens when optimistic write failed, we choose to first drain the
+        //   write buffer in this case before receiving more. This avoids
+        //   needlessly queueing received data, if the remote peer is not themselves
+        //   receiving data. This means properly utilizing TCP flow control signaling.
+        // * Otherwise, if there is no (complete) message in the receive buffer,
+        //   or there is space left in the buffer, select() for receiving data.
+        // * (if neither of the above applies, there is certainly one message
+        //   in the receiver buffer ready to be processed).
+        // Together, that means that at least one of the following is always possible,
+        // so we don't deadlock:
+        // * We send some data.
+        // * We wait for data to be received (and disconnect after timeout).
+        // * We process a message in the buffer (message handler thread).
+        if (NodeHasSendData(pnode)) {
+            FD_SET(pnode->hSocket, &fdsetSend);
+            continue;
         }
+        if (NodeCanReceive(pnode))
+            FD_SET(pnode->hSocket, &fdsetRecv);
+    }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
         FD_ZERO(&fdsetSend);
         FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        MilliSleep(timeout.tv_usec/1000);
+    }
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+    {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            vAccept.push_back(&hListenSocket);
+    }
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        pnode->fSocketError = FD_ISSET(pnode->hSocket, &fdsetError);
+        pnode->fSocketReadable = FD_ISSET(pnode->hSocket, &fdsetRecv) || pnode->fSocketError;
+        pnode->fSocketWritable = FD_ISSET(pnode->hSocket, &fdsetSend);
+    }
+    return nSelect > 0 ? nSelect : 0;
+}
 
+#ifdef USE_EPOLL
+static const int MAX_EPOLL_EVENTS = 256;
+
+// Edge triggered readiness: a node stays readable or writable until a recv or send would block,
+// EPOLLOUT is only requested while there is queued send data.
+static void EpollUpdateInterest(int hEpoll, CNode *pnode, bool fWantSend)
+{
+    if (pnode->hSocket == INVALID_SOCKET || (pnode->fSocketRegistered && pnode->fSocketPollOut == fWantSend))
+        return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (fWantSend ? EPOLLOUT : 0);
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, pnode->fSocketRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, pnode->hSocket, &event) == 0) {
+        pnode->fSocketRegistered = true;
+        pnode->fSocketPollOut = fWantSend;
+    } else {
+        LogPrint("net", "epoll_ctl error %s, peer=%d\n", NetworkErrorString(errno), pnode->id);
+    }
+}
+
+// Wait for readiness with epoll. Only the nodes queued by QueueSocketUpdate() have their interest
+// updated, so a wakeup does not touch idle nodes. Nodes are removed from the epoll set by the kernel
+// when their socket is closed, so event pointers are valid for the nodes referenced by vNodesCopy.
+// fPending is set when readiness left over from an earlier edge has to be serviced without waiting.
+static int SocketWaitEpoll(int hEpoll, const vector<CNode*> &vUpdate, vector<const ListenSocket*> &vAccept, bool fPending)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    BOOST_FOREACH(CNode* pnode, vUpdate)
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (!lockSend) {
+            QueueSocketUpdate(pnode);
+            continue;
+        }
+        EpollUpdateInterest(hEpoll, pnode, !pnode->vSendMsg.empty());
+    }
+
+    int nEvents = epoll_wait(hEpoll, events, MAX_EPOLL_EVENTS, fPending ? 0 : 50);
+    boost::this_thread::interruption_point();
+    if (nEvents < 0)
+    {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(50);
+        }
+        return 0;
+    }
+    for (int i = 0; i < nEvents; i++)
+    {
+        bool fListen = false;
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            if (events[i].data.ptr == &hListenSocket) {
+                vAccept.push_back(&hListenSocket);
+                fListen = true;
+                break;
+            }
         }
+        if (fListen)
+            continue;
+        CNode *pnode = (CNode *)events[i].data.ptr;
+        if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            pnode->fSocketError = true;
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            pnode->fSocketReadable = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSocketWritable = true;
+    }
+    return nEvents;
+}
+#endif
 
+void ThreadSocketHandler()
+{
+    unsigned int nPrevNodeCount = 0;
+    int hEpoll = -1;
+    std::string strBackend = "select";
+#ifdef USE_EPOLL
+    // the handler only leaves its loop when the thread is interrupted
+    struct CEpollCloser {
+        int &hEpoll;
+        CEpollCloser(int &hEpollIn) : hEpoll(hEpollIn) {}
+        ~CEpollCloser() { if (hEpoll >= 0) close(hEpoll); }
+    } epollCloser(hEpoll);
+    if (GetArg("-socketevents", DEFAULT_SOCKET_EVENTS) == "epoll")
+    {
+        if ((hEpoll = epoll_create1(EPOLL_CLOEXEC)) < 0)
+            LogPrintf("epoll_create1 failed: %s, falling back to select\n", NetworkErrorString(errno));
+        else
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signaling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+            strBackend = "epoll";
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                // level triggered, one connection is accepted per loop like with select
+                struct epoll_event event;
+                memset(&event, 0, sizeof(event));
+                event.events = EPOLLIN;
+                event.data.ptr = (void *)&hListenSocket;
+                if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0)
+                    LogPrintf("epoll_ctl failed for listen socket: %s\n", NetworkErrorString(errno));
             }
         }
+    }
+#endif
+    LogPrintf("Socket handler using %s\n", strBackend);
+    {
+        LOCK(cs_socketLoopStats);
+        socketLoopStats = CSocketLoopStats();
+        socketLoopStats.strBackend = strBackend;
+    }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+    bool fPending = false;
+    while (true)
+    {
+        DisconnectNodes(nPrevNodeCount);
 
-        if (nSelect == SOCKET_ERROR)
+        vector<CNode*> vNodesCopy;
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->AddRef();
+        }
+        vector<CNode*> vUpdate;
+        {
+            LOCK(cs_vSocketUpdate);
+            vUpdate.swap(vSocketUpdate);
+            BOOST_FOREACH(CNode* pnode, vUpdate)
+                pnode->fSocketUpdateQueued = false;
         }
 
         //
-        // Accept new connections
+        // Find which sockets have data to receive
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        vector<const ListenSocket*> vAccept;
+        int64_t nWaitStart = GetTimeMicros();
+        int nEvents;
+#ifdef USE_EPOLL
+        if (hEpoll >= 0)
+            nEvents = SocketWaitEpoll(hEpoll, vUpdate, vAccept, fPending);
+        else
+#endif
+            nEvents = SocketWaitSelect(vNodesCopy, vAccept);
+        int64_t nServiceStart = GetTimeMicros();
+        fPending = false;
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vUpdate)
+                pnode->Release();
         }
 
+        //
+        // Accept new connections
+        //
+        BOOST_FOREACH(const ListenSocket* pListenSocket, vAccept)
+            AcceptConnection(*pListenSocket);
+
         //
         // Service each socket
         //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->AddRef();
-        }
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
@@ -1192,7 +1379,8 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            // with select the receive set already applied flow control, errors are always read
+            if (pnode->fSocketReadable && (hEpoll < 0 || pnode->fSocketError || (!pnode->fSocketPollOut && NodeCanReceive(pnode))))
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1220,6 +1408,8 @@ void ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
+                            if (nErr == WSAEWOULDBLOCK)
+                                pnode->fSocketReadable = false;
                             if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
@@ -1236,12 +1426,26 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fSocketWritable)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
                     SocketSendData(pnode);
+                    // a partial send means the socket buffer is full, wait for the next EPOLLOUT edge
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSocketWritable = false;
+#ifdef USE_EPOLL
+                    else if (hEpoll >= 0)
+                        EpollUpdateInterest(hEpoll, pnode, false);
+#endif
+                }
             }
+#ifdef USE_EPOLL
+            if (hEpoll >= 0 && pnode->hSocket != INVALID_SOCKET &&
+                (pnode->fSocketPollOut ? pnode->fSocketWritable : (pnode->fSocketReadable && NodeCanReceive(pnode))))
+                fPending = true;
+#endif
 
             //
             // Inactivity checking
@@ -1276,6 +1480,16 @@ void ThreadSocketHandler()
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
+
+        int64_t nServiceEnd = GetTimeMicros();
+        {
+            LOCK(cs_socketLoopStats);
+            socketLoopStats.nIterations++;
+            socketLoopStats.nEvents += nEvents;
+            socketLoopStats.nWaitMicros += nServiceStart - nWaitStart;
+            socketLoopStats.nServiceMicros += nServiceEnd - nServiceStart;
+            socketLoopStats.nMaxServiceMicros = std::max(socketLoopStats.nMaxServiceMicros, nServiceEnd - nServiceStart);
+        }
     }
 }
 
@@ -1567,6 +1781,43 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
+static CCriticalSection cs_messageTimings;
+static std::map<std::string, CMessageTimingStats> mapMessageTimings;
+
+void RecordMessageTiming(const std::string& strCommand, int64_t nMicros)
+{
+    int nBucket = 0;
+    for (int64_t nLimit = 100; nBucket < MESSAGE_TIMING_BUCKETS - 1 && nMicros >= nLimit; nLimit *= 10)
+        nBucket++;
+
+    LOCK(cs_messageTimings);
+    std::map<std::string, CMessageTimingStats>::iterator it = mapMessageTimings.find(strCommand);
+    if (it == mapMessageTimings.end())
+    {
+        // commands are chosen by the peer, keep unknown ones from growing the map
+        if (mapMessageTimings.size() >= MAX_MESSAGE_TIMING_COMMANDS || SanitizeString(strCommand) != strCommand)
+            it = mapMessageTimings.insert(std::make_pair(std::string("other"), CMessageTimingStats())).first;
+        else
+            it = mapMessageTimings.insert(std::make_pair(strCommand, CMessageTimingStats())).first;
+    }
+    CMessageTimingStats& stats = it->second;
+    stats.nCount++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    stats.vBuckets[nBucket]++;
+}
+
+void GetMessageTimings(std::map<std::string, CMessageTimingStats>& mapTimings)
+{
+    LOCK(cs_messageTimings);
+    mapTimings = mapMessageTimings;
+}
+
+void WakeMessageHandler()
+{
+    messageHandlerCondition.notify_one();
+}
+
 void ThreadMessageHandler()
 {
     boost::mutex condition_mutex;
@@ -1606,7 +1857,14 @@ void ThreadMessageHandler()
 
                     if (pnode->nSendSize < SendBufferSize())
                     {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
+                        // a peer whose getdata is with a worker is skipped until the worker wakes us
+                        bool fGetDataBusy, fGetData;
+                        {
+                            TRY_LOCK(pnode->cs_vRecvGetData, lockGetData);
+                            fGetDataBusy = !lockGetData || pnode->fGetDataQueued;
+                            fGetData = !fGetDataBusy && !pnode->vRecvGetData.empty();
+                        }
+                        if (!fGetDataBusy && (fGetData || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())))
                         {
                             fSleep = false;
                         }
@@ -2140,6 +2398,16 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nPingUsecTime = 0;
     fPingQueued = false;
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
+    nSPVqueued = 0;
+    fGetDataQueued = false;
+    fSupportsCompactBlocks = false;
+    fAnnounceCompactBlocks = false;
+    fSocketRegistered = false;
+    fSocketReadable = false;
+    fSocketWritable = false;
+    fSocketError = false;
+    fSocketPollOut = false;
+    fSocketUpdateQueued = false;
 
     {
         LOCK(cs_nLastNodeId);
@@ -2255,9 +2523,12 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
 
-    // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    // If write queue empty, attempt "optimistic write", the socket handler waits to send the rest
+    if (it == vSendMsg.begin()) {
         SocketSendData(this);
+        if (!vSendMsg.empty())
+            QueueSocketUpdate(this);
+    }
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
@@ -36,6 +36,7 @@
 #include "util.h"
 
 #include <deque>
+#include <map>
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -78,6 +79,45 @@ static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 384;
 /** The period before a network upgrade activates, where connections to upgrading peers are preferred (in blocks). */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 24 * 24 * 3;
 
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+/** -socketevents default, how the socket handler waits for readiness ("epoll" or "select") */
+#ifdef USE_EPOLL
+static const char DEFAULT_SOCKET_EVENTS[] = "epoll";
+#else
+static const char DEFAULT_SOCKET_EVENTS[] = "select";
+#endif
+
+/** Socket handler loop counters, see GetSocketLoopStats() */
+struct CSocketLoopStats
+{
+    std::string strBackend;
+    uint64_t nIterations;
+    uint64_t nEvents;           //! readiness events reported by the backend
+    int64_t nWaitMicros;        //! total time blocked waiting for readiness
+    int64_t nServiceMicros;     //! total time spent receiving, sending and accepting
+    int64_t nMaxServiceMicros;  //! longest single service pass
+};
+
+/** Processing time histogram of one message command, see RecordMessageTiming() */
+static const int MESSAGE_TIMING_BUCKETS = 6;
+/** Distinct commands tracked, anything beyond is counted as "other" */
+static const unsigned int MAX_MESSAGE_TIMING_COMMANDS = 64;
+struct CMessageTimingStats
+{
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    uint64_t vBuckets[MESSAGE_TIMING_BUCKETS]; //! <100us, <1ms, <10ms, <100ms, <1s, >=1s
+
+    CMessageTimingStats() : nCount(0), nTotalMicros(0), nMaxMicros(0)
+    {
+        for (int i = 0; i < MESSAGE_TIMING_BUCKETS; i++)
+            vBuckets[i] = 0;
+    }
+};
+
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
 
@@ -94,6 +134,10 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+void GetSocketLoopStats(CSocketLoopStats &stats);
+void RecordMessageTiming(const std::string& strCommand, int64_t nMicros);
+void GetMessageTimings(std::map<std::string, CMessageTimingStats>& mapTimings);
+void WakeMessageHandler();
 
 typedef int NodeId;
 
@@ -275,6 +319,10 @@ public:
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
+    // guards vRecvGetData and fGetDataQueued, held by whichever thread serves the getdata
+    CCriticalSection cs_vRecvGetData;
+    // vRecvGetData is waiting for or being served by a getdata worker
+    bool fGetDataQueued;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
@@ -285,6 +333,21 @@ public:
     int64_t nTimeConnected;
     int64_t nTimeOffset;
     uint32_t prevtimes[16];
+    // getnSPV requests waiting in the worker queue, guarded by the queue mutex
+    int32_t nSPVqueued;
+    // serializes the getnSPV requests of this peer across worker threads
+    CCriticalSection cs_nSPV;
+    // the peer sent "sendcmpct": it understands compact blocks, and wants new blocks announced with them
+    bool fSupportsCompactBlocks;
+    bool fAnnounceCompactBlocks;
+    // socket handler readiness state, only touched by the socket handler thread
+    bool fSocketRegistered;
+    bool fSocketReadable;
+    bool fSocketWritable;
+    bool fSocketError;
+    bool fSocketPollOut;
+    // queued for the socket handler to update its epoll interest, guarded by cs_vSocketUpdate
+    bool fSocketUpdateQueued;
     // Address of this peer
     CAddress addr;
     // Bind address of our side of the connection
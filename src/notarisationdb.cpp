@@ -12,7 +12,7 @@
 NotarisationDB *pnotarisations;
 
 
-NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", nCacheSize, fMemory, fWipe, false, 64) { }
+NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", CDBOptions("notarisations", nCacheSize, false, 64).ApplyProfileArgs(), fMemory, fWipe) { }
 
 
 NotarisationsInBlock ScanBlockNotarisations(const CBlock &block, int nHeight)
@@ -116,13 +116,19 @@ void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &
  */
 int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Notarisation& out)
 {
-    if (height < 0 || height > chainActive.Height())
-        return false;
+    // Copy the hashes under cs_main so the db reads below run without it
+    std::vector<uint256> hashes;
+    {
+        LOCK(cs_main);
+        if (height < 0 || height > chainActive.Height())
+            return false;
+        for (int i=0; i<scanLimitBlocks && i<=height; i++)
+            hashes.push_back(*chainActive[height-i]->phashBlock);
+    }
 
-    for (int i=0; i<scanLimitBlocks; i++) {
-        if (i > height) break;
+    for (int i=0; i<hashes.size(); i++) {
         NotarisationsInBlock notarisations;
-        uint256 blockHash = *chainActive[height-i]->phashBlock;
+        const uint256 &blockHash = hashes[i];
         if (!GetBlockNotarisations(blockHash, notarisations))
             continue;
 
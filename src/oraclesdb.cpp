@@ -0,0 +1,280 @@
+#include "oraclesdb.h"
+#include "chainindexdb.h"
+#include "dbwrapper.h"
+#include "main.h"
+#include "sync.h"
+#include "uint256.h"
+#include "cc/CCOracles.h"
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <set>
+
+
+OraclesDB *poracles;
+
+static const char DB_ORACLE_SAMPLE = 'd';
+static const char DB_ORACLE_SAMPLE_TIME = 't';
+static const char DB_ORACLE_LATEST = 'l';
+static const char DB_ORACLE_BATONADDR = 'a';
+static const char DB_ORACLES_START = 'S';           //!< first indexed block of older versions, erased on reset
+
+/*
+ * The series are appended to as blocks are connected, the latest sample of
+ * each is also kept in memory for the prices computed from all publishers.
+ * Taken after cs_main.
+ */
+static CCriticalSection cs_oracles;
+static std::map<uint256, std::map<CPubKey, COracleSample> > mapLatestSamples;
+static uint256 hashOraclesBestBlock;
+
+
+OraclesDB::OraclesDB(size_t nCacheSize, bool fMemory, bool fWipe) : CChainIndexDB("oracles", nCacheSize, fMemory, fWipe) { }
+
+
+// position the cursor on the last record before key
+template <typename K>
+static void SeekBefore(CDBIterator *pcursor, const K &key)
+{
+    pcursor->Seek(key);
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else
+        pcursor->SeekToLast();
+}
+
+// key after the records of series up to nTo, or after all of them if nTo is 0
+static COracleSampleKey SeriesEndKey(const COracleSeriesKey &series, uint32_t nTo)
+{
+    if (nTo == 0 || nTo == 0xffffffff)
+        return COracleSampleKey(series, 0xffffffff, -1, 0xffffffff);
+    return COracleSampleKey(series, nTo + 1, 0, 0);
+}
+
+
+bool ResetOracleSamples()
+{
+    LOCK(cs_oracles);
+    mapLatestSamples.clear();
+    hashOraclesBestBlock.SetNull();
+    return poracles->Wipe(std::string(1, DB_ORACLE_SAMPLE) + DB_ORACLE_SAMPLE_TIME + DB_ORACLE_LATEST + DB_ORACLE_BATONADDR + DB_ORACLES_START, uint256());
+}
+
+
+/*
+ * Load the latest sample of each series, as of the block the index was last
+ * written at. An index of an older version, which started at the tip of the
+ * node it was created on, is built again from the genesis block since its
+ * series miss the samples before.
+ */
+bool LoadOracleSamples()
+{
+    std::pair<int32_t, uint32_t> start;
+    if (poracles->Read(DB_ORACLES_START, start) && start.first > 0) {
+        LogPrintf("%s: oracle samples are indexed from height %d only, they are indexed again\n", __func__, start.first);
+        return ResetOracleSamples();
+    }
+
+    LOCK(cs_oracles);
+    mapLatestSamples.clear();
+    hashOraclesBestBlock = poracles->ReadBestBlock();
+
+    boost::scoped_ptr<CDBIterator> pcursor(poracles->NewIterator());
+    pcursor->Seek(DB_ORACLE_LATEST);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, COracleSeriesKey> key;
+        COracleSample sample;
+        if (!pcursor->GetKey(key) || key.first != DB_ORACLE_LATEST)
+            break;
+        if (!pcursor->GetValue(sample))
+            return error("%s: cannot read the latest sample of oracle %s", __func__, key.second.oracletxid.ToString());
+        mapLatestSamples[key.second.oracletxid][key.second.publisher] = sample;
+        pcursor->Next();
+    }
+    LogPrintf("%s: loaded the latest samples of %u oracles at block %s\n", __func__, mapLatestSamples.size(), hashOraclesBestBlock.ToString());
+    return true;
+}
+
+
+uint256 GetOracleSamplesBestBlock()
+{
+    LOCK(cs_oracles);
+    return hashOraclesBestBlock;
+}
+
+
+// The node is aborted by ConnectBlock or DisconnectTip after this; the latest samples
+// are dropped so no series ends past the db, LoadOracleSamples restores them on restart
+static bool OracleSamplesWriteFailed()
+{
+    AssertLockHeld(cs_oracles);
+    mapLatestSamples.clear();
+    hashOraclesBestBlock.SetNull();
+    return error("%s: cannot write the oracle samples index", __func__);
+}
+
+
+/*
+ * Every data tx of the block is appended to the series of its publisher and
+ * becomes its latest sample. A block not extending hashOraclesBestBlock is
+ * left out, the series only grow from the block the index is at.
+ */
+bool ConnectOracleSamples(const CBlock &block, int nHeight)
+{
+    LOCK(cs_oracles);
+    if (poracles == NULL || block.hashPrevBlock != hashOraclesBestBlock || (hashOraclesBestBlock.IsNull() && nHeight != 0))
+        return true;
+
+    CDBBatch batch(*poracles);
+    for (uint32_t i = 0; i < block.vtx.size(); i++)
+    {
+        uint256 oracletxid;
+        COracleSample sample;
+        char batonaddr[64];
+        if (!OraclesDecodeSample(block.vtx[i], oracletxid, sample.publisher, sample.data, batonaddr))
+            continue;
+        sample.txid = block.vtx[i].GetHash();
+        sample.nHeight = nHeight;
+        sample.nTime = block.nTime;
+        COracleSeriesKey series(oracletxid, sample.publisher);
+        batch.Write(std::make_pair(DB_ORACLE_SAMPLE, COracleSampleKey(series, nHeight, nHeight, i)), sample);
+        batch.Write(std::make_pair(DB_ORACLE_SAMPLE_TIME, COracleSampleKey(series, block.nTime, nHeight, i)), (uint8_t)0);
+        batch.Write(std::make_pair(DB_ORACLE_LATEST, series), sample);
+        batch.Write(std::make_pair(DB_ORACLE_BATONADDR, std::make_pair(oracletxid, std::string(batonaddr))), sample.publisher);
+        mapLatestSamples[oracletxid][sample.publisher] = sample;
+    }
+    if (!poracles->WriteBlock(batch, block.GetHash()))
+        return OracleSamplesWriteFailed();
+    hashOraclesBestBlock = block.GetHash();
+    return true;
+}
+
+
+bool DisconnectOracleSamples(const CBlock &block, int nHeight)
+{
+    LOCK(cs_oracles);
+    if (poracles == NULL || block.GetHash() != hashOraclesBestBlock)
+        return true;
+
+    CDBBatch batch(*poracles);
+    std::set<COracleSeriesKey> setSeries;
+    for (uint32_t i = 0; i < block.vtx.size(); i++)
+    {
+        uint256 oracletxid;
+        CPubKey publisher;
+        std::vector<uint8_t> data;
+        char batonaddr[64];
+        if (!OraclesDecodeSample(block.vtx[i], oracletxid, publisher, data, batonaddr))
+            continue;
+        COracleSeriesKey series(oracletxid, publisher);
+        batch.Erase(std::make_pair(DB_ORACLE_SAMPLE, COracleSampleKey(series, nHeight, nHeight, i)));
+        batch.Erase(std::make_pair(DB_ORACLE_SAMPLE_TIME, COracleSampleKey(series, block.nTime, nHeight, i)));
+        setSeries.insert(series);
+    }
+    // the latest sample of a series is again the last one before the block
+    boost::scoped_ptr<CDBIterator> pcursor(poracles->NewIterator());
+    BOOST_FOREACH(const COracleSeriesKey &series, setSeries)
+    {
+        std::pair<char, COracleSampleKey> key;
+        COracleSample sample;
+        SeekBefore(pcursor.get(), std::make_pair(DB_ORACLE_SAMPLE, COracleSampleKey(series, nHeight, nHeight, 0)));
+        if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ORACLE_SAMPLE && key.second.series == series && pcursor->GetValue(sample)) {
+            batch.Write(std::make_pair(DB_ORACLE_LATEST, series), sample);
+            mapLatestSamples[series.oracletxid][series.publisher] = sample;
+        } else {
+            batch.Erase(std::make_pair(DB_ORACLE_LATEST, series));
+            mapLatestSamples[series.oracletxid].erase(series.publisher);
+            if (mapLatestSamples[series.oracletxid].empty())
+                mapLatestSamples.erase(series.oracletxid);
+        }
+    }
+    if (!poracles->WriteBlock(batch, block.hashPrevBlock))
+        return OracleSamplesWriteFailed();
+    hashOraclesBestBlock = block.hashPrevBlock;
+    return true;
+}
+
+
+// the series are complete once the index has caught up with the tip
+static bool OracleSamplesAtTip()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_oracles);
+    return poracles != NULL && chainActive.Tip() != NULL && hashOraclesBestBlock == chainActive.Tip()->GetBlockHash();
+}
+
+
+bool GetOracleSamples(const COracleSeriesKey &series, int32_t nFrom, int32_t nTo, size_t nMax, std::vector<COracleSample> &vSamples)
+{
+    vSamples.clear();
+    LOCK2(cs_main, cs_oracles);
+    if (!OracleSamplesAtTip())
+        return false;
+
+    boost::scoped_ptr<CDBIterator> pcursor(poracles->NewIterator());
+    SeekBefore(pcursor.get(), std::make_pair(DB_ORACLE_SAMPLE, SeriesEndKey(series, nTo > 0 ? nTo : 0)));
+    while (pcursor->Valid())
+    {
+        std::pair<char, COracleSampleKey> key;
+        COracleSample sample;
+        if (!pcursor->GetKey(key) || key.first != DB_ORACLE_SAMPLE || !(key.second.series == series) || key.second.nHeight < nFrom)
+            break;
+        if (!pcursor->GetValue(sample))
+            return error("%s: cannot read sample at height %d of oracle %s", __func__, key.second.nHeight, series.oracletxid.ToString());
+        vSamples.push_back(sample);
+        if (nMax != 0 && vSamples.size() >= nMax)
+            return true;
+        pcursor->Prev();
+    }
+    return true;
+}
+
+
+bool GetOracleSamplesByTime(const COracleSeriesKey &series, uint32_t nFromTime, uint32_t nToTime, size_t nMax, std::vector<COracleSample> &vSamples)
+{
+    vSamples.clear();
+    LOCK2(cs_main, cs_oracles);
+    if (!OracleSamplesAtTip())
+        return false;
+
+    boost::scoped_ptr<CDBIterator> pcursor(poracles->NewIterator());
+    SeekBefore(pcursor.get(), std::make_pair(DB_ORACLE_SAMPLE_TIME, SeriesEndKey(series, nToTime)));
+    while (pcursor->Valid())
+    {
+        std::pair<char, COracleSampleKey> key;
+        COracleSample sample;
+        if (!pcursor->GetKey(key) || key.first != DB_ORACLE_SAMPLE_TIME || !(key.second.series == series) || key.second.nOrder < nFromTime)
+            break;
+        if (!poracles->Read(std::make_pair(DB_ORACLE_SAMPLE, COracleSampleKey(series, key.second.nHeight, key.second.nHeight, key.second.nTx)), sample))
+            return error("%s: sample at height %d of oracle %s is missing", __func__, key.second.nHeight, series.oracletxid.ToString());
+        vSamples.push_back(sample);
+        if (nMax != 0 && vSamples.size() >= nMax)
+            return true;
+        pcursor->Prev();
+    }
+    return true;
+}
+
+
+bool GetOracleLatestSamples(const uint256 &oracletxid, std::vector<COracleSample> &vSamples)
+{
+    vSamples.clear();
+    LOCK2(cs_main, cs_oracles);
+    if (!OracleSamplesAtTip())
+        return false;
+    std::map<uint256, std::map<CPubKey, COracleSample> >::const_iterator it = mapLatestSamples.find(oracletxid);
+    if (it == mapLatestSamples.end())
+        return true;
+    for (std::map<CPubKey, COracleSample>::const_iterator itSample = it->second.begin(); itSample != it->second.end(); itSample++)
+        vSamples.push_back(itSample->second);
+    return true;
+}
+
+
+bool GetOraclePublisher(const uint256 &oracletxid, const std::string &batonaddr, CPubKey &publisher)
+{
+    LOCK2(cs_main, cs_oracles);
+    return OracleSamplesAtTip() && poracles->Read(std::make_pair(DB_ORACLE_BATONADDR, std::make_pair(oracletxid, batonaddr)), publisher);
+}
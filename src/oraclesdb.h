@@ -0,0 +1,123 @@
+#ifndef ORACLESDB_H
+#define ORACLESDB_H
+
+#include "chainindexdb.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+
+/** Data samples of one publisher of an oracle */
+struct COracleSeriesKey
+{
+    uint256 oracletxid;
+    CPubKey publisher;
+
+    COracleSeriesKey() {}
+    COracleSeriesKey(const uint256 &oracletxidIn, const CPubKey &publisherIn) : oracletxid(oracletxidIn), publisher(publisherIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(oracletxid);
+        READWRITE(publisher);
+    }
+
+    friend bool operator<(const COracleSeriesKey &a, const COracleSeriesKey &b) {
+        if (a.oracletxid != b.oracletxid)
+            return a.oracletxid < b.oracletxid;
+        return a.publisher < b.publisher;
+    }
+    friend bool operator==(const COracleSeriesKey &a, const COracleSeriesKey &b) {
+        return a.oracletxid == b.oracletxid && a.publisher == b.publisher;
+    }
+};
+
+/** Position of a sample in its series, by height or by block time */
+struct COracleSampleKey
+{
+    COracleSeriesKey series;
+    uint32_t nOrder;            //!< height of the block, or its time
+    int32_t nHeight;
+    uint32_t nTx;               //!< position of the tx in its block
+
+    COracleSampleKey() : nOrder(0), nHeight(0), nTx(0) {}
+    COracleSampleKey(const COracleSeriesKey &seriesIn, uint32_t nOrderIn, int32_t nHeightIn, uint32_t nTxIn) :
+        series(seriesIn), nOrder(nOrderIn), nHeight(nHeightIn), nTx(nTxIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << series;
+        // stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, nOrder);
+        ser_writedata32be(s, nHeight);
+        ser_writedata32be(s, nTx);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> series;
+        nOrder = ser_readdata32be(s);
+        nHeight = ser_readdata32be(s);
+        nTx = ser_readdata32be(s);
+    }
+};
+
+/** Data tx of a publisher, as it was confirmed */
+struct COracleSample
+{
+    uint256 txid;
+    CPubKey publisher;
+    int32_t nHeight;            //!< 0 for a tx in the mempool
+    uint32_t nTime;             //!< time of its block
+    std::vector<uint8_t> data;
+
+    COracleSample() : nHeight(0), nTime(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(publisher);
+        READWRITE(nHeight);
+        READWRITE(nTime);
+        READWRITE(data);
+    }
+};
+
+
+class OraclesDB : public CChainIndexDB
+{
+public:
+    OraclesDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+};
+
+
+extern OraclesDB *poracles;
+
+bool LoadOracleSamples();
+bool ResetOracleSamples();
+uint256 GetOracleSamplesBestBlock();
+bool ConnectOracleSamples(const CBlock &block, int nHeight);
+bool DisconnectOracleSamples(const CBlock &block, int nHeight);
+
+/**
+ * Samples of a series with nFrom <= height <= nTo (nTo 0 for no limit), newest
+ * first and at most nMax of them (0 for all). False if the index has not
+ * caught up with the tip yet and some of them may be missing.
+ */
+bool GetOracleSamples(const COracleSeriesKey &series, int32_t nFrom, int32_t nTo, size_t nMax, std::vector<COracleSample> &vSamples);
+/** As GetOracleSamples, by the time of their blocks */
+bool GetOracleSamplesByTime(const COracleSeriesKey &series, uint32_t nFromTime, uint32_t nToTime, size_t nMax, std::vector<COracleSample> &vSamples);
+/** Latest confirmed sample of every publisher of the oracle, false if the index is not at the tip */
+bool GetOracleLatestSamples(const uint256 &oracletxid, std::vector<COracleSample> &vSamples);
+/** Publisher whose data txs pass their baton on to batonaddr */
+bool GetOraclePublisher(const uint256 &oracletxid, const std::string &batonaddr, CPubKey &publisher);
+
+#endif  /* ORACLESDB_H */
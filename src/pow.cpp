@@ -649,11 +649,9 @@ uint32_t lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::
         if (!pindexFirst)
             return nProofOfStakeLimit;
 
-        CBlockHeader hdr = pindexFirst->GetBlockHeader();
-
-        if (hdr.IsVerusPOSBlock())
+        if (pindexFirst->IsVerusPOSBlock())
         {
-            nBits = hdr.GetVerusPOSTarget();
+            nBits = pindexFirst->GetVerusPOSTarget();
             break;
         }
         pindexFirst = pindexFirst->pprev;
@@ -675,10 +673,9 @@ uint32_t lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::
             if (!pindexFirst)
                 return nProofOfStakeLimit;
 
-            CBlockHeader hdr = pindexFirst->GetBlockHeader();
-            if (hdr.IsVerusPOSBlock())
+            if (pindexFirst->IsVerusPOSBlock())
             {
-                nBits = hdr.GetVerusPOSTarget();
+                nBits = pindexFirst->GetVerusPOSTarget();
                 break;
             }
         }
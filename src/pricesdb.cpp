@@ -0,0 +1,280 @@
+#include "pricesdb.h"
+#include "chainindexdb.h"
+#include "dbwrapper.h"
+#include "main.h"
+#include "sync.h"
+#include "uint256.h"
+#include "cc/CCPrices.h"
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+PricesDB *pprices;
+
+static const char DB_PRICES_BET = 's';
+static const char DB_PRICES_BETS_UNDO = 'u';
+static const char DB_PRICES_BETS_BUILT_HEIGHT = 'H';
+
+/** Blocks that keep an undo record, a deeper reorg builds the index again */
+static const int PRICES_BETS_UNDO_DEPTH = 100;
+
+typedef std::vector<std::pair<uint256, CPricesBetState> > PricesBetsUndo;
+
+/*
+ * The open bets with the profits of each scanned up to the tip. Every
+ * connected block scans each of them one height further, so the rpcs do not
+ * scan the prices of a bet from its first height every time.
+ */
+static CCriticalSection cs_prices;
+static std::map<uint256, CPricesBetState> mapBetStates;
+static uint256 hashPricesBestBlock;
+static int32_t nPricesBuiltHeight = -1;
+
+
+PricesDB::PricesDB(size_t nCacheSize, bool fMemory, bool fWipe) : CChainIndexDB("prices", nCacheSize, fMemory, fWipe) { }
+
+
+/*
+ * Load the open bets if the index is at the tip. The profits of a bet depend
+ * on the prices of every height since it was made, so an index left behind is
+ * not replayed but built again at the tip from the address and spent indexes
+ * when it is first queried.
+ */
+bool LoadPricesBets(const uint256 &hashTip)
+{
+    uint256 hashBest = pprices->ReadBestBlock();
+    int32_t nBuiltHeight = -1;
+
+    LOCK(cs_prices);
+    mapBetStates.clear();
+    hashPricesBestBlock.SetNull();
+    pprices->Read(DB_PRICES_BETS_BUILT_HEIGHT, nBuiltHeight);
+    if (hashBest != hashTip) {
+        LogPrintf("%s: prices bets index is not at the tip, it will be built again\n", __func__);
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(pprices->NewIterator());
+    pcursor->Seek(DB_PRICES_BET);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        CPricesBetState state;
+        if (!pcursor->GetKey(key) || key.first != DB_PRICES_BET)
+            break;
+        if (!pcursor->GetValue(state))
+            return error("%s: cannot read prices bet %s", __func__, key.second.ToString());
+        mapBetStates[key.second] = state;
+        pcursor->Next();
+    }
+    hashPricesBestBlock = hashBest;
+    nPricesBuiltHeight = nBuiltHeight;
+    LogPrintf("%s: loaded %u open prices bets\n", __func__, mapBetStates.size());
+    return true;
+}
+
+
+// ConnectTip and DisconnectTip abort the node when a bets batch cannot be written.
+// The open bets are dropped meanwhile and the index is rebuilt by the next query
+static bool PricesBetsWriteFailed()
+{
+    AssertLockHeld(cs_prices);
+    mapBetStates.clear();
+    hashPricesBestBlock.SetNull();
+    return error("%s: cannot write the prices bets index", __func__);
+}
+
+
+/*
+ * Build the index at the tip from the bets listed by their normal marker,
+ * each worked out from its txs as pricesinfo does without the index.
+ */
+bool BuildPricesBets()
+{
+    AssertLockHeld(cs_main);
+    if (!fAddressIndex || !fSpentIndex || chainActive.Tip() == NULL)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    std::vector<uint256> vBettxids;
+    prices_listbettxids(vBettxids);
+
+    LOCK(cs_prices);
+    mapBetStates.clear();
+    hashPricesBestBlock.SetNull();
+    if (!pprices->Wipe(std::string(1, DB_PRICES_BET) + DB_PRICES_BETS_UNDO, uint256()))
+        return error("%s: cannot wipe the prices bets index", __func__);
+    CDBBatch batch(*pprices);
+    BOOST_FOREACH(const uint256 &bettxid, vBettxids)
+    {
+        CPricesBetState state;
+        if (!prices_betstatefromchain(bettxid, state))
+            continue;
+        mapBetStates[bettxid] = state;
+        batch.Write(std::make_pair(DB_PRICES_BET, bettxid), state);
+    }
+
+    batch.Write(DB_PRICES_BETS_BUILT_HEIGHT, (int32_t)chainActive.Height());
+    if (!pprices->WriteBlock(batch, chainActive.Tip()->GetBlockHash())) {
+        mapBetStates.clear();
+        return error("%s: cannot write the prices bets index", __func__);
+    }
+    hashPricesBestBlock = chainActive.Tip()->GetBlockHash();
+    nPricesBuiltHeight = chainActive.Height();
+    LogPrintf("%s: built prices bets index with %u open bets at height %d in %dms\n", __func__,
+        mapBetStates.size(), chainActive.Height(), GetTimeMillis() - nStart);
+    return true;
+}
+
+
+/*
+ * Bets made by the block are added, fundings added to a bet go to its
+ * positions and bets closed by the block leave the index. Then every open bet
+ * is scanned up to the block, it runs after the prices of the block are read
+ * in. The states before the block are kept in its undo record, with no
+ * positions for bets it made.
+ */
+bool ConnectPricesBets(const CBlock &block, int nHeight)
+{
+    LOCK(cs_prices);
+    if (pprices == NULL || block.hashPrevBlock != hashPricesBestBlock || (hashPricesBestBlock.IsNull() && nHeight != 0))
+        return true;
+
+    std::map<uint256, CPricesBetState> mapUndo;
+    std::set<uint256> setClosed;
+    std::map<uint256, uint256> mapBatons;
+    for (std::map<uint256, CPricesBetState>::const_iterator it = mapBetStates.begin(); it != mapBetStates.end(); it++)
+        mapBatons[it->second.batontxid] = it->first;
+
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+    {
+        BOOST_FOREACH(const CTxIn &txin, tx.vin)
+        {
+            std::map<uint256, CPricesBetState>::iterator it;
+            if (txin.prevout.n == NVOUT_CCMARKER && (it = mapBetStates.find(txin.prevout.hash)) != mapBetStates.end()) {
+                mapUndo.insert(std::make_pair(it->first, it->second));
+                mapBatons.erase(it->second.batontxid);
+                mapBetStates.erase(it);
+                setClosed.insert(txin.prevout.hash);
+            }
+            else if (txin.prevout.n == 0 && mapBatons.count(txin.prevout.hash)) {
+                // as prices_enumaddedbets walks the spends of the baton, a spend which
+                // is not an added funding ends the chain of the bet
+                uint256 bettxid = mapBatons[txin.prevout.hash];
+                CPricesBetState &state = mapBetStates[bettxid];
+                int64_t amount;
+                mapUndo.insert(std::make_pair(bettxid, state));
+                mapBatons.erase(state.batontxid);
+                state.batontxid = tx.GetHash();
+                if (!prices_isaddedbet(tx, amount))
+                    continue;
+                CPricesBetPosition added;
+                added.positionsize = amount;
+                added.firstheight = nHeight;
+                state.positions.push_back(added);
+                mapBatons[state.batontxid] = bettxid;
+            }
+        }
+        CPricesBetState state;
+        if (prices_betstatefromtx(tx, state)) {
+            mapUndo.insert(std::make_pair(tx.GetHash(), CPricesBetState()));
+            mapBetStates[tx.GetHash()] = state;
+            mapBatons[state.batontxid] = tx.GetHash();
+        }
+    }
+
+    CDBBatch batch(*pprices);
+    for (std::map<uint256, CPricesBetState>::iterator it = mapBetStates.begin(); it != mapBetStates.end(); it++)
+    {
+        mapUndo.insert(std::make_pair(it->first, it->second));
+        prices_betstatescan(it->second, nHeight);
+        batch.Write(std::make_pair(DB_PRICES_BET, it->first), it->second);
+    }
+    BOOST_FOREACH(const uint256 &bettxid, setClosed)
+        if (!mapBetStates.count(bettxid))
+            batch.Erase(std::make_pair(DB_PRICES_BET, bettxid));
+
+    batch.Write(std::make_pair(DB_PRICES_BETS_UNDO, (int32_t)nHeight), PricesBetsUndo(mapUndo.begin(), mapUndo.end()));
+    batch.Erase(std::make_pair(DB_PRICES_BETS_UNDO, (int32_t)nHeight - PRICES_BETS_UNDO_DEPTH));
+    if (!pprices->WriteBlock(batch, block.GetHash()))
+        return PricesBetsWriteFailed();
+    hashPricesBestBlock = block.GetHash();
+    return true;
+}
+
+
+bool DisconnectPricesBets(const CBlock &block, int nHeight)
+{
+    LOCK(cs_prices);
+    uint256 hash = block.GetHash();
+    if (pprices == NULL || hashPricesBestBlock != hash)
+        return true;
+
+    CDBBatch batch(*pprices);
+    PricesBetsUndo vUndo;
+    if (nHeight <= nPricesBuiltHeight || !pprices->Read(std::make_pair(DB_PRICES_BETS_UNDO, (int32_t)nHeight), vUndo)) {
+        // the block was connected before the index was built or too long ago, it is built again when queried
+        mapBetStates.clear();
+        hashPricesBestBlock.SetNull();
+        return pprices->WriteBlock(batch, uint256()) || error("%s: cannot write the prices bets index", __func__);
+    }
+
+    BOOST_FOREACH(const PAIRTYPE(uint256, CPricesBetState) &undo, vUndo)
+    {
+        if (undo.second.positions.empty()) {
+            mapBetStates.erase(undo.first);
+            batch.Erase(std::make_pair(DB_PRICES_BET, undo.first));
+        }
+        else {
+            mapBetStates[undo.first] = undo.second;
+            batch.Write(std::make_pair(DB_PRICES_BET, undo.first), undo.second);
+        }
+    }
+    batch.Erase(std::make_pair(DB_PRICES_BETS_UNDO, (int32_t)nHeight));
+    if (!pprices->WriteBlock(batch, block.hashPrevBlock))
+        return PricesBetsWriteFailed();
+    hashPricesBestBlock = block.hashPrevBlock;
+    return true;
+}
+
+
+// build the index if it is not at the tip, it only follows chains with prices
+static bool CheckPricesBets()
+{
+    AssertLockHeld(cs_main);
+    if (pprices == NULL || ASSETCHAINS_CBOPRET == 0 || !KOMODO_NSPV_FULLNODE)
+        return false;
+    {
+        LOCK(cs_prices);
+        if (chainActive.Tip() != NULL && hashPricesBestBlock == chainActive.Tip()->GetBlockHash())
+            return true;
+    }
+    return BuildPricesBets();
+}
+
+
+bool GetPricesBetState(const uint256 &bettxid, CPricesBetState &state)
+{
+    LOCK2(cs_main, cs_prices);
+    if (!CheckPricesBets())
+        return false;
+    std::map<uint256, CPricesBetState>::const_iterator it = mapBetStates.find(bettxid);
+    if (it == mapBetStates.end())
+        return false;
+    state = it->second;
+    return true;
+}
+
+
+bool GetPricesBetStates(bool fRektOnly, std::map<uint256, CPricesBetState> &mapStates)
+{
+    mapStates.clear();
+    LOCK2(cs_main, cs_prices);
+    if (!CheckPricesBets())
+        return false;
+    for (std::map<uint256, CPricesBetState>::const_iterator it = mapBetStates.begin(); it != mapBetStates.end(); it++)
+        if (!fRektOnly || it->second.fRekt)
+            mapStates.insert(*it);
+    return true;
+}
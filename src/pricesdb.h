@@ -0,0 +1,109 @@
+#ifndef PRICESDB_H
+#define PRICESDB_H
+
+#include "chainindexdb.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+
+/** The bet tx or one of its added fundings */
+struct CPricesBetPosition
+{
+    int64_t positionsize;
+    int32_t firstheight;
+    int64_t costbasis;
+    int64_t profits;
+
+    CPricesBetPosition() : positionsize(0), firstheight(0), costbasis(0), profits(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(positionsize);
+        READWRITE(firstheight);
+        READWRITE(costbasis);
+        READWRITE(profits);
+    }
+};
+
+/**
+ * An open bet of the prices contract as prices_getbetinfo works it out, with
+ * the profits of its positions scanned up to nLastHeight. The scan goes on a
+ * height at a time as blocks are connected until the bet is rekt or a height
+ * has no price.
+ */
+struct CPricesBetState
+{
+    CPubKey pk;
+    int16_t leverage;
+    int64_t firstprice;
+    std::vector<uint16_t> vecparsed;
+    uint256 tokenid;
+    uint256 batontxid;          //!< last tx of the bet, added fundings spend its vout 0
+    std::vector<CPricesBetPosition> positions;
+
+    int32_t nLastHeight;        //!< last height the profits were worked out for, 0 before the first
+    int64_t lastprice;
+    bool fScanStopped;          //!< rekt at nLastHeight or no price at the height after it
+
+    int64_t totalposition;
+    int64_t equity;
+    int64_t averageCostbasis;
+    int64_t liquidationprice;
+    int64_t exitfee;            //!< fee of the rekt tx
+    bool fRekt;
+
+    CPricesBetState() : leverage(0), firstprice(0), nLastHeight(0), lastprice(0), fScanStopped(false),
+        totalposition(0), equity(0), averageCostbasis(0), liquidationprice(0), exitfee(0), fRekt(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(pk);
+        READWRITE(leverage);
+        READWRITE(firstprice);
+        READWRITE(vecparsed);
+        READWRITE(tokenid);
+        READWRITE(batontxid);
+        READWRITE(positions);
+        READWRITE(nLastHeight);
+        READWRITE(lastprice);
+        READWRITE(fScanStopped);
+        READWRITE(totalposition);
+        READWRITE(equity);
+        READWRITE(averageCostbasis);
+        READWRITE(liquidationprice);
+        READWRITE(exitfee);
+        READWRITE(fRekt);
+    }
+};
+
+
+class PricesDB : public CChainIndexDB
+{
+public:
+    PricesDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+};
+
+
+extern PricesDB *pprices;
+
+bool LoadPricesBets(const uint256 &hashTip);
+bool BuildPricesBets();
+bool ConnectPricesBets(const CBlock &block, int nHeight);
+bool DisconnectPricesBets(const CBlock &block, int nHeight);
+
+/** State of an open bet at the tip, false if it is closed or unknown */
+bool GetPricesBetState(const uint256 &bettxid, CPricesBetState &state);
+/** Every open bet at the tip, only the rekt ones if fRektOnly */
+bool GetPricesBetStates(bool fRektOnly, std::map<uint256, CPricesBetState> &mapStates);
+
+#endif  /* PRICESDB_H */
@@ -196,6 +196,9 @@ public:
 
     // memory only
     mutable std::vector<uint256> vMerkleTree;
+    // set once the Equihash solution / the merkle root were verified, see PrecheckBlock
+    mutable bool fCheckedSolution;
+    mutable bool fCheckedMerkleRoot;
 
     CBlock()
     {
@@ -214,6 +217,10 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(*(CBlockHeader*)this);
         READWRITE(vtx);
+        if (ser_action.ForRead()) {
+            fCheckedSolution = false;
+            fCheckedMerkleRoot = false;
+        }
     }
 
     void SetNull()
@@ -221,6 +228,8 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         vMerkleTree.clear();
+        fCheckedSolution = false;
+        fCheckedMerkleRoot = false;
     }
 
     CBlockHeader GetBlockHeader() const
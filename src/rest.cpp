@@ -20,8 +20,10 @@
 
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "base58.h"
 #include "main.h"
 #include "httpserver.h"
+#include "notarisationdb.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -37,6 +39,8 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_REST_ADDRESS_RECORDS = 100000; //max address index records per page
+static const long MAX_REST_NOTARISATION_BLOCKS = 2000; //max blocks scanned per notarisations request
 
 enum RetFormat {
     RF_UNDEF,
@@ -122,6 +126,62 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+/** Split "<path>?k=v&k2=v2" into the path part and a key/value map */
+static std::string ParseQueryString(const std::string& strURIPart, std::map<std::string, std::string>& query)
+{
+    size_t pos = strURIPart.find('?');
+    if (pos == std::string::npos)
+        return strURIPart;
+
+    vector<string> pairs;
+    std::string strQuery = strURIPart.substr(pos + 1);
+    boost::split(pairs, strQuery, boost::is_any_of("&"));
+    BOOST_FOREACH(const std::string& kv, pairs) {
+        size_t eq = kv.find('=');
+        if (eq == std::string::npos)
+            query[kv] = "";
+        else
+            query[kv.substr(0, eq)] = kv.substr(eq + 1);
+    }
+    return strURIPart.substr(0, pos);
+}
+
+static bool ParseQueryInt(const std::map<std::string, std::string>& query, const std::string& name, int32_t& value)
+{
+    std::map<std::string, std::string>::const_iterator it = query.find(name);
+    if (it == query.end())
+        return true;
+    return ParseInt32(it->second, &value);
+}
+
+/** Append one length-prefixed record: compactsize(len) || payload */
+static void AppendRecord(CDataStream& ssOut, const CDataStream& ssRecord)
+{
+    WriteCompactSize(ssOut, ssRecord.size());
+    if (!ssRecord.empty())
+        ssOut.write(&ssRecord[0], ssRecord.size());
+}
+
+static bool WriteBinaryReply(HTTPRequest* req, enum RetFormat rf, const CDataStream& ssOut)
+{
+    switch (rf) {
+    case RF_BINARY: {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ssOut.str());
+        return true;
+    }
+    case RF_HEX: {
+        string strHex = HexStr(ssOut.begin(), ssOut.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+}
+
 static bool CheckWarmup(HTTPRequest* req)
 {
     std::string statusmessage;
@@ -168,7 +228,10 @@ static bool rest_headers(HTTPRequest* req,
 
     CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
     BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-        ssHeader << pindex->GetBlockHeader();
+        CBlockHeader header;
+        if (!pindex->GetBlockHeader(header))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Can't read block index entry " + pindex->GetBlockHash().GetHex());
+        ssHeader << header;
     }
 
     switch (rf) {
@@ -605,6 +668,225 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool ParseAddressRequest(HTTPRequest* req, const std::string& strURIPart, enum RetFormat& rf,
+                                std::map<std::string, std::string>& query, uint160& hashBytes, int& type)
+{
+    vector<string> params;
+    rf = ParseDataFormat(params, ParseQueryString(strURIPart, query));
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    CBitcoinAddress address(params[0]);
+    if (!address.GetIndexKey(hashBytes, type, query.count("ccvout") != 0))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + params[0]);
+    return true;
+}
+
+// a cursor must point into the scanned address and, for deltas, into the requested height range
+static bool IsResumeKeyInScan(const CAddressIndexKey& key, int start, int end)
+{
+    if (key.blockHeight < 0 || (end > 0 && key.blockHeight > end))
+        return false;
+    return start <= 0 || end <= 0 || key.blockHeight >= start;
+}
+
+static bool IsResumeKeyInScan(const CAddressUnspentKey& key, int start, int end)
+{
+    return true;
+}
+
+template <typename Key>
+static bool ParseResumeKey(const std::map<std::string, std::string>& query, const uint160& hashBytes, int type,
+                           int start, int end, Key& key, bool& fResume)
+{
+    std::map<std::string, std::string>::const_iterator it = query.find("after");
+    fResume = false;
+    if (it == query.end())
+        return true;
+    if (!IsHex(it->second) || it->second.size() != 2 * key.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION))
+        return false;
+    try {
+        std::vector<unsigned char> vch = ParseHex(it->second);
+        CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> key;
+        if (!ss.empty())
+            return false;
+    } catch (const std::ios_base::failure& e) {
+        return false;
+    }
+    fResume = true;
+    return key.type == (unsigned int)type && key.hashBytes == hashBytes && IsResumeKeyInScan(key, start, end);
+}
+
+/**
+ * Address index deltas as length-prefixed binary records.
+ *
+ *   /rest/addressdeltas/<address>.<bin|hex>?start=<height>&end=<height>&limit=<n>&after=<cursor>[&ccvout]
+ *
+ * Reply: int32 chain height, uint256 tip hash, then one record per delta holding the
+ * CAddressIndexKey followed by the int64 amount, then a zero length terminator and one
+ * last record holding the key to pass back hex encoded as "after" (empty once the scan
+ * is complete).
+ */
+static bool rest_addressdeltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    enum RetFormat rf;
+    std::map<std::string, std::string> query;
+    uint160 hashBytes;
+    int type = 0;
+    if (!ParseAddressRequest(req, strURIPart, rf, query, hashBytes, type))
+        return false;
+
+    int32_t start = 0, end = 0, limit = MAX_REST_ADDRESS_RECORDS;
+    if (!ParseQueryInt(query, "start", start) || !ParseQueryInt(query, "end", end) || !ParseQueryInt(query, "limit", limit))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+    if (limit < 1 || (size_t)limit > MAX_REST_ADDRESS_RECORDS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("limit out of range (max: %d)", MAX_REST_ADDRESS_RECORDS));
+
+    CAddressIndexKey afterKey;
+    bool fResume;
+    if (!ParseResumeKey(query, hashBytes, type, start, end, afterKey, fResume))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor");
+
+    CDataStream ssOut(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        ssOut << chainActive.Height() << chainActive.LastTip()->GetBlockHash();
+    }
+
+    int32_t count = 0;
+    CAddressIndexKey lastKey;
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+    bool fOk = ScanAddressIndex(hashBytes, type, start, end, fResume ? &afterKey : NULL,
+        [&](const CAddressIndexKey& key, CAmount nValue) {
+            ssRecord.clear();
+            ssRecord << key << nValue;
+            AppendRecord(ssOut, ssRecord);
+            lastKey = key;
+            return ++count < limit;
+        });
+    if (!fOk)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "address index not available (requires -addressindex)");
+
+    WriteCompactSize(ssOut, 0);
+    ssRecord.clear();
+    if (count == limit)
+        ssRecord << lastKey;
+    AppendRecord(ssOut, ssRecord);
+    return WriteBinaryReply(req, rf, ssOut);
+}
+
+/**
+ * Address unspent outputs as length-prefixed binary records.
+ *
+ *   /rest/addressutxos/<address>.<bin|hex>?limit=<n>&after=<cursor>[&ccvout]
+ *
+ * Same framing as /rest/addressdeltas, with CAddressUnspentKey || CAddressUnspentValue records.
+ */
+static bool rest_addressutxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    enum RetFormat rf;
+    std::map<std::string, std::string> query;
+    uint160 hashBytes;
+    int type = 0;
+    if (!ParseAddressRequest(req, strURIPart, rf, query, hashBytes, type))
+        return false;
+
+    int32_t limit = MAX_REST_ADDRESS_RECORDS;
+    if (!ParseQueryInt(query, "limit", limit))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+    if (limit < 1 || (size_t)limit > MAX_REST_ADDRESS_RECORDS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("limit out of range (max: %d)", MAX_REST_ADDRESS_RECORDS));
+
+    CAddressUnspentKey afterKey;
+    bool fResume;
+    if (!ParseResumeKey(query, hashBytes, type, 0, 0, afterKey, fResume))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor");
+
+    CDataStream ssOut(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        ssOut << chainActive.Height() << chainActive.LastTip()->GetBlockHash();
+    }
+
+    int32_t count = 0;
+    CAddressUnspentKey lastKey;
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+    bool fOk = ScanAddressUnspent(hashBytes, type, fResume ? &afterKey : NULL,
+        [&](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
+            ssRecord.clear();
+            ssRecord << key << value;
+            AppendRecord(ssOut, ssRecord);
+            lastKey = key;
+            return ++count < limit;
+        });
+    if (!fOk)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "address index not available (requires -addressindex)");
+
+    WriteCompactSize(ssOut, 0);
+    ssRecord.clear();
+    if (count == limit)
+        ssRecord << lastKey;
+    AppendRecord(ssOut, ssRecord);
+    return WriteBinaryReply(req, rf, ssOut);
+}
+
+/**
+ * Notarisations recorded in a range of active chain blocks.
+ *
+ *   /rest/notarisations/<height>/<count>.<bin|hex>
+ *
+ * Reply: one record per block that carries notarisations: int32 height, uint256 block
+ * hash and the NotarisationsInBlock vector, followed by a zero length terminator.
+ */
+static bool rest_notarisations(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/notarisations/<height>/<count>.<ext>.");
+
+    int32_t nHeight, nCount;
+    if (!ParseInt32(path[0], &nHeight) || !ParseInt32(path[1], &nCount) || nHeight < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+    if (nCount < 1 || nCount > MAX_REST_NOTARISATION_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    CDataStream ssOut(SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+    NotarisationsInBlock nibs;
+    // nHeight + nCount overflows an int32_t for heights close to the maximum
+    const int64_t nEnd = (int64_t)nHeight + nCount;
+    for (int32_t h = nHeight; h < nEnd; h++) {
+        uint256 hash;
+        {
+            LOCK(cs_main);
+            if (h > chainActive.Height())
+                break;
+            hash = chainActive[h]->GetBlockHash();
+        }
+        nibs.clear();
+        if (!GetBlockNotarisations(hash, nibs) || nibs.empty())
+            continue;
+        ssRecord.clear();
+        ssRecord << h << hash << nibs;
+        AppendRecord(ssOut, ssRecord);
+    }
+    WriteCompactSize(ssOut, 0);
+    return WriteBinaryReply(req, rf, ssOut);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -617,6 +899,9 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/addressdeltas/", rest_addressdeltas},
+      {"/rest/addressutxos/", rest_addressutxos},
+      {"/rest/notarisations/", rest_notarisations},
 };
 
 bool StartREST()
@@ -25,7 +25,9 @@
 #include "crosschain.h"
 #include "base58.h"
 #include "consensus/validation.h"
+#include "dbwrapper.h"
 #include "cc/eval.h"
+#include "cc/evalstats.h"
 #include "main.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
@@ -150,7 +152,10 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("finalsaplingroot", blockindex->hashFinalSaplingRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
     result.push_back(Pair("nonce", blockindex->nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(blockindex->nSolution)));
+    std::vector<unsigned char> vSolution;
+    if (!blockindex->GetSolution(vSolution))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read block index entry");
+    result.push_back(Pair("solution", HexStr(vSolution)));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->chainPower.chainWork.GetHex()));
@@ -769,8 +774,11 @@ UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
     if (!fVerbose)
     {
+        CBlockHeader header;
+        if (!pblockindex->GetBlockHeader(header))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read block index entry");
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << pblockindex->GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
@@ -1273,32 +1281,19 @@ UniValue prices(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 {
                     offset = j*width + i;
                     rngval = (rngval*11109 + 13849);
-                    if ( (correlated[i]= komodo_pricecorrelated(rngval,j,&prices[offset],1,0,PRICES_SMOOTHWIDTH)) < 0 )
+                    // the stored prices are used as they are, they are only worked out for heights without them
+                    if ( komodo_priceget(checkprices,j,nextheight-1-i,1) >= 0 )
+                        correlated[i] = checkprices[1];
+                    else if ( (correlated[i]= komodo_pricecorrelated(rngval,j,&prices[offset],1,0,PRICES_SMOOTHWIDTH)) < 0 )
                         throw JSONRPCError(RPC_INVALID_PARAMETER, "null correlated price");
-                    {
-                        if ( komodo_priceget(checkprices,j,nextheight-1-i,1) >= 0 )
-                        {
-                            if ( checkprices[1] != correlated[i] )
-                            {
-                                //fprintf(stderr,"ind.%d ht.%d %.8f != %.8f\n",j,nextheight-1-i,(double)checkprices[1]/COIN,(double)correlated[i]/COIN);
-                                correlated[i] = checkprices[1];
-                            }
-                        }
-                    }
                 }
                 tmpbuf = (int64_t *)calloc(sizeof(int64_t),2*PRICES_DAYWINDOW);
                 for (i=0; i<maxsamples&&i<numsamples; i++)
                 {
                     offset = j*width + i;
-                    smoothed = komodo_priceave(tmpbuf,&correlated[i],1);
                     if ( komodo_priceget(checkprices,j,nextheight-1-i,1) >= 0 )
-                    {
-                        if ( checkprices[2] != smoothed )
-                        {
-                            fprintf(stderr,"ind.%d ht.%d %.8f != %.8f\n",j,nextheight-1-i,(double)checkprices[2]/COIN,(double)smoothed/COIN);
-                            smoothed = checkprices[2];
-                        }
-                    }
+                        smoothed = checkprices[2];
+                    else smoothed = komodo_priceave(tmpbuf,&correlated[i],1);
                     UniValue parr(UniValue::VARR);
                     parr.push_back(ValueFromAmount((int64_t)prices[offset] * komodo_pricemult(j)));
                     parr.push_back(ValueFromAmount(correlated[i]));
@@ -1454,6 +1449,21 @@ UniValue pricesrekt(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return PricesRekt(txfee, bettxid, height);
 }
 
+// pricesrektlist rpc implementation
+UniValue pricesrektlist(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error("pricesrektlist\n"
+            "\nReturns the open bets that can be rekt at the tip, from the prices bets index.\n"
+            "A bet stays listed until a tx closing it is in the mempool or in a block.\n");
+    LOCK(cs_main);
+
+    if (ASSETCHAINS_CBOPRET == 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "only -ac_cbopret chains have prices");
+
+    return PricesRektList();
+}
+
 // pricesrekt rpc implementation
 UniValue pricesgetorderbook(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
@@ -2014,6 +2024,198 @@ UniValue getchaintxstats(const UniValue& params, bool fHelp, const CPubKey& mypk
     return ret;
 }
 
+UniValue getsyncstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsyncstats\n"
+            "\nReturns the throughput of each stage blocks go through since startup.\n"
+            "precheck runs on the block check threads during initial download, accept and connect hold cs_main.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"checkthreads\": n,        (numeric) Threads running the precheck stage, 0 if it runs on the message thread\n"
+            "  \"queued\": n,              (numeric) Blocks waiting for a block check thread\n"
+            "  \"maxqueued\": n,           (numeric) Most blocks seen waiting\n"
+            "  \"queuefull\": n,           (numeric) Blocks checked on the message thread because the queue was full\n"
+            "  \"stage\": {                (json object) One of precheck, accept, connect\n"
+            "    \"blocks\": n,            (numeric) Blocks that passed the stage\n"
+            "    \"failed\": n,            (numeric) Blocks that failed it\n"
+            "    \"blockspersec\": x.x,    (numeric) Blocks passed per second between the first and the last block\n"
+            "    \"avgmicros\": n          (numeric) Average time spent on a block\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsyncstats", "")
+            + HelpExampleRpc("getsyncstats", "")
+        );
+
+    static const char *stageNames[BLOCK_STAGE_COUNT] = { "precheck", "accept", "connect" };
+    CBlockPipelineStats stats;
+    GetBlockPipelineStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("checkthreads", stats.nCheckThreads));
+    ret.push_back(Pair("queued", (uint64_t)stats.nQueued));
+    ret.push_back(Pair("maxqueued", (uint64_t)stats.nMaxQueued));
+    ret.push_back(Pair("queuefull", stats.nQueueFull));
+    for (int i = 0; i < BLOCK_STAGE_COUNT; i++)
+    {
+        const CBlockStageStats& stage = stats.vStages[i];
+        uint64_t nTotal = stage.nBlocks + stage.nFailed;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("blocks", stage.nBlocks));
+        obj.push_back(Pair("failed", stage.nFailed));
+        obj.push_back(Pair("blockspersec", stage.BlocksPerSecond()));
+        obj.push_back(Pair("avgmicros", nTotal > 0 ? stage.nMicros / (int64_t)nTotal : 0));
+        ret.push_back(Pair(stageNames[i], obj));
+    }
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the LevelDB settings and statistics of each open database.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",          (string) chainstate, blockindex, addressindex, spentindex, timestampindex, notarisations, tokens, batons, oracles or prices, as used by -dbprofile\n"
+            "    \"path\": \"path\",          (string) Directory of the database\n"
+            "    \"profile\": {               (json object) Settings the database was opened with\n"
+            "      \"bloombits\": n,          (numeric) Bloom filter bits per key, 0 if disabled\n"
+            "      \"blockcache\": n,         (numeric) Block cache size in bytes\n"
+            "      \"writebuffer\": n,        (numeric) Write buffer size in bytes\n"
+            "      \"maxopenfiles\": n,       (numeric) Maximum number of open table files\n"
+            "      \"compression\": true|false\n"
+            "    },\n"
+            "    \"cache\": {                 (json object) Block cache lookups since the database was opened\n"
+            "      \"hits\": n,\n"
+            "      \"misses\": n,\n"
+            "      \"hitrate\": x.x          (numeric) hits / (hits + misses)\n"
+            "    },\n"
+            "    \"sizemb\": x.x,             (numeric) Size of the table files\n"
+            "    \"compactionsecs\": x.x,     (numeric) Time spent compacting since the database was opened\n"
+            "    \"levels\": [                (json array) Levels holding files or compacted into\n"
+            "      {\n"
+            "        \"level\": n,\n"
+            "        \"files\": n,\n"
+            "        \"sizemb\": x.x,\n"
+            "        \"compactionsecs\": x.x,\n"
+            "        \"readmb\": x.x,          (numeric) Read by compactions into this level\n"
+            "        \"writemb\": x.x          (numeric) Written by compactions into this level\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    std::vector<CDBStats> vStats;
+    GetDBStats(vStats);
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(const CDBStats& stats, vStats)
+    {
+        UniValue profile(UniValue::VOBJ);
+        profile.push_back(Pair("bloombits", stats.options.nBloomBits));
+        profile.push_back(Pair("blockcache", (uint64_t)stats.options.nBlockCacheSize));
+        profile.push_back(Pair("writebuffer", (uint64_t)stats.options.nWriteBufferSize));
+        profile.push_back(Pair("maxopenfiles", stats.options.nMaxOpenFiles));
+        profile.push_back(Pair("compression", stats.options.fCompression));
+
+        uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+        UniValue cache(UniValue::VOBJ);
+        cache.push_back(Pair("hits", stats.nCacheHits));
+        cache.push_back(Pair("misses", stats.nCacheMisses));
+        cache.push_back(Pair("hitrate", nLookups > 0 ? (double)stats.nCacheHits / nLookups : 0.0));
+
+        double dSizeMB = 0, dCompactionSecs = 0;
+        UniValue levels(UniValue::VARR);
+        BOOST_FOREACH(const CDBLevelStats& level, stats.vLevels)
+        {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("level", level.nLevel));
+            obj.push_back(Pair("files", level.nFiles));
+            obj.push_back(Pair("sizemb", level.dSizeMB));
+            obj.push_back(Pair("compactionsecs", level.dCompactionSecs));
+            obj.push_back(Pair("readmb", level.dReadMB));
+            obj.push_back(Pair("writemb", level.dWriteMB));
+            levels.push_back(obj);
+            dSizeMB += level.dSizeMB;
+            dCompactionSecs += level.dCompactionSecs;
+        }
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.options.name));
+        obj.push_back(Pair("path", stats.path));
+        obj.push_back(Pair("profile", profile));
+        obj.push_back(Pair("cache", cache));
+        obj.push_back(Pair("sizemb", dSizeMB));
+        obj.push_back(Pair("compactionsecs", dCompactionSecs));
+        obj.push_back(Pair("levels", levels));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getccstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getccstats ( reset )\n"
+            "\nReturns the time spent validating CC inputs since startup or the last reset, by evalcode and funcid.\n"
+            "The funcid is the second byte of the opret of the spending tx, 0 if it has none.\n"
+            "\nArguments:\n"
+            "1. reset                (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"evalcode\": \"name\",     (string) Name of the evalcode, or its hex value for CClib and unknown codes\n"
+            "    \"funcid\": \"x\",          (string) Funcid as a character, or its hex value when not printable\n"
+            "    \"count\": n,             (numeric) Evals run\n"
+            "    \"invalid\": n,           (numeric) Evals that failed\n"
+            "    \"totalmicros\": n,       (numeric) Total eval time\n"
+            "    \"avgmicros\": n,         (numeric) Average eval time\n"
+            "    \"p99micros\": n,         (numeric) Eval time 99% of the evals stay under, rounded up to its histogram bucket\n"
+            "    \"maxmicros\": n,         (numeric) Longest eval time\n"
+            "    \"txfetches\": n,         (numeric) Transactions the validator looked up\n"
+            "    \"spentlookups\": n       (numeric) Spent index reads the validator made\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getccstats", "")
+            + HelpExampleCli("getccstats", "true")
+            + HelpExampleRpc("getccstats", "")
+        );
+
+    std::map<CCEvalKey, CCEvalStats> mapStats;
+    GetCCEvalStats(mapStats, params.size() > 0 && params[0].get_bool());
+
+    UniValue ret(UniValue::VARR);
+    for (std::map<CCEvalKey, CCEvalStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it)
+    {
+        const CCEvalStats& stats = it->second;
+        uint8_t funcid = it->first.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("evalcode", EvalToStr(it->first.first)));
+        obj.push_back(Pair("funcid", isprint(funcid) ? std::string(1, (char)funcid) : strprintf("0x%02x", (int)funcid)));
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("invalid", stats.nInvalid));
+        obj.push_back(Pair("totalmicros", stats.nTotalMicros));
+        obj.push_back(Pair("avgmicros", stats.nCount > 0 ? stats.nTotalMicros / (int64_t)stats.nCount : 0));
+        obj.push_back(Pair("p99micros", stats.PercentileMicros(0.99)));
+        obj.push_back(Pair("maxmicros", stats.nMaxMicros));
+        obj.push_back(Pair("txfetches", stats.nTxFetches));
+        obj.push_back(Pair("spentlookups", stats.nSpentLookups));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() != 1)
@@ -2102,8 +2304,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        true  },
+    { "blockchain",         "getccstats",             &getccstats,             true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
+    { "blockchain",         "getsyncstats",           &getsyncstats,           true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
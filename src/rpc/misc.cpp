@@ -1024,6 +1024,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs, in address index order\n"
+            "  \"after\"  (string, optional) Resume after this cursor, the \"next\" value of a previous call\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult\n"
@@ -1037,17 +1039,42 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nWhen limit is given the result is an object with the \"utxos\" array and a \"next\" cursor,\n"
+            "empty once every output has been returned.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
             );
 
     bool includeChainInfo = false;
+    int limit = 0;
+    bool fResume = false;
+    CAddressUnspentKey afterKey;
     if (params[0].isObject()) {
         UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
         if (chainInfo.isBool()) {
             includeChainInfo = chainInfo.get_bool();
         }
+        UniValue limitParam = find_value(params[0].get_obj(), "limit");
+        if (!limitParam.isNull()) {
+            limit = limitParam.get_int();
+            if (limit <= 0)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "limit must be positive");
+        }
+        UniValue afterParam = find_value(params[0].get_obj(), "after");
+        if (!afterParam.isNull()) {
+            if (limit == 0 || !IsHex(afterParam.get_str()))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+            try {
+                std::vector<unsigned char> vch = ParseHex(afterParam.get_str());
+                CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+                ss >> afterKey;
+            } catch (const std::ios_base::failure& e) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+            }
+            fResume = true;
+        }
     }
 
     std::vector<std::pair<uint160, int> > addresses;
@@ -1057,14 +1084,43 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
     }
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    std::string next;
+
+    if (limit > 0) {
+        // page through the addresses in the order given, the cursor is the last key returned
+        bool fSkipping = fResume;
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end() && (int)unspentOutputs.size() < limit; it++) {
+            const CAddressUnspentKey *pAfter = NULL;
+            if (fSkipping) {
+                if (it->first != afterKey.hashBytes || it->second != (int)afterKey.type)
+                    continue;
+                fSkipping = false;
+                pAfter = &afterKey;
+            }
+            if (!ScanAddressUnspent(it->first, it->second, pAfter,
+                    [&](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
+                        unspentOutputs.push_back(std::make_pair(key, value));
+                        return (int)unspentOutputs.size() < limit;
+                    })) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+        if (fSkipping)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not match any of the addresses");
+        if ((int)unspentOutputs.size() >= limit) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << unspentOutputs.back().first;
+            next = HexStr(ss.begin(), ss.end());
+        }
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue utxos(UniValue::VARR);
 
@@ -1084,9 +1140,13 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || limit > 0) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
+        if (limit > 0)
+            result.push_back(Pair("next", next));
+        if (!includeChainInfo)
+            return result;
 
         LOCK(cs_main);
         result.push_back(Pair("hash", chainActive.LastTip()->GetBlockHash().GetHex()));
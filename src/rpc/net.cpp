@@ -433,7 +433,16 @@ UniValue getnettotals(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"socketloop\": {        (json object) Socket handler loop counters\n"
+            "    \"backend\": \"xxxx\",           (string) Readiness backend, select or epoll\n"
+            "    \"iterations\": n,              (numeric) Loop iterations\n"
+            "    \"events\": n,                  (numeric) Readiness events reported by the backend\n"
+            "    \"waitmicros\": n,              (numeric) Total time waiting for readiness\n"
+            "    \"servicemicros\": n,           (numeric) Total time spent accepting, receiving and sending\n"
+            "    \"avgservicemicros\": n,        (numeric) Average service time per iteration\n"
+            "    \"maxservicemicros\": n         (numeric) Longest single service pass\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getnettotals", "")
@@ -444,9 +453,115 @@ UniValue getnettotals(const UniValue& params, bool fHelp, const CPubKey& mypk)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    CSocketLoopStats stats;
+    GetSocketLoopStats(stats);
+    UniValue loop(UniValue::VOBJ);
+    loop.push_back(Pair("backend", stats.strBackend));
+    loop.push_back(Pair("iterations", stats.nIterations));
+    loop.push_back(Pair("events", stats.nEvents));
+    loop.push_back(Pair("waitmicros", stats.nWaitMicros));
+    loop.push_back(Pair("servicemicros", stats.nServiceMicros));
+    loop.push_back(Pair("avgservicemicros", stats.nIterations > 0 ? stats.nServiceMicros / (int64_t)stats.nIterations : 0));
+    loop.push_back(Pair("maxservicemicros", stats.nMaxServiceMicros));
+    obj.push_back(Pair("socketloop", loop));
     return obj;
 }
 
+UniValue getmessagestats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagestats\n"
+            "\nReturns the time spent processing each P2P message command since startup.\n"
+            "getdata counts the passes serving a peer's requests, each up to one block, wherever they run.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {           (json object) Message command, unknown commands are grouped as \"other\"\n"
+            "    \"count\": n,           (numeric) Messages processed\n"
+            "    \"totalmicros\": n,     (numeric) Total processing time\n"
+            "    \"avgmicros\": n,       (numeric) Average processing time\n"
+            "    \"maxmicros\": n,       (numeric) Longest processing time\n"
+            "    \"histogram\": {        (json object) Messages by processing time\n"
+            "      \"<100us\": n,\n"
+            "      \"<1ms\": n,\n"
+            "      \"<10ms\": n,\n"
+            "      \"<100ms\": n,\n"
+            "      \"<1s\": n,\n"
+            "      \">=1s\": n\n"
+            "    }\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmessagestats", "")
+            + HelpExampleRpc("getmessagestats", "")
+       );
+
+    static const char *bucketNames[MESSAGE_TIMING_BUCKETS] = { "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s" };
+    std::map<std::string, CMessageTimingStats> mapTimings;
+    GetMessageTimings(mapTimings);
+
+    UniValue ret(UniValue::VOBJ);
+    for (std::map<std::string, CMessageTimingStats>::const_iterator it = mapTimings.begin(); it != mapTimings.end(); ++it)
+    {
+        const CMessageTimingStats& stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("totalmicros", stats.nTotalMicros));
+        obj.push_back(Pair("avgmicros", stats.nCount > 0 ? stats.nTotalMicros / (int64_t)stats.nCount : 0));
+        obj.push_back(Pair("maxmicros", stats.nMaxMicros));
+        UniValue histogram(UniValue::VOBJ);
+        for (int i = 0; i < MESSAGE_TIMING_BUCKETS; i++)
+            histogram.push_back(Pair(bucketNames[i], stats.vBuckets[i]));
+        obj.push_back(Pair("histogram", histogram));
+        ret.push_back(Pair(it->first, obj));
+    }
+    return ret;
+}
+
+UniValue NSPV_serverstats();
+
+UniValue getnspvstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getnspvstats\n"
+            "\nReturns statistics about the getnSPV requests answered by this node (requires -nspv_msg).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,               (numeric) Worker threads answering requests, 0 if answered inline\n"
+            "  \"maxqueue\": n,              (numeric) Maximum number of queued requests\n"
+            "  \"maxpeerqueue\": n,          (numeric) Maximum number of queued requests per peer\n"
+            "  \"depth\": n,                 (numeric) Requests currently waiting for a worker\n"
+            "  \"maxdepth\": n,              (numeric) Highest queue depth seen\n"
+            "  \"queued\": n,                (numeric) Requests queued since startup\n"
+            "  \"processed\": n,             (numeric) Requests answered by the workers\n"
+            "  \"dropped_queuefull\": n,     (numeric) Requests dropped because the queue was full\n"
+            "  \"dropped_peerlimit\": n,     (numeric) Requests dropped because the peer had too many queued\n"
+            "  \"dropped_disconnected\": n,  (numeric) Requests whose peer disconnected while queued\n"
+            "  \"avgwait_us\": n,            (numeric) Average time a request waited in the queue\n"
+            "  \"maxwait_us\": n,            (numeric) Longest time a request waited in the queue\n"
+            "  \"avgservice_us\": n,         (numeric) Average time taken to answer a request\n"
+            "  \"maxservice_us\": n,         (numeric) Longest time taken to answer a request\n"
+            "  \"cache\": {                  (object) Response cache for getinfo, notarization and proof requests\n"
+            "    \"entries\": n,             (numeric) Cached responses\n"
+            "    \"bytes\": n,               (numeric) Memory used by the cache\n"
+            "    \"maxbytes\": n,            (numeric) Memory budget (-nspv_cachesize)\n"
+            "    \"hits\": n,                (numeric) Requests answered from the cache\n"
+            "    \"misses\": n,              (numeric) Requests that had to be computed\n"
+            "    \"inserts\": n,             (numeric) Responses added to the cache\n"
+            "    \"evictions\": n,           (numeric) Responses evicted to stay within the budget\n"
+            "    \"invalidations\": n        (numeric) Responses dropped because the chain changed\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnspvstats", "")
+            + HelpExampleRpc("getnspvstats", "")
+       );
+
+    return NSPV_serverstats();
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -306,6 +306,8 @@ static const CRPCCommand vRPCCommands[] =
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getconnectioncount",     &getconnectioncount,     true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
+    { "network",            "getnspvstats",           &getnspvstats,           true  },
+    { "network",            "getmessagestats",        &getmessagestats,        true  },
     { "network",            "getpeerinfo",            &getpeerinfo,            true  },
     { "network",            "ping",                   &ping,                   true  },
     { "network",            "setban",                 &setban,                 true  },
@@ -477,6 +479,8 @@ static const CRPCCommand vRPCCommands[] =
     { "oracles",       "oraclesdata",      &oraclesdata,        true },
     { "oracles",       "oraclessample",   &oraclessample,     true },
     { "oracles",       "oraclessamples",   &oraclessamples,     true },
+    { "oracles",       "oraclesseries",    &oraclesseries,      true },
+    { "oracles",       "oraclesprice",     &oraclesprice,       true },
 
     // Prices
     { "prices",       "prices",      &prices,      true },
@@ -491,6 +495,7 @@ static const CRPCCommand vRPCCommands[] =
     { "prices",       "pricesaddfunding",         &pricesaddfunding,         true },
     { "prices",       "pricesgetorderbook",         &pricesgetorderbook,         true },
     { "prices",       "pricesrefillfund",         &pricesrefillfund,         true },
+    { "prices",       "pricesrektlist",           &pricesrektlist,           true },
 
     // Pegs
     { "pegs",       "pegsaddress",   &pegsaddress,      true },
@@ -544,6 +549,7 @@ static const CRPCCommand vRPCCommands[] =
     { "tokens",       "tokenlist",        &tokenlist,         true },
     { "tokens",       "tokenorders",      &tokenorders,       true },
     { "tokens",       "mytokenorders",    &mytokenorders,     true },
+    { "tokens",       "tokenorderbook",   &tokenorderbook,    true },
     { "tokens",       "tokenaddress",     &tokenaddress,      true },
     { "tokens",       "tokenbalance",     &tokenbalance,      true },
     { "tokens",       "tokencreate",      &tokencreate,       true },
@@ -218,6 +218,8 @@ extern UniValue addnode(const UniValue& params, bool fHelp, const CPubKey& mypk)
 extern UniValue disconnectnode(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getaddednodeinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getnettotals(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getnspvstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getmessagestats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue setban(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue listbanned(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue clearbanned(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -245,6 +247,7 @@ extern UniValue tokeninfo(const UniValue& params, bool fHelp, const CPubKey& myp
 extern UniValue tokenlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue tokenorderbook(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue assetsaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -274,6 +277,8 @@ extern UniValue oraclessubscribe(const UniValue& params, bool fHelp, const CPubK
 extern UniValue oraclesdata(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue oraclessample(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue oraclessamples(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue oraclesseries(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue oraclesprice(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue pricesaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue priceslist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue mypriceslist(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -429,6 +434,9 @@ extern UniValue getbestblockhash(const UniValue& params, bool fHelp, const CPubK
 extern UniValue getdifficulty(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue settxfee(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getsyncstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getdbstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getccstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -529,6 +537,7 @@ extern UniValue pricesrekt(const UniValue& params, bool fHelp, const CPubKey& my
 extern UniValue pricesaddfunding(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue pricesgetorderbook(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue pricesrefillfund(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue pricesrektlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
 
 
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include "batonsdb.h"
+#include "cc/CCinclude.h"
+#include "random.h"
+#include "script/script.h"
+#include "testutils.h"
+
+namespace TestBatonsDB {
+
+    // an oracle registration, its baton is vout 1
+    static CTransaction MakeRegister(uint256 oracletxid)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript()));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        mtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << E_MARSHAL(ss << (uint8_t)EVAL_ORACLES << (uint8_t)'R' << oracletxid << pk << (int64_t)10000)));
+        return CTransaction(mtx);
+    }
+
+    // a data tx passing the baton of prev on
+    static CTransaction MakeHop(const CTransaction &prev)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(prev.GetHash(), 1), CScript()));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        return CTransaction(mtx);
+    }
+
+    class TestBatonsDB : public ChainIndexTest {
+    protected:
+        virtual void SetUp() {
+            ChainIndexTest::SetUp();
+            pbatons = new BatonsDB(1 << 20, true);
+            ASSERT_TRUE(LoadBatons());
+        }
+        virtual void TearDown() {
+            ChainIndexTest::TearDown();
+            delete pbatons;
+            pbatons = NULL;
+        }
+    };
+
+    TEST_F(TestBatonsDB, ConnectDisconnect)
+    {
+
+        CBlock genesis, block1, block2, block3;
+        genesis.nTime = 1;
+        ASSERT_TRUE(ConnectBatons(genesis, 0));
+
+        CTransaction reg = MakeRegister(GetRandHash());
+        block1.hashPrevBlock = genesis.GetHash();
+        block1.vtx.push_back(reg);
+        ASSERT_TRUE(ConnectBatons(block1, 1));
+        SetTip(block1, 1);
+
+        CBatonHead head;
+        ASSERT_TRUE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_EQ(reg.GetHash(), head.txid);
+        EXPECT_EQ(0, head.nHops);
+        EXPECT_EQ(1, head.nRootHeight);
+
+        // two hops in one block, one in the next
+        CTransaction hop1 = MakeHop(reg), hop2 = MakeHop(hop1), hop3 = MakeHop(hop2);
+        block2.hashPrevBlock = block1.GetHash();
+        block2.vtx.push_back(hop1);
+        block2.vtx.push_back(hop2);
+        ASSERT_TRUE(ConnectBatons(block2, 2));
+        block3.hashPrevBlock = block2.GetHash();
+        block3.vtx.push_back(hop3);
+        ASSERT_TRUE(ConnectBatons(block3, 3));
+        SetTip(block3, 3);
+
+        ASSERT_TRUE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_EQ(hop3.GetHash(), head.txid);
+        EXPECT_EQ(3, head.nHops);
+        EXPECT_EQ(3, head.nHeight);
+        std::vector<uint256> vTxids;
+        ASSERT_TRUE(GetBatonChain(EVAL_ORACLES, reg.GetHash(), vTxids));
+        ASSERT_EQ(4U, vTxids.size());
+        EXPECT_EQ(reg.GetHash(), vTxids[0]);
+        EXPECT_EQ(hop2.GetHash(), vTxids[2]);
+        EXPECT_EQ(hop3.GetHash(), vTxids[3]);
+
+        // a block not following the index is ignored
+        CBlock other;
+        other.hashPrevBlock = block1.GetHash();
+        other.nTime = 2;
+        other.vtx.push_back(MakeHop(hop3));
+        ASSERT_TRUE(ConnectBatons(other, 2));
+        EXPECT_EQ(block3.GetHash(), GetBatonsBestBlock());
+        ASSERT_TRUE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_EQ(hop3.GetHash(), head.txid);
+
+        // the written state loads back
+        ASSERT_TRUE(LoadBatons());
+        EXPECT_EQ(block3.GetHash(), GetBatonsBestBlock());
+        ASSERT_TRUE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_EQ(3, head.nHops);
+
+        ASSERT_TRUE(DisconnectBatons(block3, 3));
+        ASSERT_TRUE(DisconnectBatons(block2, 2));
+        // an index behind the tip is not asked, the contracts walk the chain
+        EXPECT_FALSE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        SetTip(block1, 1);
+        ASSERT_TRUE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_EQ(reg.GetHash(), head.txid);
+        EXPECT_EQ(0, head.nHops);
+        EXPECT_EQ(1, head.nHeight);
+
+        ASSERT_TRUE(DisconnectBatons(block1, 1));
+        SetTip(genesis, 0);
+        EXPECT_FALSE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_FALSE(GetBatonChain(EVAL_ORACLES, reg.GetHash(), vTxids));
+
+        // connected again after a reset the index follows from the genesis block
+        ASSERT_TRUE(ConnectBatons(block1, 1));
+        ASSERT_TRUE(ResetBatons());
+        EXPECT_TRUE(GetBatonsBestBlock().IsNull());
+        ASSERT_TRUE(LoadBatons());
+        EXPECT_TRUE(GetBatonsBestBlock().IsNull());
+        ASSERT_TRUE(ConnectBatons(genesis, 0));
+        ASSERT_TRUE(ConnectBatons(block1, 1));
+        SetTip(block1, 1);
+        ASSERT_TRUE(GetBatonHead(EVAL_ORACLES, reg.GetHash(), head));
+        EXPECT_EQ(reg.GetHash(), head.txid);
+    }
+}
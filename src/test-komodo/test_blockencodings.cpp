@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include "blockencodings.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+#include "version.h"
+
+#include "testutils.h"
+
+namespace TestBlockEncodings {
+
+    /** What it took to get a block across with cmpctblock/getblocktxn/blocktxn */
+    struct RelayResult
+    {
+        bool fReconstructed;
+        size_t nBytes;          // bytes of the compact messages
+        size_t nFullBytes;      // bytes of the equivalent "block" message
+        int nRoundTrips;        // after the inv, one for getdata/cmpctblock plus one if txs were missing
+        size_t nMissing;
+    };
+
+    static CTransaction MakeNotarisation()
+    {
+        // opreturn of KMD notarisation ee2fa47820a31a979f9f21cb3fedbc484bf9a8957cb6c9acd0af28ced29bdfe1
+        CMutableTransaction mtx;
+        for (int i = 0; i < 13; i++)
+            mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript() << std::vector<unsigned char>(72, 0x30)));
+        mtx.vout.resize(2);
+        mtx.vout[0].nValue = 9800;
+        mtx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x55) << OP_EQUALVERIFY << OP_CHECKSIG;
+        mtx.vout[1].scriptPubKey = CScript() << OP_RETURN << ParseHex("c349ff90f3bce62c1b7b49d1da0423b1a3d9b733130cce825b95b9e047c729066e020d00743a06fdb95ad5775d032b30bbb3680dac2091a0f800cf54c79fd3461ce9b31d4b4d4400");
+        return CTransaction(mtx);
+    }
+
+    static CBlock MakeBlock(int nTx, bool fNotarisation)
+    {
+        CBlock block = makeTestBlock(nTx);
+        if (fNotarisation) {
+            block.vtx.insert(block.vtx.begin() + 1, MakeNotarisation());
+            block.hashMerkleRoot = block.BuildMerkleTree();
+        }
+        return block;
+    }
+
+    static void AddToPool(CTxMemPool& pool, const CTransaction& tx)
+    {
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, 0, 0.0, 0, true, false, 0));
+    }
+
+    // Plays both sides of the exchange over serialized messages, as on the wire
+    static RelayResult RelayBlock(const CBlock& block, CTxMemPool& receiverPool, CBlock& received)
+    {
+        RelayResult result;
+        result.fReconstructed = false;
+        result.nFullBytes = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+        result.nRoundTrips = 1;
+        result.nMissing = 0;
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << CBlockHeaderAndShortTxIDs(block);
+        result.nBytes = ss.size();
+
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        ss >> cmpctblock;
+        PartiallyDownloadedBlock partialBlock(&receiverPool);
+        if (partialBlock.InitData(cmpctblock) != READ_STATUS_OK)
+            return result;
+
+        BlockTransactionsRequest req;
+        req.blockhash = cmpctblock.header.GetHash();
+        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+            if (!partialBlock.IsTxAvailable(i))
+                req.indexes.push_back(i);
+        }
+        std::vector<CTransaction> vtxMissing;
+        if (!req.indexes.empty()) {
+            result.nRoundTrips++;
+            result.nMissing = req.indexes.size();
+
+            CDataStream ssReq(SER_NETWORK, PROTOCOL_VERSION);
+            ssReq << req;
+            result.nBytes += ssReq.size();
+            BlockTransactionsRequest reqReceived;
+            ssReq >> reqReceived;
+
+            BlockTransactions resp(reqReceived);
+            for (size_t i = 0; i < reqReceived.indexes.size(); i++)
+                resp.txn[i] = block.vtx[reqReceived.indexes[i]];
+            CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+            ssResp << resp;
+            result.nBytes += ssResp.size();
+            BlockTransactions respReceived;
+            ssResp >> respReceived;
+            vtxMissing = respReceived.txn;
+        }
+        result.fReconstructed = partialBlock.FillBlock(received, vtxMissing) == READ_STATUS_OK;
+        return result;
+    }
+
+    // header, nonce, 6 byte short ids and the first nPrefilled txs with their 1 byte indexes
+    static size_t CompactBlockBytes(const CBlock& block, size_t nPrefilled)
+    {
+        size_t nShortIDs = block.vtx.size() - nPrefilled;
+        size_t nBytes = ::GetSerializeSize(block.GetBlockHeader(), SER_NETWORK, PROTOCOL_VERSION) + 8;
+        nBytes += GetSizeOfCompactSize(nShortIDs) + nShortIDs * 6 + GetSizeOfCompactSize(nPrefilled);
+        for (size_t i = 0; i < nPrefilled; i++)
+            nBytes += 1 + ::GetSerializeSize(block.vtx[i], SER_NETWORK, PROTOCOL_VERSION);
+        return nBytes;
+    }
+
+    TEST(TestBlockEncodings, AllInMempool)
+    {
+        CBlock block = MakeBlock(200, false);
+        CTxMemPool pool(CFeeRate(0));
+        for (size_t i = 1; i < block.vtx.size(); i++)
+            AddToPool(pool, block.vtx[i]);
+
+        CBlock received;
+        RelayResult result = RelayBlock(block, pool, received);
+        ASSERT_TRUE(result.fReconstructed);
+        EXPECT_EQ(block.GetHash(), received.GetHash());
+        EXPECT_EQ(block.vtx.size(), received.vtx.size());
+        EXPECT_EQ(1, result.nRoundTrips);
+        EXPECT_EQ(CompactBlockBytes(block, 1), result.nBytes);
+        EXPECT_LT(result.nBytes * 10, result.nFullBytes);
+    }
+
+    TEST(TestBlockEncodings, HalfInMempool)
+    {
+        CBlock block = MakeBlock(200, false);
+        CTxMemPool pool(CFeeRate(0));
+        for (size_t i = 1; i < block.vtx.size(); i += 2)
+            AddToPool(pool, block.vtx[i]);
+
+        CBlock received;
+        RelayResult result = RelayBlock(block, pool, received);
+        ASSERT_TRUE(result.fReconstructed);
+        EXPECT_EQ(block.BuildMerkleTree(), received.BuildMerkleTree());
+        EXPECT_EQ(2, result.nRoundTrips);
+        EXPECT_EQ(100, result.nMissing);
+        // getblocktxn has the differences of the indexes, 2 and then 1, blocktxn the even txs
+        size_t nMissingBytes = 0;
+        for (size_t i = 2; i < block.vtx.size(); i += 2)
+            nMissingBytes += ::GetSerializeSize(block.vtx[i], SER_NETWORK, PROTOCOL_VERSION);
+        EXPECT_EQ(CompactBlockBytes(block, 1) + (32 + 1 + 100) + (32 + 1 + nMissingBytes), result.nBytes);
+        EXPECT_LT(result.nBytes, result.nFullBytes);
+    }
+
+    TEST(TestBlockEncodings, NotarisationPrefilled)
+    {
+        CBlock block = MakeBlock(50, true);
+        CTxMemPool pool(CFeeRate(0));
+        // the notarisation has not reached the receiver's mempool yet
+        for (size_t i = 2; i < block.vtx.size(); i++)
+            AddToPool(pool, block.vtx[i]);
+
+        CBlockHeaderAndShortTxIDs cmpctblock(block);
+        EXPECT_EQ(2, cmpctblock.PrefilledTxCount());
+
+        CBlock received;
+        RelayResult result = RelayBlock(block, pool, received);
+        ASSERT_TRUE(result.fReconstructed);
+        EXPECT_EQ(1, result.nRoundTrips);
+        EXPECT_EQ(CompactBlockBytes(block, 2), result.nBytes);
+        EXPECT_EQ(block.vtx[1].GetHash(), received.vtx[1].GetHash());
+    }
+
+    TEST(TestBlockEncodings, WrongMempoolTxFallsBack)
+    {
+        CBlock block = MakeBlock(20, false);
+        CTxMemPool pool(CFeeRate(0));
+        for (size_t i = 1; i < block.vtx.size(); i++)
+            AddToPool(pool, block.vtx[i]);
+
+        CBlockHeaderAndShortTxIDs cmpctblock(block);
+        PartiallyDownloadedBlock partialBlock(&pool);
+        ASSERT_EQ(READ_STATUS_OK, partialBlock.InitData(cmpctblock));
+
+        // a missing tx answered with the wrong transaction is caught by the merkle root
+        std::vector<CTransaction> vtxMissing;
+        vtxMissing.push_back(makeRandomTx());
+        CBlock received;
+        EXPECT_EQ(READ_STATUS_INVALID, partialBlock.FillBlock(received, vtxMissing));
+
+        CTxMemPool emptyPool(CFeeRate(0));
+        PartiallyDownloadedBlock partialEmpty(&emptyPool);
+        ASSERT_EQ(READ_STATUS_OK, partialEmpty.InitData(cmpctblock));
+        std::vector<CTransaction> vtxWrong;
+        for (size_t i = 1; i < block.vtx.size(); i++)
+            vtxWrong.push_back(i == 5 ? makeRandomTx() : block.vtx[i]);
+        EXPECT_EQ(READ_STATUS_FAILED, partialEmpty.FillBlock(received, vtxWrong));
+    }
+
+    TEST(TestBlockEncodings, TransactionsRequestRoundTrip)
+    {
+        BlockTransactionsRequest req;
+        req.blockhash = GetRandHash();
+        req.indexes.push_back(0);
+        req.indexes.push_back(1);
+        req.indexes.push_back(3);
+        req.indexes.push_back(65535);
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << req;
+        BlockTransactionsRequest req2;
+        ss >> req2;
+        EXPECT_EQ(req.blockhash, req2.blockhash);
+        EXPECT_EQ(req.indexes, req2.indexes);
+    }
+}
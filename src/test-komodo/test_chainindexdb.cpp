@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "batonsdb.h"
+#include "chainindexdb.h"
+#include "main.h"
+#include "random.h"
+#include "testutils.h"
+
+namespace TestChainIndexDB {
+
+    TEST(TestChainIndexDB, BestBlockAndWipe)
+    {
+        CChainIndexDB db("testindex", 1 << 20, true, false);
+        EXPECT_TRUE(db.ReadBestBlock().IsNull());
+        uint256 hashBlock = GetRandHash();
+        CDBBatch batch(db);
+        batch.Write(std::make_pair('x', 1), 10);
+        batch.Write(std::make_pair('y', 2), 20);
+        ASSERT_TRUE(db.WriteBlock(batch, hashBlock));
+        EXPECT_EQ(hashBlock, db.ReadBestBlock());
+        EXPECT_TRUE(db.ReadBestBlock('b').IsNull());
+
+        // only the records with the prefixes go
+        uint256 hashOther = GetRandHash();
+        ASSERT_TRUE(db.Wipe("x", hashOther));
+        EXPECT_FALSE(db.Exists(std::make_pair('x', 1)));
+        EXPECT_TRUE(db.Exists(std::make_pair('y', 2)));
+        EXPECT_EQ(hashOther, db.ReadBestBlock());
+    }
+
+    class TestChainIndexCatchUp : public ::testing::Test {
+    protected:
+        static void SetUpTestCase() { setupChain(); }
+        virtual void SetUp() {
+            pbatons = new BatonsDB(1 << 20, true);
+            ASSERT_TRUE(LoadBatons());
+        }
+        virtual void TearDown() {
+            delete pbatons;
+            pbatons = NULL;
+        }
+        void CatchUp() {
+            std::vector<CChainIndex> vIndexes;
+            CChainIndex index = { "baton index", GetBatonsBestBlock, ConnectBatons, DisconnectBatons, ResetBatons };
+            vIndexes.push_back(index);
+            boost::thread_group threadGroup;
+            StartChainIndexCatchUp(threadGroup, vIndexes);
+            threadGroup.join_all();
+        }
+    };
+
+    TEST_F(TestChainIndexCatchUp, ReplaysToTip)
+    {
+        for (int i = 0; i < 3; i++)
+            generateBlock();
+        // an empty index only follows from the genesis block
+        EXPECT_TRUE(GetBatonsBestBlock().IsNull());
+        CatchUp();
+        {
+            LOCK(cs_main);
+            EXPECT_EQ(chainActive.Tip()->GetBlockHash(), GetBatonsBestBlock());
+        }
+        // then ConnectBlock keeps it at the tip
+        generateBlock();
+        LOCK(cs_main);
+        EXPECT_EQ(chainActive.Tip()->GetBlockHash(), GetBatonsBestBlock());
+    }
+
+    TEST_F(TestChainIndexCatchUp, UnknownBestBlock)
+    {
+        generateBlock();
+        // an index written on another chain is built again
+        CBlock other;
+        other.nTime = 1;
+        ASSERT_TRUE(ConnectBatons(other, 0));
+        EXPECT_EQ(other.GetHash(), GetBatonsBestBlock());
+        CatchUp();
+        LOCK(cs_main);
+        EXPECT_EQ(chainActive.Tip()->GetBlockHash(), GetBatonsBestBlock());
+    }
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+
+#include "coins.h"
+#include "memusage.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/script.h"
+#include "txdb.h"
+#include "version.h"
+
+namespace TestCoinsDB {
+
+    class CCoinsViewDBTest : public CCoinsViewDB
+    {
+    public:
+        CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+        void WriteLegacyCoins(const uint256 &txid, const CCoins &coins) {
+            db.Write(std::make_pair('c', txid), coins);
+        }
+
+        bool HaveLegacyCoins(const uint256 &txid) {
+            return db.Exists(std::make_pair('c', txid));
+        }
+    };
+
+    // A notary or CC payout style transaction
+    static CTransaction MakePayout(int nOutputs)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        mtx.vout.resize(nOutputs);
+        for (int i = 0; i < nOutputs; i++) {
+            mtx.vout[i].nValue = 10000 + i;
+            mtx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        return CTransaction(mtx);
+    }
+
+    static size_t LegacyRecordSize(const CCoins &coins)
+    {
+        // key is the prefix and the txid
+        return 33 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+    }
+
+    TEST(TestCoinsDB, SpendOneOutput)
+    {
+        CCoinsViewDBTest db;
+        CTransaction tx = MakePayout(300);
+        {
+            CCoinsViewCache cache(&db);
+            cache.ModifyCoins(tx.GetHash())->FromTx(tx, 100);
+            ASSERT_TRUE(cache.Flush());
+        }
+        size_t nCreateBytes = db.GetLastBatchSize();
+
+        CCoinsViewCache cache(&db);
+        const CCoins *coins = cache.AccessCoins(tx.GetHash());
+        ASSERT_TRUE(coins != NULL);
+        EXPECT_TRUE(*coins == CCoins(tx, 100));
+        size_t nLegacyBytes = LegacyRecordSize(*coins);
+        // a record per output, each with its key, costs more to create than one record
+        EXPECT_GT(nCreateBytes, nLegacyBytes);
+
+        // the outputs changed since the load are part of the cache usage
+        size_t nCacheUsage = cache.DynamicMemoryUsage();
+        cache.ModifyCoins(tx.GetHash())->Spend(7);
+        std::vector<bool> dirty;
+        dirty.resize(300, false);
+        EXPECT_EQ(nCacheUsage + memusage::DynamicUsage(dirty), cache.DynamicMemoryUsage());
+
+        ASSERT_TRUE(cache.Flush());
+        size_t nSpendBytes = db.GetLastBatchSize();
+        // the erased output and the output count of the transaction
+        EXPECT_EQ((2 + 34) + (3 + 33 + 4), nSpendBytes);
+        EXPECT_LT(nSpendBytes * 20, nLegacyBytes);
+
+        CCoins reloaded;
+        ASSERT_TRUE(db.GetCoins(tx.GetHash(), reloaded));
+        EXPECT_FALSE(reloaded.IsAvailable(7));
+        EXPECT_TRUE(reloaded.IsAvailable(6));
+        EXPECT_TRUE(reloaded.IsAvailable(299));
+        EXPECT_EQ(100, reloaded.nHeight);
+        EXPECT_EQ(tx.nVersion, reloaded.nVersion);
+    }
+
+    TEST(TestCoinsDB, SpendThroughNestedCache)
+    {
+        CCoinsViewDBTest db;
+        CTransaction tx = MakePayout(20);
+        {
+            CCoinsViewCache cache(&db);
+            cache.ModifyCoins(tx.GetHash())->FromTx(tx, 5);
+            ASSERT_TRUE(cache.Flush());
+        }
+
+        CCoinsViewCache tip(&db);
+        tip.ModifyCoins(tx.GetHash())->Spend(0);
+        {
+            // as ConnectBlock does on a view on top of the tip
+            CCoinsViewCache view(&tip);
+            view.ModifyCoins(tx.GetHash())->Spend(19);
+            ASSERT_TRUE(view.Flush());
+        }
+        ASSERT_TRUE(tip.Flush());
+
+        CCoins reloaded;
+        ASSERT_TRUE(db.GetCoins(tx.GetHash(), reloaded));
+        EXPECT_FALSE(reloaded.IsAvailable(0));
+        EXPECT_FALSE(reloaded.IsAvailable(19));
+        EXPECT_EQ(19U, reloaded.vout.size());
+        for (int i = 1; i < 19; i++)
+            EXPECT_TRUE(reloaded.IsAvailable(i));
+    }
+
+    TEST(TestCoinsDB, SpendAllOutputs)
+    {
+        CCoinsViewDBTest db;
+        CTransaction tx = MakePayout(10);
+        {
+            CCoinsViewCache cache(&db);
+            cache.ModifyCoins(tx.GetHash())->FromTx(tx, 5);
+            ASSERT_TRUE(cache.Flush());
+        }
+        EXPECT_TRUE(db.HaveCoins(tx.GetHash()));
+        {
+            CCoinsViewCache cache(&db);
+            {
+                CCoinsModifier coins = cache.ModifyCoins(tx.GetHash());
+                for (int i = 0; i < 10; i++)
+                    coins->Spend(i);
+            }
+            ASSERT_TRUE(cache.Flush());
+        }
+        EXPECT_FALSE(db.HaveCoins(tx.GetHash()));
+        CCoins reloaded;
+        EXPECT_FALSE(db.GetCoins(tx.GetHash(), reloaded));
+    }
+
+    TEST(TestCoinsDB, TrailingOutputsSpent)
+    {
+        // read by lookups and by a cursor
+        int vOutputs[] = { 10, (int)COINS_DB_MAX_POINT_READS * 3 };
+        for (int i = 0; i < 2; i++) {
+            CCoinsViewDBTest db;
+            CTransaction tx = MakePayout(vOutputs[i]);
+            CTransaction txNext = MakePayout(5);
+            {
+                CCoinsViewCache cache(&db);
+                cache.ModifyCoins(tx.GetHash())->FromTx(tx, 5);
+                cache.ModifyCoins(txNext.GetHash())->FromTx(txNext, 5);
+                ASSERT_TRUE(cache.Flush());
+            }
+            {
+                CCoinsViewCache cache(&db);
+                {
+                    CCoinsModifier coins = cache.ModifyCoins(tx.GetHash());
+                    coins->Spend(1);
+                    coins->Spend(vOutputs[i] - 1);
+                    coins->Spend(vOutputs[i] - 2);
+                }
+                ASSERT_TRUE(cache.Flush());
+            }
+            CCoins reloaded;
+            ASSERT_TRUE(db.GetCoins(tx.GetHash(), reloaded));
+            EXPECT_EQ((size_t)vOutputs[i] - 2, reloaded.vout.size());
+            EXPECT_TRUE(reloaded.IsAvailable(0));
+            EXPECT_FALSE(reloaded.IsAvailable(1));
+            EXPECT_TRUE(reloaded.IsAvailable(vOutputs[i] - 3));
+            EXPECT_TRUE(db.HaveCoins(txNext.GetHash()));
+        }
+    }
+
+    TEST(TestCoinsDB, UpgradeLegacyRecords)
+    {
+        CCoinsViewDBTest db;
+        std::vector<CCoins> vCoins;
+        std::vector<uint256> vTxid;
+        for (int i = 0; i < 50; i++) {
+            CTransaction tx = MakePayout(1 + i * 3);
+            CCoins coins(tx, 1000 + i);
+            coins.fCoinBase = i % 2;
+            for (unsigned int n = 0; n + 1 < coins.vout.size(); n += 2)
+                coins.Spend(n);
+            vTxid.push_back(tx.GetHash());
+            vCoins.push_back(coins);
+            db.WriteLegacyCoins(tx.GetHash(), coins);
+        }
+        EXPECT_FALSE(db.HaveCoins(vTxid[10]));
+
+        ASSERT_TRUE(db.Upgrade());
+        for (size_t i = 0; i < vTxid.size(); i++) {
+            EXPECT_FALSE(db.HaveLegacyCoins(vTxid[i]));
+            CCoins reloaded;
+            ASSERT_TRUE(db.GetCoins(vTxid[i], reloaded));
+            EXPECT_TRUE(reloaded == vCoins[i]);
+            EXPECT_EQ(vCoins[i].fCoinBase, reloaded.fCoinBase);
+        }
+        // nothing left to do on the next start
+        EXPECT_TRUE(db.Upgrade());
+    }
+
+    TEST(TestCoinsDB, BackgroundFlushOverlay)
+    {
+        CCoinsViewDBTest db;
+        CCoinsViewFlushOverlay overlay(&db, &db, true);
+        CTransaction tx = MakePayout(50);
+        CTransaction tx2 = MakePayout(3);
+        uint256 hashBlock = GetRandHash();
+        {
+            CCoinsViewCache cache(&overlay);
+            cache.ModifyCoins(tx.GetHash())->FromTx(tx, 10);
+            cache.ModifyCoins(tx2.GetHash())->FromTx(tx2, 10);
+            cache.SetBestBlock(hashBlock);
+            ASSERT_TRUE(cache.Flush());
+        }
+        // served by the overlay whether or not the batch has committed
+        CCoinsViewCache cache(&overlay);
+        EXPECT_EQ(hashBlock, cache.GetBestBlock());
+        const CCoins *coins = cache.AccessCoins(tx.GetHash());
+        ASSERT_TRUE(coins != NULL);
+        EXPECT_TRUE(*coins == CCoins(tx, 10));
+
+        {
+            CCoinsModifier coins2 = cache.ModifyCoins(tx2.GetHash());
+            for (int i = 0; i < 3; i++)
+                coins2->Spend(i);
+        }
+        cache.ModifyCoins(tx.GetHash())->Spend(3);
+        // the next flush is applied after the first one
+        ASSERT_TRUE(cache.Flush());
+        EXPECT_FALSE(cache.HaveCoins(tx2.GetHash()));
+        ASSERT_TRUE(overlay.WaitForWrite());
+        EXPECT_FALSE(overlay.IsWriting());
+
+        EXPECT_EQ(hashBlock, db.GetBestBlock());
+        EXPECT_FALSE(db.HaveCoins(tx2.GetHash()));
+        CCoins reloaded;
+        ASSERT_TRUE(db.GetCoins(tx.GetHash(), reloaded));
+        EXPECT_FALSE(reloaded.IsAvailable(3));
+        EXPECT_TRUE(reloaded.IsAvailable(4));
+    }
+}
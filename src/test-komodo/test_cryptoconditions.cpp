@@ -162,6 +162,26 @@ TEST_F(CCTest, testVerifyEvalCondition)
 }
 
 
+TEST_F(CCTest, testReentrantCCInput)
+{
+    CC *cond;
+    CMutableTransaction mtxTo;
+
+    cond = CCNewThreshold(2, { CCNewSecp256k1(notaryKey.GetPubKey()), CCNewEval({EVAL_FAUCET}) });
+    CCSign(mtxTo, cond);
+    ASSERT_TRUE(IsReentrantCCInput(mtxTo.vin[0].scriptSig));
+    cc_free(cond);
+
+    // one eval that is not reentrant keeps the input on the connecting thread
+    cond = CCNewThreshold(3, { CCNewSecp256k1(notaryKey.GetPubKey()), CCNewEval({EVAL_FAUCET}), CCNewEval({EVAL_ASSETS}) });
+    CCSign(mtxTo, cond);
+    ASSERT_FALSE(IsReentrantCCInput(mtxTo.vin[0].scriptSig));
+    cc_free(cond);
+
+    ASSERT_FALSE(IsReentrantCCInput(CScript()));
+}
+
+
 TEST_F(CCTest, testCryptoConditionsDisabled)
 {
     CC *cond;
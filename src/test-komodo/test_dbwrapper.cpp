@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "dbwrapper.h"
+#include "random.h"
+#include "util.h"
+
+namespace TestDBWrapper {
+
+    class TestDBProfile : public ::testing::Test {
+    protected:
+        virtual void TearDown() {
+            mapMultiArgs.erase("-dbprofile");
+        }
+    };
+
+    TEST_F(TestDBProfile, DefaultsFromCacheSize)
+    {
+        CDBOptions options("chainstate", 8 << 20, true, 100);
+        EXPECT_EQ(4U << 20, options.nBlockCacheSize);
+        EXPECT_EQ(2U << 20, options.nWriteBufferSize);
+        EXPECT_EQ(10, options.nBloomBits);
+        EXPECT_EQ(100, options.nMaxOpenFiles);
+        EXPECT_TRUE(options.fCompression);
+    }
+
+    TEST_F(TestDBProfile, OverridesByName)
+    {
+        mapMultiArgs["-dbprofile"].push_back("blockindex:bloombits=16,blockcache=64,writebuffer=32");
+        mapMultiArgs["-dbprofile"].push_back("chainstate:bloombits=0,maxopenfiles=2000,compression=1");
+        std::string strError;
+        EXPECT_TRUE(CheckDBProfileArgs(strError));
+
+        CDBOptions blockindex = CDBOptions("blockindex", 8 << 20).ApplyProfileArgs();
+        EXPECT_EQ(16, blockindex.nBloomBits);
+        EXPECT_EQ(64U << 20, blockindex.nBlockCacheSize);
+        EXPECT_EQ(32U << 20, blockindex.nWriteBufferSize);
+        EXPECT_EQ(64, blockindex.nMaxOpenFiles);
+
+        CDBOptions chainstate = CDBOptions("chainstate", 8 << 20).ApplyProfileArgs();
+        EXPECT_EQ(0, chainstate.nBloomBits);
+        EXPECT_EQ(2000, chainstate.nMaxOpenFiles);
+        EXPECT_TRUE(chainstate.fCompression);
+        EXPECT_EQ(4U << 20, chainstate.nBlockCacheSize);
+    }
+
+    TEST_F(TestDBProfile, RejectsMalformed)
+    {
+        const char* bad[] = { "bloombits=10", "chainstate:", "chainstate:bloombits", "chainstate:bloombits=x",
+                              "chainstate:bloombits=-1", "chainstate:cache=10" };
+        for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            mapMultiArgs["-dbprofile"].assign(1, bad[i]);
+            std::string strError;
+            EXPECT_FALSE(CheckDBProfileArgs(strError)) << bad[i];
+            EXPECT_FALSE(strError.empty());
+        }
+    }
+
+    TEST_F(TestDBProfile, StatsOfOpenDatabase)
+    {
+        std::string name = strprintf("dbstats_%d", GetRand(1000000));
+        CDBOptions options(name, 1 << 20);
+        options.nBloomBits = 0;
+        {
+            CDBWrapper db(GetTempPath() / name, options, true, false);
+            for (int i = 0; i < 100; i++)
+                db.Write(i, GetRandHash());
+            uint256 value;
+            EXPECT_TRUE(db.Read(7, value));
+
+            std::vector<CDBStats> vStats;
+            GetDBStats(vStats);
+            bool fFound = false;
+            for (size_t i = 0; i < vStats.size(); i++) {
+                if (vStats[i].options.name == name) {
+                    fFound = true;
+                    EXPECT_EQ(0, vStats[i].options.nBloomBits);
+                    EXPECT_EQ(1U << 19, vStats[i].options.nBlockCacheSize);
+                }
+            }
+            EXPECT_TRUE(fFound);
+        }
+        // closed databases are no longer reported
+        std::vector<CDBStats> vStats;
+        GetDBStats(vStats);
+        for (size_t i = 0; i < vStats.size(); i++)
+            EXPECT_NE(name, vStats[i].options.name);
+    }
+}
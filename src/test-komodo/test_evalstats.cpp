@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "cc/eval.h"
+#include "cc/evalstats.h"
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+
+bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock);
+
+namespace TestEvalStats {
+
+    TEST(TestEvalStats, Percentile)
+    {
+        CCEvalStats stats;
+        EXPECT_EQ(0, stats.PercentileMicros(0.99));
+        for (int i = 0; i < 990; i++)
+            stats.Add(true, 5, 1, 0);
+        for (int i = 0; i < 10; i++)
+            stats.Add(false, 3000, 2, 1);
+        EXPECT_EQ(1000U, stats.nCount);
+        EXPECT_EQ(10U, stats.nInvalid);
+        EXPECT_EQ(990 * 5 + 10 * 3000, stats.nTotalMicros);
+        EXPECT_EQ(1010U, stats.nTxFetches);
+        EXPECT_EQ(10U, stats.nSpentLookups);
+        // the top of the first bucket, under 10us
+        EXPECT_EQ(9, stats.PercentileMicros(0.99));
+        // 3000us is in the bucket under 5120us, capped by the longest eval
+        EXPECT_EQ(3000, stats.PercentileMicros(0.999));
+        stats.Add(true, 4000, 0, 0);
+        EXPECT_EQ(4000, stats.PercentileMicros(1.0));
+        stats.Add(true, 100000000, 0, 0);
+        EXPECT_EQ(100000000, stats.nMaxMicros);
+        EXPECT_EQ(1U, stats.vBuckets[CC_EVAL_TIMING_BUCKETS - 1]);
+    }
+
+    TEST(TestEvalStats, Funcid)
+    {
+        CMutableTransaction mtx;
+        EXPECT_EQ(0, CCEvalFuncid(CTransaction(mtx)));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        EXPECT_EQ(0, CCEvalFuncid(CTransaction(mtx)));
+        std::vector<uint8_t> vopret = { EVAL_FAUCET, 'G', 1, 2 };
+        mtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << vopret));
+        EXPECT_EQ('G', CCEvalFuncid(CTransaction(mtx)));
+    }
+
+    TEST(TestEvalStats, RecordAndReset)
+    {
+        std::map<CCEvalKey, CCEvalStats> mapStats;
+        GetCCEvalStats(mapStats, true);
+        RecordCCEval(EVAL_TOKENS, 't', true, 120, 3, 1);
+        RecordCCEval(EVAL_TOKENS, 't', false, 80, 1, 0);
+        RecordCCEval(EVAL_TOKENS, 'c', true, 40, 0, 0);
+        GetCCEvalStats(mapStats, true);
+        ASSERT_EQ(2U, mapStats.size());
+        const CCEvalStats &stats = mapStats[CCEvalKey(EVAL_TOKENS, 't')];
+        EXPECT_EQ(2U, stats.nCount);
+        EXPECT_EQ(1U, stats.nInvalid);
+        EXPECT_EQ(200, stats.nTotalMicros);
+        EXPECT_EQ(4U, stats.nTxFetches);
+        GetCCEvalStats(mapStats);
+        EXPECT_TRUE(mapStats.empty());
+    }
+
+    TEST(TestEvalStats, TxFetchesCounted)
+    {
+        CTransaction tx;
+        uint256 hashBlock;
+        uint64_t nTxFetches = nCCTxFetches;
+        myGetTransaction(GetRandHash(), tx, hashBlock);
+        EXPECT_EQ(nTxFetches + 1, nCCTxFetches);
+    }
+}
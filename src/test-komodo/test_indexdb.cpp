@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+#include "txdb.h"
+
+namespace TestIndexDB {
+
+    static uint160 MakeAddress(unsigned char c)
+    {
+        return uint160(std::vector<unsigned char>(20, c));
+    }
+
+    TEST(TestIndexDB, MigrateFromBlockIndex)
+    {
+        CBlockTreeDB db(1 << 20, true);
+        uint160 addr = MakeAddress(7);
+        CAddressUnspentKey unspentKey(1, addr, GetRandHash(), 3);
+        CAddressIndexKey addressKey(1, addr, 10, 1, unspentKey.txhash, 3, false);
+        CSpentIndexKey spentKey(GetRandHash(), 1);
+        CTimestampIndexKey timestampKey(1570000000, GetRandHash());
+
+        // as written by versions keeping every index in blocks/index
+        db.Write(std::make_pair('u', unspentKey), CAddressUnspentValue(5000, CScript() << OP_TRUE, 10));
+        db.Write(std::make_pair('d', addressKey), (CAmount)5000);
+        db.Write(std::make_pair('p', spentKey), CSpentIndexValue(GetRandHash(), 0, 11, 5000, 1, addr));
+        db.Write(std::make_pair('S', timestampKey), 0);
+        db.Write(std::make_pair('z', timestampKey.blockHash), CTimestampBlockIndexValue(timestampKey.timestamp));
+        ASSERT_TRUE(db.WriteFlag("addressindex", true));
+
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+        ASSERT_TRUE(db.ReadAddressUnspentIndex(addr, 1, unspent));
+        EXPECT_TRUE(unspent.empty());
+
+        ASSERT_TRUE(db.MigrateIndexes());
+        EXPECT_FALSE(db.Exists(std::make_pair('u', unspentKey)));
+        EXPECT_FALSE(db.Exists(std::make_pair('p', spentKey)));
+        EXPECT_FALSE(db.Exists(std::make_pair('z', timestampKey.blockHash)));
+
+        ASSERT_TRUE(db.ReadAddressUnspentIndex(addr, 1, unspent));
+        ASSERT_EQ(1U, unspent.size());
+        EXPECT_EQ(5000, unspent[0].second.satoshis);
+        std::vector<std::pair<CAddressIndexKey, CAmount> > deltas;
+        ASSERT_TRUE(db.ReadAddressIndex(addr, 1, deltas));
+        EXPECT_EQ(1U, deltas.size());
+        CSpentIndexValue spentValue;
+        ASSERT_TRUE(db.ReadSpentIndex(spentKey, spentValue));
+        EXPECT_EQ(11, spentValue.blockHeight);
+        unsigned int logicalTS = 0;
+        ASSERT_TRUE(db.ReadTimestampBlockIndex(timestampKey.blockHash, logicalTS));
+        EXPECT_EQ(timestampKey.timestamp, logicalTS);
+
+        // flags stay in the block index
+        bool fValue = false;
+        EXPECT_TRUE(db.ReadFlag("addressindex", fValue) && fValue);
+        // nothing left to do on the next start
+        EXPECT_TRUE(db.MigrateIndexes());
+    }
+
+    TEST(TestIndexDB, ConnectAndDisconnectEntries)
+    {
+        CBlockTreeDB db(1 << 20, true);
+        uint160 addr = MakeAddress(9);
+        uint256 txid = GetRandHash();
+        CBlockIndexEntries connect;
+        // enough entries for the batches to be written in parallel
+        for (unsigned int n = 0; n < 2000; n++) {
+            connect.addressIndex.push_back(std::make_pair(CAddressIndexKey(1, addr, 20, 1, txid, n, false), (CAmount)n + 1));
+            connect.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, addr, txid, n),
+                CAddressUnspentValue(n + 1, CScript() << OP_DUP << OP_HASH160 << ToByteVector(addr) << OP_EQUALVERIFY << OP_CHECKSIG, 20)));
+            connect.spentIndex.push_back(std::make_pair(CSpentIndexKey(GetRandHash(), n), CSpentIndexValue(txid, n, 20, n + 1, 1, addr)));
+        }
+        connect.fTimestampIndex = true;
+        connect.timestampIndex = CTimestampIndexKey(1570000000, GetRandHash());
+        ASSERT_TRUE(db.WriteIndexEntries(connect));
+
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+        ASSERT_TRUE(db.ReadAddressUnspentIndex(addr, 1, unspent));
+        EXPECT_EQ(2000U, unspent.size());
+        CSpentIndexKey spentKey = connect.spentIndex[1234].first;
+        CSpentIndexValue spentValue;
+        ASSERT_TRUE(db.ReadSpentIndex(spentKey, spentValue));
+        EXPECT_EQ(1234U, spentValue.inputIndex);
+        unsigned int logicalTS = 0;
+        ASSERT_TRUE(db.ReadTimestampBlockIndex(connect.timestampIndex.blockHash, logicalTS));
+        EXPECT_EQ(1570000000U, logicalTS);
+
+        // what DisconnectBlock hands over for the same block
+        CBlockIndexEntries disconnect;
+        disconnect.fEraseAddressIndex = true;
+        disconnect.addressIndex = connect.addressIndex;
+        for (size_t i = 0; i < connect.addressUnspentIndex.size(); i++)
+            disconnect.addressUnspentIndex.push_back(std::make_pair(connect.addressUnspentIndex[i].first, CAddressUnspentValue()));
+        for (size_t i = 0; i < connect.spentIndex.size(); i++)
+            disconnect.spentIndex.push_back(std::make_pair(connect.spentIndex[i].first, CSpentIndexValue()));
+        ASSERT_TRUE(db.WriteIndexEntries(disconnect));
+
+        unspent.clear();
+        ASSERT_TRUE(db.ReadAddressUnspentIndex(addr, 1, unspent));
+        EXPECT_TRUE(unspent.empty());
+        std::vector<std::pair<CAddressIndexKey, CAmount> > deltas;
+        ASSERT_TRUE(db.ReadAddressIndex(addr, 1, deltas));
+        EXPECT_TRUE(deltas.empty());
+        EXPECT_FALSE(db.ReadSpentIndex(spentKey, spentValue));
+
+        ASSERT_TRUE(db.WipeIndex(TIMESTAMP_INDEX));
+        EXPECT_FALSE(db.ReadTimestampBlockIndex(connect.timestampIndex.blockHash, logicalTS));
+    }
+
+    TEST(TestIndexDB, TrimmedSolution)
+    {
+        CBlockTreeDB *pblocktreeOld = pblocktree;
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        CBlockHeader header;
+        header.nSolution = std::vector<unsigned char>(1344, 7);
+        uint256 hashStored = GetRandHash(), hashMissing = GetRandHash();
+        CBlockIndex stored(header), missing(header);
+        stored.phashBlock = &hashStored;
+        missing.phashBlock = &hashMissing;
+
+        std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+        std::vector<const CBlockIndex*> vBlocks(1, &stored);
+        ASSERT_TRUE(pblocktree->WriteBatchSync(vFiles, 0, vBlocks));
+        {
+            LOCK(cs_main);
+            stored.TrimSolution();
+            missing.TrimSolution();
+        }
+        EXPECT_FALSE(stored.HasSolution());
+
+        // read back from the db
+        std::vector<unsigned char> vSolution;
+        ASSERT_TRUE(stored.GetSolution(vSolution));
+        EXPECT_EQ(header.nSolution, vSolution);
+        CBlockHeader readHeader;
+        ASSERT_TRUE(stored.GetBlockHeader(readHeader));
+        EXPECT_EQ(header.nSolution, readHeader.nSolution);
+
+        // an entry whose solution is gone is neither served nor written
+        EXPECT_FALSE(missing.GetSolution(vSolution));
+        EXPECT_FALSE(missing.GetBlockHeader(readHeader));
+        vBlocks[0] = &missing;
+        EXPECT_FALSE(pblocktree->WriteBatchSync(vFiles, 0, vBlocks));
+
+        delete pblocktree;
+        pblocktree = pblocktreeOld;
+    }
+}
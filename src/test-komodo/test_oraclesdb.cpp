@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "cc/CCOracles.h"
+#include "oraclesdb.h"
+#include "random.h"
+#include "script/script.h"
+#include "testutils.h"
+
+namespace TestOraclesDB {
+
+    // a data tx of pk with an 'L' value
+    static CTransaction MakeData(uint256 oracletxid, CPubKey pk, int64_t price)
+    {
+        std::vector<uint8_t> data(8);
+        for (int i = 0; i < 8; i++)
+            data[i] = (uint8_t)(price >> (8 * i));
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_ORACLES, 0, pk));
+        mtx.vout.push_back(MakeCC1vout(EVAL_ORACLES, 10000, pk));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        mtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << E_MARSHAL(ss << (uint8_t)EVAL_ORACLES << (uint8_t)'D' << oracletxid << GetRandHash() << pk << data)));
+        return CTransaction(mtx);
+    }
+
+    // the series are complete when the index follows the tip
+    class TestOraclesDB : public ChainIndexTest {
+    protected:
+        virtual void SetUp() {
+            ChainIndexTest::SetUp();
+            poracles = new OraclesDB(1 << 20, true);
+            ASSERT_TRUE(LoadOracleSamples());
+        }
+        virtual void TearDown() {
+            ChainIndexTest::TearDown();
+            delete poracles;
+            poracles = NULL;
+        }
+    };
+
+    TEST_F(TestOraclesDB, SeriesConnectDisconnect)
+    {
+        uint256 oracletxid = GetRandHash();
+        CPubKey pk = notaryKey.GetPubKey();
+        COracleSeriesKey series(oracletxid, pk);
+
+        CBlock genesis;
+        genesis.nTime = 1000;
+        ASSERT_TRUE(ConnectOracleSamples(genesis, 0));
+        CBlock block1 = makeNextBlock(genesis, 100), block2 = makeNextBlock(block1, 100), block3 = makeNextBlock(block2, 100);
+        block1.vtx.push_back(MakeData(oracletxid, pk, 100));
+        block2.vtx.push_back(MakeData(oracletxid, pk, 200));
+        block2.vtx.push_back(MakeData(GetRandHash(), pk, 1));
+        block3.vtx.push_back(MakeData(oracletxid, pk, 300));
+        ASSERT_TRUE(ConnectOracleSamples(block1, 1));
+        ASSERT_TRUE(ConnectOracleSamples(block2, 2));
+        ASSERT_TRUE(ConnectOracleSamples(block3, 3));
+
+        std::vector<COracleSample> vSamples;
+        // not answered before the index is at the tip
+        EXPECT_FALSE(GetOracleSamples(series, 0, 0, 0, vSamples));
+        SetTip(block3, 3);
+        ASSERT_TRUE(GetOracleSamples(series, 0, 0, 0, vSamples));
+        ASSERT_EQ(3U, vSamples.size());
+        EXPECT_EQ(block3.vtx[0].GetHash(), vSamples[0].txid);
+        EXPECT_EQ(1, vSamples[2].nHeight);
+        EXPECT_EQ(1100U, vSamples[2].nTime);
+
+        ASSERT_TRUE(GetOracleSamples(series, 2, 2, 0, vSamples));
+        ASSERT_EQ(1U, vSamples.size());
+        EXPECT_EQ(block2.vtx[0].GetHash(), vSamples[0].txid);
+        ASSERT_TRUE(GetOracleSamples(series, 0, 0, 2, vSamples));
+        EXPECT_EQ(2U, vSamples.size());
+
+        ASSERT_TRUE(GetOracleSamplesByTime(series, 1150, 1300, 0, vSamples));
+        ASSERT_EQ(2U, vSamples.size());
+        EXPECT_EQ(3, vSamples[0].nHeight);
+        EXPECT_EQ(2, vSamples[1].nHeight);
+        // the largest ends of the ranges do not wrap around
+        ASSERT_TRUE(GetOracleSamplesByTime(series, 1150, 0xffffffff, 0, vSamples));
+        EXPECT_EQ(2U, vSamples.size());
+        ASSERT_TRUE(GetOracleSamples(series, 2, 0x7fffffff, 0, vSamples));
+        EXPECT_EQ(2U, vSamples.size());
+
+        CPubKey publisher;
+        char batonaddr[64];
+        Getscriptaddress(batonaddr, block1.vtx[0].vout[1].scriptPubKey);
+        ASSERT_TRUE(GetOraclePublisher(oracletxid, batonaddr, publisher));
+        EXPECT_EQ(pk, publisher);
+
+        ASSERT_TRUE(GetOracleLatestSamples(oracletxid, vSamples));
+        ASSERT_EQ(1U, vSamples.size());
+        EXPECT_EQ(3, vSamples[0].nHeight);
+        int64_t median;
+        EXPECT_EQ(300, OraclePrice(3, oracletxid, 10, median, vSamples));
+        EXPECT_EQ(300, median);
+
+        // the latest sample goes back with the block
+        ASSERT_TRUE(DisconnectOracleSamples(block3, 3));
+        SetTip(block2, 2);
+        ASSERT_TRUE(GetOracleLatestSamples(oracletxid, vSamples));
+        ASSERT_EQ(1U, vSamples.size());
+        EXPECT_EQ(2, vSamples[0].nHeight);
+        ASSERT_TRUE(GetOracleSamplesByTime(series, 0, 0, 0, vSamples));
+        EXPECT_EQ(2U, vSamples.size());
+
+        ASSERT_TRUE(DisconnectOracleSamples(block2, 2));
+        ASSERT_TRUE(DisconnectOracleSamples(block1, 1));
+        SetTip(genesis, 0);
+        ASSERT_TRUE(GetOracleLatestSamples(oracletxid, vSamples));
+        EXPECT_EQ(0U, vSamples.size());
+
+        // an index of an older version started above the genesis block is indexed again
+        ASSERT_TRUE(ConnectOracleSamples(block1, 1));
+        ASSERT_TRUE(poracles->Write('S', std::make_pair((int32_t)5, (uint32_t)1500)));
+        ASSERT_TRUE(LoadOracleSamples());
+        EXPECT_TRUE(GetOracleSamplesBestBlock().IsNull());
+        EXPECT_FALSE(poracles->Exists('S'));
+        ASSERT_TRUE(ConnectOracleSamples(genesis, 0));
+        SetTip(genesis, 0);
+        ASSERT_TRUE(GetOracleSamples(series, 0, 0, 0, vSamples));
+        EXPECT_EQ(0U, vSamples.size());
+    }
+
+    TEST(TestOraclesDB, CorrelatedPrice)
+    {
+        std::vector<int64_t> prices;
+        prices.push_back(1000);
+        prices.push_back(1001);
+        prices.push_back(5000);
+        EXPECT_EQ(1000, OracleCorrelatedPrice(0, prices));
+        prices.clear();
+        prices.push_back(42);
+        EXPECT_EQ(42, OracleCorrelatedPrice(7, prices));
+    }
+}
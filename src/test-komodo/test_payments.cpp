@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+
+#include "cc/CCPayments.h"
+#include "cc/CCtokens.h"
+#include "hash.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "testutils.h"
+
+extern int64_t mpz_get_si2( mpz_t op );
+
+namespace TestPayments {
+
+    // the allocations walk of the daily snapshot as it was done for each entry
+    static int32_t ReferenceAllocations(const std::vector<std::pair<CAmount, CScript>> &vEntries, int32_t top, int32_t bottom,
+        const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, int64_t &total, std::vector<CScript> &scriptPubKeys, std::vector<int64_t> &allocations)
+    {
+        int32_t i = 0;
+        total = 0;
+        for (int32_t j = bottom; j < vEntries.size(); j++)
+        {
+            bool skip = false;
+            for (auto skipkey : excludeScriptPubKeys)
+                if (vEntries[j].second == CScript(skipkey.begin(), skipkey.end()))
+                    skip = true;
+            if (!skip)
+            {
+                i++;
+                scriptPubKeys.push_back(vEntries[j].second);
+                allocations.push_back(vEntries[j].first);
+                total += vEntries[j].first;
+            }
+            if (i + bottom == top)
+                break;
+        }
+        return i;
+    }
+
+    static std::vector<uint8_t> ScriptBytes(const CScript &script)
+    {
+        return std::vector<uint8_t>(script.begin(), script.end());
+    }
+
+    TEST(TestPayments, SnapshotAllocationsMatchWalk)
+    {
+        std::vector<std::pair<CAmount, CScript>> vEntries;
+        for (int k = 0; k < 300; k++)
+        {
+            uint256 seed = GetRandHash();
+            vEntries.push_back(std::make_pair((CAmount)(GetRand(1000) + 1) * COIN, GetScriptForDestination(CKeyID(Hash160(seed.begin(), seed.end())))));
+        }
+        std::sort(vEntries.rbegin(), vEntries.rend());
+        CPaymentsSnapshot snapshot;
+        snapshot.Set(10, vEntries);
+
+        for (int t = 0; t < 200; t++)
+        {
+            int32_t bottom = GetRand(320), top = GetRand(340);
+            std::vector<std::vector<uint8_t>> excludeScriptPubKeys;
+            for (int k = GetRand(6); k > 0; k--)
+                excludeScriptPubKeys.push_back(ScriptBytes(vEntries[GetRand(vEntries.size())].second));
+            if (t % 3 == 0)
+                excludeScriptPubKeys.push_back(ScriptBytes(CScript() << OP_TRUE));
+
+            int64_t total;
+            std::vector<CScript> refScripts, scripts;
+            std::vector<int64_t> refAllocations, allocations;
+            int32_t n = ReferenceAllocations(vEntries, top, bottom, excludeScriptPubKeys, total, refScripts, refAllocations);
+
+            mpz_t mpzTotal;
+            mpz_init(mpzTotal);
+            EXPECT_EQ(n, snapshot.GetAllocations(top, bottom, excludeScriptPubKeys, mpzTotal, scripts, allocations)) << "top " << top << " bottom " << bottom;
+            EXPECT_EQ(total, mpz_get_si2(mpzTotal)) << "top " << top << " bottom " << bottom;
+            EXPECT_EQ(refScripts, scripts);
+            EXPECT_EQ(refAllocations, allocations);
+            mpz_clear(mpzTotal);
+        }
+    }
+
+    TEST(TestPayments, SnapshotAllocationsEmpty)
+    {
+        CPaymentsSnapshot snapshot;
+        std::vector<CScript> scripts;
+        std::vector<int64_t> allocations;
+        mpz_t mpzTotal;
+        mpz_init(mpzTotal);
+        EXPECT_EQ(0, snapshot.GetAllocations(10, 0, std::vector<std::vector<uint8_t>>(), mpzTotal, scripts, allocations));
+        EXPECT_EQ(0, mpz_get_si2(mpzTotal));
+        EXPECT_TRUE(scripts.empty());
+        mpz_clear(mpzTotal);
+    }
+
+    TEST(TestPayments, TokenSnapshotHeight)
+    {
+        int32_t nInterval = KOMODO_SNAPSHOT_INTERVAL;
+        KOMODO_SNAPSHOT_INTERVAL = 0;
+        EXPECT_EQ(0, payments_tokensnapshotheight(500));
+        KOMODO_SNAPSHOT_INTERVAL = 100;
+        EXPECT_EQ(0, payments_tokensnapshotheight(100));
+        // always a block before the one the release is in
+        EXPECT_EQ(100, payments_tokensnapshotheight(101));
+        EXPECT_EQ(100, payments_tokensnapshotheight(200));
+        EXPECT_EQ(200, payments_tokensnapshotheight(201));
+        KOMODO_SNAPSHOT_INTERVAL = nInterval;
+    }
+
+    TEST(TestPayments, TokenAllocationsNotActive)
+    {
+        int32_t nInterval = KOMODO_SNAPSHOT_INTERVAL, nActivation = KOMODO_PAYMENTSTOKENS_HEIGHT;
+        KOMODO_SNAPSHOT_INTERVAL = 100;
+        KOMODO_PAYMENTSTOKENS_HEIGHT = 0;
+        EXPECT_FALSE(payments_tokensactive(1000));
+        KOMODO_PAYMENTSTOKENS_HEIGHT = 500;
+        EXPECT_FALSE(payments_tokensactive(499));
+        EXPECT_TRUE(payments_tokensactive(500));
+
+        int32_t top = 10, bottom = 0;
+        std::vector<CScript> scripts;
+        std::vector<int64_t> allocations;
+        mpz_t mpzTotal;
+        mpz_init(mpzTotal);
+        EXPECT_EQ(-1, payments_gettokenallocations(499, GetRandHash(), top, bottom, false, std::vector<std::vector<uint8_t>>(), mpzTotal, scripts, allocations));
+        // a snapshot above the tip cannot be taken
+        EXPECT_EQ(-1, payments_gettokenallocations(1000000, GetRandHash(), top, bottom, false, std::vector<std::vector<uint8_t>>(), mpzTotal, scripts, allocations));
+        EXPECT_TRUE(scripts.empty());
+        mpz_clear(mpzTotal);
+        KOMODO_SNAPSHOT_INTERVAL = nInterval;
+        KOMODO_PAYMENTSTOKENS_HEIGHT = nActivation;
+    }
+
+    // the chain is given by the test, blocks not in mapBlocks are empty
+    class TestTokenHolders : public CPaymentsTokenHolders
+    {
+    public:
+        std::map<int32_t, CBlock> mapBlocks;
+        int32_t nTokenbaseHeight;
+        mutable int32_t nBlocksRead;
+
+        TestTokenHolders() : nTokenbaseHeight(0), nBlocksRead(0) {}
+
+    protected:
+        CBlockIndex *GetTokenbaseIndex(uint256 tokenid) const { return chainActive[nTokenbaseHeight]; }
+        bool ReadBlock(CBlockIndex *pindex, CBlock &block) const
+        {
+            std::map<int32_t, CBlock>::const_iterator it = mapBlocks.find(pindex->GetHeight());
+            block = it != mapBlocks.end() ? it->second : CBlock();
+            nBlocksRead++;
+            return true;
+        }
+    };
+
+    static CTransaction MakeTokenTransfer(std::vector<COutPoint> vPrevouts, uint256 tokenid, std::vector<CTxOut> vOutputs, std::vector<CPubKey> voutPubkeys)
+    {
+        CMutableTransaction mtx;
+        for (auto &prevout : vPrevouts)
+            mtx.vin.push_back(CTxIn(prevout, CScript()));
+        mtx.vout = vOutputs;
+        mtx.vout.push_back(CTxOut(0, EncodeTokenOpRet(tokenid, voutPubkeys, std::vector<std::pair<uint8_t, vscript_t> >())));
+        return CTransaction(mtx);
+    }
+
+    TEST(TestPayments, TokenHoldersScan)
+    {
+        CKey key2, key3;
+        key2.MakeNewKey(true);
+        key3.MakeNewKey(true);
+        CPubKey pk1 = notaryKey.GetPubKey(), pk2 = key2.GetPubKey(), pk3 = key3.GetPubKey();
+        CScript holder1 = GetScriptForDestination(pk1.GetID()), holder2 = GetScriptForDestination(pk2.GetID()), holder3 = GetScriptForDestination(pk3.GetID());
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_TOKENS);
+
+        // the tokenbase has to be paid by its creator, found in the mempool
+        CMutableTransaction fund;
+        fund.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript()));
+        fund.vout.push_back(CTxOut(10000, CScript() << ParseHex(HexStr(pk1)) << OP_CHECKSIG));
+        CTransaction fundtx(fund);
+        mempool.addUnchecked(fundtx.GetHash(), CTxMemPoolEntry(fundtx, 0, 0, 0.0, 0, true, false, 0));
+
+        CMutableTransaction create;
+        create.vin.push_back(CTxIn(COutPoint(fundtx.GetHash(), 0), CScript()));
+        create.vout.push_back(MakeCC1vout(EVAL_TOKENS, 1000, pk1));
+        create.vout.push_back(CTxOut(0, EncodeTokenCreateOpRet('c', std::vector<uint8_t>(pk1.begin(), pk1.end()), "token", "", vscript_t())));
+        CTransaction tokenbase(create);
+        uint256 tokenid = tokenbase.GetHash();
+
+        std::vector<CTxOut> vOutputs;
+        vOutputs.push_back(MakeCC1vout(EVAL_TOKENS, 600, pk2));
+        vOutputs.push_back(MakeCC1vout(EVAL_TOKENS, 300, pk1));
+        // tokens locked in a 1of2 with the global pubkey have no holder
+        vOutputs.push_back(MakeTokensCC1of2vout(EVAL_TOKENS, 100, pk2, GetUnspendable(cp, NULL)));
+        // a pubkey not in the opret, not a token output
+        vOutputs.push_back(MakeCC1vout(EVAL_TOKENS, 50, pk3));
+        std::vector<CPubKey> voutPubkeys;
+        voutPubkeys.push_back(pk2);
+        voutPubkeys.push_back(pk1);
+        CTransaction transfer = MakeTokenTransfer(std::vector<COutPoint>(1, COutPoint(tokenid, 0)), tokenid, vOutputs, voutPubkeys);
+
+        // spends the 300 of pk1 and creates 500, none of it are tokens
+        CTransaction overcreate = MakeTokenTransfer(std::vector<COutPoint>(1, COutPoint(transfer.GetHash(), 1)), tokenid,
+            std::vector<CTxOut>(1, MakeCC1vout(EVAL_TOKENS, 500, pk1)), std::vector<CPubKey>(1, pk1));
+        CTransaction transfer2 = MakeTokenTransfer(std::vector<COutPoint>(1, COutPoint(transfer.GetHash(), 0)), tokenid,
+            std::vector<CTxOut>(1, MakeCC1vout(EVAL_TOKENS, 600, pk3)), std::vector<CPubKey>(1, pk3));
+
+        std::vector<CBlockIndex> vIndex(201);
+        std::vector<uint256> vHashes(201);
+        for (int32_t h = 0; h <= 200; h++)
+        {
+            vHashes[h] = GetRandHash();
+            vIndex[h].phashBlock = &vHashes[h];
+            vIndex[h].pprev = h > 0 ? &vIndex[h-1] : NULL;
+            vIndex[h].SetHeight(h);
+        }
+        LOCK(cs_main);
+        CBlockIndex *savedTip = chainActive.Tip();
+        chainActive.SetTip(&vIndex[200]);
+
+        TestTokenHolders holders;
+        holders.nTokenbaseHeight = 10;
+        holders.mapBlocks[10].vtx.push_back(tokenbase);
+        holders.mapBlocks[50].vtx.push_back(transfer);
+        holders.mapBlocks[150].vtx.push_back(overcreate);
+        holders.mapBlocks[160].vtx.push_back(transfer2);
+
+        ASSERT_TRUE(holders.Scan(tokenid, 100));
+        EXPECT_EQ(91, holders.nBlocksRead);
+        EXPECT_EQ(3U, holders.mapOutputs.size());
+        EXPECT_EQ(0U, holders.mapOutputs.count(COutPoint(transfer.GetHash(), 3)));
+        ASSERT_EQ(1U, holders.mapOutputs.count(COutPoint(transfer.GetHash(), 2)));
+        EXPECT_TRUE(holders.mapOutputs[COutPoint(transfer.GetHash(), 2)].second.empty());
+
+        std::vector<CScript> scripts;
+        std::vector<int64_t> allocations;
+        mpz_t mpzTotal;
+        mpz_init(mpzTotal);
+        EXPECT_EQ(2, holders.snapshot.GetAllocations(10, 0, std::vector<std::vector<uint8_t>>(), mpzTotal, scripts, allocations));
+        ASSERT_EQ(2U, scripts.size());
+        EXPECT_EQ(holder2, scripts[0]);
+        EXPECT_EQ(holder1, scripts[1]);
+        EXPECT_EQ(600, allocations[0]);
+        EXPECT_EQ(300, allocations[1]);
+        EXPECT_EQ(900, mpz_get_si2(mpzTotal));
+
+        // the next snapshot only reads the blocks after the last one
+        ASSERT_TRUE(holders.Scan(tokenid, 200));
+        EXPECT_EQ(191, holders.nBlocksRead);
+        EXPECT_EQ(200, holders.nHeight);
+        EXPECT_EQ(vHashes[200], holders.hashBlock);
+        EXPECT_EQ(0U, holders.mapOutputs.count(COutPoint(transfer.GetHash(), 1)));
+        EXPECT_EQ(0U, holders.mapOutputs.count(COutPoint(overcreate.GetHash(), 0)));
+        scripts.clear();
+        allocations.clear();
+        EXPECT_EQ(1, holders.snapshot.GetAllocations(10, 0, std::vector<std::vector<uint8_t>>(), mpzTotal, scripts, allocations));
+        ASSERT_EQ(1U, scripts.size());
+        EXPECT_EQ(holder3, scripts[0]);
+        EXPECT_EQ(600, allocations[0]);
+        EXPECT_EQ(600, mpz_get_si2(mpzTotal));
+        // scanned already
+        ASSERT_TRUE(holders.Scan(tokenid, 200));
+        EXPECT_EQ(191, holders.nBlocksRead);
+        mpz_clear(mpzTotal);
+
+        chainActive.SetTip(savedTip);
+        std::list<CTransaction> removed;
+        mempool.remove(fundtx, removed, false);
+    }
+}
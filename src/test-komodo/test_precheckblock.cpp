@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include "consensus/validation.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include "testutils.h"
+
+namespace TestPrecheckBlock {
+
+    TEST(TestPrecheckBlock, ValidBlockIsFlagged)
+    {
+        CBlock block = makeTestBlock(10);
+        CValidationState state;
+        EXPECT_TRUE(PrecheckBlock(block, state));
+        EXPECT_TRUE(block.fCheckedSolution);
+        EXPECT_TRUE(block.fCheckedMerkleRoot);
+
+        // the flags are memory only
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        CBlock received;
+        ss >> received;
+        EXPECT_FALSE(received.fCheckedSolution);
+        EXPECT_FALSE(received.fCheckedMerkleRoot);
+    }
+
+    TEST(TestPrecheckBlock, BadMerkleRoot)
+    {
+        CBlock block = makeTestBlock(10);
+        block.vtx[3] = makeRandomTx();
+        CValidationState state;
+        EXPECT_FALSE(PrecheckBlock(block, state));
+        EXPECT_EQ("bad-txnmrklroot", state.GetRejectReason());
+        EXPECT_TRUE(state.CorruptionPossible());
+        EXPECT_FALSE(block.fCheckedMerkleRoot);
+    }
+
+    TEST(TestPrecheckBlock, DuplicateTransactions)
+    {
+        // with an odd number of transactions, repeating the last one gives the same merkle root
+        CBlock block = makeTestBlock(2);
+        block.vtx.push_back(block.vtx[2]);
+        ASSERT_EQ(block.hashMerkleRoot, block.BuildMerkleTree());
+        CValidationState state;
+        EXPECT_FALSE(PrecheckBlock(block, state));
+        EXPECT_EQ("bad-txns-duplicate", state.GetRejectReason());
+    }
+
+    TEST(TestPrecheckBlock, CoinbasePlacement)
+    {
+        CBlock block = makeTestBlock(3);
+        block.vtx[2] = makeCoinbaseTx();
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        CValidationState state;
+        EXPECT_FALSE(PrecheckBlock(block, state));
+        EXPECT_EQ("bad-cb-multiple", state.GetRejectReason());
+
+        CBlock noCoinbase = makeTestBlock(3);
+        noCoinbase.vtx.erase(noCoinbase.vtx.begin());
+        noCoinbase.hashMerkleRoot = noCoinbase.BuildMerkleTree();
+        CValidationState state2;
+        EXPECT_FALSE(PrecheckBlock(noCoinbase, state2));
+        EXPECT_EQ("bad-cb-missing", state2.GetRejectReason());
+    }
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include "komodo.h"
+#include "komodo_extern_globals.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace TestPriceKernels {
+
+    class TestPriceKernels : public ::testing::Test {
+    protected:
+        uint64_t savedCbopret;
+        virtual void SetUp() {
+            // komodo_pricemult is 0 unless the chain has prices
+            savedCbopret = ASSETCHAINS_CBOPRET;
+            ASSETCHAINS_CBOPRET = 1;
+        }
+        virtual void TearDown() {
+            ASSETCHAINS_CBOPRET = savedCbopret;
+        }
+    };
+
+#ifdef KOMODO_PRICES_AVX2
+
+    static uint64_t rngstate = 88172645463325252ULL;
+
+    static uint64_t rnd()
+    {
+        rngstate ^= rngstate << 13;
+        rngstate ^= rngstate >> 7;
+        rngstate ^= rngstate << 17;
+        return rngstate;
+    }
+
+    // numprices interleaved feeds as komodo_pricesupdate reads them, each drawn the way of mode
+    static std::vector<uint32_t> MakeFeeds(int32_t numprices, int mode)
+    {
+        std::vector<uint32_t> rawprices(PRICES_DAYWINDOW * numprices);
+        for (size_t i = 0; i < rawprices.size(); i++)
+        {
+            uint32_t base = 1000 + (i % numprices) * 997;
+            switch (mode)
+            {
+                case 0: rawprices[i] = base * 1000 + rnd() % (base * 40); break;                      // correlated
+                case 1: rawprices[i] = rnd() % 2 ? base * 1000 + rnd() % 6000 : base * 3000; break;   // two levels
+                case 2: rawprices[i] = rnd() % 3 ? 4000000000U + rnd() % 200000000 : rnd() % 0xffffffff + 1; break;
+                case 3: rawprices[i] = rnd() % 20 + 1; break;                                         // below the error rate
+                default: rawprices[i] = rnd() % 300 == 0 ? 0 : base * 1000 + rnd() % 6000; break;    // with null prices
+            }
+        }
+        return rawprices;
+    }
+
+    TEST_F(TestPriceKernels, CorrelatedMatchesScalar)
+    {
+        if (!__builtin_cpu_supports("avx2")) {
+            std::cerr << "no AVX2 on this cpu, skipped" << std::endl;
+            return;
+        }
+        const int32_t numprices = 4;
+        for (int mode = 0; mode < 5; mode++)
+        {
+            std::vector<uint32_t> rawprices = MakeFeeds(numprices, mode);
+            for (int32_t ind = 0; ind < numprices; ind++)
+            {
+                uint64_t seed = rnd();
+                // forward as the prices rpc reads them and backward from the newest as komodo_pricesupdate does
+                EXPECT_EQ(komodo_pricecorrelated_scalar(seed, ind, &rawprices[ind], numprices, 0, PRICES_SMOOTHWIDTH),
+                          komodo_pricecorrelated_avx2(seed, ind, &rawprices[ind], numprices, 0, PRICES_SMOOTHWIDTH)) << "mode " << mode;
+                uint32_t *newest = &rawprices[(PRICES_DAYWINDOW - 1) * numprices + ind];
+                EXPECT_EQ(komodo_pricecorrelated_scalar(seed, ind, newest, -numprices, 0, PRICES_SMOOTHWIDTH),
+                          komodo_pricecorrelated_avx2(seed, ind, newest, -numprices, 0, PRICES_SMOOTHWIDTH)) << "mode " << mode;
+            }
+        }
+    }
+
+    TEST_F(TestPriceKernels, TrioaveMatchesScalar)
+    {
+        if (!__builtin_cpu_supports("avx2")) {
+            std::cerr << "no AVX2 on this cpu, skipped" << std::endl;
+            return;
+        }
+        for (int t = 0; t < 200; t++)
+        {
+            int32_t n = 130 + rnd() % 700;
+            std::vector<int64_t> srcA(n), srcB(n), destA(n), destB(n);
+            for (int32_t i = 0; i < n; i++)
+                srcA[i] = srcB[i] = rnd() % 4 == 0 ? 0 : (int64_t)(rnd() % 2000000000000LL) - (t % 2 ? 1000000000000LL : 0);
+            buf_trioave64_scalar(&destA[0], &srcA[0], n);
+            buf_trioave64_avx2(&destB[0], &srcB[0], n);
+            ASSERT_EQ(srcA, srcB);
+            ASSERT_EQ(destA, destB) << "n " << n;
+        }
+    }
+
+    // a day of prices for every feed of a full prices chain, the way komodo_pricesupdate walks them each block
+    TEST_F(TestPriceKernels, Bench)
+    {
+        const int32_t numprices = KOMODO_MAXPRICES / 16;
+        std::vector<uint32_t> rawprices = MakeFeeds(numprices, 1);
+        int64_t checks[2] = { 0, 0 };
+        for (int k = 0; k < 2; k++)
+        {
+            int64_t &check = checks[k];
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int32_t ind = 0; ind < numprices; ind++)
+            {
+                uint32_t *newest = &rawprices[(PRICES_DAYWINDOW - 1) * numprices + ind];
+                if (k == 0)
+                    check += komodo_pricecorrelated_scalar(ind, ind, newest, -numprices, 0, PRICES_SMOOTHWIDTH);
+                else if (__builtin_cpu_supports("avx2"))
+                    check += komodo_pricecorrelated_avx2(ind, ind, newest, -numprices, 0, PRICES_SMOOTHWIDTH);
+            }
+            std::cerr << (k == 0 ? "scalar" : "avx2") << ": " << numprices << " feeds in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()
+                      << " us" << std::endl;
+        }
+        if (__builtin_cpu_supports("avx2"))
+            EXPECT_EQ(checks[0], checks[1]);
+    }
+
+#endif
+
+    TEST_F(TestPriceKernels, Autodetect)
+    {
+        std::string kernels = komodo_pricekernels_autodetect();
+        EXPECT_TRUE(kernels == "avx2" || kernels == "scalar");
+        std::vector<int64_t> src(300, 1000), dest(300);
+        buf_trioave64(&dest[0], &src[0], src.size());
+        EXPECT_EQ(0, dest[100]);
+        EXPECT_EQ(1000, dest[200]);
+    }
+}
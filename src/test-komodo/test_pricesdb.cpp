@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+
+#include "cc/CCPrices.h"
+#include "komodo_extern_globals.h"
+#include "main.h"
+#include "pricesdb.h"
+#include "random.h"
+#include "script/script.h"
+#include "testutils.h"
+
+CScript prices_betopret(CPubKey mypk,int32_t height,int64_t amount,int16_t leverage,int64_t firstprice,std::vector<uint16_t> vec,uint256 tokenid);
+CScript prices_addopret(uint256 bettxid,CPubKey mypk,int64_t amount);
+void komodo_pricesupdate(int32_t height,CBlock *pblock);
+
+namespace TestPricesDB {
+
+    // a bet tx with its baton, cc marker, bet amount and normal marker
+    static CTransaction MakeBet(CPubKey pk, int32_t height, int64_t amount, int16_t leverage = 10, std::vector<uint16_t> vec = std::vector<uint16_t>(1, 0))
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_PRICES);
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_PRICES, 10000, pk));
+        mtx.vout.push_back(MakeCC1vout(EVAL_PRICES, 10000, pk));
+        mtx.vout.push_back(MakeCC1vout(EVAL_PRICES, amount, pk));
+        mtx.vout.push_back(CTxOut(10000, CScript() << ParseHex(HexStr(GetUnspendable(cp, 0))) << OP_CHECKSIG));
+        mtx.vout.push_back(CTxOut(0, prices_betopret(pk, height, amount, leverage, 1000, vec, uint256())));
+        return CTransaction(mtx);
+    }
+
+    static CTransaction MakeAddFunding(uint256 batontxid, uint256 bettxid, CPubKey pk, int64_t amount)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(batontxid, 0), CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_PRICES, 10000, pk));
+        mtx.vout.push_back(MakeCC1vout(EVAL_PRICES, amount, pk));
+        mtx.vout.push_back(CTxOut(0, prices_addopret(bettxid, pk, amount)));
+        return CTransaction(mtx);
+    }
+
+    static CTransaction MakeCashout(uint256 bettxid)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(bettxid, NVOUT_CCMARKER), CScript()));
+        mtx.vout.push_back(CTxOut(10000, CScript() << OP_TRUE));
+        return CTransaction(mtx);
+    }
+
+    class TestPricesDB : public ChainIndexTest {
+    protected:
+        uint64_t savedCbopret;
+        virtual void SetUp() {
+            ChainIndexTest::SetUp();
+            savedCbopret = ASSETCHAINS_CBOPRET;
+            ASSETCHAINS_CBOPRET = 1;
+            pprices = new PricesDB(1 << 20, true);
+            ASSERT_TRUE(LoadPricesBets(uint256()));
+        }
+        virtual void TearDown() {
+            ChainIndexTest::TearDown();
+            ASSETCHAINS_CBOPRET = savedCbopret;
+            delete pprices;
+            pprices = NULL;
+        }
+    };
+
+    TEST_F(TestPricesDB, BetsConnectDisconnect)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CBlock genesis;
+        genesis.nTime = 1000;
+        ConnectPricesBets(genesis, 0);
+        CBlock block1 = makeNextBlock(genesis), block2 = makeNextBlock(block1), block3 = makeNextBlock(block2);
+        block1.vtx.push_back(MakeBet(pk, 1, 1000 * COIN));
+        block1.vtx.push_back(MakeBet(pk, 1, 50 * COIN));
+        // prices_listbettxids does not find a bet without the normal marker
+        CMutableTransaction unmarked(MakeBet(pk, 1, 10 * COIN));
+        unmarked.vout[NVOUT_NORMALMARKER] = CTxOut(10000, CScript() << OP_TRUE);
+        block1.vtx.push_back(CTransaction(unmarked));
+        uint256 bettxid = block1.vtx[0].GetHash(), bettxid2 = block1.vtx[1].GetHash();
+        block2.vtx.push_back(MakeAddFunding(bettxid, bettxid, pk, 200 * COIN));
+        // the later fundings follow the baton whatever bet their opret names
+        block3.vtx.push_back(MakeAddFunding(block2.vtx[0].GetHash(), GetRandHash(), pk, 100 * COIN));
+        block3.vtx.push_back(MakeCashout(bettxid2));
+        ConnectPricesBets(block1, 1);
+        ConnectPricesBets(block2, 2);
+        ConnectPricesBets(block3, 3);
+        SetTip(block3, 3);
+
+        CPricesBetState state;
+        ASSERT_TRUE(GetPricesBetState(bettxid, state));
+        ASSERT_EQ(3U, state.positions.size());
+        EXPECT_EQ(1, state.positions[0].firstheight);
+        EXPECT_EQ(2, state.positions[1].firstheight);
+        EXPECT_EQ(3, state.positions[2].firstheight);
+        EXPECT_EQ(block3.vtx[0].GetHash(), state.batontxid);
+        EXPECT_EQ(1300 * COIN, state.totalposition);
+        // without prices the profits are not scanned
+        EXPECT_EQ(0, state.nLastHeight);
+        EXPECT_EQ(1300 * COIN, state.equity);
+        EXPECT_FALSE(state.fRekt);
+        EXPECT_FALSE(GetPricesBetState(bettxid2, state));
+        EXPECT_FALSE(GetPricesBetState(block1.vtx[2].GetHash(), state));
+
+        std::map<uint256, CPricesBetState> mapStates;
+        ASSERT_TRUE(GetPricesBetStates(false, mapStates));
+        EXPECT_EQ(1U, mapStates.size());
+        ASSERT_TRUE(GetPricesBetStates(true, mapStates));
+        EXPECT_EQ(0U, mapStates.size());
+
+        // the closed bet comes back with the block, then the added fundings go
+        DisconnectPricesBets(block3, 3);
+        SetTip(block2, 2);
+        ASSERT_TRUE(GetPricesBetState(bettxid2, state));
+        EXPECT_EQ(50 * COIN, state.totalposition);
+        ASSERT_TRUE(GetPricesBetState(bettxid, state));
+        EXPECT_EQ(2U, state.positions.size());
+        EXPECT_EQ(block2.vtx[0].GetHash(), state.batontxid);
+        DisconnectPricesBets(block2, 2);
+        SetTip(block1, 1);
+        ASSERT_TRUE(GetPricesBetState(bettxid, state));
+        EXPECT_EQ(1U, state.positions.size());
+        EXPECT_EQ(bettxid, state.batontxid);
+        DisconnectPricesBets(block1, 1);
+        SetTip(genesis, 0);
+        EXPECT_FALSE(GetPricesBetState(bettxid, state));
+    }
+
+    TEST_F(TestPricesDB, IndexNotAtTip)
+    {
+        // a block not following the index is not indexed
+        CBlock genesis, block1;
+        genesis.nTime = 1000;
+        block1 = makeNextBlock(genesis);
+        block1.vtx.push_back(MakeBet(notaryKey.GetPubKey(), 1, 1000 * COIN));
+        ConnectPricesBets(block1, 1);
+        SetTip(block1, 1);
+        // and without the address index it cannot be built
+        CPricesBetState state;
+        EXPECT_FALSE(GetPricesBetState(block1.vtx[0].GetHash(), state));
+    }
+
+    /*
+     * The profits scanned block by block by the index against those
+     * prices_scanchain works out from the first height of a bet, on prices
+     * written the way blocks write them. A day window of 11 blocks gives
+     * smoothed prices from height 23.
+     */
+    class TestPricesScan : public TestPricesDB {
+    protected:
+        static const int32_t nPricesHeight = 60;
+        static int32_t savedBlocktime;
+        static std::string savedDatadir;
+
+        static void SetUpTestCase() {
+            savedBlocktime = ASSETCHAINS_BLOCKTIME;
+            ASSETCHAINS_BLOCKTIME = 3600 * 24 / 10;
+            uint64_t savedCbopret = ASSETCHAINS_CBOPRET;
+            ASSETCHAINS_CBOPRET = 1;
+            savedDatadir = GetArg("-datadir", "");
+            boost::filesystem::path pathTemp = GetTempPath() / strprintf("test_komodo_prices_%li_%i", GetTime(), GetRand(100000));
+            boost::filesystem::create_directories(pathTemp);
+            mapArgs["-datadir"] = pathTemp.string();
+            ClearDatadirCache();
+            komodo_pricesinit();
+            // BTC rises by 0.3% a block
+            for (int32_t h = 0; h <= nPricesHeight; h++)
+            {
+                uint32_t rawprices[4] = { 1000 + (uint32_t)h * 60, 100000 * (1000 + 3 * (uint32_t)h), 80000 * (1000 + 3 * (uint32_t)h), 90000 * (1000 + 3 * (uint32_t)h) };
+                CMutableTransaction coinbase;
+                coinbase.vout.push_back(CTxOut(0, CScript() << OP_RETURN << std::vector<uint8_t>((uint8_t *)rawprices, (uint8_t *)rawprices + sizeof(rawprices))));
+                CBlock block;
+                block.vtx.push_back(CTransaction(coinbase));
+                komodo_pricesupdate(h, &block);
+            }
+            ASSETCHAINS_CBOPRET = savedCbopret;
+        }
+        static void TearDownTestCase() {
+            ASSETCHAINS_BLOCKTIME = savedBlocktime;
+            if (savedDatadir.empty())
+                mapArgs.erase("-datadir");
+            else
+                mapArgs["-datadir"] = savedDatadir;
+            ClearDatadirCache();
+        }
+    };
+    int32_t TestPricesScan::savedBlocktime;
+    std::string TestPricesScan::savedDatadir;
+
+    TEST_F(TestPricesScan, MatchesScanChain)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        std::vector<uint16_t> vec = { 1, PRICES_WEIGHT | 1 };   // BTC_USD
+        CBlock prev;
+        prev.nTime = 1000;
+        ConnectPricesBets(prev, 0);
+        uint256 longtxid, shorttxid;
+        for (int32_t h = 1; h <= nPricesHeight; h++)
+        {
+            CBlock block = makeNextBlock(prev);
+            if (h == 25) {
+                block.vtx.push_back(MakeBet(pk, h, 1000 * COIN, 10, vec));
+                block.vtx.push_back(MakeBet(pk, h, 100 * COIN, -100, vec));
+                longtxid = block.vtx[0].GetHash();
+                shorttxid = block.vtx[1].GetHash();
+            }
+            else if (h == 40)
+                block.vtx.push_back(MakeAddFunding(longtxid, longtxid, pk, 500 * COIN));
+            ASSERT_TRUE(ConnectPricesBets(block, h));
+            prev = block;
+        }
+        SetTip(prev, nPricesHeight);
+
+        CPricesBetState state, scanned;
+        // the long bet gains with the prices up to the last one
+        ASSERT_TRUE(GetPricesBetState(longtxid, state));
+        ASSERT_EQ(2U, state.positions.size());
+        EXPECT_EQ(nPricesHeight, state.nLastHeight);
+        EXPECT_FALSE(state.fScanStopped);
+        EXPECT_GT(state.equity, state.totalposition);
+        // the short one is rekt on the way
+        ASSERT_TRUE(GetPricesBetState(shorttxid, state));
+        EXPECT_TRUE(state.fScanStopped);
+        EXPECT_TRUE(state.fRekt);
+        EXPECT_LT(state.nLastHeight, nPricesHeight);
+
+        BOOST_FOREACH(const uint256 &bettxid, std::vector<uint256>({ longtxid, shorttxid }))
+        {
+            ASSERT_TRUE(GetPricesBetState(bettxid, state));
+            scanned = state;
+            ASSERT_TRUE(prices_betstatescanchain(scanned));
+            EXPECT_EQ(scanned.nLastHeight, state.nLastHeight);
+            EXPECT_EQ(scanned.fScanStopped, state.fScanStopped);
+            EXPECT_EQ(scanned.lastprice, state.lastprice);
+            ASSERT_EQ(scanned.positions.size(), state.positions.size());
+            for (size_t i = 0; i < state.positions.size(); i++)
+            {
+                EXPECT_EQ(scanned.positions[i].costbasis, state.positions[i].costbasis);
+                EXPECT_EQ(scanned.positions[i].profits, state.positions[i].profits);
+            }
+            EXPECT_EQ(scanned.equity, state.equity);
+            EXPECT_EQ(scanned.averageCostbasis, state.averageCostbasis);
+            EXPECT_EQ(scanned.liquidationprice, state.liquidationprice);
+            EXPECT_EQ(scanned.fRekt, state.fRekt);
+            EXPECT_EQ(scanned.exitfee, state.exitfee);
+        }
+    }
+
+    TEST_F(TestPricesScan, NoRowsPastTheLastPrice)
+    {
+        int64_t buf[PRICES_MAXDATAPOINTS * 2];
+        EXPECT_EQ(PRICES_MAXDATAPOINTS, komodo_priceget(buf, 1, nPricesHeight - 1, 2));
+        EXPECT_NE(0, buf[PRICES_MAXDATAPOINTS]);
+        // the zero padding of the file is not read as prices
+        EXPECT_EQ(-1, komodo_priceget(buf, 1, nPricesHeight + 1, 1));
+        EXPECT_EQ(-1, komodo_priceget(buf, 1, nPricesHeight, 2));
+    }
+}
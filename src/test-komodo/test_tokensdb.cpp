@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+
+#include "cc/CCassets.h"
+#include "cc/CCtokens.h"
+#include "random.h"
+#include "script/script.h"
+#include "tokensdb.h"
+#include "testutils.h"
+
+namespace TestTokensDB {
+
+    // a token transfer spending an output the test does not provide
+    static CTransaction MakeTransfer(uint256 tokenid, CAmount nValue)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_TOKENS, nValue, pk));
+        mtx.vout.push_back(CTxOut(0, EncodeTokenOpRet(tokenid, std::vector<CPubKey>(1, pk), std::vector<std::pair<uint8_t, vscript_t> >())));
+        return CTransaction(mtx);
+    }
+
+    TEST(TestTokensDB, IsTokensvoutFromDB)
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_TOKENS);
+        uint256 tokenid = GetRandHash();
+        CTransaction tx = MakeTransfer(tokenid, 1000);
+        ASSERT_TRUE(IsTokenOpRet(tx));
+
+        // the spent output cannot be loaded, so the tx is not balanced
+        EXPECT_EQ(0, IsTokensvout(true, true, cp, NULL, tx, 0, tokenid));
+
+        ptokens = new TokensDB(1 << 20, true);
+        CTokenOutput out;
+        out.tokenid = tokenid;
+        out.nValue = 1000;
+        TokenOutputsInBlock outputs;
+        outputs.push_back(std::make_pair(COutPoint(tx.GetHash(), 0), out));
+        CDBBatch batch(*ptokens);
+        WriteTokenOutputs(outputs, batch);
+        ASSERT_TRUE(ptokens->WriteBatch(batch));
+
+        EXPECT_EQ(1000, IsTokensvout(true, true, cp, NULL, tx, 0, tokenid));
+        // recorded for another token, checked as before
+        EXPECT_EQ(0, IsTokensvout(true, true, cp, NULL, tx, 0, GetRandHash()));
+
+        // a record not matching the output is not trusted
+        outputs[0].second.nValue = 999;
+        CDBBatch badBatch(*ptokens);
+        WriteTokenOutputs(outputs, badBatch);
+        ASSERT_TRUE(ptokens->WriteBatch(badBatch));
+        EXPECT_EQ(0, IsTokensvout(true, true, cp, NULL, tx, 0, tokenid));
+
+        CBlock block;
+        block.vtx.push_back(tx);
+        CDBBatch eraseBatch(*ptokens);
+        EraseBlockTokenOutputs(block, eraseBatch);
+        ASSERT_TRUE(ptokens->WriteBatch(eraseBatch));
+        EXPECT_FALSE(GetTokenOutput(COutPoint(tx.GetHash(), 0), out));
+        EXPECT_EQ(0, IsTokensvout(true, true, cp, NULL, tx, 0, tokenid));
+
+        delete ptokens;
+        ptokens = NULL;
+    }
+
+    // a bid of nValue coins for nRequired tokens, spending prevout if it is set
+    static CTransaction MakeBid(uint256 tokenid, CAmount nValue, int64_t nRequired, COutPoint prevout = COutPoint())
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_ASSETS);
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(prevout.IsNull() ? COutPoint(GetRandHash(), 0) : prevout, CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_ASSETS, nValue, GetUnspendable(cp, NULL)));
+        CPubKey pk = notaryKey.GetPubKey();
+        mtx.vout.push_back(CTxOut(0, EncodeTokenOpRet(tokenid, std::vector<CPubKey>(1, pk),
+            std::make_pair(OPRETID_ASSETSDATA, EncodeAssetOpRet('b', zeroid, nRequired, std::vector<uint8_t>(pk.begin(), pk.end()))))));
+        return CTransaction(mtx);
+    }
+
+    static CAssetOrder MakeOrder(uint256 tokenid, uint8_t funcid, CAmount nValue, int64_t nRequired)
+    {
+        CAssetOrder order;
+        order.assetid = tokenid;
+        order.funcid = funcid;
+        order.nValue = nValue;
+        order.nRequired = nRequired;
+        return order;
+    }
+
+    TEST(TestTokensDB, OrderbookBestFirst)
+    {
+        CAssetsOrderbook book;
+        uint256 tokenid = GetRandHash();
+        COutPoint bidLow(GetRandHash(), 0), bidHigh(GetRandHash(), 0), askLow(GetRandHash(), 0), askHigh(GetRandHash(), 0);
+        book.Add(bidLow, MakeOrder(tokenid, 'b', 100, 10));
+        book.Add(bidHigh, MakeOrder(tokenid, 'B', 300, 10));
+        book.Add(askHigh, MakeOrder(tokenid, 's', 10, 500));
+        book.Add(askLow, MakeOrder(tokenid, 'S', 10, 200));
+        book.Add(COutPoint(GetRandHash(), 0), MakeOrder(GetRandHash(), 'b', 100, 10));
+        EXPECT_EQ(5U, book.Size());
+        EXPECT_EQ(2U, book.GetBookKeys(tokenid).size());
+
+        std::set<COutPoint> setSpent;
+        AssetOrderList vOrders;
+        book.GetBook(CAssetBookKey(tokenid, uint256(), 'b'), 0, setSpent, vOrders);
+        ASSERT_EQ(2U, vOrders.size());
+        EXPECT_EQ(bidHigh, vOrders[0].first);
+        EXPECT_EQ(bidLow, vOrders[1].first);
+
+        vOrders.clear();
+        book.GetBook(CAssetBookKey(tokenid, uint256(), 's'), 1, setSpent, vOrders);
+        ASSERT_EQ(1U, vOrders.size());
+        EXPECT_EQ(askLow, vOrders[0].first);
+
+        // spent in the mempool
+        setSpent.insert(askLow);
+        vOrders.clear();
+        book.GetBook(CAssetBookKey(tokenid, uint256(), 's'), 1, setSpent, vOrders);
+        ASSERT_EQ(1U, vOrders.size());
+        EXPECT_EQ(askHigh, vOrders[0].first);
+
+        CAssetOrder order;
+        ASSERT_TRUE(book.Remove(bidHigh, order));
+        EXPECT_EQ(300, order.nValue);
+        EXPECT_FALSE(book.Get(bidHigh, order));
+        EXPECT_EQ(4U, book.Size());
+    }
+
+    TEST(TestTokensDB, OrderbookConnectDisconnect)
+    {
+        ptokens = new TokensDB(1 << 20, true);
+        assetsOrderbook.Clear();
+        uint256 tokenid = GetRandHash();
+
+        CBlock genesis, block1, block2;
+        genesis.nTime = 1;
+        CTransaction bid = MakeBid(tokenid, 1000, 10);
+        CAssetOrder order;
+        ASSERT_TRUE(GetAssetOrderFromTx(bid, order));
+        EXPECT_EQ('b', order.Side());
+        EXPECT_EQ(100, order.UnitPrice());
+
+        // an empty book follows the chain from the genesis block
+        ASSERT_TRUE(ConnectAssetOrders(genesis, 0));
+        EXPECT_EQ(genesis.GetHash(), assetsOrderbook.GetBestBlock());
+
+        block1.hashPrevBlock = genesis.GetHash();
+        block1.vtx.push_back(bid);
+        ASSERT_TRUE(ConnectAssetOrders(block1, 1));
+        ASSERT_TRUE(assetsOrderbook.Get(COutPoint(bid.GetHash(), 0), order));
+        EXPECT_EQ(1, order.nHeight);
+
+        // a fill leaving a remainder of the bid
+        block2.hashPrevBlock = block1.GetHash();
+        CTransaction fill = MakeBid(tokenid, 500, 5, COutPoint(bid.GetHash(), 0));
+        block2.vtx.push_back(fill);
+        ASSERT_TRUE(ConnectAssetOrders(block2, 2));
+        EXPECT_FALSE(assetsOrderbook.Get(COutPoint(bid.GetHash(), 0), order));
+        EXPECT_TRUE(assetsOrderbook.Get(COutPoint(fill.GetHash(), 0), order));
+        EXPECT_EQ(block2.GetHash(), ptokens->ReadBestBlock());
+
+        // a block not following the book is ignored
+        CBlock other;
+        other.hashPrevBlock = genesis.GetHash();
+        other.nTime = 2;
+        ASSERT_TRUE(ConnectAssetOrders(other, 1));
+        EXPECT_EQ(block2.GetHash(), assetsOrderbook.GetBestBlock());
+        EXPECT_EQ(block2.GetHash(), ptokens->ReadBestBlock());
+
+        ASSERT_TRUE(DisconnectAssetOrders(block2, 2));
+        EXPECT_TRUE(assetsOrderbook.Get(COutPoint(bid.GetHash(), 0), order));
+        EXPECT_FALSE(assetsOrderbook.Get(COutPoint(fill.GetHash(), 0), order));
+
+        ASSERT_TRUE(DisconnectAssetOrders(block1, 1));
+        EXPECT_EQ(0U, assetsOrderbook.Size());
+        EXPECT_EQ(genesis.GetHash(), assetsOrderbook.GetBestBlock());
+
+        // the written state loads back
+        ASSERT_TRUE(LoadAssetOrders(genesis.GetHash()));
+        EXPECT_EQ(genesis.GetHash(), assetsOrderbook.GetBestBlock());
+
+        assetsOrderbook.Clear();
+        delete ptokens;
+        ptokens = NULL;
+    }
+
+    TEST(TestTokensDB, TokenOutputsFollowChain)
+    {
+        ptokens = new TokensDB(1 << 20, true);
+        ASSERT_TRUE(LoadTokenOutputs());
+        EXPECT_TRUE(GetTokenOutputsBestBlock().IsNull());
+
+        CBlock genesis, block1, other;
+        genesis.nTime = 1;
+        ASSERT_TRUE(ConnectTokenOutputs(genesis, 0));
+        block1.hashPrevBlock = genesis.GetHash();
+        block1.vtx.push_back(MakeTransfer(GetRandHash(), 10));
+        ASSERT_TRUE(ConnectTokenOutputs(block1, 1));
+        EXPECT_EQ(block1.GetHash(), GetTokenOutputsBestBlock());
+        // kept apart from the best block of the assets orderbook
+        EXPECT_TRUE(ptokens->ReadBestBlock().IsNull());
+
+        // a block not following the index is ignored
+        other.hashPrevBlock = genesis.GetHash();
+        other.nTime = 2;
+        ASSERT_TRUE(ConnectTokenOutputs(other, 1));
+        ASSERT_TRUE(DisconnectTokenOutputs(other, 1));
+        EXPECT_EQ(block1.GetHash(), GetTokenOutputsBestBlock());
+
+        ASSERT_TRUE(DisconnectTokenOutputs(block1, 1));
+        EXPECT_EQ(genesis.GetHash(), GetTokenOutputsBestBlock());
+        ASSERT_TRUE(LoadTokenOutputs());
+        EXPECT_EQ(genesis.GetHash(), GetTokenOutputsBestBlock());
+
+        // the orders stay when the outputs are built again
+        COutPoint orderOut(GetRandHash(), 0), tokenOut(GetRandHash(), 0);
+        ASSERT_TRUE(ptokens->Write(std::make_pair('o', orderOut), MakeOrder(GetRandHash(), 'b', 100, 10)));
+        ASSERT_TRUE(ptokens->Write(std::make_pair('t', tokenOut), CTokenOutput()));
+        ASSERT_TRUE(ResetTokenOutputs());
+        EXPECT_TRUE(GetTokenOutputsBestBlock().IsNull());
+        EXPECT_TRUE(ptokens->Exists(std::make_pair('o', orderOut)));
+        EXPECT_FALSE(ptokens->Exists(std::make_pair('t', tokenOut)));
+
+        delete ptokens;
+        ptokens = NULL;
+    }
+
+    TEST(TestTokensDB, IsTokenOpRet)
+    {
+        CMutableTransaction mtx;
+        mtx.vout.push_back(CTxOut(1000, CScript() << OP_TRUE));
+        mtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << ParseHex("e274657374")));
+        EXPECT_FALSE(IsTokenOpRet(CTransaction(mtx)));
+        mtx.vout.pop_back();
+        EXPECT_FALSE(IsTokenOpRet(CTransaction(mtx)));
+        EXPECT_TRUE(IsTokenOpRet(MakeTransfer(GetRandHash(), 1)));
+    }
+}
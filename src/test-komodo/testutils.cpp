@@ -145,3 +145,86 @@ void getInputTx(CScript scriptPubKey, CTransaction &txIn)
     acceptTxFail(mtx);
     txIn = CTransaction(mtx);
 }
+
+
+CTransaction makeCoinbaseTx()
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vin[0].scriptSig = CScript() << 1234 << OP_0;
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 3 * COIN;
+    mtx.vout[0].scriptPubKey = CScript() << ParseHex("020e46e79a2a8d12b9b5d12c7a91adb4e454edfae43c0a0cb805427d2ac7613fd9") << OP_CHECKSIG;
+    return CTransaction(mtx);
+}
+
+
+/*
+ * A P2PKH spend of a random outpoint, with a dummy signature of the usual size
+ */
+CTransaction makeRandomTx()
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+    mtx.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        mtx.vout[i].nValue = 1000 + i;
+        mtx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return CTransaction(mtx);
+}
+
+
+CBlock makeTestBlock(int nTx)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = 1570000000;
+    block.nBits = 0x200f0f0f;
+    block.nNonce = GetRandHash();
+    block.nSolution.resize(1344);
+    block.vtx.push_back(makeCoinbaseTx());
+    for (int i = 0; i < nTx; i++)
+        block.vtx.push_back(makeRandomTx());
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+
+/*
+ * The block nSpacing seconds after prev, only linked to it by hash
+ */
+CBlock makeNextBlock(const CBlock &prev, uint32_t nSpacing)
+{
+    CBlock block;
+    block.hashPrevBlock = prev.GetHash();
+    block.nTime = prev.nTime + nSpacing;
+    return block;
+}
+
+
+void ChainIndexTest::SetUp()
+{
+    savedTip = chainActive.Tip();
+}
+
+
+void ChainIndexTest::TearDown()
+{
+    LOCK(cs_main);
+    chainActive.SetTip(savedTip);
+}
+
+
+void ChainIndexTest::SetTip(const CBlock &block, int nHeight)
+{
+    LOCK(cs_main);
+    hashTip = block.GetHash();
+    tip.phashBlock = &hashTip;
+    tip.SetHeight(nHeight);
+    chainActive.SetTip(&tip);
+}
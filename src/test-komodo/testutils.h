@@ -1,6 +1,8 @@
 #ifndef TESTUTILS_H
 #define TESTUTILS_H
 
+#include <gtest/gtest.h>
+
 #include "main.h"
 
 
@@ -25,5 +27,27 @@ void getInputTx(CScript scriptPubKey, CTransaction &txIn);
 CMutableTransaction spendTx(const CTransaction &txIn, int nOut=0);
 std::vector<uint8_t> getSig(const CMutableTransaction mtx, CScript inputPubKey, int nIn=0);
 
+/*
+ * Standalone transactions and blocks with wire realistic sizes, not connected to any chain
+ */
+CTransaction makeCoinbaseTx();
+CTransaction makeRandomTx();
+CBlock makeTestBlock(int nTx);
+CBlock makeNextBlock(const CBlock &prev, uint32_t nSpacing=60);
+
+/*
+ * Fixture of the tests of an index following chainActive: SetTip makes the last
+ * block the test connected the tip, the index answers queries from then on
+ */
+class ChainIndexTest : public ::testing::Test {
+protected:
+    CBlockIndex *savedTip;
+    CBlockIndex tip;
+    uint256 hashTip;
+    virtual void SetUp();
+    virtual void TearDown();
+    void SetTip(const CBlock &block, int nHeight);
+};
+
 
 #endif /* TESTUTILS_H */
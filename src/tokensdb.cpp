@@ -0,0 +1,575 @@
+#include "chainindexdb.h"
+#include "dbwrapper.h"
+#include "tokensdb.h"
+#include "uint256.h"
+#include "cc/CCassets.h"
+#include "cc/CCtokens.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+TokensDB *ptokens;
+CAssetsOrderbook assetsOrderbook;
+
+static const char DB_TOKEN_OUTPUT = 't';
+static const char DB_TOKEN_OUTPUTS_BEST_BLOCK = 'b';
+static const char DB_ASSET_ORDER = 'o';
+static const char DB_ASSET_ORDERS_UNDO = 'u';
+static const char DB_ASSET_ORDERS_BEST_BLOCK = DB_CHAIN_INDEX_BEST_BLOCK;
+static const char DB_ASSET_ORDERS_BUILT_HEIGHT = 'H';
+
+
+/*
+ * The token outputs are a cache of IsTokensvout results, they follow the chain
+ * under their own best block and are caught up in the background when missing.
+ */
+static CCriticalSection cs_tokenoutputs;
+static uint256 hashTokenOutputsBestBlock;
+
+
+TokensDB::TokensDB(size_t nCacheSize, bool fMemory, bool fWipe) : CChainIndexDB("tokens", nCacheSize, fMemory, fWipe) { }
+
+
+/*
+ * Valid token outputs created by the block. Txs spending token outputs of an
+ * earlier tx of the same block do not find them in the db yet and load it instead.
+ */
+TokenOutputsInBlock ScanBlockTokenOutputs(const CBlock &block)
+{
+    TokenOutputsInBlock vOutputs;
+    std::vector<std::pair<int32_t, CTokenOutput> > vTxOutputs;
+
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+    {
+        if (!IsTokenOpRet(tx))
+            continue;
+        GetValidTokenOutputs(tx, vTxOutputs);
+        BOOST_FOREACH(const PAIRTYPE(int32_t, CTokenOutput) &out, vTxOutputs)
+            vOutputs.push_back(std::make_pair(COutPoint(tx.GetHash(), out.first), out.second));
+    }
+    return vOutputs;
+}
+
+
+bool GetTokenOutput(const COutPoint &outpoint, CTokenOutput &output)
+{
+    if (ptokens == NULL)
+        return false;
+    return ptokens->Read(std::make_pair(DB_TOKEN_OUTPUT, outpoint), output);
+}
+
+
+void WriteTokenOutputs(const TokenOutputsInBlock &outputs, CDBBatch &batch)
+{
+    BOOST_FOREACH(const PAIRTYPE(COutPoint, CTokenOutput) &out, outputs)
+        batch.Write(std::make_pair(DB_TOKEN_OUTPUT, out.first), out.second);
+}
+
+
+/*
+ * Erase whatever the block's token txs may have written, no need to keep
+ * a per block list of the outputs.
+ */
+void EraseBlockTokenOutputs(const CBlock &block, CDBBatch &batch)
+{
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+    {
+        if (!IsTokenOpRet(tx))
+            continue;
+        for (uint32_t n = 0; n + 1 < tx.vout.size(); n++)
+            batch.Erase(std::make_pair(DB_TOKEN_OUTPUT, COutPoint(tx.GetHash(), n)));
+    }
+}
+
+
+bool LoadTokenOutputs()
+{
+    LOCK(cs_tokenoutputs);
+    hashTokenOutputsBestBlock = ptokens != NULL ? ptokens->ReadBestBlock(DB_TOKEN_OUTPUTS_BEST_BLOCK) : uint256();
+    return true;
+}
+
+
+bool ResetTokenOutputs()
+{
+    LOCK(cs_tokenoutputs);
+    hashTokenOutputsBestBlock.SetNull();
+    return ptokens == NULL || ptokens->Wipe(std::string(1, DB_TOKEN_OUTPUT), uint256(), DB_TOKEN_OUTPUTS_BEST_BLOCK);
+}
+
+
+uint256 GetTokenOutputsBestBlock()
+{
+    LOCK(cs_tokenoutputs);
+    return hashTokenOutputsBestBlock;
+}
+
+
+// the outputs in the db stay valid, only the blocks they follow are lost
+static bool TokenOutputsWriteFailed()
+{
+    AssertLockHeld(cs_tokenoutputs);
+    hashTokenOutputsBestBlock.SetNull();
+    return error("%s: cannot write the token outputs", __func__);
+}
+
+
+/*
+ * Record the valid token outputs of a block following the index, so that
+ * IsTokensvout need not check their inputs again. An empty index follows the
+ * chain from the genesis block on.
+ */
+bool ConnectTokenOutputs(const CBlock &block, int nHeight)
+{
+    LOCK(cs_tokenoutputs);
+    if (ptokens == NULL || block.hashPrevBlock != hashTokenOutputsBestBlock || (hashTokenOutputsBestBlock.IsNull() && nHeight != 0))
+        return true;
+
+    TokenOutputsInBlock outputs = ScanBlockTokenOutputs(block);
+    CDBBatch batch(*ptokens);
+    WriteTokenOutputs(outputs, batch);
+    if (!ptokens->WriteBlock(batch, block.GetHash(), DB_TOKEN_OUTPUTS_BEST_BLOCK))
+        return TokenOutputsWriteFailed();
+    hashTokenOutputsBestBlock = block.GetHash();
+    if (outputs.size() > 0)
+        LogPrint("cctokens", "%s: wrote %i token outputs in block: %s\n", __func__, outputs.size(), block.GetHash().GetHex());
+    return true;
+}
+
+
+bool DisconnectTokenOutputs(const CBlock &block, int nHeight)
+{
+    LOCK(cs_tokenoutputs);
+    if (ptokens == NULL || hashTokenOutputsBestBlock != block.GetHash())
+        return true;
+
+    CDBBatch batch(*ptokens);
+    EraseBlockTokenOutputs(block, batch);
+    if (!ptokens->WriteBlock(batch, block.hashPrevBlock, DB_TOKEN_OUTPUTS_BEST_BLOCK))
+        return TokenOutputsWriteFailed();
+    hashTokenOutputsBestBlock = block.hashPrevBlock;
+    return true;
+}
+
+
+char CAssetOrder::Side() const
+{
+    if (funcid == 'b' || funcid == 'B')
+        return 'b';
+    if (funcid == 'e' || funcid == 'E')
+        return 'e';
+    return 's';
+}
+
+
+double CAssetOrder::UnitPrice() const
+{
+    if (Side() == 'b')
+        return nRequired != 0 ? (double)nValue / nRequired : 0;
+    return nValue != 0 ? (double)nRequired / nValue : 0;
+}
+
+
+double CAssetsOrderbook::Rank(const CAssetOrder &order)
+{
+    return order.Side() == 'b' ? -order.UnitPrice() : order.UnitPrice();
+}
+
+
+void CAssetsOrderbook::Clear()
+{
+    LOCK(cs);
+    mapOrders.clear();
+    mapBooks.clear();
+    hashBestBlock.SetNull();
+    nBuiltHeight = 0;
+}
+
+
+void CAssetsOrderbook::Add(const COutPoint &outpoint, const CAssetOrder &order)
+{
+    CAssetOrder old;
+    Remove(outpoint, old);
+
+    LOCK(cs);
+    mapOrders[outpoint] = order;
+    mapBooks[CAssetBookKey(order)].insert(std::make_pair(Rank(order), outpoint));
+}
+
+
+bool CAssetsOrderbook::Remove(const COutPoint &outpoint, CAssetOrder &order)
+{
+    LOCK(cs);
+    std::map<COutPoint, CAssetOrder>::iterator it = mapOrders.find(outpoint);
+    if (it == mapOrders.end())
+        return false;
+    order = it->second;
+    CAssetBookKey key(order);
+    std::map<CAssetBookKey, std::set<std::pair<double, COutPoint> > >::iterator itBook = mapBooks.find(key);
+    if (itBook != mapBooks.end()) {
+        itBook->second.erase(std::make_pair(Rank(order), outpoint));
+        if (itBook->second.empty())
+            mapBooks.erase(itBook);
+    }
+    mapOrders.erase(it);
+    return true;
+}
+
+
+bool CAssetsOrderbook::Get(const COutPoint &outpoint, CAssetOrder &order) const
+{
+    LOCK(cs);
+    std::map<COutPoint, CAssetOrder>::const_iterator it = mapOrders.find(outpoint);
+    if (it == mapOrders.end())
+        return false;
+    order = it->second;
+    return true;
+}
+
+
+uint256 CAssetsOrderbook::GetBestBlock() const
+{
+    LOCK(cs);
+    return hashBestBlock;
+}
+
+
+void CAssetsOrderbook::SetBestBlock(const uint256 &hashBlock)
+{
+    LOCK(cs);
+    hashBestBlock = hashBlock;
+}
+
+
+int32_t CAssetsOrderbook::GetBuiltHeight() const
+{
+    LOCK(cs);
+    return nBuiltHeight;
+}
+
+
+void CAssetsOrderbook::SetBuiltHeight(int32_t nHeight)
+{
+    LOCK(cs);
+    nBuiltHeight = nHeight;
+}
+
+
+// books of a token, of every token if assetid is null
+std::vector<CAssetBookKey> CAssetsOrderbook::GetBookKeys(const uint256 &assetid) const
+{
+    std::vector<CAssetBookKey> vKeys;
+    LOCK(cs);
+    std::map<CAssetBookKey, std::set<std::pair<double, COutPoint> > >::const_iterator it = assetid.IsNull() ?
+        mapBooks.begin() : mapBooks.lower_bound(CAssetBookKey(assetid, uint256(), 0));
+    for (; it != mapBooks.end() && (assetid.IsNull() || it->first.assetid == assetid); it++)
+        vKeys.push_back(it->first);
+    return vKeys;
+}
+
+
+void CAssetsOrderbook::GetBook(const CAssetBookKey &key, size_t nDepth, const std::set<COutPoint> &setSpent, AssetOrderList &vOrders) const
+{
+    size_t nAdded = 0;
+    LOCK(cs);
+    std::map<CAssetBookKey, std::set<std::pair<double, COutPoint> > >::const_iterator itBook = mapBooks.find(key);
+    if (itBook == mapBooks.end())
+        return;
+    BOOST_FOREACH(const PAIRTYPE(double, COutPoint) &entry, itBook->second)
+    {
+        if (nDepth > 0 && nAdded >= nDepth)
+            break;
+        if (setSpent.count(entry.second))
+            continue;
+        std::map<COutPoint, CAssetOrder>::const_iterator it = mapOrders.find(entry.second);
+        if (it != mapOrders.end()) {
+            vOrders.push_back(*it);
+            nAdded++;
+        }
+    }
+}
+
+
+size_t CAssetsOrderbook::Size() const
+{
+    LOCK(cs);
+    return mapOrders.size();
+}
+
+
+/*
+ * Load the open orders if the book is at the tip. Its undo records only go
+ * back to the block it was built at, so a book left behind is not replayed but
+ * built again from the unspent outputs in the address index when first queried.
+ */
+bool LoadAssetOrders(const uint256 &hashTip)
+{
+    uint256 hashBest = ptokens->ReadBestBlock(DB_ASSET_ORDERS_BEST_BLOCK);
+    int32_t nBuiltHeight = 0;
+
+    assetsOrderbook.Clear();
+    ptokens->Read(DB_ASSET_ORDERS_BUILT_HEIGHT, nBuiltHeight);
+    if (hashBest != hashTip) {
+        LogPrintf("%s: assets orderbook is not at the tip, it will be built again\n", __func__);
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(ptokens->NewIterator());
+    pcursor->Seek(std::make_pair(DB_ASSET_ORDER, COutPoint(uint256(), 0)));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, COutPoint> key;
+        CAssetOrder order;
+        if (!pcursor->GetKey(key) || key.first != DB_ASSET_ORDER)
+            break;
+        if (!pcursor->GetValue(order))
+            return error("%s: cannot read assets order %s", __func__, key.second.ToString());
+        assetsOrderbook.Add(key.second, order);
+        pcursor->Next();
+    }
+    assetsOrderbook.SetBestBlock(hashBest);
+    assetsOrderbook.SetBuiltHeight(nBuiltHeight);
+    LogPrintf("%s: loaded %u assets orders\n", __func__, assetsOrderbook.Size());
+    return true;
+}
+
+
+/*
+ * Build the book at the tip from the unspent outputs of the assets
+ * unspendable addresses, fungible and of every non-fungible evalcode.
+ */
+bool BuildAssetOrders()
+{
+    AssertLockHeld(cs_main);
+    if (!fAddressIndex || chainActive.Tip() == NULL)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    struct CCcontract_info *cpAssets, assetsC;
+    cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+    CPubKey unspendableAssetsPk = GetUnspendable(cpAssets, NULL);
+    std::set<std::string> setAddresses;
+    char addr[64];
+
+    GetCCaddress(cpAssets, addr, unspendableAssetsPk);
+    setAddresses.insert(addr);
+    for (int evalCode2 = 0; evalCode2 < 256; evalCode2++) {
+        cpAssets->additionalTokensEvalcode2 = evalCode2;
+        GetTokensCCaddress(cpAssets, addr, unspendableAssetsPk);
+        setAddresses.insert(addr);
+    }
+
+    // orders of an earlier build, the token outputs stay
+    assetsOrderbook.Clear();
+    if (!ptokens->Wipe(std::string(1, DB_ASSET_ORDER) + DB_ASSET_ORDERS_UNDO, uint256(), DB_ASSET_ORDERS_BEST_BLOCK))
+        return error("%s: cannot wipe the assets orderbook", __func__);
+    CDBBatch batch(*ptokens);
+
+    BOOST_FOREACH(const std::string &address, setAddresses)
+    {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        SetCCunspents(unspentOutputs, (char *)address.c_str(), true);
+        BOOST_FOREACH(const PAIRTYPE(CAddressUnspentKey, CAddressUnspentValue) &unspent, unspentOutputs)
+        {
+            CTransaction tx;
+            uint256 hashBlock;
+            CAssetOrder order;
+            if (unspent.first.index != 0 || !myGetTransaction(unspent.first.txhash, tx, hashBlock) || !GetAssetOrderFromTx(tx, order))
+                continue;
+            order.nHeight = unspent.second.blockHeight;
+            COutPoint outpoint(unspent.first.txhash, 0);
+            assetsOrderbook.Add(outpoint, order);
+            batch.Write(std::make_pair(DB_ASSET_ORDER, outpoint), order);
+        }
+    }
+
+    batch.Write(DB_ASSET_ORDERS_BUILT_HEIGHT, (int32_t)chainActive.Height());
+    if (!ptokens->WriteBlock(batch, chainActive.Tip()->GetBlockHash(), DB_ASSET_ORDERS_BEST_BLOCK)) {
+        assetsOrderbook.Clear();
+        return error("%s: cannot write the assets orderbook", __func__);
+    }
+    assetsOrderbook.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    assetsOrderbook.SetBuiltHeight(chainActive.Height());
+    LogPrintf("%s: built assets orderbook with %u orders at height %d in %dms\n", __func__,
+        assetsOrderbook.Size(), chainActive.Height(), GetTimeMillis() - nStart);
+    return true;
+}
+
+
+// ConnectBlock and DisconnectTip abort the node on this. Until it stops the book is
+// emptied, so no query is answered with orders the db does not have
+static bool AssetOrdersWriteFailed()
+{
+    assetsOrderbook.Clear();
+    return error("%s: cannot write the assets orderbook", __func__);
+}
+
+
+/*
+ * Orders spent by the block leave the book and are kept in its undo record,
+ * orders created by it are added. Blocks not following the book are ignored,
+ * an empty book follows the chain from the genesis block on.
+ */
+bool ConnectAssetOrders(const CBlock &block, int nHeight)
+{
+    uint256 hashBest = assetsOrderbook.GetBestBlock();
+    if (ptokens == NULL || block.hashPrevBlock != hashBest || (hashBest.IsNull() && nHeight != 0))
+        return true;
+
+    CDBBatch batch(*ptokens);
+    AssetOrderList vSpent;
+    CAssetOrder order;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+    {
+        BOOST_FOREACH(const CTxIn &txin, tx.vin)
+        {
+            if (assetsOrderbook.Remove(txin.prevout, order)) {
+                vSpent.push_back(std::make_pair(txin.prevout, order));
+                batch.Erase(std::make_pair(DB_ASSET_ORDER, txin.prevout));
+            }
+        }
+        if (GetAssetOrderFromTx(tx, order)) {
+            order.nHeight = nHeight;
+            COutPoint outpoint(tx.GetHash(), 0);
+            assetsOrderbook.Add(outpoint, order);
+            batch.Write(std::make_pair(DB_ASSET_ORDER, outpoint), order);
+        }
+    }
+    if (!vSpent.empty())
+        batch.Write(std::make_pair(DB_ASSET_ORDERS_UNDO, block.GetHash()), vSpent);
+    if (!ptokens->WriteBlock(batch, block.GetHash(), DB_ASSET_ORDERS_BEST_BLOCK))
+        return AssetOrdersWriteFailed();
+    assetsOrderbook.SetBestBlock(block.GetHash());
+    return true;
+}
+
+
+bool DisconnectAssetOrders(const CBlock &block, int nHeight)
+{
+    uint256 hash = block.GetHash();
+    if (ptokens == NULL || assetsOrderbook.GetBestBlock() != hash)
+        return true;
+
+    CDBBatch batch(*ptokens);
+    if (nHeight <= assetsOrderbook.GetBuiltHeight()) {
+        // the block was connected before the book was built, what it spent is not known
+        assetsOrderbook.Clear();
+        return ptokens->WriteBlock(batch, uint256(), DB_ASSET_ORDERS_BEST_BLOCK) || error("%s: cannot write the assets orderbook", __func__);
+    }
+
+    AssetOrderList vSpent;
+    CAssetOrder order;
+    ptokens->Read(std::make_pair(DB_ASSET_ORDERS_UNDO, hash), vSpent);
+    BOOST_FOREACH(const PAIRTYPE(COutPoint, CAssetOrder) &spent, vSpent)
+    {
+        assetsOrderbook.Add(spent.first, spent.second);
+        batch.Write(std::make_pair(DB_ASSET_ORDER, spent.first), spent.second);
+    }
+    // orders created by the block, also the ones it spent again which the undo record brought back
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+    {
+        COutPoint outpoint(tx.GetHash(), 0);
+        if (assetsOrderbook.Remove(outpoint, order))
+            batch.Erase(std::make_pair(DB_ASSET_ORDER, outpoint));
+    }
+    batch.Erase(std::make_pair(DB_ASSET_ORDERS_UNDO, hash));
+    if (!ptokens->WriteBlock(batch, block.hashPrevBlock, DB_ASSET_ORDERS_BEST_BLOCK))
+        return AssetOrdersWriteFailed();
+    assetsOrderbook.SetBestBlock(block.hashPrevBlock);
+    return true;
+}
+
+
+// build the book if it is not at the tip
+static bool CheckAssetOrders()
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Tip() != NULL && assetsOrderbook.GetBestBlock() == chainActive.Tip()->GetBlockHash())
+        return true;
+    return BuildAssetOrders();
+}
+
+
+// orders the mempool creates and the outputs it spends, applied to the book when it is queried
+static void GetMempoolAssetOrders(std::set<COutPoint> &setSpent, AssetOrderList &vOrders)
+{
+    std::vector<CTransaction> vtx;
+    {
+        LOCK(mempool.cs);
+        for (CTxMemPool::indexed_transaction_set::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); it++)
+            if (IsTokenOpRet(it->GetTx()))
+                vtx.push_back(it->GetTx());
+    }
+    BOOST_FOREACH(const CTransaction &tx, vtx)
+        BOOST_FOREACH(const CTxIn &txin, tx.vin)
+            setSpent.insert(txin.prevout);
+
+    CAssetOrder order;
+    BOOST_FOREACH(const CTransaction &tx, vtx)
+    {
+        COutPoint outpoint(tx.GetHash(), 0);
+        if (!setSpent.count(outpoint) && GetAssetOrderFromTx(tx, order))
+            vOrders.push_back(std::make_pair(outpoint, order));
+    }
+}
+
+
+static bool CompareAssetOrders(const std::pair<COutPoint, CAssetOrder> &a, const std::pair<COutPoint, CAssetOrder> &b)
+{
+    double rankA = CAssetsOrderbook::Rank(a.second), rankB = CAssetsOrderbook::Rank(b.second);
+    if (rankA != rankB)
+        return rankA < rankB;
+    return a.first < b.first;
+}
+
+
+bool GetAssetOrder(const COutPoint &outpoint, CAssetOrder &order)
+{
+    LOCK(cs_main);
+    return CheckAssetOrders() && assetsOrderbook.Get(outpoint, order);
+}
+
+
+/** Up to nDepth orders of a book (0 for all) with the mempool applied, best first */
+bool GetAssetOrderbook(const CAssetBookKey &key, size_t nDepth, AssetOrderList &vOrders)
+{
+    std::set<COutPoint> setSpent;
+    AssetOrderList vMempoolOrders;
+
+    vOrders.clear();
+    LOCK(cs_main);
+    if (!CheckAssetOrders())
+        return false;
+    GetMempoolAssetOrders(setSpent, vMempoolOrders);
+    assetsOrderbook.GetBook(key, 0, setSpent, vOrders);
+    BOOST_FOREACH(const PAIRTYPE(COutPoint, CAssetOrder) &order, vMempoolOrders)
+        if (CAssetBookKey(order.second) == key)
+            vOrders.push_back(order);
+    std::sort(vOrders.begin(), vOrders.end(), CompareAssetOrders);
+    if (nDepth > 0 && vOrders.size() > nDepth)
+        vOrders.resize(nDepth);
+    return true;
+}
+
+
+/** Every order of a token (of every token if assetid is null) with the mempool applied */
+bool GetAllAssetOrders(const uint256 &assetid, AssetOrderList &vOrders)
+{
+    std::set<COutPoint> setSpent;
+    AssetOrderList vMempoolOrders;
+
+    vOrders.clear();
+    LOCK(cs_main);
+    if (!CheckAssetOrders())
+        return false;
+    GetMempoolAssetOrders(setSpent, vMempoolOrders);
+    BOOST_FOREACH(const CAssetBookKey &key, assetsOrderbook.GetBookKeys(assetid))
+        assetsOrderbook.GetBook(key, 0, setSpent, vOrders);
+    BOOST_FOREACH(const PAIRTYPE(COutPoint, CAssetOrder) &order, vMempoolOrders)
+        if (assetid.IsNull() || order.second.assetid == assetid)
+            vOrders.push_back(order);
+    return true;
+}
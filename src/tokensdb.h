@@ -0,0 +1,167 @@
+#ifndef TOKENSDB_H
+#define TOKENSDB_H
+
+#include "amount.h"
+#include "chainindexdb.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+
+
+/** A token output which passed IsTokensvout with its inputs checked when its block was connected */
+struct CTokenOutput
+{
+    uint256 tokenid;
+    CAmount nValue;
+    uint8_t evalCode2;          //!< evalcode of the contract data in the token opret, 0 if none
+    uint256 nonfungibleHash;    //!< hash of the non-fungible data of the tokenbase tx, null for fungible tokens
+
+    CTokenOutput() : nValue(0), evalCode2(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(tokenid);
+        READWRITE(nValue);
+        READWRITE(evalCode2);
+        READWRITE(nonfungibleHash);
+    }
+};
+
+
+/** An open order of the assets contract, vout 0 of the bid, ask or swap tx or of the fill which left a remainder */
+struct CAssetOrder
+{
+    uint256 assetid;
+    uint256 assetid2;           //!< token asked for by a swap, null when coins are asked for
+    uint8_t funcid;             //!< 'b', 's' or 'e' for a new order, 'B', 'S' or 'E' for a remainder
+    CAmount nValue;             //!< coins of a bid, tokens of an ask
+    int64_t nRequired;          //!< tokens a bid still buys, coins an ask still asks for
+    uint8_t evalCode2;          //!< non-fungible evalcode of the token, 0 for fungible tokens
+    std::vector<uint8_t> origpubkey;
+    int32_t nHeight;            //!< 0 while in the mempool
+
+    CAssetOrder() : funcid(0), nValue(0), nRequired(0), evalCode2(0), nHeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(assetid);
+        READWRITE(assetid2);
+        READWRITE(funcid);
+        READWRITE(nValue);
+        READWRITE(nRequired);
+        READWRITE(evalCode2);
+        READWRITE(origpubkey);
+        READWRITE(nHeight);
+    }
+
+    //! 'b' for bids, 's' for asks, 'e' for swaps
+    char Side() const;
+    //! coins per token (or assetid2 tokens per token), the orders of a book are sorted by it
+    double UnitPrice() const;
+};
+
+/** Orders of one token against coins or another token on one side, best first */
+struct CAssetBookKey
+{
+    uint256 assetid;
+    uint256 assetid2;
+    char side;
+
+    CAssetBookKey() : side(0) {}
+    CAssetBookKey(const uint256 &assetidIn, const uint256 &assetid2In, char sideIn) : assetid(assetidIn), assetid2(assetid2In), side(sideIn) {}
+    explicit CAssetBookKey(const CAssetOrder &order) : assetid(order.assetid), assetid2(order.assetid2), side(order.Side()) {}
+
+    friend bool operator<(const CAssetBookKey &a, const CAssetBookKey &b) {
+        if (a.assetid != b.assetid)
+            return a.assetid < b.assetid;
+        if (a.assetid2 != b.assetid2)
+            return a.assetid2 < b.assetid2;
+        return a.side < b.side;
+    }
+    friend bool operator==(const CAssetBookKey &a, const CAssetBookKey &b) {
+        return a.assetid == b.assetid && a.assetid2 == b.assetid2 && a.side == b.side;
+    }
+};
+
+typedef std::vector<std::pair<COutPoint, CAssetOrder> > AssetOrderList;
+
+/**
+ * Open orders of the assets contract at the tip, kept in memory and in the
+ * tokens db. The book follows the chain from the block it was built at,
+ * blocks connected or disconnected elsewhere are ignored.
+ */
+class CAssetsOrderbook
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CAssetOrder> mapOrders;
+    //! best order first: lowest price of an ask, highest price of a bid
+    std::map<CAssetBookKey, std::set<std::pair<double, COutPoint> > > mapBooks;
+    uint256 hashBestBlock;      //!< null if the book has to be built
+    int32_t nBuiltHeight;       //!< blocks up to this height were not connected by the book, they have no undo record
+
+public:
+    CAssetsOrderbook() : nBuiltHeight(0) {}
+
+    //! sort key of an order in its book
+    static double Rank(const CAssetOrder &order);
+
+    void Clear();
+    void Add(const COutPoint &outpoint, const CAssetOrder &order);
+    bool Remove(const COutPoint &outpoint, CAssetOrder &order);
+    bool Get(const COutPoint &outpoint, CAssetOrder &order) const;
+
+    uint256 GetBestBlock() const;
+    void SetBestBlock(const uint256 &hashBlock);
+    int32_t GetBuiltHeight() const;
+    void SetBuiltHeight(int32_t nHeight);
+
+    std::vector<CAssetBookKey> GetBookKeys(const uint256 &assetid) const;
+    /** Up to nDepth orders of a book (0 for all) which are not in setSpent, best first */
+    void GetBook(const CAssetBookKey &key, size_t nDepth, const std::set<COutPoint> &setSpent, AssetOrderList &vOrders) const;
+    size_t Size() const;
+};
+
+extern CAssetsOrderbook assetsOrderbook;
+
+
+class TokensDB : public CChainIndexDB
+{
+public:
+    TokensDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+};
+
+
+extern TokensDB *ptokens;
+
+typedef std::vector<std::pair<COutPoint, CTokenOutput> > TokenOutputsInBlock;
+
+TokenOutputsInBlock ScanBlockTokenOutputs(const CBlock &block);
+bool GetTokenOutput(const COutPoint &outpoint, CTokenOutput &output);
+void WriteTokenOutputs(const TokenOutputsInBlock &outputs, CDBBatch &batch);
+void EraseBlockTokenOutputs(const CBlock &block, CDBBatch &batch);
+
+bool LoadTokenOutputs();
+bool ResetTokenOutputs();
+uint256 GetTokenOutputsBestBlock();
+bool ConnectTokenOutputs(const CBlock &block, int nHeight);
+bool DisconnectTokenOutputs(const CBlock &block, int nHeight);
+
+bool LoadAssetOrders(const uint256 &hashTip);
+bool BuildAssetOrders();
+bool ConnectAssetOrders(const CBlock &block, int nHeight);
+bool DisconnectAssetOrders(const CBlock &block, int nHeight);
+bool GetAssetOrder(const COutPoint &outpoint, CAssetOrder &order);
+bool GetAssetOrderbook(const CAssetBookKey &key, size_t nDepth, AssetOrderList &vOrders);
+bool GetAllAssetOrders(const uint256 &assetid, AssetOrderList &vOrders);
+
+#endif  /* TOKENSDB_H */
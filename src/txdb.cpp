@@ -20,12 +20,15 @@
 
 #include "txdb.h"
 
+#include "cc/evalstats.h"
 #include "chainparams.h"
 #include "hash.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
 #include "core_io.h"
+#include "init.h"
+#include "compressor.h"
 
 #include <stdint.h>
 
@@ -39,7 +42,9 @@ static const char DB_SPROUT_ANCHOR = 'A';
 static const char DB_SAPLING_ANCHOR = 'Z';
 static const char DB_NULLIFIER = 's';
 static const char DB_SAPLING_NULLIFIER = 'S';
-static const char DB_COINS = 'c';
+static const char DB_COINS = 'c'; // per-transaction CCoins, only read by the upgrade
+static const char DB_COIN = 'C';
+static const char DB_COIN_OUTPUTS = 'O'; // per-transaction vout.size() of the unspent outputs
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'd';
@@ -56,11 +61,56 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
+namespace {
 
-CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+/** Key of an unspent output, outputs of a transaction are adjacent and ordered by index */
+struct CCoinEntryKey {
+    char key;
+    uint256 hash;
+    uint32_t n;
+
+    CCoinEntryKey() : key(0), n(0) {}
+    CCoinEntryKey(const uint256 &hashIn, uint32_t nIn) : key(DB_COIN), hash(hashIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(key);
+        READWRITE(hash);
+        READWRITE(VARINT(n));
+    }
+};
+
+/** An unspent output with the fields of its transaction that CCoins needs */
+struct CCoinEntry {
+    CTxOut out;
+    int nHeight;
+    int nVersion;
+    bool fCoinBase;
+
+    CCoinEntry() : nHeight(0), nVersion(0), fCoinBase(false) {}
+    CCoinEntry(const CCoins &coins, unsigned int n) : out(coins.vout[n]), nHeight(coins.nHeight), nVersion(coins.nVersion), fCoinBase(coins.fCoinBase) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        uint32_t nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nCode));
+        nHeight = nCode / 2;
+        fCoinBase = nCode & 1;
+        READWRITE(VARINT(nVersion));
+        READWRITE(REF(CTxOutCompressor(REF(out))));
+    }
+};
+
+}
+
+CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, CDBOptions(dbName, nCacheSize).ApplyProfileArgs(), fMemory, fWipe), nLastBatchSize(0) {
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", CDBOptions("chainstate", nCacheSize).ApplyProfileArgs(), fMemory, fWipe), nLastBatchSize(0)
 {
 }
 
@@ -105,12 +155,47 @@ bool CCoinsViewDB::GetNullifier(const uint256 &nf, ShieldedType type) const {
     return db.Read(make_pair(dbChar, nf), spent);
 }
 
+static void SetCoinsEntry(CCoins &coins, uint32_t n, const CCoinEntry &entry)
+{
+    coins.nHeight = entry.nHeight;
+    coins.nVersion = entry.nVersion;
+    coins.fCoinBase = entry.fCoinBase;
+    coins.vout[n] = entry.out;
+}
+
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    coins.Clear();
+    uint32_t nOutputs;
+    if (!db.Read(make_pair(DB_COIN_OUTPUTS, txid), nOutputs) || nOutputs == 0)
+        return false;
+    coins.vout.resize(nOutputs);
+
+    // the last output is always unspent, read them one by one unless there are many
+    if (nOutputs <= COINS_DB_MAX_POINT_READS) {
+        for (uint32_t n = 0; n < nOutputs; n++) {
+            CCoinEntry entry;
+            if (db.Read(CCoinEntryKey(txid, n), entry))
+                SetCoinsEntry(coins, n, entry);
+        }
+    } else {
+        boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+        for (pcursor->Seek(CCoinEntryKey(txid, 0)); pcursor->Valid(); pcursor->Next()) {
+            CCoinEntryKey key;
+            if (!pcursor->GetKey(key) || key.key != DB_COIN || key.hash != txid || key.n >= nOutputs)
+                break;
+            CCoinEntry entry;
+            if (!pcursor->GetValue(entry))
+                return error("CCoinsViewDB::GetCoins() : unable to read output %s:%u", txid.ToString(), key.n);
+            SetCoinsEntry(coins, key.n, entry);
+        }
+    }
+    if (coins.vout.back().IsNull())
+        return error("CCoinsViewDB::GetCoins() : outputs of %s do not match their count", txid.ToString());
+    return true;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    return db.Exists(make_pair(DB_COIN_OUTPUTS, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -139,9 +224,9 @@ uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
     return hashBestAnchor;
 }
 
-void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
+void BatchWriteNullifiers(CDBBatch& batch, const CNullifiersMap& mapToUse, const char& dbChar)
 {
-    for (CNullifiersMap::iterator it = mapToUse.begin(); it != mapToUse.end();) {
+    for (CNullifiersMap::const_iterator it = mapToUse.begin(); it != mapToUse.end(); it++) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(make_pair(dbChar, it->first));
@@ -149,15 +234,13 @@ void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char&
                 batch.Write(make_pair(dbChar, it->first), true);
             // TODO: changed++? ... See comment in CCoinsViewDB::BatchWrite. If this is needed we could return an int
         }
-        CNullifiersMap::iterator itOld = it++;
-        mapToUse.erase(itOld);
     }
 }
 
 template<typename Map, typename MapIterator, typename MapEntry, typename Tree>
-void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
+void BatchWriteAnchors(CDBBatch& batch, const Map& mapToUse, const char& dbChar)
 {
-    for (MapIterator it = mapToUse.begin(); it != mapToUse.end();) {
+    for (MapIterator it = mapToUse.begin(); it != mapToUse.end(); it++) {
         if (it->second.flags & MapEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(make_pair(dbChar, it->first));
@@ -168,8 +251,6 @@ void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
             }
             // TODO: changed++?
         }
-        MapIterator itOld = it++;
-        mapToUse.erase(itOld);
     }
 }
 
@@ -181,24 +262,63 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
                               CAnchorsSaplingMap &mapSaplingAnchors,
                               CNullifiersMap &mapSproutNullifiers,
                               CNullifiersMap &mapSaplingNullifiers) {
+    bool fOk = WriteEntries(mapCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor,
+                            mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers);
+    mapCoins.clear();
+    mapSproutAnchors.clear();
+    mapSaplingAnchors.clear();
+    mapSproutNullifiers.clear();
+    mapSaplingNullifiers.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::WriteEntries(const CCoinsMap &mapCoins,
+                                const uint256 &hashBlock,
+                                const uint256 &hashSproutAnchor,
+                                const uint256 &hashSaplingAnchor,
+                                const CAnchorsSproutMap &mapSproutAnchors,
+                                const CAnchorsSaplingMap &mapSaplingAnchors,
+                                const CNullifiersMap &mapSproutNullifiers,
+                                const CNullifiersMap &mapSaplingNullifiers) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    size_t outputs = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
+            const CCoins &coins = it->second.coins;
+            // the cache keeps coins cleaned up, so the last output is the last unspent one
+            if (coins.IsPruned())
+                batch.Erase(make_pair(DB_COIN_OUTPUTS, it->first));
             else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(make_pair(DB_COIN_OUTPUTS, it->first), (uint32_t)coins.vout.size());
+            if (it->second.flags & CCoinsCacheEntry::FRESH) {
+                // Nothing stored yet for this transaction
+                for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                    if (!coins.vout[i].IsNull()) {
+                        batch.Write(CCoinEntryKey(it->first, i), CCoinEntry(coins, i));
+                        outputs++;
+                    }
+                }
+            } else {
+                const std::vector<bool> &dirty = it->second.dirtyOutputs;
+                for (unsigned int i = 0; i < dirty.size(); i++) {
+                    if (!dirty[i])
+                        continue;
+                    if (coins.IsAvailable(i))
+                        batch.Write(CCoinEntryKey(it->first, i), CCoinEntry(coins, i));
+                    else
+                        batch.Erase(CCoinEntryKey(it->first, i));
+                    outputs++;
+                }
+            }
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
 
-    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR);
-    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::const_iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::const_iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
 
     ::BatchWriteNullifiers(batch, mapSproutNullifiers, DB_NULLIFIER);
     ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER);
@@ -210,11 +330,237 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     if (!hashSaplingAnchor.IsNull())
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    nLastBatchSize = batch.SizeEstimate();
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database, %u bytes...\n",
+             (unsigned int)outputs, (unsigned int)changed, (unsigned int)count, (unsigned int)nLastBatchSize);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+bool CCoinsViewDB::Upgrade() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(make_pair(DB_COINS, uint256()));
+    std::pair<char, uint256> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS)
+        return true;
+
+    LogPrintf("Upgrading the coin database to one record per unspent output...\n");
+    // Each batch converts whole transactions and erases their old records, an
+    // interrupted upgrade carries on from where it stopped on the next start.
+    CDBBatch batch(db);
+    size_t nTransactions = 0, nOutputs = 0;
+    int nReportDone = -1;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            break;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS)
+            break;
+        CCoins coins;
+        if (!pcursor->GetValue(coins))
+            return error("CCoinsViewDB::Upgrade() : unable to read coins of %s", key.second.ToString());
+        coins.Cleanup();
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull()) {
+                batch.Write(CCoinEntryKey(key.second, i), CCoinEntry(coins, i));
+                nOutputs++;
+            }
+        }
+        if (!coins.IsPruned())
+            batch.Write(make_pair(DB_COIN_OUTPUTS, key.second), (uint32_t)coins.vout.size());
+        batch.Erase(key);
+        nTransactions++;
+        if (batch.SizeEstimate() > COINS_DB_UPGRADE_BATCH_SIZE) {
+            db.WriteBatch(batch);
+            batch.Clear();
+            // txids are evenly spread, their leading byte tells how far along we are
+            int nDone = (int)(*key.second.begin()) * 100 / 256;
+            if (nDone / 10 != nReportDone / 10) {
+                LogPrintf("Upgrading coin database: %d%% (%u transactions, %u outputs)\n", nDone, (unsigned int)nTransactions, (unsigned int)nOutputs);
+                nReportDone = nDone;
+            }
+        }
+        pcursor->Next();
+    }
+    db.WriteBatch(batch);
+    LogPrintf("Upgraded %u transactions with %u unspent outputs in the coin database%s\n",
+              (unsigned int)nTransactions, (unsigned int)nOutputs, ShutdownRequested() ? ", interrupted" : "");
+    return !ShutdownRequested();
+}
+
+CCoinsViewFlushOverlay::CCoinsViewFlushOverlay(CCoinsView *baseIn, CCoinsViewDB *pdbIn, bool fBackgroundIn) :
+    CCoinsViewBacked(baseIn), pdb(pdbIn), fBackground(fBackgroundIn), fWriting(false), fWriteFailed(false), nWritingUsage(0)
+{
+}
+
+CCoinsViewFlushOverlay::~CCoinsViewFlushOverlay()
+{
+    WaitForWrite();
+}
+
+void CCoinsViewFlushOverlay::ThreadWrite()
+{
+    RenameThread("komodo-coinsflush");
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        fOk = pdb->WriteEntries(mapCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor,
+                                mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    if (!fOk)
+        fWriteFailed = true;
+    LogPrint("coindb", "Background write of %u coin cache entries took %.2fms\n", (unsigned int)mapCoins.size(), 0.001 * (GetTimeMicros() - nStart));
+    fWriting = false;
+}
+
+bool CCoinsViewFlushOverlay::WaitForWrite()
+{
+    if (writer.joinable())
+        writer.join();
+    mapCoins.clear();
+    mapSproutAnchors.clear();
+    mapSaplingAnchors.clear();
+    mapSproutNullifiers.clear();
+    mapSaplingNullifiers.clear();
+    hashBlock.SetNull();
+    hashSproutAnchor.SetNull();
+    hashSaplingAnchor.SetNull();
+    nWritingUsage = 0;
+    return !fWriteFailed;
+}
+
+bool CCoinsViewFlushOverlay::ReleaseWritten()
+{
+    if (fWriting)
+        return !fWriteFailed;
+    return WaitForWrite();
+}
+
+bool CCoinsViewFlushOverlay::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const {
+    CAnchorsSproutMap::const_iterator it = mapSproutAnchors.find(rt);
+    if (it != mapSproutAnchors.end()) {
+        if (!it->second.entered)
+            return false;
+        tree = it->second.tree;
+        return true;
+    }
+    return base->GetSproutAnchorAt(rt, tree);
+}
+
+bool CCoinsViewFlushOverlay::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
+    CAnchorsSaplingMap::const_iterator it = mapSaplingAnchors.find(rt);
+    if (it != mapSaplingAnchors.end()) {
+        if (!it->second.entered)
+            return false;
+        tree = it->second.tree;
+        return true;
+    }
+    return base->GetSaplingAnchorAt(rt, tree);
+}
+
+bool CCoinsViewFlushOverlay::GetNullifier(const uint256 &nf, ShieldedType type) const {
+    const CNullifiersMap &mapToUse = type == SAPLING ? mapSaplingNullifiers : mapSproutNullifiers;
+    CNullifiersMap::const_iterator it = mapToUse.find(nf);
+    if (it != mapToUse.end())
+        return it->second.entered;
+    return base->GetNullifier(nf, type);
+}
+
+bool CCoinsViewFlushOverlay::GetCoins(const uint256 &txid, CCoins &coins) const {
+    CCoinsMap::const_iterator it = mapCoins.find(txid);
+    if (it != mapCoins.end()) {
+        // a pruned entry is returned as such, the write in flight erases it
+        coins = it->second.coins;
+        return true;
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewFlushOverlay::HaveCoins(const uint256 &txid) const {
+    CCoinsMap::const_iterator it = mapCoins.find(txid);
+    if (it != mapCoins.end())
+        return !it->second.coins.IsPruned();
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewFlushOverlay::GetBestBlock() const {
+    if (!hashBlock.IsNull())
+        return hashBlock;
+    return base->GetBestBlock();
+}
+
+uint256 CCoinsViewFlushOverlay::GetBestAnchor(ShieldedType type) const {
+    switch (type) {
+        case SPROUT:
+            if (!hashSproutAnchor.IsNull())
+                return hashSproutAnchor;
+            break;
+        case SAPLING:
+            if (!hashSaplingAnchor.IsNull())
+                return hashSaplingAnchor;
+            break;
+        default:
+            throw runtime_error("Unknown shielded type");
+    }
+    return base->GetBestAnchor(type);
+}
+
+bool CCoinsViewFlushOverlay::BatchWrite(CCoinsMap &mapCoinsIn,
+                                        const uint256 &hashBlockIn,
+                                        const uint256 &hashSproutAnchorIn,
+                                        const uint256 &hashSaplingAnchorIn,
+                                        CAnchorsSproutMap &mapSproutAnchorsIn,
+                                        CAnchorsSaplingMap &mapSaplingAnchorsIn,
+                                        CNullifiersMap &mapSproutNullifiersIn,
+                                        CNullifiersMap &mapSaplingNullifiersIn) {
+    // Writes are applied in order, the database must have the previous flush first
+    if (!WaitForWrite())
+        return false;
+    if (!fBackground)
+        return base->BatchWrite(mapCoinsIn, hashBlockIn, hashSproutAnchorIn, hashSaplingAnchorIn,
+                                mapSproutAnchorsIn, mapSaplingAnchorsIn, mapSproutNullifiersIn, mapSaplingNullifiersIn);
+
+    mapCoins.swap(mapCoinsIn);
+    mapSproutAnchors.swap(mapSproutAnchorsIn);
+    mapSaplingAnchors.swap(mapSaplingAnchorsIn);
+    mapSproutNullifiers.swap(mapSproutNullifiersIn);
+    mapSaplingNullifiers.swap(mapSaplingNullifiersIn);
+    hashBlock = hashBlockIn;
+    hashSproutAnchor = hashSproutAnchorIn;
+    hashSaplingAnchor = hashSaplingAnchorIn;
+    size_t nUsage = memusage::DynamicUsage(mapCoins) +
+                    memusage::DynamicUsage(mapSproutAnchors) +
+                    memusage::DynamicUsage(mapSaplingAnchors) +
+                    memusage::DynamicUsage(mapSproutNullifiers) +
+                    memusage::DynamicUsage(mapSaplingNullifiers);
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
+        nUsage += it->second.DynamicMemoryUsage();
+    for (CAnchorsSproutMap::const_iterator it = mapSproutAnchors.begin(); it != mapSproutAnchors.end(); it++)
+        nUsage += it->second.tree.DynamicMemoryUsage();
+    for (CAnchorsSaplingMap::const_iterator it = mapSaplingAnchors.begin(); it != mapSaplingAnchors.end(); it++)
+        nUsage += it->second.tree.DynamicMemoryUsage();
+    nWritingUsage = nUsage;
+    fWriting = true;
+    writer = boost::thread(boost::bind(&CCoinsViewFlushOverlay::ThreadWrite, this));
+    return true;
+}
+
+bool CCoinsViewFlushOverlay::GetStats(CCoinsStats &stats) const {
+    // Statistics are computed from a snapshot of the database alone, the last
+    // write committed before it, so the write in flight is left alone
+    return base->GetStats(stats);
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles, size_t nIndexCacheSize) : CDBWrapper(GetDataDir() / "blocks" / "index", CDBOptions("blockindex", nCacheSize, compression, maxOpenFiles).ApplyProfileArgs(), fMemory, fWipe) {
+    // the address index takes an entry per output and per input, the other two far less
+    static const size_t nMinIndexCache = 1 << 20;
+    vIndexDB[ADDRESS_INDEX].reset(new CDBWrapper(GetDataDir() / "blocks" / "addressindex",
+        CDBOptions("addressindex", std::max(nIndexCacheSize * 3 / 4, nMinIndexCache), compression, maxOpenFiles).ApplyProfileArgs(), fMemory, fWipe));
+    vIndexDB[SPENT_INDEX].reset(new CDBWrapper(GetDataDir() / "blocks" / "spentindex",
+        CDBOptions("spentindex", std::max(nIndexCacheSize / 8, nMinIndexCache), compression).ApplyProfileArgs(), fMemory, fWipe));
+    vIndexDB[TIMESTAMP_INDEX].reset(new CDBWrapper(GetDataDir() / "blocks" / "timestampindex",
+        CDBOptions("timestampindex", std::max(nIndexCacheSize / 8, nMinIndexCache), compression).ApplyProfileArgs(), fMemory, fWipe));
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -242,30 +588,40 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
 
+    // The best block is read through the cursor, which sees the database as it was
+    // when created, so it matches the coins even if a background write commits meanwhile
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
+    char chKey;
+    stats.hashBlock.SetNull();
+    pcursor->Seek(DB_BEST_BLOCK);
+    if (pcursor->Valid() && pcursor->GetKey(chKey) && chKey == DB_BEST_BLOCK && !pcursor->GetValue(stats.hashBlock))
+        return error("CCoinsViewDB::GetStats() : unable to read best block");
     ss << stats.hashBlock;
+    pcursor->Seek(DB_COIN);
     CAmount nTotalAmount = 0;
+    uint256 prevHash;
+    bool fFirst = true;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+        CCoinEntryKey key;
+        CCoinEntry entry;
+        if (pcursor->GetKey(key) && key.key == DB_COIN) {
+            if (pcursor->GetValue(entry)) {
+                // Outputs of a transaction are adjacent, hash them as a single record
+                if (fFirst || key.hash != prevHash) {
+                    if (!fFirst)
+                        ss << VARINT(0);
+                    stats.nTransactions++;
+                    stats.nSerializedSize += 32;
+                    prevHash = key.hash;
+                    fFirst = false;
                 }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
+                stats.nTransactionOutputs++;
+                ss << VARINT(key.n+1);
+                ss << entry.out;
+                nTotalAmount += entry.out.nValue;
+                stats.nSerializedSize += pcursor->GetValueSize();
             } else {
                 return error("CCoinsViewDB::GetStats() : unable to read value");
             }
@@ -274,6 +630,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
         }
         pcursor->Next();
     }
+    if (!fFirst)
+        ss << VARINT(0);
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->GetHeight();
@@ -290,11 +648,19 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        CDiskBlockIndex dbindex(*it);
+        // never store an entry without its solution
+        if (!dbindex.HasSolution())
+            return error("%s: no solution for block index entry %s", __func__, (*it)->GetBlockHash().ToString());
+        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), dbindex);
     }
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) {
+    return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
+}
+
 bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(*this);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
@@ -315,54 +681,55 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+    nCCSpentLookups++;
+    return IndexDB(SPENT_INDEX).Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
-}
+bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
+    return ScanAddressUnspentIndex(addressHash, type, NULL,
+        [&unspentOutputs](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+            unspentOutputs.push_back(make_pair(key, value));
+            return true;
+        });
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+/**
+ * Walk the unspent outputs of one address in key order without materialising them.
+ * If pAfter is set the scan resumes right after that key, so a caller can page
+ * through an address by passing back the last key it was handed. The visitor
+ * returns false to stop early.
+ */
+bool CBlockTreeDB::ScanAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey *pAfter,
+                                           const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &visitor) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB(ADDRESS_INDEX).NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pAfter != NULL) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pAfter));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             pair<char, CAddressUnspentKey> keyObj;
             pcursor->GetKey(keyObj);
             char chType = keyObj.first;
             CAddressUnspentKey indexKey = keyObj.second;
 
             if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
+                if (pAfter != NULL && indexKey.txhash == pAfter->txhash && indexKey.index == pAfter->index) {
+                    pcursor->Next();
+                    continue;
+                }
                 try {
                     CAddressUnspentValue nValue;
                     pcursor->GetValue(nValue);
-                    unspentOutputs.push_back(make_pair(indexKey, nValue));
+                    if (!visitor(indexKey, nValue))
+                        break;
                     pcursor->Next();
                 } catch (const std::exception& e) {
                     return error("failed to get address unspent value");
@@ -377,27 +744,30 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    return ScanAddressIndex(addressHash, type, start, end, NULL,
+        [&addressIndex](const CAddressIndexKey &key, CAmount nValue) {
+            addressIndex.push_back(make_pair(key, nValue));
+            return true;
+        });
+}
+
+/**
+ * Walk the address index deltas of one address in (height, txindex) order without
+ * materialising them. pAfter resumes the scan right after a previously visited key.
+ * The visitor returns false to stop early.
+ */
+bool CBlockTreeDB::ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pAfter,
+                                    const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB(ADDRESS_INDEX).NewIterator());
 
-    if (start > 0 && end > 0) {
+    if (pAfter != NULL) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pAfter));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
@@ -415,11 +785,16 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                 if (end > 0 && indexKey.blockHeight > end) {
                     break;
                 }
+                if (pAfter != NULL && indexKey.blockHeight == pAfter->blockHeight && indexKey.txindex == pAfter->txindex &&
+                    indexKey.txhash == pAfter->txhash && indexKey.index == pAfter->index && indexKey.spending == pAfter->spending) {
+                    pcursor->Next();
+                    continue;
+                }
                 try {
                     CAmount nValue;
                     pcursor->GetValue(nValue);
-
-                    addressIndex.push_back(make_pair(indexKey, nValue));
+                    if (!visitor(indexKey, nValue))
+                        break;
                     pcursor->Next();
                 } catch (const std::exception& e) {
                     return error("failed to get address index value");
@@ -463,9 +838,10 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
     int64_t total = 0; int64_t totalAddresses = 0; std::string address;
     int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
     DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
+    boost::scoped_ptr<CDBIterator> iter(IndexDB(ADDRESS_INDEX).NewIterator());
     //std::map <std::string, CAmount> addressAmounts;
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    // the unspent entries are contiguous in the address index, the totals do not depend on the order
+    for (iter->Seek(DB_ADDRESSUNSPENTINDEX); iter->Valid(); iter->Next())
     {
         boost::this_thread::interruption_point();
         try
@@ -523,6 +899,8 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
                     return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
                 }
             }
+            else
+                break;
         }
         catch (const std::exception& e)
         {
@@ -603,15 +981,9 @@ UniValue CBlockTreeDB::Snapshot(int top)
     return(result);
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB(TIMESTAMP_INDEX).NewIterator());
 
     pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
 
@@ -644,22 +1016,154 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
     CTimestampBlockIndexValue(lts);
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+    if (!IndexDB(TIMESTAMP_INDEX).Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
 	return false;
 
     ltimestamp = lts.ltimestamp;
     return true;
 }
 
+bool CBlockTreeDB::MigrateIndexes() {
+    struct IndexKeyMove { char chKey; BlockTreeIndex index; };
+    static const IndexKeyMove vMoves[] = {
+        { DB_ADDRESSINDEX, ADDRESS_INDEX }, { DB_ADDRESSUNSPENTINDEX, ADDRESS_INDEX },
+        { DB_SPENTINDEX, SPENT_INDEX },
+        { DB_TIMESTAMPINDEX, TIMESTAMP_INDEX }, { DB_BLOCKHASHINDEX, TIMESTAMP_INDEX }
+    };
+
+    size_t nMoved = 0;
+    bool fFound = false;
+    for (const IndexKeyMove &move : vMoves) {
+        CDBWrapper &dbTo = IndexDB(move.index);
+        CDBBatch batchTo(dbTo), batchFrom(*this);
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(move.chKey);
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested())
+                break;
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION);
+            if (!pcursor->GetKeyDataStream(ssKey) || ssKey.empty() || ssKey[0] != move.chKey)
+                break;
+            if (!pcursor->GetValueDataStream(ssValue))
+                return error("%s: unable to read index entry", __func__);
+            if (!fFound) {
+                LogPrintf("Moving the address, spent and timestamp indexes out of blocks/index...\n");
+                fFound = true;
+            }
+            batchTo.Write(ssKey, ssValue);
+            batchFrom.Erase(ssKey);
+            nMoved++;
+            if (batchTo.SizeEstimate() > INDEX_DB_BATCH_SIZE) {
+                // the copies are on disk before the originals go, an interrupted
+                // move carries on from where it stopped on the next start
+                dbTo.WriteBatch(batchTo, true);
+                WriteBatch(batchFrom);
+                batchTo.Clear();
+                batchFrom.Clear();
+                LogPrintf("Moving indexes: %u entries\n", (unsigned int)nMoved);
+            }
+            pcursor->Next();
+        }
+        dbTo.WriteBatch(batchTo, true);
+        WriteBatch(batchFrom);
+        if (ShutdownRequested())
+            break;
+    }
+    if (fFound)
+        LogPrintf("Moved %u index entries out of blocks/index%s\n", (unsigned int)nMoved, ShutdownRequested() ? ", interrupted" : "");
+    return !ShutdownRequested();
+}
+
+bool CBlockTreeDB::WipeIndex(BlockTreeIndex index) {
+    CDBWrapper &db = IndexDB(index);
+    CDBBatch batch(db);
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        if (!pcursor->GetKeyDataStream(ssKey))
+            return error("%s: unable to read index key", __func__);
+        batch.Erase(ssKey);
+        if (batch.SizeEstimate() > INDEX_DB_BATCH_SIZE) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteIndexEntries(const CBlockIndexEntries &entries) {
+    CDBBatch addressBatch(IndexDB(ADDRESS_INDEX)), spentBatch(IndexDB(SPENT_INDEX)), timestampBatch(IndexDB(TIMESTAMP_INDEX));
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = entries.addressIndex.begin(); it != entries.addressIndex.end(); it++) {
+        if (entries.fEraseAddressIndex)
+            addressBatch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+        else
+            addressBatch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = entries.addressUnspentIndex.begin(); it != entries.addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull())
+            addressBatch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            addressBatch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = entries.spentIndex.begin(); it != entries.spentIndex.end(); it++) {
+        if (it->second.IsNull())
+            spentBatch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            spentBatch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    if (entries.fTimestampIndex) {
+        timestampBatch.Write(make_pair(DB_TIMESTAMPINDEX, entries.timestampIndex), 0);
+        timestampBatch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(entries.timestampIndex.blockHash)),
+                             CTimestampBlockIndexValue(entries.timestampIndex.timestamp));
+    }
+
+    CDBBatch *vBatches[MAX_BLOCKTREE_INDEXES] = { &addressBatch, &spentBatch, &timestampBatch };
+    size_t nTotalSize = 0;
+    for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++)
+        nTotalSize += vBatches[i]->SizeEstimate();
+    if (nTotalSize < INDEX_DB_PARALLEL_WRITE_SIZE) {
+        for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++) {
+            if (vBatches[i]->SizeEstimate() > 0 && !IndexDB((BlockTreeIndex)i).WriteBatch(*vBatches[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // the databases do not share anything, their batches are written side by side
+    bool vWritten[MAX_BLOCKTREE_INDEXES];
+    boost::thread_group writers;
+    for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++) {
+        vWritten[i] = true;
+        if (i == ADDRESS_INDEX || vBatches[i]->SizeEstimate() == 0)
+            continue;
+        writers.create_thread([this, i, &vBatches, &vWritten]() {
+            try {
+                vWritten[i] = IndexDB((BlockTreeIndex)i).WriteBatch(*vBatches[i]);
+            } catch (const std::exception& e) {
+                LogPrintf("CBlockTreeDB::WriteIndexEntries(): %s\n", e.what());
+                vWritten[i] = false;
+            }
+        });
+    }
+    try {
+        vWritten[ADDRESS_INDEX] = IndexDB(ADDRESS_INDEX).WriteBatch(addressBatch);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        vWritten[ADDRESS_INDEX] = false;
+    }
+    writers.join_all();
+    for (int i = 0; i < MAX_BLOCKTREE_INDEXES; i++) {
+        if (!vWritten[i])
+            return false;
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -685,62 +1189,141 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+// One decoded DB_BLOCK_INDEX record, produced by the parallel stage of LoadBlockIndexGuts
+struct CBlockIndexLoadEntry
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    uint256 hash;
+    uint256 hashPrev;
+    CBlockIndex *pindex;
+};
 
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
+// Decode (and optionally hash) the block index records whose key hash starts with a byte in [nFirst, nEnd)
+static bool LoadBlockIndexShard(CBlockTreeDB *pdb, int nFirst, int nEnd, bool fVerifyHashes,
+                                std::vector<CBlockIndexLoadEntry> &vEntries, std::string &strError)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(pdb->NewIterator());
+    uint256 hashStart;
+    *hashStart.begin() = (unsigned char)nFirst;
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, hashStart));
 
-    // Load mapBlockIndex
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->SetHeight(diskindex.GetHeight());
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->segid          = diskindex.segid;
-                pindexNew->nNotaryPay     = diskindex.nNotaryPay;
-//fprintf(stderr,"loadguts ht.%d\n",pindexNew->GetHeight());
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
-                if (header.GetHash() != pindexNew->GetBlockHash())
-                    return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
-                                 diskindex.ToString(),  pindexNew->ToString());
-                if ( 0 ) // POW will be checked before any block is connected
-                {
-                    uint8_t pubkey33[33];
-                    komodo_index2pubkey33(pubkey33,pindexNew,pindexNew->GetHeight());
-                    if (!CheckProofOfWork(header,pubkey33,pindexNew->GetHeight(),Params().GetConsensus()))
-                        return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+            break;
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex)) {
+            strError = "failed to read value";
+            return false;
+        }
+        // Consistency check, the record must hash to the key it is stored under
+        if (fVerifyHashes && diskindex.GetBlockHash() != key.second) {
+            strError = strprintf("block header inconsistency detected: key = %s, on-disk = %s",
+                                 key.second.ToString(), diskindex.ToString());
+            return false;
+        }
+        CBlockIndex* pindexNew = new CBlockIndex();
+        pindexNew->SetHeight(diskindex.GetHeight());
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+        // the solution stays on disk, only keep it until the deferred hash check has seen it
+        if (!fVerifyHashes)
+            pindexNew->nSolution.swap(diskindex.nSolution);
+        else pindexNew->fSolutionTrimmed = true;
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+        pindexNew->nTx            = diskindex.nTx;
+        pindexNew->nSproutValue   = diskindex.nSproutValue;
+        pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+        pindexNew->segid          = diskindex.segid;
+        pindexNew->nNotaryPay     = diskindex.nNotaryPay;
+
+        CBlockIndexLoadEntry entry;
+        entry.hash = key.second;
+        entry.hashPrev = diskindex.hashPrev;
+        entry.pindex = pindexNew;
+        vEntries.push_back(entry);
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(bool fVerifyHashes)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Block hashes are uniformly distributed, so sharding on the first key byte balances the work.
+    // Decoding and hashing (header plus equihash solution) run in parallel, linking stays serial.
+    int nShards = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<CBlockIndexLoadEntry> > vShards(nShards);
+    std::vector<std::string> vErrors(nShards);
+    std::vector<char> vOk(nShards, 0);
+    {
+        boost::this_thread::disable_interruption di;
+        boost::thread_group loaders;
+        for (int i = 0; i < nShards; i++) {
+            int nFirst = (256 * i) / nShards, nEnd = (256 * (i + 1)) / nShards;
+            loaders.create_thread([this, i, nFirst, nEnd, fVerifyHashes, &vShards, &vErrors, &vOk]() {
+                try {
+                    vOk[i] = LoadBlockIndexShard(this, nFirst, nEnd, fVerifyHashes, vShards[i], vErrors[i]);
+                } catch (const std::exception& e) {
+                    vErrors[i] = e.what();
                 }
-                pcursor->Next();
+            });
+        }
+        loaders.join_all();
+    }
+    int64_t nTimeDecode = GetTimeMicros();
+
+    size_t nEntries = 0;
+    bool fOk = true;
+    for (int i = 0; i < nShards; i++) {
+        nEntries += vShards[i].size();
+        if (!vOk[i]) {
+            fOk = error("LoadBlockIndex(): %s", vErrors[i]);
+        }
+    }
+    if (!fOk) {
+        for (size_t i = 0; i < vShards.size(); i++)
+            BOOST_FOREACH(CBlockIndexLoadEntry& entry, vShards[i])
+                delete entry.pindex;
+        return false;
+    }
+    boost::this_thread::interruption_point();
+
+    // Insert every entry first so that linking pprev below never creates placeholders for known blocks
+    mapBlockIndex.reserve(mapBlockIndex.size() + nEntries);
+    BOOST_FOREACH(std::vector<CBlockIndexLoadEntry>& vEntries, vShards) {
+        BOOST_FOREACH(CBlockIndexLoadEntry& entry, vEntries) {
+            BlockMap::iterator mi = mapBlockIndex.find(entry.hash);
+            if (mi == mapBlockIndex.end()) {
+                mi = mapBlockIndex.insert(make_pair(entry.hash, entry.pindex)).first;
+            } else if (mi->second == NULL) {
+                mi->second = entry.pindex;
             } else {
-                return error("LoadBlockIndex() : failed to read value");
+                // already known (placeholder), fill it in place so existing pointers stay valid
+                *mi->second = *entry.pindex;
+                delete entry.pindex;
+                entry.pindex = mi->second;
             }
-        } else {
-            break;
+            entry.pindex->phashBlock = &((*mi).first);
+        }
+    }
+    BOOST_FOREACH(std::vector<CBlockIndexLoadEntry>& vEntries, vShards) {
+        BOOST_FOREACH(CBlockIndexLoadEntry& entry, vEntries) {
+            entry.pindex->pprev = InsertBlockIndex(entry.hashPrev);
         }
     }
+    int64_t nTimeLink = GetTimeMicros();
 
+    LogPrintf("%s: %u entries, decode%s %.2fms (%d threads), link %.2fms\n", __func__, (unsigned int)nEntries,
+              fVerifyHashes ? "+hash" : "", 0.001 * (nTimeDecode - nTimeStart), nShards, 0.001 * (nTimeLink - nTimeDecode));
     return true;
 }
@@ -24,14 +24,20 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 #include <univalue.h>
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
 class CBlockFileInfo;
 class CBlockIndex;
+class CDiskBlockIndex;
 struct CDiskTxPos;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
@@ -44,20 +50,47 @@ struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CBlockIndexEntries;
 class uint256;
 
+//! -asyncflush default
+static const bool DEFAULT_ASYNC_FLUSH = true;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! max. threads decoding the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
+//! bytes written per batch while upgrading the coin database
+static const size_t COINS_DB_UPGRADE_BATCH_SIZE = 16 << 20;
+//! outputs of a transaction up to which they are looked up one by one instead of with a cursor
+static const uint32_t COINS_DB_MAX_POINT_READS = 16;
+//! bytes per batch while moving the optional indexes out of blocks/index or wiping them
+static const size_t INDEX_DB_BATCH_SIZE = 16 << 20;
+//! index batches of a block smaller than this together are written one after the other
+static const size_t INDEX_DB_PARALLEL_WRITE_SIZE = 64 << 10;
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** The optional indexes, each kept in its own database next to blocks/index */
+enum BlockTreeIndex
+{
+    ADDRESS_INDEX = 0,
+    SPENT_INDEX,
+    TIMESTAMP_INDEX,
+    MAX_BLOCKTREE_INDEXES
+};
+
+/**
+ * CCoinsView backed by the coin database (chainstate/). Every unspent output is
+ * stored under its own key, spending one output of a large transaction only
+ * erases that output instead of rewriting the whole CCoins.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    size_t nLastBatchSize;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
@@ -78,45 +111,132 @@ public:
                     CNullifiersMap &mapSproutNullifiers,
                     CNullifiersMap &mapSaplingNullifiers);
     bool GetStats(CCoinsStats &stats) const;
+    //! Write the dirty entries in one batch like BatchWrite, leaving the maps untouched
+    bool WriteEntries(const CCoinsMap &mapCoins,
+                      const uint256 &hashBlock,
+                      const uint256 &hashSproutAnchor,
+                      const uint256 &hashSaplingAnchor,
+                      const CAnchorsSproutMap &mapSproutAnchors,
+                      const CAnchorsSaplingMap &mapSaplingAnchors,
+                      const CNullifiersMap &mapSproutNullifiers,
+                      const CNullifiersMap &mapSaplingNullifiers);
+    //! Convert per-transaction records written by older versions, resumes if interrupted
+    bool Upgrade();
+    //! Approximate size of the last BatchWrite in bytes
+    size_t GetLastBatchSize() const { return nLastBatchSize; }
 };
 
-/** Access to the block database (blocks/index/) */
+/**
+ * View between pcoinsTip and the coin database that commits flushes in the background.
+ * BatchWrite takes over the flushed entries and returns, a thread writes them to the
+ * database in a single batch as before, and until that batch has committed reads are
+ * answered from the entries being written. One write is in flight at a time, the next
+ * flush waits for it. All calls except the writer thread's and GetStats are made
+ * holding cs_main. The entries being written count towards the coin cache size.
+ */
+class CCoinsViewFlushOverlay : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB *pdb;
+    bool fBackground;
+
+    //! Entries of the last flush, not modified while a write is in flight
+    CCoinsMap mapCoins;
+    CAnchorsSproutMap mapSproutAnchors;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    CNullifiersMap mapSproutNullifiers;
+    CNullifiersMap mapSaplingNullifiers;
+    uint256 hashBlock;
+    uint256 hashSproutAnchor;
+    uint256 hashSaplingAnchor;
+
+    boost::thread writer;
+    std::atomic<bool> fWriting;
+    std::atomic<bool> fWriteFailed;
+    std::atomic<size_t> nWritingUsage;
+
+    void ThreadWrite();
+
+public:
+    CCoinsViewFlushOverlay(CCoinsView *baseIn, CCoinsViewDB *pdbIn, bool fBackgroundIn);
+    ~CCoinsViewFlushOverlay();
+
+    bool GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const;
+    bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
+    bool GetNullifier(const uint256 &nf, ShieldedType type) const;
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    uint256 GetBestAnchor(ShieldedType type) const;
+    bool BatchWrite(CCoinsMap &mapCoins,
+                    const uint256 &hashBlock,
+                    const uint256 &hashSproutAnchor,
+                    const uint256 &hashSaplingAnchor,
+                    CAnchorsSproutMap &mapSproutAnchors,
+                    CAnchorsSaplingMap &mapSaplingAnchors,
+                    CNullifiersMap &mapSproutNullifiers,
+                    CNullifiersMap &mapSaplingNullifiers);
+    bool GetStats(CCoinsStats &stats) const;
+
+    //! Wait until the write in flight has committed, false if it failed
+    bool WaitForWrite();
+    //! Drop the entries of a committed write, false if it failed
+    bool ReleaseWritten();
+    bool IsWriting() const { return fWriting; }
+    //! Memory held by the entries of the last flush until they are released
+    size_t DynamicMemoryUsage() const { return nWritingUsage; }
+};
+
+/**
+ * Access to the block database (blocks/index/). The address, spent and timestamp
+ * indexes live in blocks/addressindex/, blocks/spentindex/ and blocks/timestampindex/,
+ * each with its own cache, so that their writes do not compact the block index.
+ */
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000, size_t nIndexCacheSize = 0);
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    boost::scoped_ptr<CDBWrapper> vIndexDB[MAX_BLOCKTREE_INDEXES];
+
+    CDBWrapper &IndexDB(BlockTreeIndex index) { return *vIndexDB[index]; }
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
+    bool ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+    bool ScanAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey *pAfter,
+                                 const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &visitor);
+    bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pAfter,
+                          const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts();
+    bool LoadBlockIndexGuts(bool fVerifyHashes = true);
     bool blockOnchainActive(const uint256 &hash);
     UniValue Snapshot(int top);
     bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
+    //! Move index entries written by older versions out of blocks/index, resumable
+    bool MigrateIndexes();
+    //! Erase every entry of an index before it is built again
+    bool WipeIndex(BlockTreeIndex index);
+    //! Write the index entries of a connected or disconnected block, one batch per index database in parallel
+    bool WriteIndexEntries(const CBlockIndexEntries &entries);
 };
 
 #endif // BITCOIN_TXDB_H
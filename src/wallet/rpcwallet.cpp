@@ -3367,6 +3367,16 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
 #endif
         } else if (benchmarktype == "verifyequihash") {
             sample_times.push_back(benchmark_verify_equihash());
+        } else if (benchmarktype == "precheckblocks") {
+            // Blocks per second = 200 / runningtime
+            int nThreads = 1;
+            if (params.size() >= 3) {
+                nThreads = params[2].get_int();
+            }
+            if (nThreads <= 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid thread count");
+            }
+            sample_times.push_back(benchmark_precheck_blocks(200, nThreads));
         } else if (benchmarktype == "validatelargetx") {
             // Number of inputs in the spending transaction that we will simulate
             int nInputs = 11130;
@@ -5597,6 +5607,7 @@ int32_t verus_staked(CBlock *pBlock, CMutableTransaction &txNew, uint32_t &nBits
 #include "../cc/CCHeir.h"
 #include "../cc/CCPayments.h"
 #include "../cc/CCPegs.h"
+#include "../tokensdb.h"
 
 int32_t ensure_CCrequirements(uint8_t evalcode)
 {
@@ -5984,7 +5995,7 @@ UniValue payments_airdroptokens(const UniValue& params, bool fHelp, const CPubKe
 {
     struct CCcontract_info *cp,C;
     if ( fHelp || params.size() != 1 )
-        throw runtime_error("payments_airdroptokens \"[%22tokenid%22,lockedblocks,minamount,mintoaddress,top,bottom,fixedFlag,%22excludePubKey%22,...,%22excludePubKeyN%22]\"\n");
+        throw runtime_error("payments_airdroptokens \"[%22tokenid%22,lockedblocks,minamount,mintoaddress,top,bottom,fixedFlag,%22excludeAddress%22,...,%22excludeAddressN%22]\"\n");
     if ( ensure_CCrequirements(EVAL_PAYMENTS) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
     const CKeyStore& keystore = *pwalletMain;
@@ -6920,6 +6931,44 @@ UniValue oraclessamples(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(OracleDataSamples(txid,batonaddr,num));
 }
 
+UniValue oraclesseries(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 txid; std::vector<unsigned char> pubkey; uint32_t from,to = 0; bool raw = false;
+    if ( fHelp || params.size() < 3 || params.size() > 5 )
+        throw runtime_error("oraclesseries oracletxid publisher from [to] [raw]\n"
+                            "from and to are heights, or block times when from is at least 500000000 as for a locktime\n"
+                            "without to the samples up to the tip and in the mempool are returned\n"
+                            "complete is false while the samples index catches up with the tip after a start\n");
+    if ( ensure_CCrequirements(EVAL_ORACLES) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    txid = Parseuint256((char *)params[0].get_str().c_str());
+    pubkey = ParseHex(params[1].get_str().c_str());
+    if ( pubkey.size() != CPubKey::COMPRESSED_PUBLIC_KEY_SIZE )
+        throw runtime_error("invalid publisher pubkey\n");
+    from = atol(params[2].get_str().c_str());
+    if ( params.size() > 3 )
+        to = atol(params[3].get_str().c_str());
+    if ( params.size() > 4 )
+        raw = (params[4].get_str() == "raw");
+    return(OracleDataSeries(txid,pubkey2pk(pubkey),from,to,raw));
+}
+
+UniValue oraclesprice(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 txid; int32_t maxage = 10;
+    if ( fHelp || params.size() < 1 || params.size() > 2 )
+        throw runtime_error("oraclesprice oracletxid [maxage]\n"
+                            "correlated and median price of the publishers which published within maxage blocks of the newest of them\n");
+    if ( ensure_CCrequirements(EVAL_ORACLES) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    txid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( params.size() > 1 )
+        maxage = atoi(params[1].get_str().c_str());
+    if ( maxage < 0 )
+        throw runtime_error("invalid maxage\n");
+    return(OraclePrices(txid,maxage));
+}
+
 UniValue oraclesdata(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue result(UniValue::VOBJ); uint256 txid; std::vector<unsigned char> data;
@@ -7407,6 +7456,60 @@ UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return AssetOrders(zeroid, Mypubkey(), additionalEvalCode);
 }
 
+UniValue tokenorderbook(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 tokenid; size_t depth = 20;
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error("tokenorderbook tokenid [depth]\n"
+                            "returns up to depth (default 20, 0 for all) bids and asks of the tokenid for coins, best first\n"
+                            "orders in the mempool have height 0, orders spent in the mempool are left out\n"
+                            "(requires -addressindex)\n" "\n");
+    if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if (tokenid == zeroid)
+        throw runtime_error("incorrect tokenid\n");
+    if (params.size() == 2) {
+        int64_t n = atoll(params[1].get_str().c_str());
+        if (n < 0)
+            throw runtime_error("depth must not be negative\n");
+        depth = n;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("tokenid", tokenid.GetHex()));
+    for (const char side : std::string("bs"))
+    {
+        AssetOrderList vOrders;
+        UniValue orders(UniValue::VARR);
+        char numstr[32];
+        if (!GetAssetOrderbook(CAssetBookKey(tokenid, zeroid, side), depth, vOrders))
+            throw runtime_error("no orderbook, it needs -addressindex\n");
+        for (AssetOrderList::const_iterator it = vOrders.begin(); it != vOrders.end(); it++)
+        {
+            const CAssetOrder &order = it->second;
+            UniValue item(UniValue::VOBJ);
+            item.push_back(Pair("txid", it->first.hash.GetHex()));
+            item.push_back(Pair("vout", (int64_t)it->first.n));
+            item.push_back(Pair("funcid", std::string(1, (char)order.funcid)));
+            if (side == 'b') {
+                item.push_back(Pair("bidamount", ValueFromAmount(order.nValue)));
+                item.push_back(Pair("tokens", order.nRequired));
+            } else {
+                item.push_back(Pair("tokens", order.nValue));
+                item.push_back(Pair("askamount", ValueFromAmount(order.nRequired)));
+            }
+            sprintf(numstr, "%.8f", order.UnitPrice() / COIN);
+            item.push_back(Pair("price", numstr));
+            item.push_back(Pair("origpubkey", HexStr(order.origpubkey)));
+            item.push_back(Pair("height", order.nHeight));
+            orders.push_back(item);
+        }
+        result.push_back(Pair(side == 'b' ? "bids" : "asks", orders));
+    }
+    return result;
+}
+
 UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue result(UniValue::VOBJ); uint256 tokenid; uint64_t balance; std::vector<unsigned char> pubkey; struct CCcontract_info *cp,C;
@@ -7659,13 +7762,20 @@ UniValue tokenfillbid(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue result(UniValue::VOBJ); int64_t fillamount; std::string hex; uint256 tokenid,bidtxid;
     if ( fHelp || params.size() != 3 )
-        throw runtime_error("tokenfillbid tokenid bidtxid fillamount\n");
+        throw runtime_error("tokenfillbid tokenid bidtxid fillamount\n"
+                            "bidtxid \"best\" fills the best bid of the orderbook paying coins for the token\n");
     if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
         throw runtime_error(CC_REQUIREMENTS_MSG);
     const CKeyStore& keystore = *pwalletMain;
     LOCK2(cs_main, pwalletMain->cs_wallet);
     tokenid = Parseuint256((char *)params[0].get_str().c_str());
-    bidtxid = Parseuint256((char *)params[1].get_str().c_str());
+    if ( params[1].get_str() == "best" )
+        bidtxid = zeroid;   // filled from the orderbook
+    else if ( (bidtxid = Parseuint256((char *)params[1].get_str().c_str())) == zeroid )
+    {
+        ERR_RESULT("must provide tokenid and bidtxid");
+        return(result);
+    }
     // fillamount = atol(params[2].get_str().c_str());
 	fillamount = atoll(params[2].get_str().c_str());		// dimxy changed to prevent loss of significance
     if ( fillamount <= 0 )
@@ -7673,7 +7783,7 @@ UniValue tokenfillbid(const UniValue& params, bool fHelp, const CPubKey& mypk)
         ERR_RESULT("fillamount must be positive");
         return(result);
     }
-    if ( tokenid == zeroid || bidtxid == zeroid )
+    if ( tokenid == zeroid )
     {
         ERR_RESULT("must provide tokenid and bidtxid");
         return(result);
@@ -7683,6 +7793,8 @@ UniValue tokenfillbid(const UniValue& params, bool fHelp, const CPubKey& mypk)
     {
         result.push_back(Pair("result", "success"));
         result.push_back(Pair("hex", hex));
+    } else if (CCerror != "") {
+        ERR_RESULT(CCerror);
     } else ERR_RESULT("couldnt fill bid");
     return(result);
 }
@@ -7778,13 +7890,20 @@ UniValue tokenfillask(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue result(UniValue::VOBJ); int64_t fillunits; std::string hex; uint256 tokenid,asktxid;
     if ( fHelp || params.size() != 3 )
-        throw runtime_error("tokenfillask tokenid asktxid fillunits\n");
+        throw runtime_error("tokenfillask tokenid asktxid fillunits\n"
+                            "asktxid \"best\" fills the best ask of the orderbook asking coins for the token, swaps for other tokens are not filled\n");
     if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
         throw runtime_error(CC_REQUIREMENTS_MSG);
     const CKeyStore& keystore = *pwalletMain;
     LOCK2(cs_main, pwalletMain->cs_wallet);
     tokenid = Parseuint256((char *)params[0].get_str().c_str());
-    asktxid = Parseuint256((char *)params[1].get_str().c_str());
+    if ( params[1].get_str() == "best" )
+        asktxid = zeroid;   // filled from the orderbook
+    else if ( (asktxid = Parseuint256((char *)params[1].get_str().c_str())) == zeroid )
+    {
+        result.push_back(Pair("error", "invalid parameter"));
+        return(result);
+    }
     //fillunits = atol(params[2].get_str().c_str());
 	fillunits = atoll(params[2].get_str().c_str());	 // dimxy changed to prevent loss of significance
     if ( fillunits <= 0 )
@@ -7792,7 +7911,7 @@ UniValue tokenfillask(const UniValue& params, bool fHelp, const CPubKey& mypk)
         ERR_RESULT("fillunits must be positive");
         return(result);
     }
-    if ( tokenid == zeroid || asktxid == zeroid )
+    if ( tokenid == zeroid )
     {
         result.push_back(Pair("error", "invalid parameter"));
         return(result);
@@ -1357,9 +1357,9 @@ bool CWallet::VerusSelectStakeOutput(CBlock *pBlock, arith_uint256 &hashResult,
 
     pwalletMain->AvailableCoins(vecOutputs, true, NULL, false, false);
 
-    if (pastBlockIndex = komodo_chainactive(nHeight - 100))
+    CBlockHeader bh;
+    if ((pastBlockIndex = komodo_chainactive(nHeight - 100)) && pastBlockIndex->GetBlockHeader(bh))
     {
-        CBlockHeader bh = pastBlockIndex->GetBlockHeader();
         uint256 pastHash = bh.GetVerusEntropyHash(nHeight - 100);
         CPOSNonce curNonce;
 
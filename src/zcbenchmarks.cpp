@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cstdio>
 #include <future>
 #include <map>
@@ -225,6 +226,36 @@ double benchmark_verify_equihash()
     return timer_stop(tv_start);
 }
 
+// PrecheckBlock over the last nBlocks blocks of the active chain, spread over nThreads as the block
+// check threads do during initial download
+double benchmark_precheck_blocks(size_t nBlocks, int nThreads)
+{
+    std::vector<CBlock> blocks;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex != NULL && blocks.size() < nBlocks; pindex = pindex->pprev) {
+        blocks.push_back(CBlock());
+        if (!ReadBlockFromDisk(blocks.back(), pindex, false))
+            throw new std::runtime_error("Failed to read block from disk");
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&blocks, &next]() {
+            size_t n;
+            while ((n = next++) < blocks.size()) {
+                CValidationState state;
+                assert(PrecheckBlock(blocks[n], state));
+            }
+        });
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+    return timer_stop(tv_start);
+}
+
 double benchmark_large_tx(size_t nInputs)
 {
     // Create priv/pub key